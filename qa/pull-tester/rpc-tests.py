@@ -183,6 +183,13 @@ testScripts = [
 
     # Other new tests for Huntercoin.
     'getstatsforheight.py',
+    'snapshot.py',
+    'socketevents.py',
+    'msghandthreads.py',
+    'rpcqueues.py',
+    'rpcbatch.py',
+    'gamestream.py',
+    'rescanthreads.py',
 ]
 if ENABLE_ZMQ:
     testScripts.append('zmq_test.py')
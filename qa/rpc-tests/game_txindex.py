@@ -3,7 +3,8 @@
 # Distributed under the MIT/X11 software license, see the accompanying
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-# Verify -txindex handling of game and non-game tx.
+# Verify -txindex handling of game and non-game tx, and that game tx
+# can be found also without -txindex through the dedicated game tx index.
 
 from test_framework.game import GameTestFramework
 from test_framework.util import *
@@ -64,6 +65,10 @@ class GameTxIndexTest (GameTestFramework):
       assert_equal (txdata['blockhash'], blkhash)
       gameTx.append (txdata)
 
+      # Game tx are indexed also without -txindex.
+      for n in [0, 2]:
+        assert_equal (self.nodes[n].getrawtransaction (txid, 1), txdata)
+
     # The first game tx should be killing of redshirt.
     assert_equal (len (gameTx[0]['vin']), 1)
     assert_equal (len (gameTx[0]['vout']), 0)
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Huntercoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the game state stream of the REST interface:  Clients get the state
+# at the tip right away and then the state after each new block, without
+# holding an RPC worker thread.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import binascii
+import http.client
+import json
+import urllib.parse
+
+class GameStreamTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        args = ["-rest", "-rpcthreads=1", "-rpcservertimeout=2"]
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, [args])
+        self.is_network_split = False
+
+    def subscribe(self, fmt):
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port, timeout=30)
+        conn.request('GET', '/rest/game/stream.' + fmt)
+        res = conn.getresponse()
+        assert_equal(res.status, 200)
+        return conn, res
+
+    def readState(self, res):
+        return json.loads(res.readline().decode('utf-8'), parse_float=Decimal)
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(1)
+
+        # More streams than worker threads.
+        streams = [self.subscribe('json') for i in range(5)]
+        hexConn, hexStream = self.subscribe('hex')
+
+        # The current state is sent right away.
+        for conn, res in streams:
+            assert_equal(self.readState(res),
+                         node.game_getstate())
+        hexState = hexStream.readline()
+        assert_equal(binascii.unhexlify(hexState.strip())[-32:],
+                     binascii.unhexlify(node.getbestblockhash())[::-1])
+
+        # RPC calls are still answered.
+        assert_equal(node.getblockcount(), 1)
+
+        # One client goes away, the others get each new state, also after
+        # the HTTP server timeout.
+        streams[0][0].close()
+        for i in range(2):
+            time.sleep(3)
+            node.generate(1)
+            state = node.game_getstate()
+            assert_equal(state['hashBlock'], node.getbestblockhash())
+            for conn, res in streams[1:]:
+                assert_equal(self.readState(res), state)
+            hexState = hexStream.readline()
+            assert_equal(binascii.unhexlify(hexState.strip())[-32:],
+                         binascii.unhexlify(node.getbestblockhash())[::-1])
+
+        # Binary data can not be streamed.
+        url = urllib.parse.urlparse(node.url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/rest/game/stream.bin')
+        assert_equal(conn.getresponse().status, http.client.NOT_FOUND)
+
+        # Open streams do not keep the node from shutting down.
+        stop_nodes(self.nodes)
+        for conn, res in streams[1:]:
+            assert_equal(res.read(), b'')
+
+if __name__ == '__main__':
+    GameStreamTest().main()
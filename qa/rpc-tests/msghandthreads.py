@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Huntercoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test parallel message handling:  Many peers request headers and old
+# blocks at the same time, and each has to get complete answers in the
+# order it asked for them.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.mininode import *
+from test_framework.util import *
+
+import time
+
+class BlockRequester(SingleNodeConnCB):
+
+    def __init__(self):
+        super().__init__()
+        self.blocks = []
+        self.headers = []
+
+    def on_block(self, conn, message):
+        message.block.calc_sha256()
+        self.blocks.append(message.block.sha256)
+
+    def on_headers(self, conn, message):
+        self.headers.append(len(message.headers))
+
+    def received(self, numBlocks):
+        with mininode_lock:
+            return len(self.blocks) == numBlocks and len(self.headers) > 0
+
+class MsgHandThreadsTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir,
+                                 [["-msghandthreads=4"],
+                                  ["-msghandthreads=1"]])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+
+    def run_test(self):
+        self.nodes[0].generate(200)
+        sync_blocks(self.nodes)
+        genesis = int(self.nodes[0].getblockhash(0), 16)
+        hashes = [int(self.nodes[0].getblockhash(h), 16)
+                  for h in range(1, 201)]
+
+        peers = []
+        for n in range(self.num_nodes):
+            for i in range(8):
+                peer = BlockRequester()
+                conn = NodeConn('127.0.0.1', p2p_port(n), self.nodes[n], peer)
+                peer.add_connection(conn)
+                peers.append(peer)
+        NetworkThread().start()
+        for peer in peers:
+            peer.wait_for_verack()
+
+        for peer in peers:
+            getheaders = msg_getheaders()
+            getheaders.locator.vHave = [genesis]
+            peer.send_message(getheaders)
+            getdata = msg_getdata()
+            getdata.inv = [CInv(2, h) for h in hashes]
+            peer.send_message(getdata)
+        for peer in peers:
+            timeout = 60
+            while not peer.received(len(hashes)) and timeout > 0:
+                time.sleep(0.1)
+                timeout -= 0.1
+            with mininode_lock:
+                assert_equal(peer.headers, [len(hashes)])
+                assert_equal(peer.blocks, hashes)
+
+        # Blocks from both nodes are still relayed.
+        self.nodes[1].generate(5)
+        sync_blocks(self.nodes)
+
+if __name__ == '__main__':
+    MsgHandThreadsTest().main()
@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Huntercoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test that a rescan gives the same wallet state no matter how many
+# threads read the blocks:  The keys of a wallet with coinbases, payments,
+# names and game transactions (bounties and kills, which are only stored
+# in the undo data) are imported into a node rescanning with one thread
+# and into one rescanning with four.
+#
+
+from test_framework.game import GameTestFramework
+from test_framework.util import *
+
+class RescanThreadsTest (GameTestFramework):
+
+  def setup_nodes (self):
+    return self.setupNodesWithArgs ([[], [],
+                                     ["-rescanthreads=1"],
+                                     ["-rescanthreads=4"]])
+
+  def run_test (self):
+    # Mine some coinbases to a fresh address of node 0, so that the
+    # imported wallet has mature and immature ones.
+    print ("Mining to node 0...")
+    addr = self.nodes[0].getnewaddress ()
+    self.nodes[0].generatetoaddress (5, addr)
+    self.sync_all ()
+
+    # A payment to node 0 that it spends again.
+    addr = self.nodes[0].getnewaddress ()
+    self.nodes[1].sendtoaddress (addr, 10)
+    self.advance (1, 1)
+    self.nodes[0].sendtoaddress (self.nodes[1].getnewaddress (), 3)
+    self.advance (1, 1)
+
+    # Register two hunters.  One of them is killed, the other one collects
+    # loot and banks it, so that node 0 receives a bounty.
+    print ("Playing the game...")
+    self.register (0, "me", 0)
+    self.register (0, "victim", 0)
+    self.advance (1, 1)
+    self.get (0, "victim", 0).destruct ()
+    me = self.get (0, "me", 0)
+    pos = self.nearestLoot (0, me.pos)
+    me.move (pos)
+    me = self.finishMove (0, "me", 0)
+    assert me.loot > 0
+    me.move ([0, 0])
+    self.finishMove (0, "me", 0)
+    self.advance (1, 5)
+
+    categories = set ()
+    for tx in self.nodes[0].listtransactions ("*", 1000, 0, True):
+      categories.add (tx['category'])
+    for cat in ['generate', 'immature', 'receive', 'send',
+                'bounty', 'immature_bounty', 'killed']:
+      if cat in categories:
+        continue
+      if cat in ['bounty', 'immature_bounty']:
+        assert 'bounty' in categories or 'immature_bounty' in categories
+        continue
+      if cat in ['generate', 'immature']:
+        assert 'generate' in categories or 'immature' in categories
+        continue
+      raise AssertionError ("no %s transaction in node 0's wallet" % cat)
+
+    # Import all keys of node 0 into nodes 2 and 3.
+    print ("Importing keys...")
+    addresses = set ()
+    for tx in self.nodes[0].listtransactions ("*", 1000, 0, True):
+      if 'address' in tx:
+        addresses.add (tx['address'])
+    for out in self.nodes[0].listunspent (0):
+      addresses.add (out['address'])
+    addresses = [a for a in addresses
+                   if self.nodes[0].validateaddress (a)['ismine']]
+    assert len (addresses) > 0
+
+    # Keys that are already known are not imported again, so only the
+    # last one triggers the rescan.
+    before = [self.walletState (n, addresses) for n in [2, 3]]
+    for i, a in enumerate (addresses):
+      privkey = self.nodes[0].dumpprivkey (a)
+      for n in [2, 3]:
+        self.nodes[n].importprivkey (privkey, "", i + 1 == len (addresses))
+    after = [self.walletState (n, addresses) for n in [2, 3]]
+
+    # Both nodes found the same transactions, and they changed the
+    # balances by the same amounts.
+    print ("Comparing the wallets...")
+    assert_equal (after[0]['txs'], after[1]['txs'])
+    assert_equal (after[0]['unspent'], after[1]['unspent'])
+    for key in ['balance', 'unconfirmed', 'immature']:
+      assert_equal (after[0][key] - before[0][key],
+                    after[1][key] - before[1][key])
+    assert any (tx[2] in ['bounty', 'immature_bounty']
+                for tx in after[0]['txs'])
+    assert any (tx[2] == 'killed' for tx in after[0]['txs'])
+
+    # The imported keys hold what they hold in node 0's wallet.
+    assert_equal (after[0]['unspent'],
+                  self.walletState (0, addresses)['unspent'])
+
+  def walletState (self, node, addresses):
+    """
+    Collect the wallet transactions and unspent outputs of the given
+    addresses together with the node's balances.
+    """
+
+    rpc = self.nodes[node]
+
+    txs = []
+    for tx in rpc.listtransactions ("*", 1000, 0, True):
+      if tx.get ('address') not in addresses and tx['category'] != 'killed':
+        continue
+      txs.append ((tx['txid'], tx.get ('vout'), tx['category'],
+                   tx['amount'], tx.get ('blockhash'), tx['confirmations']))
+    txs.sort (key=lambda t: tuple (str (x) for x in t))
+
+    unspent = []
+    for out in rpc.listunspent (0, 9999999, addresses):
+      unspent.append ((out['txid'], out['vout'], out['amount'],
+                       out['confirmations']))
+    unspent.sort ()
+
+    info = rpc.getwalletinfo ()
+    return {'txs': txs, 'unspent': unspent,
+            'balance': info['balance'],
+            'unconfirmed': info['unconfirmed_balance'],
+            'immature': info['immature_balance']}
+
+if __name__ == '__main__':
+  RescanThreadsTest ().main ()
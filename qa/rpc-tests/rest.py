@@ -340,6 +340,9 @@ class RESTTest (BitcoinTestFramework):
         # Test name handling.
         self.name_tests(url)
 
+        # Test game state queries.
+        self.game_tests(url)
+
     def name_tests(self, url):
         """
         Run REST tests specific to names.
@@ -389,5 +392,65 @@ class RESTTest (BitcoinTestFramework):
             res = http_get_call(url.hostname, url.port, query, True)
             assert_equal(res.status, http.client.BAD_REQUEST)
 
+    def game_tests(self, url):
+        """
+        Run REST tests specific to the game state.
+        """
+
+        # Register a player so that the state is not empty.
+        name = "rest hunter"
+        self.nodes[0].name_register(name, '{"color":0}')
+        self.nodes[0].generate(1)
+        self.sync_all()
+        bb_hash = self.nodes[0].getbestblockhash()
+        state = self.nodes[0].game_getstate()
+        assert_equal(state['hashBlock'], bb_hash)
+
+        # The JSON formats should match the RPC interface.
+        query = '/rest/game/tip' + self.FORMAT_SEPARATOR + 'json'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, 200)
+        assert_equal(json.loads(res.read().decode("utf-8")), state)
+        query = '/rest/game/state/' + bb_hash + self.FORMAT_SEPARATOR + 'json'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, 200)
+        assert_equal(json.loads(res.read().decode("utf-8")), state)
+
+        # The binary and hex formats should agree with each other, both
+        # for the tip and explicit block hashes.
+        query = '/rest/game/tip' + self.FORMAT_SEPARATOR + 'bin'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, 200)
+        binState = res.read()
+        query = '/rest/game/state/' + bb_hash + self.FORMAT_SEPARATOR + 'bin'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, 200)
+        assert_equal(res.read(), binState)
+        query = '/rest/game/state/' + bb_hash + self.FORMAT_SEPARATOR + 'hex'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, 200)
+        assert_equal(res.read(), binascii.hexlify(binState) + b"\n")
+
+        # The serialised state ends with the block hash.
+        assert_equal(binState[-32:], binascii.unhexlify(bb_hash)[::-1])
+
+        # Query a player state.
+        query = '/rest/game/player/' + urllib.parse.quote_plus(name) + self.FORMAT_SEPARATOR + 'json'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, 200)
+        assert_equal(json.loads(res.read().decode("utf-8")),
+                     self.nodes[0].game_getplayerstate(name))
+
+        # Error cases.
+        query = '/rest/game/player/nobody' + self.FORMAT_SEPARATOR + 'json'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, http.client.NOT_FOUND)
+        query = '/rest/game/player/' + urllib.parse.quote_plus(name) + self.FORMAT_SEPARATOR + 'bin'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, http.client.NOT_FOUND)
+        query = '/rest/game/state/' + "00" * 32 + self.FORMAT_SEPARATOR + 'json'
+        res = http_get_call(url.hostname, url.port, query, True)
+        assert_equal(res.status, http.client.NOT_FOUND)
+
 if __name__ == '__main__':
     RESTTest ().main ()
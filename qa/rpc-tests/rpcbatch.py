@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Huntercoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test JSON-RPC batches:  Read-only calls are executed in parallel, but the
+# replies are still in request order, calls that change state see the
+# calls before them, and the batch time budget is enforced.
+#
+
+from test_framework.authproxy import AuthServiceProxy
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class RPCBatchTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        args = [["-rpcthreads=4"], ["-rpcbatchtimeout=1"]]
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, args)
+        self.is_network_split = False
+
+    def batch(self, node, calls):
+        return AuthServiceProxy(node.url, timeout=60)._batch(calls)
+
+    def call(self, method, params, id):
+        return {"version": "1.1", "method": method, "params": params, "id": id}
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(20)
+
+        # A large batch of read-only calls, with some invalid ones.
+        calls = []
+        for i in range(300):
+            if i % 50 == 7:
+                calls.append(self.call("nosuchmethod", [], i))
+            elif i % 3 == 0:
+                calls.append(self.call("getblockcount", [], i))
+            else:
+                calls.append(self.call("getblockhash", [i % 21], i))
+        replies = self.batch(node, calls)
+        assert_equal(len(replies), len(calls))
+        for i, reply in enumerate(replies):
+            assert_equal(reply["id"], i)
+            if i % 50 == 7:
+                assert_equal(reply["error"]["code"], -32601)
+            elif i % 3 == 0:
+                assert_equal(reply["result"], 20)
+            else:
+                assert_equal(reply["result"], node.getblockhash(i % 21))
+
+        # Read-only calls see the state changes of the calls before them.
+        calls = [self.call("listbanned", [], 0),
+                 self.call("setban", ["127.0.0.42", "add"], 1),
+                 self.call("listbanned", [], 2),
+                 self.call("getblockcount", [], 3),
+                 self.call("clearbanned", [], 4),
+                 self.call("listbanned", [], 5)]
+        replies = self.batch(node, calls)
+        assert_equal([r["id"] for r in replies], list(range(6)))
+        assert_equal(replies[0]["result"], [])
+        assert_equal(len(replies[2]["result"]), 1)
+        assert_equal(replies[2]["result"][0]["address"], "127.0.0.42/32")
+        assert_equal(replies[3]["result"], 20)
+        assert_equal(replies[5]["result"], [])
+
+        # Calls that start after the time budget are answered with an error.
+        calls = [self.call("getblockcount", [], 0),
+                 self.call("waitfornewblock", [2000], 1),
+                 self.call("getblockcount", [], 2),
+                 self.call("getbestblockhash", [], 3)]
+        replies = self.batch(self.nodes[1], calls)
+        assert_equal([r["id"] for r in replies], list(range(4)))
+        assert_equal(replies[0]["result"], 0)
+        assert_equal(replies[1]["error"], None)
+        for reply in replies[2:]:
+            assert_equal(reply["result"], None)
+            assert_equal(reply["error"]["message"], "Batch time budget exceeded")
+
+if __name__ == '__main__':
+    RPCBatchTest().main()
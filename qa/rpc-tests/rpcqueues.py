@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Huntercoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the separate work queues for expensive RPC calls and long-polls:
+# While long-polls wait, expensive and cheap calls are still answered right
+# away, and while all long-poll threads are busy, cheap calls are too.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import threading
+import time
+
+class RPCQueuesTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        # Node 0 runs with the default queues, node 1 with one thread each.
+        args = ["-rpcthreads=1", "-rpcheavythreads=1",
+                "-rpclongpollthreads=1", "-rpceventthreads=2"]
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir,
+                                 [[], args])
+        self.is_network_split = False
+
+    def call_async(self, n, results, method, *args):
+        node = get_rpc_proxy(self.nodes[n].url, n, timeout=60)
+        start = time.time()
+        res = getattr(node, method)(*args)
+        results.append((method, res, time.time() - start))
+
+    def start_calls(self, n, results, calls):
+        threads = []
+        for method, args in calls:
+            thread = threading.Thread(target=self.call_async,
+                                      args=[n, results, method] + args)
+            thread.start()
+            threads.append(thread)
+            time.sleep(0.5)
+        return threads
+
+    def run_test(self):
+        for node in self.nodes:
+            node.generate(1)
+
+        # Two long-polls that wait for the next block do not hold up the
+        # expensive calls that would give it to them.
+        results = []
+        threads = self.start_calls(0, results, [("waitfornewblock", []),
+                                                ("game_waitforchange", [])])
+        proxy = get_rpc_proxy(self.nodes[0].url, 0, timeout=10)
+        proxy.game_getstate()
+        blockhash = proxy.generate(1)[0]
+        for thread in threads:
+            thread.join()
+        assert_equal(len(results), 2)
+        for method, res, _ in results:
+            if method == "waitfornewblock":
+                assert_equal(res['hash'], blockhash)
+            else:
+                assert_equal(res['hashBlock'], blockhash)
+
+        # Block the only thread for long-polls, and queue another long-poll
+        # behind it.
+        node = self.nodes[1]
+        results = []
+        threads = self.start_calls(1, results, [("waitfornewblock", [4000]),
+                                                ("waitforblockheight", [100, 1])])
+
+        # Cheap and expensive calls on new connections are not blocked.
+        start = time.time()
+        for i in range(10):
+            proxy = get_rpc_proxy(node.url, 1, timeout=60)
+            assert_equal(proxy.getblockcount(), 1)
+        proxy.game_getstate()
+        assert time.time() - start < 2
+
+        for thread in threads:
+            thread.join()
+        assert_equal([r[0] for r in results],
+                     ["waitfornewblock", "waitforblockheight"])
+        # The second call waited for the first one to finish.
+        assert results[1][2] > 2
+
+if __name__ == '__main__':
+    RPCQueuesTest().main()
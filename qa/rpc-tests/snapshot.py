@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Huntercoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+# Test dumpsnapshot and loadsnapshot:  A new node gets the headers from
+# a test peer, starts from the snapshot of another node and then downloads
+# and validates the blocks before it in the background.
+
+from test_framework.game import GameTestFramework
+from test_framework.mininode import *
+from test_framework.util import *
+
+from io import BytesIO
+import os
+import time
+
+class HeadersPeer (NodeConnCB):
+
+  def __init__ (self):
+    NodeConnCB.__init__ (self)
+    self.connection = None
+
+  def add_connection (self, conn):
+    self.connection = conn
+
+class SnapshotTest (GameTestFramework):
+
+  def __init__ (self):
+    GameTestFramework.__init__ (self)
+    self.num_nodes = 2
+
+  def setup_chain (self):
+    print ("Initializing test directory " + self.options.tmpdir)
+    initialize_chain (self.options.tmpdir, 2, self.options.cachedir)
+    # The new node is node 3, which runs without -txindex and -namehistory.
+    # Those need the blocks before the snapshot.
+    initialize_datadir (self.options.tmpdir, 3)
+
+  def setup_network (self):
+    self.nodes = self.setupNodesWithArgs ([[]] * 2)
+    connect_nodes_bi (self.nodes, 0, 1)
+    self.is_network_split = False
+    self.sync_all ()
+    self.fresh = start_node (3, self.options.tmpdir)
+
+  def sendHeaders (self):
+    """
+    Send all headers of node 0 to the new node from a test peer, and
+    disconnect again before it can ask for any blocks.
+    """
+
+    peer = HeadersPeer ()
+    conn = NodeConn ('127.0.0.1', p2p_port (3), self.fresh, peer)
+    peer.add_connection (conn)
+    NetworkThread ().start ()
+    peer.wait_for_verack ()
+
+    msg = msg_headers ()
+    for height in range (1, self.nodes[0].getblockcount () + 1):
+      blockhash = self.nodes[0].getblockhash (height)
+      header = CBlockHeader ()
+      data = hex_str_to_bytes (self.nodes[0].getblockheader (blockhash, False))
+      header.deserialize (BytesIO (data))
+      msg.headers.append (header)
+    conn.send_message (msg)
+
+    height = self.nodes[0].getblockcount ()
+    while self.fresh.getblockchaininfo ()['headers'] < height:
+      time.sleep (0.1)
+    conn.disconnect_node ()
+    while len (self.fresh.getpeerinfo ()) > 0:
+      time.sleep (0.1)
+
+  def run_test (self):
+    # Build up some name and game state.
+    self.register (0, "hunter", 0)
+    self.advance (0, 1)
+    self.get (0, "hunter", 0).move ([5, 5])
+    self.advance (0, 5)
+    self.nodes[1].name_register ("other", '{"color":1}')
+    self.advance (0, 3)
+
+    dump = self.nodes[0].dumpsnapshot ("snapshot.dat")
+    height = self.nodes[0].getblockcount ()
+    assert_equal (dump['height'], height)
+    assert_equal (dump['blockhash'], self.nodes[0].getbestblockhash ())
+    assert os.path.isfile (dump['path'])
+    assert_raises (JSONRPCException, self.nodes[0].dumpsnapshot,
+                   "snapshot.dat")
+
+    # Without the headers, the snapshot can not be used yet.
+    try:
+      self.fresh.loadsnapshot (dump['path'])
+      raise AssertionError ("snapshot loaded without headers")
+    except JSONRPCException as exc:
+      assert_equal (exc.error['code'], -1)
+    self.sendHeaders ()
+    assert_equal (self.fresh.getblockcount (), 0)
+
+    loaded = self.fresh.loadsnapshot (dump['path'])
+    for key in ['blockhash', 'height', 'coins', 'names', 'hash']:
+      assert_equal (loaded[key], dump[key])
+    assert_equal (self.fresh.getbestblockhash (), dump['blockhash'])
+    info = self.fresh.getblockchaininfo ()['snapshot']
+    assert_equal (info['height'], height)
+    assert_equal (info['historyheight'], 0)
+    assert_raises (JSONRPCException, self.fresh.loadsnapshot,
+                   dump['path'])
+
+    # The chainstate is the same as on the node it came from.
+    assert_equal (self.fresh.gettxoutsetinfo ()['hash_serialized_2'],
+                  self.nodes[0].gettxoutsetinfo ()['hash_serialized_2'])
+    assert_equal (self.fresh.name_show ("hunter"),
+                  self.nodes[0].name_show ("hunter"))
+    assert_equal (self.fresh.game_getstate (),
+                  self.nodes[0].game_getstate ())
+
+    # Continue the chain and join the new node.  It catches up with the
+    # tip, and downloads and validates the history in the background.
+    self.advance (0, 5)
+    connect_nodes (self.fresh, 1)
+    sync_blocks (self.nodes + [self.fresh])
+    assert_equal (self.fresh.game_getstate (),
+                  self.nodes[0].game_getstate ())
+    while 'snapshot' in self.fresh.getblockchaininfo ():
+      time.sleep (0.5)
+    assert_equal (self.fresh.getblock (self.fresh.getblockhash (1)),
+                  self.nodes[0].getblock (self.nodes[0].getblockhash (1)))
+
+    # Everything is still there after a restart.
+    stop_node (self.fresh, 3)
+    self.fresh = start_node (3, self.options.tmpdir)
+    assert 'snapshot' not in self.fresh.getblockchaininfo ()
+    assert_equal (self.fresh.getbestblockhash (),
+                  self.nodes[0].getbestblockhash ())
+    assert_equal (self.fresh.name_show ("other"),
+                  self.nodes[0].name_show ("other"))
+    assert self.fresh.verifychain (4, 0)
+    stop_node (self.fresh, 3)
+
+if __name__ == '__main__':
+  SnapshotTest ().main ()
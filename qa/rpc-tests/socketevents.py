@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Huntercoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the socket event handlers:  One node uses epoll and the other
+# select.  Both have to sync blocks and handle many inbound connections
+# that come and go.
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.mininode import *
+from test_framework.util import *
+
+import time
+
+class SocketEventsTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir,
+                                 [[], ["-socketevents=select"]])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.is_network_split = False
+
+    def run_test(self):
+        for i in range(10):
+            self.nodes[0].generate(20)
+            self.nodes[1].generate(5)
+        sync_blocks(self.nodes)
+
+        conns = []
+        for n in range(self.num_nodes):
+            for i in range(40):
+                conn = NodeConn('127.0.0.1', p2p_port(n), self.nodes[n],
+                                SingleNodeConnCB())
+                conn.cb.add_connection(conn)
+                conns.append(conn)
+        NetworkThread().start()
+        for conn in conns:
+            conn.cb.wait_for_verack()
+        for node in self.nodes:
+            assert_equal(len(node.getpeerinfo()), 42)
+
+        for conn in conns:
+            conn.send_message(msg_ping(nonce=5))
+        for conn in conns:
+            conn.disconnect_node()
+        for node in self.nodes:
+            timeout = 30
+            while len(node.getpeerinfo()) > 2 and timeout > 0:
+                time.sleep(0.1)
+                timeout -= 0.1
+            assert_equal(len(node.getpeerinfo()), 2)
+
+        # The nodes are still connected to each other.
+        self.nodes[1].generate(30)
+        sync_blocks(self.nodes)
+
+if __name__ == '__main__':
+    SocketEventsTest().main()
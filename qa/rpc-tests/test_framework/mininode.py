@@ -1016,10 +1016,14 @@ class msg_version(object):
             self.nVersion = 300
         self.nServices = struct.unpack("<Q", f.read(8))[0]
         self.nTime = struct.unpack("<q", f.read(8))[0]
+        # Huntercoin's INIT_PROTO_VERSION is past CADDR_TIME_VERSION, so
+        # the addresses in version messages include their time.
+        f.read(4)
         self.addrTo = CAddress()
         self.addrTo.deserialize(f)
 
         if self.nVersion >= 106:
+            f.read(4)
             self.addrFrom = CAddress()
             self.addrFrom.deserialize(f)
             self.nNonce = struct.unpack("<Q", f.read(8))[0]
@@ -1049,7 +1053,9 @@ class msg_version(object):
         r += struct.pack("<i", self.nVersion)
         r += struct.pack("<Q", self.nServices)
         r += struct.pack("<q", self.nTime)
+        r += struct.pack("<I", 0)
         r += self.addrTo.serialize()
+        r += struct.pack("<I", 0)
         r += self.addrFrom.serialize()
         r += struct.pack("<Q", self.nNonce)
         r += ser_string(self.strSubVer)
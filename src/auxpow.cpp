@@ -11,7 +11,9 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "cuckoocache.h"
 #include "hash.h"
+#include "random.h"
 #include "script/script.h"
 #include "txmempool.h"
 #include "util.h"
@@ -86,9 +88,127 @@ bool CMerkleTx::AcceptToMemoryPool(const CAmount& nAbsurdFee, CValidationState&
 
 /* ************************************************************************** */
 
+namespace
+{
+
+/**
+ * Cache of auxpows that passed CAuxPow::check, so that the same proof
+ * is not verified again when a header is followed by its full block,
+ * on reorgs or when a miner resubmits work.  Like the signature cache,
+ * it is a lock-free CCuckooCache of salted entries.
+ */
+class CAuxPowCache
+{
+private:
+
+  /** Entries are SHA256(nonce || aux hash || chain ID || parent hash).  */
+  uint256 nonce;
+  CCuckooCache setValid;
+
+public:
+
+  CAuxPowCache ()
+  {
+    GetRandBytes (nonce.begin (), 32);
+  }
+
+  void
+  ComputeEntry (uint256& entry, const uint256& hashAuxBlock, int nChainId,
+                const uint256& hashParent)
+  {
+    unsigned char chainId[4];
+    WriteLE32 (chainId, (uint32_t) nChainId);
+    CSHA256 ().Write (nonce.begin (), 32)
+              .Write (hashAuxBlock.begin (), 32)
+              .Write (chainId, sizeof (chainId))
+              .Write (hashParent.begin (), 32)
+              .Finalize (entry.begin ());
+  }
+
+  bool
+  Get (const uint256& entry)
+  {
+    return setValid.contains (entry, false);
+  }
+
+  void
+  Set (const uint256& entry)
+  {
+    setValid.insert (entry);
+  }
+
+  size_t
+  setup_bytes (size_t n)
+  {
+    return setValid.setup_bytes (n);
+  }
+};
+
+/* Sized by InitAuxpowCheckCache before blocks are processed.  */
+static CAuxPowCache auxpowCache;
+
+} // anonymous namespace
+
+void
+InitAuxpowCheckCache ()
+{
+  const int64_t nMaxCacheSizeMiB
+    = std::max<int64_t> (0, GetArg ("-maxauxpowcheckcachesize",
+                                    DEFAULT_MAX_AUXPOW_CHECK_CACHE_SIZE));
+  const size_t nMaxCacheSize = nMaxCacheSizeMiB * ((size_t) 1 << 20);
+  const size_t nElems = auxpowCache.setup_bytes (nMaxCacheSize);
+  LogPrintf ("Using %zu MiB out of %zu requested for auxpow cache,"
+             " able to store %zu elements\n",
+             (nElems * CCuckooCache::BUCKET_SIZE
+                / CCuckooCache::SLOTS_PER_BUCKET) >> 20,
+             nMaxCacheSize >> 20, nElems);
+}
+
 bool
 CAuxPow::check (const uint256& hashAuxBlock, int nChainId,
                 const Consensus::Params& params) const
+{
+  uint256 entry;
+  auxpowCache.ComputeEntry (entry, hashAuxBlock, nChainId,
+                            parentBlock.GetHash ());
+  if (auxpowCache.Get (entry))
+    return checkCommitment (hashAuxBlock);
+
+  if (!checkUncached (hashAuxBlock, nChainId, params))
+    return false;
+
+  auxpowCache.Set (entry);
+  return true;
+}
+
+bool
+CAuxPow::checkCommitment (const uint256& hashAuxBlock) const
+{
+  if (nIndex != 0 || vChainMerkleBranch.size () > 30)
+    return false;
+  if (CheckMerkleBranch (GetHash (), vMerkleBranch, nIndex)
+        != parentBlock.hashMerkleRoot)
+    return false;
+
+  /* With an empty chain merkle branch, the index does not change the root
+     but checkUncached requires it to be zero.  */
+  if (vChainMerkleBranch.empty () && nChainIndex != 0)
+    return false;
+
+  const uint256 nRootHash
+    = CheckMerkleBranch (hashAuxBlock, vChainMerkleBranch, nChainIndex);
+  valtype vchRootHash(nRootHash.begin (), nRootHash.end ());
+  std::reverse (vchRootHash.begin (), vchRootHash.end ());
+
+  const CScript& script = tx->vin[0].scriptSig;
+  return std::search (script.begin (), script.end (),
+                      vchRootHash.begin (), vchRootHash.end ())
+           != script.end ();
+}
+
+bool
+CAuxPow::checkUncached (const uint256& hashAuxBlock, int nChainId,
+                        const Consensus::Params& params) const
 {
     if (nIndex != 0)
         return error("AuxPow is not a generate");
@@ -191,25 +311,6 @@ CAuxPow::getExpectedIndex (uint32_t nNonce, int nChainId, unsigned h)
   return rand % (1 << h);
 }
 
-uint256
-CAuxPow::CheckMerkleBranch (uint256 hash,
-                            const std::vector<uint256>& vMerkleBranch,
-                            int nIndex)
-{
-  if (nIndex == -1)
-    return uint256 ();
-  for (std::vector<uint256>::const_iterator it(vMerkleBranch.begin ());
-       it != vMerkleBranch.end (); ++it)
-  {
-    if (nIndex & 1)
-      hash = Hash (BEGIN (*it), END (*it), BEGIN (hash), END (hash));
-    else
-      hash = Hash (BEGIN (hash), END (hash), BEGIN (*it), END (*it));
-    nIndex >>= 1;
-  }
-  return hash;
-}
-
 void
 CAuxPow::initAuxPow (CBlockHeader& header)
 {
@@ -9,6 +9,7 @@
 
 #include "consensus/params.h"
 #include "consensus/validation.h"
+#include "hash.h"
 #include "primitives/pureheader.h"
 #include "primitives/transaction.h"
 #include "serialize.h"
@@ -20,6 +21,21 @@ class CBlock;
 class CBlockHeader;
 class CBlockIndex;
 
+/** Default for -maxauxpowcheckcachesize, the size in MiB of the cache
+    of verified auxpows.  */
+static const unsigned int DEFAULT_MAX_AUXPOW_CHECK_CACHE_SIZE = 4;
+
+/** Size the cache of verified auxpows from -maxauxpowcheckcachesize.  */
+void InitAuxpowCheckCache ();
+
+/**
+ * Stream version flag that selects the compact encoding of auxpows.  It
+ * leaves out fields that can be derived from the rest of the auxpow and
+ * is used with peers that advertise NODE_AUXPOW_COMPACT and, optionally,
+ * in the block files.
+ */
+static const int SERIALIZE_AUXPOW_COMPACT = 0x20000000;
+
 /** Header for merge-mining data in the coinbase.  */
 static const unsigned char pchMergedMiningHeader[] = { 0xfa, 0xbe, 'm', 'm' };
 
@@ -125,6 +141,83 @@ public:
 class CAuxPow : public CMerkleTx
 {
 
+private:
+
+  /**
+   * Flags of the compact encoding.  They tell which fields are left out
+   * because they have their usual values and are derived on decoding.
+   */
+  enum
+  {
+    /** hashBlock is null.  */
+    COMPACT_HASHBLOCK_NULL = (1 << 0),
+    /** hashBlock is the parent block's hash.  */
+    COMPACT_HASHBLOCK_PARENT = (1 << 1),
+    /** The coinbase is at index zero of the parent block.  */
+    COMPACT_INDEX_ZERO = (1 << 2),
+    /** The parent's merkle root follows from the coinbase and its branch.  */
+    COMPACT_MERKLE_ROOT = (1 << 3),
+
+    COMPACT_ALL = (1 << 4) - 1
+  };
+
+  /**
+   * Compute the parent block's merkle root from the coinbase and its
+   * branch.  This is what the compact encoding derives the root from.
+   * @return The derived merkle root.
+   */
+  inline uint256
+  getDerivedMerkleRoot () const
+  {
+    return CheckMerkleBranch (tx->GetHash (), vMerkleBranch, nIndex);
+  }
+
+  /**
+   * Compute the flags for the compact encoding of this auxpow.  This and
+   * expandCompact (as well as CheckMerkleBranch) are inline so that users
+   * of the serialisation code need not link against auxpow.cpp.
+   * @return The flags for the fields that can be left out.
+   */
+  inline unsigned char
+  getCompactFlags () const
+  {
+    unsigned char nFlags = 0;
+
+    if (hashBlock.IsNull ())
+      nFlags |= COMPACT_HASHBLOCK_NULL;
+    else if (hashBlock == parentBlock.GetHash ())
+      nFlags |= COMPACT_HASHBLOCK_PARENT;
+
+    if (nIndex == 0)
+      nFlags |= COMPACT_INDEX_ZERO;
+
+    if (parentBlock.hashMerkleRoot == getDerivedMerkleRoot ())
+      nFlags |= COMPACT_MERKLE_ROOT;
+
+    return nFlags;
+  }
+
+  /**
+   * Fill in the fields left out of the compact encoding after the
+   * other fields have been read.
+   * @param nFlags The flags read from the stream.
+   */
+  inline void
+  expandCompact (unsigned char nFlags)
+  {
+    if (nFlags & COMPACT_INDEX_ZERO)
+      nIndex = 0;
+
+    if (nFlags & COMPACT_MERKLE_ROOT)
+      parentBlock.hashMerkleRoot = getDerivedMerkleRoot ();
+
+    /* This must come last, since the parent hash depends on the root.  */
+    if (nFlags & COMPACT_HASHBLOCK_NULL)
+      hashBlock.SetNull ();
+    else if (nFlags & COMPACT_HASHBLOCK_PARENT)
+      hashBlock = parentBlock.GetHash ();
+  }
+
 /* Public for the unit tests.  */
 public:
 
@@ -148,16 +241,62 @@ public:
     : CMerkleTx ()
   {}
 
-  ADD_SERIALIZE_METHODS;
+  template<typename Stream>
+    void
+    Serialize (Stream& s) const
+  {
+    if (!(s.GetVersion () & SERIALIZE_AUXPOW_COMPACT))
+      {
+        s << *static_cast<const CMerkleTx*> (this);
+        s << vChainMerkleBranch << nChainIndex << parentBlock;
+        return;
+      }
+
+    const unsigned char nFlags = getCompactFlags ();
+    s << nFlags << tx;
+    if (!(nFlags & (COMPACT_HASHBLOCK_NULL | COMPACT_HASHBLOCK_PARENT)))
+      s << hashBlock;
+    s << vMerkleBranch;
+    if (!(nFlags & COMPACT_INDEX_ZERO))
+      s << nIndex;
+    s << vChainMerkleBranch << nChainIndex;
+    s << parentBlock.nVersion << parentBlock.hashPrevBlock;
+    if (!(nFlags & COMPACT_MERKLE_ROOT))
+      s << parentBlock.hashMerkleRoot;
+    s << parentBlock.nTime << parentBlock.nBits << parentBlock.nNonce;
+  }
 
-  template<typename Stream, typename Operation>
-    inline void
-    SerializationOp (Stream& s, Operation ser_action)
+  template<typename Stream>
+    void
+    Unserialize (Stream& s)
   {
-    READWRITE (*static_cast<CMerkleTx*> (this));
-    READWRITE (vChainMerkleBranch);
-    READWRITE (nChainIndex);
-    READWRITE (parentBlock);
+    if (!(s.GetVersion () & SERIALIZE_AUXPOW_COMPACT))
+      {
+        s >> *static_cast<CMerkleTx*> (this);
+        s >> vChainMerkleBranch >> nChainIndex >> parentBlock;
+        return;
+      }
+
+    unsigned char nFlags;
+    s >> nFlags;
+    if ((nFlags & ~COMPACT_ALL)
+        || ((nFlags & COMPACT_HASHBLOCK_NULL)
+              && (nFlags & COMPACT_HASHBLOCK_PARENT)))
+      throw std::ios_base::failure ("invalid compact auxpow flags");
+
+    s >> tx;
+    if (!(nFlags & (COMPACT_HASHBLOCK_NULL | COMPACT_HASHBLOCK_PARENT)))
+      s >> hashBlock;
+    s >> vMerkleBranch;
+    if (!(nFlags & COMPACT_INDEX_ZERO))
+      s >> nIndex;
+    s >> vChainMerkleBranch >> nChainIndex;
+    s >> parentBlock.nVersion >> parentBlock.hashPrevBlock;
+    if (!(nFlags & COMPACT_MERKLE_ROOT))
+      s >> parentBlock.hashMerkleRoot;
+    s >> parentBlock.nTime >> parentBlock.nBits >> parentBlock.nNonce;
+
+    expandCompact (nFlags);
   }
 
   /**
@@ -172,6 +311,21 @@ public:
   bool check (const uint256& hashAuxBlock, int nChainId,
               const Consensus::Params& params) const;
 
+  /**
+   * Check the auxpow like check does, but without looking up or adding
+   * the result in the cache of verified auxpows.
+   */
+  bool checkUncached (const uint256& hashAuxBlock, int nChainId,
+                      const Consensus::Params& params) const;
+
+  /**
+   * Check that this auxpow's merkle branches link hashAuxBlock to the
+   * parent block.  The cache is keyed on the aux block, chain ID and
+   * parent hash only, so a hit is confirmed with this before the proof
+   * is accepted; a tampered copy of a cached proof must not pass.
+   */
+  bool checkCommitment (const uint256& hashAuxBlock) const;
+
   /**
    * Get the parent block's hash.  This is used to verify that it
    * satisfies the PoW requirement.
@@ -210,9 +364,23 @@ public:
    * Check a merkle branch.  This used to be in CBlock, but was removed
    * upstream.  Thus include it here now.
    */
-  static uint256 CheckMerkleBranch (uint256 hash,
-                                    const std::vector<uint256>& vMerkleBranch,
-                                    int nIndex);
+  static inline uint256
+  CheckMerkleBranch (uint256 hash, const std::vector<uint256>& vMerkleBranch,
+                     int nIndex)
+  {
+    if (nIndex == -1)
+      return uint256 ();
+    for (std::vector<uint256>::const_iterator it(vMerkleBranch.begin ());
+         it != vMerkleBranch.end (); ++it)
+    {
+      if (nIndex & 1)
+        hash = Hash (it->begin (), it->end (), hash.begin (), hash.end ());
+      else
+        hash = Hash (hash.begin (), hash.end (), it->begin (), it->end ());
+      nIndex >>= 1;
+    }
+    return hash;
+  }
 
   /**
    * Initialise the auxpow of the given block header.  This constructs
@@ -3,9 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "random.h"
 #include "wallet/wallet.h"
 
 #include <boost/foreach.hpp>
+#include <algorithm>
 #include <set>
 
 using namespace std;
@@ -59,4 +61,32 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// A wallet that collected many small bounties, with all coins below the
+// target.  The coins are sorted by value, as AvailableCoins returns them.
+static void CoinSelectionManySmall(benchmark::State& state)
+{
+    const CWallet wallet;
+    vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    FastRandomContext rng(true);
+    for (int i = 0; i < 20000; i++)
+        addCoin(COIN / 100 + rng.rand32() % (COIN / 10), wallet, vCoins);
+    std::sort(vCoins.begin(), vCoins.end(), [](const COutput& a, const COutput& b) {
+        return a.tx->tx->vout[a.i].nValue > b.tx->tx->vout[b.i].nValue;
+    });
+
+    while (state.KeepRunning()) {
+        set<pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(37 * COIN + 12345, 1, 6, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet >= 37 * COIN + 12345);
+    }
+
+    BOOST_FOREACH (COutput output, vCoins)
+        delete output.tx;
+}
+
 BENCHMARK(CoinSelection);
+BENCHMARK(CoinSelectionManySmall);
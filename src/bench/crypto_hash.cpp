@@ -13,6 +13,7 @@
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "scrypt/scrypt.h"
 
 /* Number of bytes to hash per iteration */
 static const uint64_t BUFFER_SIZE = 1000*1000;
@@ -51,6 +52,14 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -69,10 +78,34 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void Scrypt(benchmark::State& state)
+{
+    char hash[32];
+    std::vector<char> in(80, 0);
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256(&in[0], hash);
+        in[0]++;
+    }
+}
+
+static void ScryptBatch_16(benchmark::State& state)
+{
+    std::vector<char> hashes(32 * 16);
+    std::vector<char> in(80 * 16, 0);
+    scrypt_detect_multilane();
+    while (state.KeepRunning()) {
+        scrypt_1024_1_1_256_batch(&in[0], &hashes[0], 16);
+        in[0]++;
+    }
+}
+
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
 BENCHMARK(SHA256);
 BENCHMARK(SHA512);
 
 BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
 BENCHMARK(SipHash_32b);
+BENCHMARK(Scrypt);
+BENCHMARK(ScryptBatch_16);
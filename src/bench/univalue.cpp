@@ -0,0 +1,80 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "game/move.h"
+#include "game/state.h"
+#include "tinyformat.h"
+
+#include <univalue.h>
+
+// A game state with many players, characters with waypoints and loot,
+// similar in size to what game_getstate returns on the main chain.
+static void FillGameState(GameState& gameState)
+{
+    for (int i = 0; i < 2000; ++i) {
+        PlayerState& pl = gameState.players[strprintf("player %d", i)];
+        pl.color = i % 4;
+        pl.value = 200 * COIN;
+        pl.lockedCoins = 200 * COIN;
+        pl.next_character_index = 3;
+        pl.message = strprintf("Hello from player %d, \"quoted\" and\nwith a newline", i);
+        pl.message_block = i;
+
+        for (int c = 0; c < 3; ++c) {
+            CharacterState& ch = pl.characters[c];
+            ch.coord = Coord(i % 502, (i / 502) * 3 + c);
+            ch.from = ch.coord;
+            for (int w = 0; w < 8; ++w)
+                ch.waypoints.push_back(Coord((i + w) % 502, (c + w) % 502));
+        }
+    }
+
+    for (int i = 0; i < 5000; ++i)
+        gameState.loot[Coord(i % 502, i / 502)] = LootInfo(COIN / 2, i);
+}
+
+static void GameStateToJson(benchmark::State& state)
+{
+    GameState gameState(Params(CBaseChainParams::MAIN).GetConsensus());
+    FillGameState(gameState);
+
+    while (state.KeepRunning()) {
+        const std::string json = gameState.ToJsonValue().write();
+        assert(!json.empty());
+    }
+}
+
+static void GameStateJsonParse(benchmark::State& state)
+{
+    GameState gameState(Params(CBaseChainParams::MAIN).GetConsensus());
+    FillGameState(gameState);
+    const std::string json = gameState.ToJsonValue().write();
+
+    while (state.KeepRunning()) {
+        UniValue val;
+        bool ok = val.read(json);
+        assert(ok);
+    }
+}
+
+static void MoveParse(benchmark::State& state)
+{
+    const std::string json = "{\"0\":{\"wp\":[12,34,56,78,90,123,145,167]},"
+                             "\"1\":{\"destruct\":true},"
+                             "\"2\":{\"wp\":[250,248]},"
+                             "\"msg\":\"Going for the crown, don't follow me!\"}";
+
+    while (state.KeepRunning()) {
+        Move move;
+        bool ok = move.Parse("hunter_42", json);
+        assert(ok);
+    }
+}
+
+BENCHMARK(GameStateToJson);
+BENCHMARK(GameStateJsonParse);
+BENCHMARK(MoveParse);
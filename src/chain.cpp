@@ -16,22 +16,22 @@ CBlockHeader CBlockIndex::GetBlockHeader(const Consensus::Params& consensusParam
     CBlockHeader block;
 
     block.nVersion       = nVersion;
-
-    /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
-    if (block.IsAuxpow())
-    {
-        ReadBlockHeaderFromDisk(block, this, consensusParams);
-        return block;
-    }
-
     if (pprev)
         block.hashPrevBlock = pprev->GetBlockHash();
     block.hashMerkleRoot = hashMerkleRoot;
     block.nTime          = nTime;
     block.nBits          = nBits;
     block.nNonce         = nNonce;
+
+    /* The CBlockIndex object's block header is missing the auxpow.
+       So if this is an auxpow block, take it from the auxpow cache or
+       read the header from disk.  */
+    if (block.IsAuxpow())
+    {
+        if (!ReadBlockAuxpow(block.auxpow, this, consensusParams))
+            block.SetNull();
+    }
+
     return block;
 }
 
@@ -143,8 +143,12 @@ const CBlockIndex* CBlockIndex::GetAncestor(int height) const
 
 void CBlockIndex::BuildSkip()
 {
-    if (pprev)
-        pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+    if (!pprev)
+        return;
+
+    pskip = pprev->GetAncestor(GetSkipHeight(nHeight));
+    for (int algo = 0; algo < NUM_ALGOS; ++algo)
+        pprevAlgo[algo] = (pprev->GetAlgo() == algo ? pprev : pprev->pprevAlgo[algo]);
 }
 
 arith_uint256 GetBlockProof(const CBlockIndex& block)
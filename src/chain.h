@@ -166,6 +166,10 @@ public:
     //! pointer to the index of some further predecessor of this block
     CBlockIndex* pskip;
 
+    //! (memory only) pointers to the last predecessor of this block that was
+    //! mined with each of the PoW algorithms (NULL if there is none)
+    CBlockIndex* pprevAlgo[NUM_ALGOS];
+
     //! height of the entry in the chain. The genesis block has height 0
     int nHeight;
 
@@ -208,6 +212,8 @@ public:
         phashBlock = NULL;
         pprev = NULL;
         pskip = NULL;
+        for (int algo = 0; algo < NUM_ALGOS; ++algo)
+            pprevAlgo[algo] = NULL;
         nHeight = 0;
         nFile = 0;
         nDataPos = 0;
@@ -318,7 +324,8 @@ public:
         return false;
     }
 
-    //! Build the skiplist pointer for this entry.
+    //! Build the skiplist pointer and the per-algo predecessor pointers
+    //! for this entry.  This requires them to be built for pprev already.
     void BuildSkip();
 
     //! Efficiently find an ancestor of this block.
@@ -335,6 +342,15 @@ public:
         return CPureBlockHeader::GetAlgo(nVersion);
     }
 
+    //! Return the last block mined with the given algorithm, which is
+    //! either this block itself or one of its predecessors.
+    inline const CBlockIndex* GetLastOfAlgo(PowAlgo algo) const
+    {
+        if (GetAlgo() == algo)
+            return this;
+        return pprevAlgo[algo];
+    }
+
 };
 
 arith_uint256 GetBlockProof(const CBlockIndex& block);
@@ -6,6 +6,11 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -16,6 +21,9 @@
 template <typename T>
 class CCheckQueueControl;
 
+/** Default number of per-worker deques of a CCheckQueue.  */
+static const unsigned int DEFAULT_CHECKQUEUE_DEQUES = 16;
+
 /** 
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -25,12 +33,39 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * The checks are spread over per-worker deques.  Each worker takes
+  * batches from the back of its own deque and, when that runs empty,
+  * steals from the front of the others.  The deque locks are normally
+  * only taken by their owner, and the shared mutex is only used to sleep
+  * and wake up, so that workers do not contend on every batch.  The
+  * batch size adapts to the amount of queued work: small blocks are
+  * spread in single checks for latency, big ones in batches of up to
+  * nBatchSize for throughput.
+  *
+  * Besides checks, the workers also run arbitrary tasks (see AddTask),
+  * like the game step or proof-of-work checks, so that these can share
+  * the same threads.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! A deque of checks and its lock
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        std::deque<T> checks;
+        //! Size of checks, readable without the lock
+        std::atomic<size_t> nSize;
+
+        WorkerQueue() : nSize(0) {}
+    };
+
+    //! The per-worker deques.  The master uses the first one.
+    std::vector<std::unique_ptr<WorkerQueue>> vQueues;
+
+    //! Mutex to protect sleeping, waking up and the tasks
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,96 +74,131 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Tasks that are not checks, run by the workers before any checks
+    std::deque<std::function<void()>> tasks;
+
+    //! Number of queued tasks, readable without the lock
+    std::atomic<unsigned int> nTasks;
+
+    //! Number of checks in the deques that have not been taken yet.
+    std::atomic<unsigned int> nQueued;
 
     //! The number of workers (including the master) that are idle.
-    int nIdle;
+    std::atomic<int> nIdle;
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal;
+
+    //! Number of worker threads that have been assigned a deque.
+    std::atomic<unsigned int> nWorkers;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! The deque that the next batch of the master goes to.
+    unsigned int nNextQueue;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /**
+     * Take a batch of checks, from the given deque if possible and
+     * otherwise from any other.  Returns false if there were none.
+     */
+    bool Take(unsigned int nOwn, std::vector<T>& vChecks)
+    {
+        // Aim for increasingly smaller batches so all workers finish
+        // approximately simultaneously, and account for idle workers
+        // which will instantly start helping.
+        const unsigned int nWant = std::max(1U, std::min(nBatchSize, nQueued / (nTotal + nIdle + 1)));
+        for (unsigned int i = 0; i < vQueues.size(); i++) {
+            WorkerQueue& q = *vQueues[(nOwn + i) % vQueues.size()];
+            if (q.nSize == 0)
+                continue;
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            const size_t nNow = std::min<size_t>(nWant, q.checks.size());
+            if (nNow == 0)
+                continue;
+            vChecks.resize(nNow);
+            for (size_t j = 0; j < nNow; j++) {
+                // The owner works from the back, thieves from the front
+                if (i == 0) {
+                    vChecks[j].swap(q.checks.back());
+                    q.checks.pop_back();
+                } else {
+                    vChecks[j].swap(q.checks.front());
+                    q.checks.pop_front();
+                }
+            }
+            q.nSize = q.checks.size();
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const unsigned int nOwn = fMaster ? 0 : 1 + nWorkers++ % (vQueues.size() - 1);
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+        nTotal++;
+        while (true) {
+            if (!fMaster && nTasks > 0 && RunTask())
+                continue;
+
+            if (Take(nOwn, vChecks)) {
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = fAllOk;
+                BOOST_FOREACH (T& check, vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk = false;
+                const unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (nTodo.fetch_sub(nNow) == nNow) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster && nTodo == 0) {
+                nTotal--;
+                bool fRet = fAllOk;
+                // reset the status for new work later
+                fAllOk = true;
+                return fRet;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+            // Announce being idle before looking for work, so that Add
+            // either sees us idle or we see its work
+            nIdle++;
+            if (nQueued == 0 && (fMaster || nTasks == 0))
+                (fMaster ? condMaster : condWorker).wait(lock);
+            nIdle--;
+        }
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nQueuesIn = DEFAULT_CHECKQUEUE_DEQUES) :
+        nTasks(0), nQueued(0), nIdle(0), nTotal(0), nWorkers(0), fAllOk(true), nTodo(0), nNextQueue(0), nBatchSize(nBatchSizeIn)
+    {
+        assert(nQueuesIn >= 2);
+        for (unsigned int i = 0; i < nQueuesIn; i++)
+            vQueues.emplace_back(new WorkerQueue());
+    }
 
     //! Worker thread
     void Thread()
@@ -144,17 +214,70 @@ public:
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
+    {
+        if (vChecks.empty())
+            return;
+        nTodo += vChecks.size();
+        // Count the checks before publishing them, so that a thief taking
+        // them right away cannot make the counter wrap around.  Until they
+        // are published, idle workers only spin instead of sleeping.
+        nQueued += vChecks.size();
+
+        // Spread the checks over the deques of the workers we have
+        const unsigned int nActive = std::min<unsigned int>(vQueues.size(), 1 + nWorkers);
+        const size_t nChunk = (vChecks.size() + nActive - 1) / nActive;
+        for (size_t i = 0; i < vChecks.size(); i += nChunk) {
+            WorkerQueue& q = *vQueues[nNextQueue];
+            nNextQueue = (nNextQueue + 1) % nActive;
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (size_t j = i; j < std::min(vChecks.size(), i + nChunk); j++) {
+                q.checks.push_back(T());
+                vChecks[j].swap(q.checks.back());
+            }
+            q.nSize = q.checks.size();
+        }
+
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
+    }
+
+    /**
+     * Queue a task that is not a check.  It is run by one of the worker
+     * threads, independently of the checks and of Wait, so the caller has
+     * to track its completion (e.g. through a std::packaged_task).  There
+     * must be worker threads, or a thread calling RunTask, for it to run.
+     */
+    void AddTask(std::function<void()> task)
     {
         boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        tasks.push_back(std::move(task));
+        nTasks++;
+        condWorker.notify_one();
+    }
+
+    /**
+     * Run one of the queued tasks in the calling thread.  This allows
+     * a thread waiting for a task to help instead of blocking.
+     * @return False if there was no task to run.
+     */
+    bool RunTask()
+    {
+        std::function<void()> task;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (tasks.empty())
+                return false;
+            task.swap(tasks.front());
+            tasks.pop_front();
+            nTasks--;
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        task();
+        return true;
     }
 
     ~CCheckQueue()
@@ -163,8 +286,7 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo == 0 && nQueued == 0 && fAllOk == true);
     }
 
 };
@@ -0,0 +1,150 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* 8-way double-SHA256 of 64-byte inputs using AVX2.  Word i of the
+   state of lane l is kept in element l of a vector, so that 8 independent
+   hashes are computed at once.  The function is compiled via a target
+   attribute and must only be called after SHA256AutoDetect has checked
+   that the CPU supports it.  */
+
+#include "crypto/common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define SHA256_AVX2 __attribute__((target("avx2")))
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+inline SHA256_AVX2 __m256i Const(uint32_t x) { return _mm256_set1_epi32(x); }
+inline SHA256_AVX2 __m256i Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+inline SHA256_AVX2 __m256i Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+inline SHA256_AVX2 __m256i Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+inline SHA256_AVX2 __m256i Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+inline SHA256_AVX2 __m256i Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+inline SHA256_AVX2 __m256i Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+inline SHA256_AVX2 __m256i And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+inline SHA256_AVX2 __m256i ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+inline SHA256_AVX2 __m256i Ror(__m256i x, int n) { return Or(ShR(x, n), _mm256_slli_epi32(x, 32 - n)); }
+
+inline SHA256_AVX2 __m256i Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+inline SHA256_AVX2 __m256i Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+inline SHA256_AVX2 __m256i Sigma0(__m256i x) { return Xor(Ror(x, 2), Ror(x, 13), Ror(x, 22)); }
+inline SHA256_AVX2 __m256i Sigma1(__m256i x) { return Xor(Ror(x, 6), Ror(x, 11), Ror(x, 25)); }
+inline SHA256_AVX2 __m256i sigma0(__m256i x) { return Xor(Ror(x, 7), Ror(x, 18), ShR(x, 3)); }
+inline SHA256_AVX2 __m256i sigma1(__m256i x) { return Xor(Ror(x, 17), Ror(x, 19), ShR(x, 10)); }
+
+inline SHA256_AVX2 void Initialize(__m256i* s)
+{
+    s[0] = Const(0x6a09e667ul);
+    s[1] = Const(0xbb67ae85ul);
+    s[2] = Const(0x3c6ef372ul);
+    s[3] = Const(0xa54ff53aul);
+    s[4] = Const(0x510e527ful);
+    s[5] = Const(0x9b05688cul);
+    s[6] = Const(0x1f83d9abul);
+    s[7] = Const(0x5be0cd19ul);
+}
+
+/** Perform one SHA-256 transformation on all lanes.  The message
+    schedule w is expanded in place. */
+inline SHA256_AVX2 void Transform(__m256i* s, __m256i* w)
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for (int i = 0; i < 64; i++) {
+        if (i >= 16)
+            w[i & 15] = Add(w[i & 15], sigma1(w[(i - 2) & 15]), w[(i - 7) & 15], sigma0(w[(i - 15) & 15]));
+        const __m256i t1 = Add(Add(h, Sigma1(e), Ch(e, f, g)), Const(K[i]), w[i & 15]);
+        const __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = Add(t1, t2);
+    }
+
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Load big-endian word i of each of the 8 64-byte inputs. */
+inline SHA256_AVX2 __m256i Read(const unsigned char* in, int i)
+{
+    return _mm256_set_epi32(ReadBE32(in + 448 + 4 * i), ReadBE32(in + 384 + 4 * i), ReadBE32(in + 320 + 4 * i), ReadBE32(in + 256 + 4 * i), ReadBE32(in + 192 + 4 * i), ReadBE32(in + 128 + 4 * i), ReadBE32(in + 64 + 4 * i), ReadBE32(in + 4 * i));
+}
+
+/** Store the 8 resulting states as 32-byte big-endian hashes. */
+inline SHA256_AVX2 void Write(unsigned char* out, const __m256i* s)
+{
+    alignas(32) uint32_t words[8][8];
+    for (int i = 0; i < 8; i++)
+        _mm256_store_si256((__m256i*)words[i], s[i]);
+    for (int l = 0; l < 8; l++)
+        for (int i = 0; i < 8; i++)
+            WriteBE32(out + 32 * l + 4 * i, words[i][l]);
+}
+
+} // namespace
+
+namespace sha256d64_avx2 {
+
+SHA256_AVX2 void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], w[16];
+    int i;
+
+    // The 64-byte input itself.
+    Initialize(s);
+    for (i = 0; i < 16; i++)
+        w[i] = Read(in, i);
+    Transform(s, w);
+
+    // The padding block of a 64-byte message.
+    w[0] = Const(0x80000000ul);
+    for (i = 1; i < 15; i++)
+        w[i] = Const(0);
+    w[15] = Const(0x200);
+    Transform(s, w);
+
+    // Hash the 32-byte result again.
+    for (i = 0; i < 8; i++)
+        w[i] = s[i];
+    w[8] = Const(0x80000000ul);
+    for (i = 9; i < 15; i++)
+        w[i] = Const(0);
+    w[15] = Const(0x100);
+    Initialize(s);
+    Transform(s, w);
+
+    Write(out, s);
+}
+
+} // namespace sha256d64_avx2
+
+#endif
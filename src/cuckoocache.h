@@ -0,0 +1,253 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CUCKOOCACHE_H
+#define BITCOIN_CUCKOOCACHE_H
+
+#include "crypto/common.h"
+#include "uint256.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Fixed-size set of uint256 keys for caches like the signature cache,
+ * which is queried by all script verification threads at once.
+ *
+ * Keys must be uniformly random (e.g. salted hashes).  Each key can live
+ * in two buckets chosen from its first 64 bits, and each bucket is one
+ * cache line holding two slots.  A slot stores the first 192 bits of the
+ * key; a false positive among them is as unlikely as a hash collision.
+ *
+ * No locks are used.  Every slot has a sequence number that is odd while
+ * a writer owns the slot; readers check that it did not change while they
+ * read the key, like a seqlock.  Writers claim a slot with a compare and
+ * swap, so concurrent inserts never block each other either.
+ *
+ * Eviction is based on generations: a global counter is advanced after
+ * every quarter of the capacity worth of inserts, and each slot records
+ * the generation it was written in.  Inserting prefers empty or erased
+ * slots, then slots from before the previous generation.  When all slots
+ * are more recent, the oldest is moved to its other bucket, cuckoo-style,
+ * for a few steps before the last displaced key is dropped.
+ *
+ * Lookups and inserts may spuriously fail while other threads write the
+ * same slots.  That is fine for a cache, which only has to make sure it
+ * never reports keys that were not inserted.
+ */
+class CCuckooCache
+{
+public:
+    /** Bytes used by each bucket, which is also its alignment.  */
+    static const size_t BUCKET_SIZE = 64;
+    /** Number of slots in a bucket.  */
+    static const unsigned int SLOTS_PER_BUCKET = 2;
+    /** How often a displaced key is moved on before it is dropped.  */
+    static const unsigned int MAX_KICKS = 8;
+
+private:
+    /** Number of 64-bit words in a slot: meta data and 192 key bits.  */
+    static const unsigned int SLOT_WORDS = 4;
+
+    /**
+     * A bucket.  Word 0 of a slot holds the generation (upper half, zero
+     * for an empty slot) and the sequence number (lower half).  Words 1
+     * to 3 hold the key.
+     */
+    struct Bucket
+    {
+        std::atomic<uint64_t> slots[SLOTS_PER_BUCKET][SLOT_WORDS];
+    };
+    static_assert(sizeof(Bucket) == BUCKET_SIZE, "buckets must fill a cache line");
+
+    std::unique_ptr<unsigned char[]> memory;
+    Bucket* buckets;
+    uint32_t nBuckets;
+
+    std::atomic<uint32_t> nGeneration;
+    std::atomic<uint32_t> nInsertsInGeneration;
+    uint32_t nInsertsPerGeneration;
+
+    static uint32_t GetGeneration(uint64_t meta) { return meta >> 32; }
+    static uint32_t GetSequence(uint64_t meta) { return meta & 0xffffffff; }
+    static uint64_t MakeMeta(uint32_t gen, uint32_t seq) { return ((uint64_t)gen << 32) | seq; }
+
+    static void GetKeyWords(const uint256& key, uint64_t words[3])
+    {
+        for (unsigned int i = 0; i < 3; ++i)
+            words[i] = ReadLE64(key.begin() + 8 * i);
+    }
+
+    /** Map 32 random bits onto a bucket without a division.  */
+    uint32_t GetBucket(uint32_t h) const { return ((uint64_t)h * nBuckets) >> 32; }
+
+    void GetSlots(const uint64_t words[3], std::atomic<uint64_t>* slots[2 * SLOTS_PER_BUCKET]) const
+    {
+        const uint32_t b[2] = {GetBucket(words[0] & 0xffffffff), GetBucket(words[0] >> 32)};
+        for (unsigned int i = 0; i < 2; ++i)
+            for (unsigned int j = 0; j < SLOTS_PER_BUCKET; ++j)
+                slots[i * SLOTS_PER_BUCKET + j] = buckets[b[i]].slots[j];
+    }
+
+    /** Read a slot consistently.  Fails if a writer holds or changed it.  */
+    static bool ReadSlot(const std::atomic<uint64_t>* slot, uint64_t& meta, uint64_t words[3])
+    {
+        meta = slot[0].load(std::memory_order_acquire);
+        if (GetSequence(meta) & 1)
+            return false;
+        for (unsigned int i = 0; i < 3; ++i)
+            words[i] = slot[i + 1].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot[0].load(std::memory_order_relaxed) == meta;
+    }
+
+    static bool SameKey(const uint64_t a[3], const uint64_t b[3])
+    {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+    }
+
+    /** Find the slot holding a key and its meta data at that time.  */
+    std::atomic<uint64_t>* Find(const uint64_t words[3], uint64_t& meta) const
+    {
+        std::atomic<uint64_t>* slots[2 * SLOTS_PER_BUCKET];
+        GetSlots(words, slots);
+        for (unsigned int i = 0; i < 2 * SLOTS_PER_BUCKET; ++i) {
+            uint64_t stored[3];
+            if (ReadSlot(slots[i], meta, stored) && GetGeneration(meta) != 0 && SameKey(words, stored))
+                return slots[i];
+        }
+        return nullptr;
+    }
+
+    /** Count an insert and start a new generation if enough were done.  */
+    uint32_t NextInsert()
+    {
+        uint32_t gen = nGeneration.load(std::memory_order_relaxed);
+        if (nInsertsInGeneration.fetch_add(1, std::memory_order_relaxed) + 1 >= nInsertsPerGeneration) {
+            nInsertsInGeneration.store(0, std::memory_order_relaxed);
+            uint32_t next = gen + 1;
+            if (next == 0)
+                next = 1;
+            if (nGeneration.compare_exchange_strong(gen, next, std::memory_order_relaxed))
+                gen = next;
+        }
+        return gen;
+    }
+
+public:
+    CCuckooCache() : buckets(nullptr), nBuckets(0), nGeneration(1), nInsertsInGeneration(0), nInsertsPerGeneration(1) {}
+
+    /**
+     * Allocate the table for a memory budget, dropping all entries.  This
+     * must not be called while other threads use the cache.  A budget
+     * smaller than one bucket disables the cache.
+     * @return The number of keys that fit into the table.
+     */
+    size_t setup_bytes(size_t nBytes)
+    {
+        buckets = nullptr;
+        memory.reset();
+        nBuckets = std::min<size_t>(nBytes / BUCKET_SIZE, std::numeric_limits<uint32_t>::max());
+        if (nBuckets > 0) {
+            memory.reset(new unsigned char[(size_t)nBuckets * BUCKET_SIZE + BUCKET_SIZE - 1]);
+            buckets = reinterpret_cast<Bucket*>(((uintptr_t)memory.get() + BUCKET_SIZE - 1) & ~(uintptr_t)(BUCKET_SIZE - 1));
+            for (uint32_t i = 0; i < nBuckets; ++i) {
+                new (&buckets[i]) Bucket;
+                for (unsigned int j = 0; j < SLOTS_PER_BUCKET; ++j)
+                    for (unsigned int k = 0; k < SLOT_WORDS; ++k)
+                        buckets[i].slots[j][k].store(0, std::memory_order_relaxed);
+            }
+        }
+        nGeneration.store(1);
+        nInsertsInGeneration.store(0);
+        nInsertsPerGeneration = std::max<size_t>(1, capacity() / 4);
+        return capacity();
+    }
+
+    size_t capacity() const { return (size_t)nBuckets * SLOTS_PER_BUCKET; }
+
+    /**
+     * Check for a key.
+     * @param erase Mark the key's slot as free if it is found.
+     */
+    bool contains(const uint256& key, bool erase)
+    {
+        if (nBuckets == 0)
+            return false;
+        uint64_t words[3];
+        GetKeyWords(key, words);
+        uint64_t meta;
+        std::atomic<uint64_t>* slot = Find(words, meta);
+        if (!slot)
+            return false;
+        // Bump the sequence so that readers that saw the key retry
+        if (erase)
+            slot[0].compare_exchange_strong(meta, MakeMeta(0, GetSequence(meta) + 2), std::memory_order_release, std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Add a key, evicting old entries if needed.  */
+    void insert(const uint256& key)
+    {
+        if (nBuckets == 0)
+            return;
+        uint64_t words[3];
+        GetKeyWords(key, words);
+        uint64_t meta;
+        if (Find(words, meta))
+            return;
+
+        uint32_t gen = NextInsert();
+        const std::atomic<uint64_t>* skip = nullptr;
+        for (unsigned int kick = 0; kick <= MAX_KICKS; ++kick) {
+            const uint32_t cur = nGeneration.load(std::memory_order_relaxed);
+            std::atomic<uint64_t>* slots[2 * SLOTS_PER_BUCKET];
+            GetSlots(words, slots);
+
+            // Pick an empty slot, else the one written longest ago
+            std::atomic<uint64_t>* victim = nullptr;
+            uint64_t victimMeta = 0;
+            uint32_t victimAge = 0;
+            for (unsigned int i = 0; i < 2 * SLOTS_PER_BUCKET; ++i) {
+                if (slots[i] == skip)
+                    continue;
+                const uint64_t m = slots[i][0].load(std::memory_order_relaxed);
+                if (GetSequence(m) & 1)
+                    continue;
+                const uint32_t age = GetGeneration(m) == 0 ? std::numeric_limits<uint32_t>::max() : cur - GetGeneration(m);
+                if (!victim || age > victimAge) {
+                    victim = slots[i];
+                    victimMeta = m;
+                    victimAge = age;
+                }
+            }
+            if (!victim || !victim[0].compare_exchange_strong(victimMeta, victimMeta + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            std::atomic_thread_fence(std::memory_order_release);
+
+            // Entries from the current and previous generation are kept
+            const bool fDisplace = GetGeneration(victimMeta) != 0 && victimAge < 2 && kick < MAX_KICKS;
+            uint64_t displaced[3];
+            for (unsigned int i = 0; i < 3; ++i) {
+                displaced[i] = victim[i + 1].load(std::memory_order_relaxed);
+                victim[i + 1].store(words[i], std::memory_order_relaxed);
+            }
+            victim[0].store(MakeMeta(gen, GetSequence(victimMeta) + 2), std::memory_order_release);
+
+            if (!fDisplace)
+                return;
+            for (unsigned int i = 0; i < 3; ++i)
+                words[i] = displaced[i];
+            gen = GetGeneration(victimMeta);
+            skip = victim;
+        }
+    }
+};
+
+#endif // BITCOIN_CUCKOOCACHE_H
@@ -6,6 +6,7 @@
 
 #include "util.h"
 #include "random.h"
+#include "utilstrencodings.h"
 
 #include <boost/filesystem.hpp>
 
@@ -15,14 +16,46 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+CDBOptions::CDBOptions(size_t nCacheSize)
+    : nBlockCacheSize(nCacheSize / 2),
+      nWriteBufferSize(nCacheSize / 4), // up to two write buffers may be held in memory simultaneously
+      nBloomBits(10),
+      nMaxOpenFiles(64)
+{
+}
+
+namespace {
+
+/** Find the value of a <name>:<value> argument for the given database.  */
+bool GetDBArg(const std::string& strArg, const std::string& strName, int64_t& nValue)
+{
+    if (!mapMultiArgs.count(strArg))
+        return false;
+    bool fFound = false;
+    for (const std::string& strValue : mapMultiArgs.at(strArg)) {
+        const size_t nSep = strValue.rfind(':');
+        if (nSep == std::string::npos || strValue.substr(0, nSep) != strName)
+            continue;
+        int64_t n;
+        if (!ParseInt64(strValue.substr(nSep + 1), &n) || n < 0) {
+            LogPrintf("Ignoring invalid %s=%s\n", strArg, strValue);
+            continue;
+        }
+        nValue = n;
+        fFound = true;
+    }
+    return fFound;
+}
+
+leveldb::Options GetOptions(const CDBOptions& dboptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = leveldb::NewLRUCache(dboptions.nBlockCacheSize);
+    options.write_buffer_size = dboptions.nWriteBufferSize;
+    if (dboptions.nBloomBits > 0)
+        options.filter_policy = leveldb::NewBloomFilterPolicy(dboptions.nBloomBits);
     options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    options.max_open_files = dboptions.nMaxOpenFiles;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -31,14 +64,37 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
+}
+
+CDBOptions GetDBOptions(const std::string& strName, const CDBOptions& defaults)
+{
+    CDBOptions options(defaults);
+    int64_t nValue;
+    if (GetDBArg("-dbbloombits", strName, nValue))
+        options.nBloomBits = std::min<int64_t>(nValue, 64);
+    if (GetDBArg("-dbblockcache", strName, nValue))
+        options.nBlockCacheSize = std::min<int64_t>(nValue, DBWRAPPER_MAX_CACHE_SIZE) << 20;
+    if (GetDBArg("-dbwritebuffer", strName, nValue))
+        options.nWriteBufferSize = std::min<int64_t>(std::max<int64_t>(nValue, 1), DBWRAPPER_MAX_CACHE_SIZE) << 20;
+    if (GetDBArg("-dbmaxopenfiles", strName, nValue))
+        options.nMaxOpenFiles = std::min<int64_t>(nValue, 50000);
+    return options;
+}
+
 CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+    : CDBWrapper(path, CDBOptions(nCacheSize), fMemory, fWipe, obfuscate)
+{
+}
+
+CDBWrapper::CDBWrapper(const boost::filesystem::path& path, const CDBOptions& optionsIn, bool fMemory, bool fWipe, bool obfuscate)
+    : dboptions(optionsIn), nReads(0), nHits(0)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(dboptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -50,7 +106,9 @@ CDBWrapper::CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, b
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectory(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (block cache %.1fMiB, write buffer %.1fMiB, bloom filter %d bits/key, %d open files)\n",
+                  path.string(), dboptions.nBlockCacheSize * (1.0 / 1024 / 1024), dboptions.nWriteBufferSize * (1.0 / 1024 / 1024),
+                  dboptions.nBloomBits, dboptions.nMaxOpenFiles);
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -88,6 +146,19 @@ CDBWrapper::~CDBWrapper()
     options.env = NULL;
 }
 
+CDBStats CDBWrapper::GetStats() const
+{
+    CDBStats stats(dboptions);
+    stats.nReads = nReads;
+    stats.nHits = nHits;
+    std::string strValue;
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nMemoryUsage = atoi64(strValue);
+    for (int nLevel = 0; pdb->GetProperty("leveldb.num-files-at-level" + std::to_string(nLevel), &strValue); ++nLevel)
+        stats.nFiles += atoi64(strValue);
+    return stats;
+}
+
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
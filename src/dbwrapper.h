@@ -12,6 +12,8 @@
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <atomic>
+
 #include <boost/filesystem/path.hpp>
 
 #include <leveldb/db.h>
@@ -19,6 +21,8 @@
 
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+//! Maximum block cache and write buffer size of a single database (MiB)
+static const int64_t DBWRAPPER_MAX_CACHE_SIZE = sizeof(void*) > 4 ? 16384 : 1024;
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -26,6 +30,45 @@ public:
     dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+/** LevelDB tuning for one database.  */
+struct CDBOptions
+{
+    //! Size of the LRU cache for uncompressed data blocks
+    size_t nBlockCacheSize;
+    //! Size of each write buffer (up to two may be held in memory)
+    size_t nWriteBufferSize;
+    //! Bits per key of the bloom filters, zero to disable them
+    int nBloomBits;
+    //! Number of table files that are kept open
+    int nMaxOpenFiles;
+
+    /** Split a total cache size between block cache and write buffers.  */
+    explicit CDBOptions(size_t nCacheSize);
+};
+
+/** Read statistics of a database, collected since it was opened.  */
+struct CDBStats
+{
+    CDBOptions options;
+    //! Number of point reads (including existence checks)
+    uint64_t nReads;
+    //! Number of point reads that found their key
+    uint64_t nHits;
+    //! LevelDB's estimate of its memory usage (memtables and block cache)
+    uint64_t nMemoryUsage;
+    //! Number of table files over all levels
+    uint64_t nFiles;
+
+    CDBStats(const CDBOptions& optionsIn) : options(optionsIn), nReads(0), nHits(0), nMemoryUsage(0), nFiles(0) {}
+};
+
+/**
+ * Get the options for the database <strName>, starting from the given
+ * defaults and applying the per-database -dbbloombits, -dbblockcache,
+ * -dbwritebuffer and -dbmaxopenfiles arguments (given as <name>:<value>).
+ */
+CDBOptions GetDBOptions(const std::string& strName, const CDBOptions& defaults);
+
 class CDBWrapper;
 
 /** These should be considered an implementation detail of the specific database.
@@ -53,11 +96,19 @@ private:
     const CDBWrapper &parent;
     leveldb::WriteBatch batch;
 
+    size_t size_estimate;
+
 public:
     /**
      * @param[in] _parent   CDBWrapper that this batch is to be submitted to
      */
-    CDBBatch(const CDBWrapper &_parent) : parent(_parent) { };
+    CDBBatch(const CDBWrapper &_parent) : parent(_parent), size_estimate(0) { };
+
+    void Clear()
+    {
+        batch.Clear();
+        size_estimate = 0;
+    }
 
     template <typename K, typename V>
     void Write(const K& key, const V& value)
@@ -74,6 +125,14 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        // LevelDB serializes writes as:
+        // - byte: header
+        // - varint: key length (1 byte up to 127B, 2 bytes up to 16383B, ...)
+        // - byte[]: key
+        // - varint: value length
+        // - byte[]: value
+        // The formula below assumes the key and value are both less than 16k.
+        size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
     }
 
     /* Write an empty value.  This is used for the expire-index
@@ -90,6 +149,7 @@ public:
         leveldb::Slice slValue(&dummy, 0);
 
         batch.Put(slKey, slValue);
+        size_estimate += 3 + (slKey.size() > 127) + slKey.size();
     }
 
     template <typename K>
@@ -101,7 +161,15 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        // LevelDB serializes erases as:
+        // - byte: header
+        // - varint: key length
+        // - byte[]: key
+        // The formula below assumes the key is less than 16kB.
+        size_estimate += 2 + (slKey.size() > 127) + slKey.size();
     }
+
+    size_t SizeEstimate() const { return size_estimate; }
 };
 
 class CDBIterator
@@ -192,6 +260,13 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! tuning the database was opened with
+    CDBOptions dboptions;
+
+    //! read statistics
+    mutable std::atomic<uint64_t> nReads;
+    mutable std::atomic<uint64_t> nHits;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -213,8 +288,15 @@ public:
      *                        with a zero'd byte array.
      */
     CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    /**
+     * @param[in] optionsIn   Block cache, write buffer and filter settings.
+     * The other parameters are the same as above.
+     */
+    CDBWrapper(const boost::filesystem::path& path, const CDBOptions& optionsIn, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
     ~CDBWrapper();
 
+    CDBStats GetStats() const;
+
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
@@ -224,6 +306,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
+        ++nReads;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
@@ -231,6 +314,7 @@ public:
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        ++nHits;
         try {
             CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(obfuscate_key);
@@ -241,6 +325,37 @@ public:
         return true;
     }
 
+    /**
+     * Read the value for a key without deserialising it.  The
+     * (de-obfuscated) serialised bytes are appended to ssValue.  This
+     * can be used to pass data on in its serialised form without
+     * a round-trip through the in-memory representation.
+     */
+    template <typename K>
+    bool ReadRaw(const K& key, CDataStream& ssValue) const
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey << key;
+        leveldb::Slice slKey(&ssKey[0], ssKey.size());
+
+        std::string strValue;
+        ++nReads;
+        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        if (!status.ok()) {
+            if (status.IsNotFound())
+                return false;
+            LogPrintf("LevelDB read failure: %s\n", status.ToString());
+            dbwrapper_private::HandleError(status);
+        }
+        ++nHits;
+        CDataStream ssRaw(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        ssRaw.Xor(obfuscate_key);
+        if (!ssRaw.empty())
+            ssValue.write(&ssRaw[0], ssRaw.size());
+        return true;
+    }
+
     template <typename K, typename V>
     bool Write(const K& key, const V& value, bool fSync = false)
     {
@@ -258,6 +373,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
+        ++nReads;
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
@@ -265,6 +381,7 @@ public:
             LogPrintf("LevelDB read failure: %s\n", status.ToString());
             dbwrapper_private::HandleError(status);
         }
+        ++nHits;
         return true;
     }
 
@@ -299,6 +416,20 @@ public:
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    /** Compact the on-disk data of the keys in [key_begin, key_end].  */
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(&ssKey1[0], ssKey1.size());
+        leveldb::Slice slKey2(&ssKey2[0], ssKey2.size());
+        pdb->CompactRange(&slKey1, &slKey2);
+    }
 };
 
 #endif // BITCOIN_DBWRAPPER_H
@@ -33,8 +33,9 @@
    is also in the database.  */
 static const char DB_GAMESTATE = 'g';
 
-/* Define some configuration parameters.  */
-/* TODO: Make them CLI options.  */
+/* Define some configuration parameters.  The LevelDB settings can be
+   changed with the -db* options for "gamestates".  */
+/* TODO: Make the others CLI options.  */
 static const unsigned KEEP_EVERY_NTH = 2000;
 static const unsigned MIN_IN_MEMORY = 10;
 static const unsigned MAX_IN_MEMORY = 100;
@@ -43,8 +44,10 @@ static const unsigned DB_CACHE_SIZE = (25 << 20);
 CGameDB::CGameDB (bool fMemory, bool fWipe)
   : keepEveryNth(KEEP_EVERY_NTH),
     minInMemory(MIN_IN_MEMORY), maxInMemory(MAX_IN_MEMORY),
-    keepEverything(false),
-    db(GetDataDir() / "gamestates", DB_CACHE_SIZE, fMemory, fWipe, true),
+    keepEverything(false), pinned(), lastStored(),
+    db(GetDataDir() / "gamestates",
+       GetDBOptions ("gamestates", CDBOptions (DB_CACHE_SIZE)),
+       fMemory, fWipe, true),
     cache(), cs_cache()
 {
   // Nothing else to do.
@@ -138,6 +141,31 @@ CGameDB::get (const uint256& hash, GameState& state)
   return true;
 }
 
+bool
+CGameDB::getSerialized (const uint256& hash, CDataStream& ss)
+{
+  {
+    LOCK (cs_cache);
+    const GameStateMap::const_iterator mi = cache.find (hash);
+    if (mi != cache.end ())
+      {
+        assert (hash == mi->second->hashBlock);
+        ss << *mi->second;
+        return true;
+      }
+  }
+
+  if (db.ReadRaw (std::make_pair (DB_GAMESTATE, hash), ss))
+    return true;
+
+  GameState state(Params ().GetConsensus ());
+  if (!get (hash, state))
+    return false;
+
+  ss << state;
+  return true;
+}
+
 void
 CGameDB::store (const uint256& hash, const GameState& state)
 {
@@ -157,6 +185,12 @@ CGameDB::store (const uint256& hash, const GameState& state)
       *s = state;
       cache.insert (std::make_pair (hash, s.release ()));
     }
+  lastStored = hash;
+
+  /* A pinned state can not be recomputed, so make sure it is on disk
+     even if we crash before the next flush.  */
+  if (hash == pinned && !db.Write (std::make_pair (DB_GAMESTATE, hash), state, true))
+    error ("failed to write pinned game state");
 
   attemptFlush ();
 }
@@ -179,6 +213,8 @@ CGameDB::flush (bool saveAll)
     for (; pindex && pindex->nHeight > minHeight; pindex = pindex->pprev)
       keepInMemory.insert (*pindex->phashBlock);
   }
+  if (!lastStored.IsNull ())
+    keepInMemory.insert (lastStored);
 
   /* Go through everything and delete or store to disk.  */
   std::set<uint256> toErase;
@@ -191,7 +227,7 @@ CGameDB::flush (bool saveAll)
         continue;
 
       LOCK (cs_main);
-      bool write = keepThis;
+      bool write = keepThis || mi->first == pinned;
 
       /* It can happen that cache contains blocks that are not in mapBlockIndex.
          This is the case if they were added to the cache through ConnectBlock
@@ -249,7 +285,7 @@ CGameDB::flush (bool saveAll)
       /* Check first if this is in our keep-in-memory list.  If it is
          and we want to "save all", keep it.  */
       const bool keepThis = (keepInMemory.count (key.second) > 0);
-      if (saveAll && keepThis)
+      if ((saveAll && keepThis) || key.second == pinned)
         continue;
 
       /* Otherwise, check for block height condition and delete if
@@ -77,6 +77,18 @@ public:
      */
     bool get (const uint256& hash, GameState& state);
 
+    /**
+     * Query for a game state and return it in serialised form.  If the
+     * state is in the memory cache, it is serialised from there directly.
+     * States stored on disk are passed on as their raw database value,
+     * and only states that need recomputation go through get().
+     * This is meant for serving the state to external clients.
+     * @param hash The block hash to look up.
+     * @param ss Append the serialised game state here.
+     * @return True iff successful.
+     */
+    bool getSerialized (const uint256& hash, CDataStream& ss);
+
     /**
      * Store a game state.  This is in principle not necessary, since get()
      * itself also stores the game state after computing it.  We use it,
@@ -85,6 +97,24 @@ public:
      */
     void store (const uint256& hash, const GameState& state);
 
+    /**
+     * Pin the game state of a block, so that it is never discarded when
+     * flushing.  This is needed for the base block of a loaded UTXO
+     * snapshot, since the state can not be recomputed without the blocks
+     * before it.  Pass a null hash to unpin it again.
+     */
+    void setPinned (const uint256& hash)
+    {
+      LOCK (cs_cache);
+      pinned = hash;
+    }
+
+    /** Return the read statistics of the backing LevelDB.  */
+    CDBStats getDBStats () const
+    {
+      return db.GetStats ();
+    }
+
 private:
 
     /** Keep every Nth game state permanently on disk.  */
@@ -100,6 +130,16 @@ private:
     /** Temporarily disable flushing at all and keep everything.  */
     bool keepEverything;
 
+    /** State that is always written to disk and never purged.  */
+    uint256 pinned;
+    /**
+     * The most recently stored state.  It is kept in memory even if it is
+     * not on the main chain, so that connecting blocks elsewhere (like
+     * when validating the history of a UTXO snapshot) does not recompute
+     * the state before each of them.
+     */
+    uint256 lastStored;
+
     /** The backing LevelDB.  */
     CDBWrapper db;
 
@@ -330,6 +330,31 @@ Move::IsValidPlayerName (const std::string& player)
 /* ************************************************************************** */
 /* StepData.  */
 
+/* If one of the inputs of tx has address equal to addressLock, then
+   that input has been signed by the address owner and thus authorises
+   an address change operation.  */
+static bool
+HasAddressLockInput (const CTransaction& tx, const CCoinsView& view,
+                     const std::string& addressLock)
+{
+  BOOST_FOREACH (const CTxIn& txi, tx.vin)
+    {
+      Coin coin;
+      if (!view.GetCoin (txi.prevout, coin) || coin.IsSpent ())
+        continue;
+
+      const CTxOut& prevTxo = coin.out;
+      CTxDestination dest;
+      CBitcoinAddress addrParsed;
+      if (ExtractDestination (prevTxo.scriptPubKey, dest)
+            && addrParsed.Set (dest)
+            && addrParsed.ToString () == addressLock)
+        return true;
+    }
+
+  return false;
+}
+
 StepData::StepData (const GameState& s)
   : state(s), dup(), nTreasureAmount(-1), newHash(), vMoves()
 {
@@ -384,36 +409,10 @@ StepData::addTransaction (const CTransaction& tx, const CCoinsView* pview,
         return res.Invalid (error ("%s: firstupdate is not spawn"));
 
       const std::string addressLock = m.AddressOperationPermission (state);
-      if (pview && !addressLock.empty ())
-        {
-          /* If one of inputs has address equal to addressLock, then that input
-             has been signed by the address owner and thus authorizes the
-             address change operation.  */
-          bool found = false;
-          BOOST_FOREACH (const CTxIn& txi, tx.vin)
-            {
-              const COutPoint prevout = txi.prevout;
-              CCoins coins;
-
-              if (!pview->GetCoins (prevout.hash, coins)
-                    || !coins.IsAvailable (prevout.n))
-                continue;
-
-              const CTxOut& prevTxo = coins.vout[prevout.n];
-              CTxDestination dest;
-              CBitcoinAddress addrParsed;
-              if (ExtractDestination (prevTxo.scriptPubKey, dest)
-                    && addrParsed.Set (dest)
-                    && addrParsed.ToString () == addressLock)
-                {
-                  found = true;
-                  break;
-                }
-            }
-          if (!found)
-            return res.Invalid (error ("%s: address operation denied",
-                                       __func__));
-        }
+      if (pview && !addressLock.empty ()
+            && !HasAddressLockInput (tx, *pview, addressLock))
+        return res.Invalid (error ("%s: address operation denied",
+                                   __func__));
 
       newMoves.push_back (m);
     }
@@ -441,3 +440,37 @@ PerformStep (const CBlock& block, const GameState& stateIn,
 
   return true;
 }
+
+bool
+CheckMovePermissions (const CBlock& block, const GameState& stateIn,
+                      const CCoinsView& view, CValidationState& valid)
+{
+  for (const auto& tx : block.vtx)
+    {
+      if (!tx->IsNamecoin ())
+        continue;
+
+      BOOST_FOREACH (const CTxOut& txo, tx->vout)
+        {
+          const CNameScript nameOp(txo.scriptPubKey);
+          if (!nameOp.isNameOp () || !nameOp.isAnyUpdate ())
+            continue;
+
+          const std::string strName = ValtypeToString (nameOp.getOpName ());
+          const std::string strValue = ValtypeToString (nameOp.getOpValue ());
+
+          Move m;
+          if (!m.Parse (strName, strValue))
+            return valid.Invalid (error ("%s: cannot parse move %s",
+                                         __func__, strValue.c_str ()));
+
+          const std::string addressLock = m.AddressOperationPermission (stateIn);
+          if (!addressLock.empty ()
+                && !HasAddressLockInput (*tx, view, addressLock))
+            return valid.Invalid (error ("%s: address operation denied",
+                                         __func__));
+        }
+    }
+
+  return true;
+}
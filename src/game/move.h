@@ -106,4 +106,12 @@ bool PerformStep (const CBlock& block, const GameState& stateIn,
                   const CCoinsView* pview, CValidationState& valid,
                   StepResult& res, GameState& stateOut);
 
+/* Perform only the checks of PerformStep that depend on the UTXO set,
+   namely the address-lock permissions of moves.  Together with PerformStep
+   called without a view, this is equivalent to PerformStep with the view.
+   It allows to run the (expensive) game step before the view is ready,
+   concurrently with connecting the block's transactions.  */
+bool CheckMovePermissions (const CBlock& block, const GameState& stateIn,
+                           const CCoinsView& view, CValidationState& valid);
+
 #endif
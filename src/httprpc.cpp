@@ -15,6 +15,7 @@
 #include "utilstrencodings.h"
 #include "ui_interface.h"
 #include "crypto/hmac_sha256.h"
+#include <algorithm>
 #include <stdio.h>
 #include "utilstrencodings.h"
 
@@ -65,6 +66,8 @@ private:
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static HTTPRPCTimerInterface* httpRPCTimerInterface = 0;
+/* Number of other worker threads that read-only calls of a batch are spread over */
+static unsigned int nBatchHelpers = 0;
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -147,6 +150,59 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+/** Work queue for a JSON-RPC request.  A batch goes where its slowest call
+ * would go:  to the long-poll queue if it waits, else to the queue for
+ * expensive calls if it has one.
+ */
+static RPCQueue GetRequestQueue(const UniValue& valRequest)
+{
+    if (valRequest.isArray()) {
+        RPCQueue queue = RPC_QUEUE_CHEAP;
+        for (unsigned int i = 0; i < valRequest.size(); i++)
+            queue = std::max(queue, GetRequestQueue(valRequest[i]));
+        return queue;
+    }
+    if (!valRequest.isObject())
+        return RPC_QUEUE_CHEAP;
+    const UniValue& method = find_value(valRequest, "method");
+    if (!method.isStr())
+        return RPC_QUEUE_CHEAP;
+    const CRPCCommand* pcmd = tableRPC[method.get_str()];
+    return pcmd ? pcmd->queue : RPC_QUEUE_CHEAP;
+}
+
+/** Execute a parsed JSON-RPC request or batch and send the reply */
+static bool JSONRPCExecRequest(HTTPRequest* req, JSONRPCRequest& jreq, const UniValue& valRequest)
+{
+    try {
+        std::string strReply;
+        // singleton request
+        if (valRequest.isObject()) {
+            jreq.parse(valRequest);
+
+            UniValue result = tableRPC.execute(jreq);
+
+            // Send reply
+            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+
+        // array of requests
+        } else if (valRequest.isArray())
+            strReply = JSONRPCExecBatch(valRequest.get_array(), EnqueueHTTPWorkIfIdle, nBatchHelpers);
+        else
+            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strReply);
+    } catch (const UniValue& objError) {
+        JSONErrorReply(req, objError, jreq.id);
+        return false;
+    } catch (const std::exception& e) {
+        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
+        return false;
+    }
+    return true;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -176,41 +232,33 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         return false;
     }
 
-    try {
-        // Parse request
-        UniValue valRequest;
-        if (!valRequest.read(req->ReadBody()))
-            throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
-
-        // Set the URI
-        jreq.URI = req->GetURI();
-
-        std::string strReply;
-        // singleton request
-        if (valRequest.isObject()) {
-            jreq.parse(valRequest);
-
-            UniValue result = tableRPC.execute(jreq);
-
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+    // Parse request
+    UniValue valRequest;
+    if (!valRequest.read(req->ReadBody())) {
+        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, "Parse error"), jreq.id);
+        return false;
+    }
 
-        // array of requests
-        } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
-        else
-            throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
+    // Set the URI
+    jreq.URI = req->GetURI();
 
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
-    } catch (const UniValue& objError) {
-        JSONErrorReply(req, objError, jreq.id);
-        return false;
-    } catch (const std::exception& e) {
-        JSONErrorReply(req, JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
-        return false;
+    // Expensive calls and long-polls continue on their own work queues
+    switch (GetRequestQueue(valRequest)) {
+    case RPC_QUEUE_HEAVY:
+        EnqueueHeavyHTTPRequest(req, [jreq, valRequest](HTTPRequest* heavyReq) mutable {
+            JSONRPCExecRequest(heavyReq, jreq, valRequest);
+        });
+        return true;
+    case RPC_QUEUE_LONGPOLL:
+        EnqueueLongPollHTTPRequest(req, [jreq, valRequest](HTTPRequest* longPollReq) mutable {
+            JSONRPCExecRequest(longPollReq, jreq, valRequest);
+        });
+        return true;
+    case RPC_QUEUE_CHEAP:
+        break;
     }
-    return true;
+
+    return JSONRPCExecRequest(req, jreq, valRequest);
 }
 
 static bool InitRPCAuthentication()
@@ -237,6 +285,7 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
+    nBatchHelpers = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L) - 1;
     RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
 
     assert(EventBase());
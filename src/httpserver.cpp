@@ -25,6 +25,7 @@
 #include <event2/http.h>
 #include <event2/thread.h>
 #include <event2/buffer.h>
+#include <event2/bufferevent.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
 
@@ -58,6 +59,23 @@ private:
     HTTPRequestHandler func;
 };
 
+/** Work item that runs a function without a request */
+class HTTPFunctionItem : public HTTPClosure
+{
+public:
+    HTTPFunctionItem(const std::function<void()>& _func):
+        func(_func)
+    {
+    }
+    void operator()()
+    {
+        func();
+    }
+
+private:
+    std::function<void()> func;
+};
+
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
  */
@@ -72,6 +90,8 @@ private:
     bool running;
     size_t maxDepth;
     int numThreads;
+    /** Number of worker threads waiting for work */
+    int numIdle;
 
     /** RAII object to keep track of number of running worker threads */
     class ThreadCounter
@@ -94,7 +114,8 @@ private:
 public:
     WorkQueue(size_t _maxDepth) : running(true),
                                  maxDepth(_maxDepth),
-                                 numThreads(0)
+                                 numThreads(0),
+                                 numIdle(0)
     {
     }
     /** Precondition: worker threads have all stopped
@@ -114,6 +135,19 @@ public:
         cond.notify_one();
         return true;
     }
+    /** Enqueue a work item only if an idle worker will pick it up right
+     * away, so that it never takes queue slots from client requests.
+     */
+    bool EnqueueIfIdle(WorkItem* item)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        if (queue.size() >= (size_t)numIdle) {
+            return false;
+        }
+        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        cond.notify_one();
+        return true;
+    }
     /** Thread function */
     void Run()
     {
@@ -122,8 +156,11 @@ public:
             std::unique_ptr<WorkItem> i;
             {
                 std::unique_lock<std::mutex> lock(cs);
-                while (running && queue.empty())
+                while (running && queue.empty()) {
+                    numIdle += 1;
                     cond.wait(lock);
+                    numIdle -= 1;
+                }
                 if (!running)
                     break;
                 i = std::move(queue.front());
@@ -169,18 +206,24 @@ struct HTTPPathHandler
 
 /** HTTP module state */
 
-//! libevent event loop
-static struct event_base* eventBase = 0;
-//! HTTP server
-struct evhttp* eventHTTP = 0;
+//! libevent event loops, one for each event thread
+static std::vector<struct event_base*> eventBases;
+//! HTTP servers, one for each event loop
+static std::vector<struct evhttp*> eventHTTPs;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
 static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queue for expensive requests, so that they do not delay cheap ones
+static WorkQueue<HTTPClosure>* workQueueHeavy = 0;
+//! Work queue for long-polls, which may wait for a long time without work
+static WorkQueue<HTTPClosure>* workQueueLongPoll = 0;
+//! Timeout for HTTP connections in seconds
+static int httpServerTimeout = DEFAULT_HTTP_SERVER_TIMEOUT;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
-//! Bound listening sockets
-std::vector<evhttp_bound_socket *> boundSockets;
+//! Bound listening sockets, with the HTTP server they belong to
+std::vector<std::pair<struct evhttp*, evhttp_bound_socket*> > boundSockets;
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -315,8 +358,48 @@ static bool ThreadHTTP(struct event_base* base, struct evhttp* http)
     return event_base_got_break(base) == 0;
 }
 
-/** Bind HTTP server to specified addresses */
-static bool HTTPBindAddresses(struct evhttp* http)
+/**
+ * Create a listening socket for an RPC endpoint.  With several event
+ * threads, each of them binds its own socket to the endpoint with
+ * SO_REUSEPORT, and the kernel distributes new connections between them.
+ */
+static evutil_socket_t HTTPListenSocket(const std::string& host, uint16_t port, bool fReusePort)
+{
+    struct evutil_addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = EVUTIL_AI_PASSIVE | EVUTIL_AI_ADDRCONFIG;
+    struct evutil_addrinfo* ai = NULL;
+    if (evutil_getaddrinfo(host.empty() ? NULL : host.c_str(), strprintf("%u", port).c_str(), &hints, &ai) != 0 || !ai) {
+        LogPrintf("Binding RPC on address %s port %i failed: could not resolve the address\n", host, port);
+        return -1;
+    }
+
+    evutil_socket_t fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    bool fOk = (fd >= 0 &&
+                evutil_make_socket_nonblocking(fd) == 0 &&
+                evutil_make_socket_closeonexec(fd) == 0 &&
+                evutil_make_listen_socket_reuseable(fd) == 0);
+#ifdef SO_REUSEPORT
+    if (fOk && fReusePort) {
+        int one = 1;
+        fOk = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == 0;
+    }
+#endif
+    fOk = fOk && bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SOMAXCONN) == 0;
+    if (!fOk) {
+        LogPrintf("Binding RPC on address %s port %i failed: %s\n", host, port, NetworkErrorString(WSAGetLastError()));
+        if (fd >= 0)
+            evutil_closesocket(fd);
+        fd = -1;
+    }
+    evutil_freeaddrinfo(ai);
+    return fd;
+}
+
+/** Bind the HTTP servers to specified addresses */
+static bool HTTPBindAddresses()
 {
     int defaultPort = GetArg("-rpcport", BaseParams().RPCPort());
     std::vector<std::pair<std::string, uint16_t> > endpoints;
@@ -342,22 +425,38 @@ static bool HTTPBindAddresses(struct evhttp* http)
     }
 
     // Bind addresses
+    const bool fReusePort = eventHTTPs.size() > 1;
     for (std::vector<std::pair<std::string, uint16_t> >::iterator i = endpoints.begin(); i != endpoints.end(); ++i) {
         LogPrint("http", "Binding RPC on address %s port %i\n", i->first, i->second);
-        evhttp_bound_socket *bind_handle = evhttp_bind_socket_with_handle(http, i->first.empty() ? NULL : i->first.c_str(), i->second);
-        if (bind_handle) {
-            boundSockets.push_back(bind_handle);
-        } else {
-            LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+        if (fReusePort) {
+            // SO_REUSEPORT would let us share the port with another process
+            // of the same user (e.g. a second node on the same -rpcport).
+            // Make sure that nobody listens on it yet.
+            evutil_socket_t fdProbe = HTTPListenSocket(i->first, i->second, false);
+            if (fdProbe < 0)
+                continue;
+            evutil_closesocket(fdProbe);
+        }
+        for (struct evhttp* http : eventHTTPs) {
+            evutil_socket_t fd = HTTPListenSocket(i->first, i->second, fReusePort);
+            if (fd < 0)
+                break;
+            evhttp_bound_socket *bind_handle = evhttp_accept_socket_with_handle(http, fd);
+            if (!bind_handle) {
+                LogPrintf("Binding RPC on address %s port %i failed.\n", i->first, i->second);
+                evutil_closesocket(fd);
+                break;
+            }
+            boundSockets.push_back(std::make_pair(http, bind_handle));
         }
     }
     return !boundSockets.empty();
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
+static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue, const char* name)
 {
-    RenameThread("bitcoin-httpworker");
+    RenameThread(name);
     queue->Run();
 }
 
@@ -374,11 +473,19 @@ static void libevent_log_cb(int severity, const char *msg)
         LogPrint("libevent", "libevent: %s\n", msg);
 }
 
-bool InitHTTPServer()
+/** Free the HTTP servers and their event loops */
+static void FreeHTTPEventBases()
 {
-    struct evhttp* http = 0;
-    struct event_base* base = 0;
+    for (struct evhttp* http : eventHTTPs)
+        evhttp_free(http);
+    eventHTTPs.clear();
+    for (struct event_base* base : eventBases)
+        event_base_free(base);
+    eventBases.clear();
+}
 
+bool InitHTTPServer()
+{
     if (!InitHTTPAllowList())
         return false;
 
@@ -405,56 +512,81 @@ bool InitHTTPServer()
     evthread_use_pthreads();
 #endif
 
-    base = event_base_new(); // XXX RAII
-    if (!base) {
-        LogPrintf("Couldn't create an event_base: exiting\n");
-        return false;
+    httpServerTimeout = GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    int eventThreads = std::max((long)GetArg("-rpceventthreads", DEFAULT_HTTP_EVENT_THREADS), 1L);
+#ifndef SO_REUSEPORT
+    if (eventThreads > 1) {
+        LogPrintf("HTTP: SO_REUSEPORT is not supported, using a single event thread\n");
+        eventThreads = 1;
     }
+#endif
+    for (int i = 0; i < eventThreads; i++) {
+        struct event_base* base = event_base_new(); // XXX RAII
+        if (!base) {
+            LogPrintf("Couldn't create an event_base: exiting\n");
+            FreeHTTPEventBases();
+            return false;
+        }
+        eventBases.push_back(base);
 
-    /* Create a new evhttp object to handle requests. */
-    http = evhttp_new(base); // XXX RAII
-    if (!http) {
-        LogPrintf("couldn't create evhttp. Exiting.\n");
-        event_base_free(base);
-        return false;
-    }
+        /* Create a new evhttp object to handle requests. */
+        struct evhttp* http = evhttp_new(base); // XXX RAII
+        if (!http) {
+            LogPrintf("couldn't create evhttp. Exiting.\n");
+            FreeHTTPEventBases();
+            return false;
+        }
+        eventHTTPs.push_back(http);
 
-    evhttp_set_timeout(http, GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
-    evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
-    evhttp_set_max_body_size(http, MAX_SIZE);
-    evhttp_set_gencb(http, http_request_cb, NULL);
+        evhttp_set_timeout(http, httpServerTimeout);
+        evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
+        evhttp_set_max_body_size(http, MAX_SIZE);
+        evhttp_set_gencb(http, http_request_cb, NULL);
+    }
 
-    if (!HTTPBindAddresses(http)) {
+    if (!HTTPBindAddresses()) {
         LogPrintf("Unable to bind any endpoint for RPC server\n");
-        evhttp_free(http);
-        event_base_free(base);
+        FreeHTTPEventBases();
         return false;
     }
 
     LogPrint("http", "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    LogPrintf("HTTP: creating work queues of depth %d\n", workQueueDepth);
 
     workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
-    eventBase = base;
-    eventHTTP = http;
+    workQueueHeavy = new WorkQueue<HTTPClosure>(workQueueDepth);
+    workQueueLongPoll = new WorkQueue<HTTPClosure>(workQueueDepth);
     return true;
 }
 
-std::thread threadHTTP;
-std::future<bool> threadResult;
+std::vector<std::thread> threadHTTP;
+std::vector<std::future<bool> > threadResult;
 
 bool StartHTTPServer()
 {
     LogPrint("http", "Starting HTTP server\n");
     int rpcThreads = std::max((long)GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
-    std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
-    threadResult = task.get_future();
-    threadHTTP = std::thread(std::move(task), eventBase, eventHTTP);
+    int rpcHeavyThreads = std::max((long)GetArg("-rpcheavythreads", DEFAULT_HTTP_HEAVY_THREADS), 1L);
+    int rpcLongPollThreads = std::max((long)GetArg("-rpclongpollthreads", DEFAULT_HTTP_LONGPOLL_THREADS), 1L);
+    LogPrintf("HTTP: starting %d event threads, %d worker threads, %d threads for expensive requests and %d for long-polls\n",
+              eventBases.size(), rpcThreads, rpcHeavyThreads, rpcLongPollThreads);
+    for (size_t i = 0; i < eventBases.size(); i++) {
+        std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
+        threadResult.push_back(task.get_future());
+        threadHTTP.push_back(std::thread(std::move(task), eventBases[i], eventHTTPs[i]));
+    }
 
     for (int i = 0; i < rpcThreads; i++) {
-        std::thread rpc_worker(HTTPWorkQueueRun, workQueue);
+        std::thread rpc_worker(HTTPWorkQueueRun, workQueue, "bitcoin-httpworker");
+        rpc_worker.detach();
+    }
+    for (int i = 0; i < rpcHeavyThreads; i++) {
+        std::thread rpc_worker(HTTPWorkQueueRun, workQueueHeavy, "bitcoin-httpheavy");
+        rpc_worker.detach();
+    }
+    for (int i = 0; i < rpcLongPollThreads; i++) {
+        std::thread rpc_worker(HTTPWorkQueueRun, workQueueLongPoll, "bitcoin-httppoll");
         rpc_worker.detach();
     }
     return true;
@@ -463,16 +595,21 @@ bool StartHTTPServer()
 void InterruptHTTPServer()
 {
     LogPrint("http", "Interrupting HTTP server\n");
-    if (eventHTTP) {
-        // Unlisten sockets
-        for (evhttp_bound_socket *socket : boundSockets) {
-            evhttp_del_accept_socket(eventHTTP, socket);
-        }
-        // Reject requests on current connections
-        evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
+    // Unlisten sockets
+    for (const std::pair<struct evhttp*, evhttp_bound_socket*>& socket : boundSockets) {
+        evhttp_del_accept_socket(socket.first, socket.second);
+    }
+    boundSockets.clear();
+    // Reject requests on current connections
+    for (struct evhttp* http : eventHTTPs) {
+        evhttp_set_gencb(http, http_reject_request_cb, NULL);
     }
     if (workQueue)
         workQueue->Interrupt();
+    if (workQueueHeavy)
+        workQueueHeavy->Interrupt();
+    if (workQueueLongPoll)
+        workQueueLongPoll->Interrupt();
 }
 
 void StopHTTPServer()
@@ -482,35 +619,43 @@ void StopHTTPServer()
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
         workQueue->WaitExit();
         delete workQueue;
-    }
-    if (eventBase) {
-        LogPrint("http", "Waiting for HTTP event thread to exit\n");
-        // Give event loop a few seconds to exit (to send back last RPC responses), then break it
-        // Before this was solved with event_base_loopexit, but that didn't work as expected in
-        // at least libevent 2.0.21 and always introduced a delay. In libevent
-        // master that appears to be solved, so in the future that solution
-        // could be used again (if desirable).
-        // (see discussion in https://github.com/bitcoin/bitcoin/pull/6990)
-        if (threadResult.valid() && threadResult.wait_for(std::chrono::milliseconds(2000)) == std::future_status::timeout) {
-            LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
-            event_base_loopbreak(eventBase);
+        workQueue = 0;
+    }
+    if (workQueueHeavy) {
+        workQueueHeavy->WaitExit();
+        delete workQueueHeavy;
+        workQueueHeavy = 0;
+    }
+    if (workQueueLongPoll) {
+        workQueueLongPoll->WaitExit();
+        delete workQueueLongPoll;
+        workQueueLongPoll = 0;
+    }
+    if (!threadHTTP.empty()) {
+        LogPrint("http", "Waiting for HTTP event threads to exit\n");
+        for (size_t i = 0; i < threadHTTP.size(); i++) {
+            // Give event loop a few seconds to exit (to send back last RPC responses), then break it
+            // Before this was solved with event_base_loopexit, but that didn't work as expected in
+            // at least libevent 2.0.21 and always introduced a delay. In libevent
+            // master that appears to be solved, so in the future that solution
+            // could be used again (if desirable).
+            // (see discussion in https://github.com/bitcoin/bitcoin/pull/6990)
+            if (threadResult[i].valid() && threadResult[i].wait_for(std::chrono::milliseconds(2000)) == std::future_status::timeout) {
+                LogPrintf("HTTP event loop did not exit within allotted time, sending loopbreak\n");
+                event_base_loopbreak(eventBases[i]);
+            }
+            threadHTTP[i].join();
         }
-        threadHTTP.join();
-    }
-    if (eventHTTP) {
-        evhttp_free(eventHTTP);
-        eventHTTP = 0;
-    }
-    if (eventBase) {
-        event_base_free(eventBase);
-        eventBase = 0;
+        threadHTTP.clear();
+        threadResult.clear();
     }
+    FreeHTTPEventBases();
     LogPrint("http", "Stopped HTTP server\n");
 }
 
 struct event_base* EventBase()
 {
-    return eventBase;
+    return eventBases.empty() ? 0 : eventBases[0];
 }
 
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
@@ -542,6 +687,8 @@ void HTTPEvent::trigger(struct timeval* tv)
 HTTPRequest::HTTPRequest(struct evhttp_request* _req) : req(_req),
                                                        replySent(false)
 {
+    // Replies are sent from the event loop the request came in on
+    base = evhttp_connection_get_base(evhttp_request_get_connection(req));
 }
 HTTPRequest::~HTTPRequest()
 {
@@ -603,13 +750,22 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     struct evbuffer* evb = evhttp_request_get_output_buffer(req);
     assert(evb);
     evbuffer_add(evb, strReply.data(), strReply.size());
-    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+    HTTPEvent* ev = new HTTPEvent(base, true,
         std::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
     ev->trigger(0);
     replySent = true;
     req = 0; // transferred back to main thread
 }
 
+std::unique_ptr<HTTPRequest> HTTPRequest::Detach()
+{
+    assert(!replySent && req);
+    std::unique_ptr<HTTPRequest> detached(new HTTPRequest(req));
+    replySent = true;
+    req = 0;
+    return detached;
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -650,6 +806,150 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
+/** Hand a request over to another work queue, see EnqueueHeavyHTTPRequest */
+static void EnqueueDetachedHTTPRequest(WorkQueue<HTTPClosure>* queue, const char* what,
+                                       HTTPRequest* req, const std::function<void(HTTPRequest*)>& func)
+{
+    HTTPRequestHandler handler = [func](HTTPRequest* detachedReq, const std::string&) {
+        func(detachedReq);
+        return true;
+    };
+    std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(req->Detach(), "", handler));
+    assert(queue);
+    if (queue->Enqueue(item.get()))
+        item.release(); /* if true, queue took ownership */
+    else {
+        LogPrintf("WARNING: request rejected because http work queue depth for %s exceeded, it can be increased with the -rpcworkqueue= setting\n", what);
+        item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
+    }
+}
+
+void EnqueueHeavyHTTPRequest(HTTPRequest* req, const std::function<void(HTTPRequest*)>& func)
+{
+    EnqueueDetachedHTTPRequest(workQueueHeavy, "expensive requests", req, func);
+}
+
+void EnqueueLongPollHTTPRequest(HTTPRequest* req, const std::function<void(HTTPRequest*)>& func)
+{
+    EnqueueDetachedHTTPRequest(workQueueLongPoll, "long-polls", req, func);
+}
+
+std::shared_ptr<HTTPReplyStream> HTTPRequest::StartReplyStream(int nStatus)
+{
+    assert(!replySent && req);
+    std::shared_ptr<HTTPReplyStream> stream(new HTTPReplyStream(req, base));
+    HTTPEvent* ev = new HTTPEvent(base, true, std::bind(&HTTPReplyStream::Start, stream, nStatus));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred to the stream
+    return stream;
+}
+
+HTTPReplyStream::HTTPReplyStream(struct evhttp_request* reqIn, struct event_base* baseIn) :
+    req(reqIn), base(baseIn), pCloseRef(NULL), fClosed(false)
+{
+}
+
+void HTTPReplyStream::Start(int nStatus)
+{
+    struct evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (!evcon) {
+        // The client disconnected before the request was handled, and
+        // libevent left the request to us
+        evhttp_request_free(req);
+        req = NULL;
+        fClosed = true;
+        return;
+    }
+    pCloseRef = new std::shared_ptr<HTTPReplyStream>(shared_from_this());
+    evhttp_connection_set_closecb(evcon, CloseCallback, pCloseRef);
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+    // The client sends nothing while the reply is open, so only time out
+    // writes that do not make progress
+    struct timeval tvWrite;
+    tvWrite.tv_sec = httpServerTimeout;
+    tvWrite.tv_usec = 0;
+    bufferevent_set_timeouts(evhttp_connection_get_bufferevent(evcon), NULL, &tvWrite);
+#endif
+    evhttp_send_reply_start(req, nStatus, NULL);
+}
+
+void HTTPReplyStream::CloseCallback(struct evhttp_connection* evcon, void* arg)
+{
+    std::unique_ptr<std::shared_ptr<HTTPReplyStream> > ref(static_cast<std::shared_ptr<HTTPReplyStream>*>(arg));
+    HTTPReplyStream& stream = **ref;
+    stream.pCloseRef = NULL;
+    stream.fClosed = true;
+    // libevent detaches unfinished requests from a failed connection
+    // instead of freeing them
+    if (stream.req && !evhttp_request_get_connection(stream.req))
+        evhttp_request_free(stream.req);
+    stream.req = NULL;
+}
+
+static void http_chunk_cleanup(const void*, size_t, void* arg)
+{
+    delete static_cast<std::shared_ptr<const std::string>*>(arg);
+}
+
+void HTTPReplyStream::Write(const std::shared_ptr<const std::string>& data)
+{
+    if (fClosed || data->empty())
+        return;
+    std::shared_ptr<HTTPReplyStream> self = shared_from_this();
+    HTTPEvent* ev = new HTTPEvent(base, true, [self, data]() {
+        if (!self->req)
+            return;
+        struct evbuffer* evb = evbuffer_new();
+        evbuffer_add_reference(evb, data->data(), data->size(), http_chunk_cleanup,
+                               new std::shared_ptr<const std::string>(data));
+        evhttp_send_reply_chunk(self->req, evb);
+        evbuffer_free(evb);
+    });
+    ev->trigger(0);
+}
+
+void HTTPReplyStream::End()
+{
+    if (fClosed)
+        return;
+    std::shared_ptr<HTTPReplyStream> self = shared_from_this();
+    HTTPEvent* ev = new HTTPEvent(base, true, [self]() {
+        if (!self->req)
+            return;
+        struct evhttp_connection* evcon = evhttp_request_get_connection(self->req);
+        if (evcon && self->pCloseRef) {
+            evhttp_connection_set_closecb(evcon, NULL, NULL);
+            delete self->pCloseRef;
+            self->pCloseRef = NULL;
+        }
+        evhttp_send_reply_end(self->req);
+        self->req = NULL;
+        self->fClosed = true;
+    });
+    ev->trigger(0);
+}
+
+bool EnqueueHTTPWork(const std::function<void()>& func)
+{
+    std::unique_ptr<HTTPFunctionItem> item(new HTTPFunctionItem(func));
+    assert(workQueue);
+    if (!workQueue->Enqueue(item.get()))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
+bool EnqueueHTTPWorkIfIdle(const std::function<void()>& func)
+{
+    std::unique_ptr<HTTPFunctionItem> item(new HTTPFunctionItem(func));
+    assert(workQueue);
+    if (!workQueue->EnqueueIfIdle(item.get()))
+        return false;
+    item.release(); /* queue took ownership */
+    return true;
+}
+
 void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
 {
     LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
@@ -8,15 +8,22 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <atomic>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_HEAVY_THREADS=2;
+static const int DEFAULT_HTTP_LONGPOLL_THREADS=4;
+static const int DEFAULT_HTTP_EVENT_THREADS=1;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
+struct evhttp_connection;
 struct event_base;
 class CService;
 class HTTPRequest;
+class HTTPReplyStream;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -42,8 +49,32 @@ void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPR
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
-/** Return evhttp event base. This can be used by submodules to
- * queue timers or custom events.
+/** Continue handling a request on the work queue for expensive requests,
+ * so that it does not hold up cheap ones.  This takes over the request, and
+ * req must not be used afterwards.  If the queue is full, the request is
+ * answered with an error instead.
+ */
+void EnqueueHeavyHTTPRequest(HTTPRequest* req, const std::function<void(HTTPRequest*)>& func);
+
+/** Continue handling a request that waits for an event on the work queue
+ * for long-polls, so that waiting does not hold up other requests.  Takes
+ * over the request like EnqueueHeavyHTTPRequest.
+ */
+void EnqueueLongPollHTTPRequest(HTTPRequest* req, const std::function<void(HTTPRequest*)>& func);
+
+/** Run a function on one of the worker threads for cheap requests.
+ * Returns false if the work queue is full.
+ */
+bool EnqueueHTTPWork(const std::function<void()>& func);
+
+/** Run a function on an idle worker thread for cheap requests.
+ * Returns false if no worker is idle; such work is never queued behind, or
+ * counted against the -rpcworkqueue depth of, client requests.
+ */
+bool EnqueueHTTPWorkIfIdle(const std::function<void()>& func);
+
+/** Return evhttp event base of the first event thread. This can be used by
+ * submodules to queue timers or custom events.
  */
 struct event_base* EventBase();
 
@@ -54,6 +85,7 @@ class HTTPRequest
 {
 private:
     struct evhttp_request* req;
+    struct event_base* base;
     bool replySent;
 
 public:
@@ -110,6 +142,55 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Move the request into a new object, e.g. to continue handling it on
+     * another work queue.  Do not call any other methods of this object
+     * afterwards.
+     */
+    std::unique_ptr<HTTPRequest> Detach();
+
+    /**
+     * Start a reply that is sent in chunks over time, e.g. to push
+     * notifications to a client.  It holds no worker thread while open.
+     *
+     * @note Write any headers before calling this.  Do not call any other
+     * HTTPRequest methods afterwards.
+     */
+    std::shared_ptr<HTTPReplyStream> StartReplyStream(int nStatus);
+};
+
+/** HTTP reply that is sent in chunks (chunked transfer encoding).
+ * The chunks are sent from the event loop of the request's connection,
+ * and the methods can be called from any thread.
+ */
+class HTTPReplyStream : public std::enable_shared_from_this<HTTPReplyStream>
+{
+private:
+    friend class HTTPRequest;
+
+    //! The request while the reply is open.  Only used on the event loop.
+    struct evhttp_request* req;
+    struct event_base* base;
+    //! Reference to this held by the connection's close callback
+    std::shared_ptr<HTTPReplyStream>* pCloseRef;
+    std::atomic<bool> fClosed;
+
+    HTTPReplyStream(struct evhttp_request* reqIn, struct event_base* baseIn);
+    void Start(int nStatus);
+    static void CloseCallback(struct evhttp_connection* evcon, void* arg);
+
+public:
+    /** Send a chunk.  The data is referenced rather than copied, so that it
+     * can be shared by many streams.  Empty chunks are ignored.
+     */
+    void Write(const std::shared_ptr<const std::string>& data);
+
+    /** End the reply */
+    void End();
+
+    /** Whether the reply has ended or the client has disconnected */
+    bool IsClosed() const { return fClosed; }
 };
 
 /** Event handler closure.
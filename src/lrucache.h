@@ -0,0 +1,103 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LRUCACHE_H
+#define BITCOIN_LRUCACHE_H
+
+#include <assert.h>
+#include <list>
+#include <map>
+#include <utility>
+
+/**
+ * STL-like map container that keeps at most N elements.  When it is full,
+ * the least recently used element (inserted or looked up via get) is
+ * evicted.  The container is not thread-safe; users have to lock it.
+ */
+template <typename K, typename V>
+class lrucache
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<key_type, mapped_type> value_type;
+
+protected:
+    /** The elements, ordered from most to least recently used.  */
+    typedef std::list<value_type> list_type;
+    typedef typename list_type::iterator list_iterator;
+    list_type items;
+    std::map<K, list_iterator> index;
+    typedef typename std::map<K, list_iterator>::iterator index_iterator;
+
+public:
+    typedef typename std::map<K, list_iterator>::size_type size_type;
+
+protected:
+    size_type nMaxSize;
+
+    void trim(size_type s)
+    {
+        while (index.size() > s) {
+            index.erase(items.back().first);
+            items.pop_back();
+        }
+    }
+
+public:
+    explicit lrucache(size_type nMaxSizeIn)
+    {
+        assert(nMaxSizeIn > 0);
+        nMaxSize = nMaxSizeIn;
+    }
+    size_type size() const { return index.size(); }
+    bool empty() const { return index.empty(); }
+    /** Check for an element without marking it as used.  */
+    size_type count(const key_type& k) const { return index.count(k); }
+    void insert(const key_type& k, const mapped_type& v)
+    {
+        index_iterator it = index.find(k);
+        if (it != index.end()) {
+            it->second->second = v;
+            items.splice(items.begin(), items, it->second);
+            return;
+        }
+        items.push_front(value_type(k, v));
+        index.insert(std::make_pair(k, items.begin()));
+        trim(nMaxSize);
+    }
+    /** Look up an element and mark it as most recently used.  */
+    bool get(const key_type& k, mapped_type& v)
+    {
+        index_iterator it = index.find(k);
+        if (it == index.end())
+            return false;
+        items.splice(items.begin(), items, it->second);
+        v = it->second->second;
+        return true;
+    }
+    void erase(const key_type& k)
+    {
+        index_iterator it = index.find(k);
+        if (it == index.end())
+            return;
+        items.erase(it->second);
+        index.erase(it);
+    }
+    void clear()
+    {
+        index.clear();
+        items.clear();
+    }
+    size_type max_size() const { return nMaxSize; }
+    size_type max_size(size_type s)
+    {
+        assert(s > 0);
+        trim(s);
+        nMaxSize = s;
+        return nMaxSize;
+    }
+};
+
+#endif // BITCOIN_LRUCACHE_H
@@ -28,6 +28,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -46,6 +50,13 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long the socket handler waits for socket events (in milliseconds).
+static const int SOCKET_EVENTS_TIMEOUT = 50;
+// Number of bytes read from a socket at once.
+static const int SOCKET_RECV_BUFFER_SIZE = 0x10000;
+// Maximum number of events returned by one epoll_wait call.
+static const int MAX_SOCKET_EVENTS = 64;
+
 #if !defined(HAVE_MSG_NOSIGNAL) && !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -360,7 +371,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed))
     {
-        if (!IsSelectableSocket(hSocket)) {
+        if (hEpoll == -1 && !IsSelectableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -396,6 +407,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         pnode->nTimeConnected = GetTime();
         pnode->AddRef();
         GetNodeSignals().InitializeNode(pnode, *this);
+        RegisterNodeSocket(pnode);
         {
             LOCK(cs_vNodes);
             vNodes.push_back(pnode);
@@ -964,9 +976,16 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     int nInbound = 0;
     int nMaxInbound = nMaxConnections - (nMaxOutbound + nMaxFeeler);
 
-    if (hSocket != INVALID_SOCKET)
-        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-            LogPrintf("Warning: Unknown socket family\n");
+    if (hSocket == INVALID_SOCKET)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
+        return;
+    }
+
+    if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+        LogPrintf("Warning: Unknown socket family\n");
 
     bool whitelisted = hListenSocket.whitelisted || IsWhitelistedRange(addr);
     {
@@ -976,21 +995,14 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
                 nInbound++;
     }
 
-    if (hSocket == INVALID_SOCKET)
-    {
-        int nErr = WSAGetLastError();
-        if (nErr != WSAEWOULDBLOCK)
-            LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-        return;
-    }
-
     if (!fNetworkActive) {
         LogPrintf("connection from %s dropped: not accepting new connections\n", addr.ToString());
         CloseSocket(hSocket);
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    // epoll has no limit on the socket number.
+    if (hEpoll == -1 && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1033,289 +1045,521 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint("net", "connection from %s accepted\n", addr.ToString());
 
+    RegisterNodeSocket(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadSocketHandler()
+void CConnman::DisconnectNodes()
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true)
     {
-        //
-        // Disconnect nodes
-        //
+        LOCK(cs_vNodes);
+        // Disconnect unused nodes
+        std::vector<CNode*> vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes
-            std::vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            if (pnode->fDisconnect ||
+                (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0))
             {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0))
-                {
-                    // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                // remove from vNodes
+                vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                setNodesReady.erase(pnode);
+                setNodesPaused.erase(pnode);
 
-                    // release outbound grant (if any)
-                    pnode->grantOutbound.Release();
+                // release outbound grant (if any)
+                pnode->grantOutbound.Release();
 
-                    // close socket and cleanup
-                    pnode->CloseSocketDisconnect();
+                // close socket and cleanup
+                pnode->CloseSocketDisconnect();
 
-                    // hold in disconnected pool until all refs are released
-                    pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
+                // hold in disconnected pool until all refs are released
+                pnode->Release();
+                vNodesDisconnected.push_back(pnode);
             }
         }
+    }
+    {
+        // Delete disconnected nodes
+        std::list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+        BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
         {
-            // Delete disconnected nodes
-            std::list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+            // wait until threads are done using it
+            if (pnode->GetRefCount() <= 0)
             {
-                // wait until threads are done using it
-                if (pnode->GetRefCount() <= 0)
+                bool fDelete = false;
                 {
-                    bool fDelete = false;
+                    TRY_LOCK(pnode->cs_vSend, lockSend);
+                    if (lockSend)
                     {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend)
+                        TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                        if (lockRecv)
                         {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv)
-                            {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
+                            TRY_LOCK(pnode->cs_inventory, lockInv);
+                            if (lockInv)
+                                fDelete = true;
                         }
                     }
-                    if (fDelete)
-                    {
-                        vNodesDisconnected.remove(pnode);
-                        DeleteNode(pnode);
-                    }
+                }
+                if (fDelete)
+                {
+                    vNodesDisconnected.remove(pnode);
+                    DeleteNode(pnode);
                 }
             }
         }
-        size_t vNodesSize;
+    }
+}
+
+// requires LOCK(pnode->cs_vRecvMsg)
+bool CConnman::ReceiveBufferFull(CNode* pnode) const
+{
+    return !pnode->vRecvMsg.empty() && pnode->vRecvMsg.front().complete() &&
+           pnode->GetTotalRecvSize() > GetReceiveFloodSize();
+}
+
+// requires LOCK(pnode->cs_vRecvMsg)
+int CConnman::SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[SOCKET_RECV_BUFFER_SIZE];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        if(notify)
+            messageHandlerCondition.notify_one();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        RecordBytesRecv(nBytes);
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect)
+            LogPrint("net", "socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
         {
-            LOCK(cs_vNodes);
-            vNodesSize = vNodes.size();
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
         }
-        if(vNodesSize != nPrevNodeCount) {
-            nPrevNodeCount = vNodesSize;
-            if(clientInterface)
-                clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+    }
+    return nBytes;
+}
+
+void CConnman::InactivityCheck(CNode* pnode)
+{
+    int64_t nTime = GetTime();
+    if (nTime - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
+            pnode->fDisconnect = true;
         }
+        else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
+        {
+            LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
+            pnode->fDisconnect = true;
+        }
+        else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
+        {
+            LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
+            pnode->fDisconnect = true;
+        }
+        else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
+        {
+            LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
+            pnode->fDisconnect = true;
+        }
+    }
+}
 
-        //
-        // Find which sockets have data to receive
-        //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+void CConnman::SocketHandlerSelect()
+{
+    //
+    // Find which sockets have data to receive
+    //
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SOCKET_EVENTS_TIMEOUT * 1000; // frequency to poll pnode->vSend
 
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+#ifndef WIN32
+    if (hWakeupPipe[0] != -1) {
+        FD_SET(hWakeupPipe[0], &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, (SOCKET)hWakeupPipe[0]);
+        have_fds = true;
+    }
+#endif
 
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
         {
-            LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodes)
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is no (complete) message in the receive buffer,
+            //   or there is space left in the buffer, select() for receiving data.
+            // * (if neither of the above applies, there is certainly one message
+            //   in the receiver buffer ready to be processed).
+            // Together, that means that at least one of the following is always possible,
+            // so we don't deadlock:
+            // * We send some data.
+            // * We wait for data to be received (and disconnect after timeout).
+            // * We process a message in the buffer (message handler thread).
             {
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is no (complete) message in the receive buffer,
-                //   or there is space left in the buffer, select() for receiving data.
-                // * (if neither of the above applies, there is certainly one message
-                //   in the receiver buffer ready to be processed).
-                // Together, that means that at least one of the following is always possible,
-                // so we don't deadlock:
-                // * We send some data.
-                // * We wait for data to be received (and disconnect after timeout).
-                // * We process a message in the buffer (message handler thread).
-                {
-                    TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend) {
-                        if (!pnode->vSendMsg.empty()) {
-                            FD_SET(pnode->hSocket, &fdsetSend);
-                            continue;
-                        }
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend) {
+                    if (!pnode->vSendMsg.empty()) {
+                        FD_SET(pnode->hSocket, &fdsetSend);
+                        continue;
                     }
                 }
-                {
-                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= GetReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
-                }
+            }
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv && !ReceiveBufferFull(pnode))
+                    FD_SET(pnode->hSocket, &fdsetRecv);
             }
         }
+    }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
-        boost::this_thread::interruption_point();
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR)
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
         {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec/1000);
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        MilliSleep(timeout.tv_usec/1000);
+    }
+
+#ifndef WIN32
+    if (hWakeupPipe[0] != -1 && FD_ISSET(hWakeupPipe[0], &fdsetRecv))
+        DrainWakeupPipe();
+#endif
+
+    //
+    // Accept new connections
+    //
+    BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+    {
+        if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
+        {
+            AcceptConnection(hListenSocket);
         }
+    }
+
+    //
+    // Service each socket
+    //
+    std::vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            pnode->AddRef();
+    }
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        boost::this_thread::interruption_point();
 
         //
-        // Accept new connections
+        // Receive
         //
-        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (lockRecv)
+                SocketRecvData(pnode);
         }
 
         //
-        // Service each socket
+        // Send
         //
-        std::vector<CNode*> vNodesCopy;
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (FD_ISSET(pnode->hSocket, &fdsetSend))
         {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->AddRef();
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (lockSend) {
+                size_t nBytes = SocketSendData(pnode);
+                if (nBytes)
+                    RecordBytesSent(nBytes);
+            }
         }
+
+        //
+        // Inactivity checking
+        //
+        InactivityCheck(pnode);
+    }
+    {
+        LOCK(cs_vNodes);
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
-        {
-            boost::this_thread::interruption_point();
+            pnode->Release();
+    }
+}
 
-            //
-            // Receive
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
+#ifdef HAVE_SYS_EPOLL_H
+bool CConnman::SocketHandlerEpoll(bool fPoll)
+{
+    //
+    // Wait for sockets to become readable or writable.  Nodes are registered
+    // edge-triggered, so an event only says that the state changed.  The
+    // socket stays "ready" (and the node in setNodesReady) until a read or
+    // write comes up short.  Listen sockets and the wakeup pipe are
+    // level-triggered.
+    //
+    struct epoll_event events[MAX_SOCKET_EVENTS];
+    int nEvents = epoll_wait(hEpoll, events, MAX_SOCKET_EVENTS, fPoll ? 0 : SOCKET_EVENTS_TIMEOUT);
+    boost::this_thread::interruption_point();
+
+    if (nEvents < 0)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            MilliSleep(SOCKET_EVENTS_TIMEOUT);
+        }
+        nEvents = 0;
+    }
+
+    bool fWakeup = false;
+    bool fAccept = false;
+    for (int i = 0; i < nEvents; ++i)
+    {
+        if (events[i].data.ptr == hWakeupPipe) {
+            fWakeup = true;
+            continue;
+        }
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        if (!pnode) {
+            fAccept = true;
+            continue;
+        }
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            pnode->fSocketRecvReady = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSocketSendReady = true;
+        setNodesReady.insert(pnode);
+    }
+
+    if (fWakeup)
+    {
+        DrainWakeupPipe();
+
+        // Resume reading from nodes whose receive buffer has room again.
+        for (std::set<CNode*>::iterator it = setNodesPaused.begin(); it != setNodesPaused.end(); )
+        {
+            if ((*it)->fPauseRecv) {
+                ++it;
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError))
-            {
-                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
-                {
-                    {
-                        // typical socket buffer is 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            bool notify = false;
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                                pnode->CloseSocketDisconnect();
-                            if(notify)
-                                messageHandlerCondition.notify_one();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                            RecordBytesRecv(nBytes);
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully
-                            if (!pnode->fDisconnect)
-                                LogPrint("net", "socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
             }
+            setNodesReady.insert(*it);
+            setNodesPaused.erase(it++);
+        }
+    }
 
-            //
-            // Send
-            //
-            if (pnode->hSocket == INVALID_SOCKET)
-                continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend))
-            {
-                TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend) {
-                    size_t nBytes = SocketSendData(pnode);
-                    if (nBytes)
-                        RecordBytesSent(nBytes);
-                }
+    //
+    // Accept new connections
+    //
+    if (fAccept)
+    {
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket)
+            if (hListenSocket.socket != INVALID_SOCKET)
+                AcceptConnection(hListenSocket);
+    }
+
+    //
+    // Service the ready sockets.  The same logic as with select applies:
+    // while there is data left to send, we do not receive more.
+    //
+    bool fMoreWork = false;
+    const std::vector<CNode*> vReady(setNodesReady.begin(), setNodesReady.end());
+    BOOST_FOREACH(CNode* pnode, vReady)
+    {
+        boost::this_thread::interruption_point();
+
+        if (pnode->hSocket == INVALID_SOCKET) {
+            setNodesReady.erase(pnode);
+            continue;
+        }
+
+        // Sockets whose lock is busy are retried after the next wait.
+        bool fBusy = false;
+
+        //
+        // Send
+        //
+        if (pnode->fSocketSendReady)
+        {
+            TRY_LOCK(pnode->cs_vSend, lockSend);
+            if (!lockSend)
+                fBusy = true;
+            else if (!pnode->vSendMsg.empty()) {
+                size_t nBytes = SocketSendData(pnode);
+                if (nBytes)
+                    RecordBytesSent(nBytes);
+                // A short write means the socket buffer is full.
+                if (!pnode->vSendMsg.empty())
+                    pnode->fSocketSendReady = false;
             }
+        }
 
-            //
-            // Inactivity checking
-            //
-            int64_t nTime = GetTime();
-            if (nTime - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    LogPrint("net", "socket no message in first 60 seconds, %d %d from %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0, pnode->id);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastSend > TIMEOUT_INTERVAL)
-                {
-                    LogPrintf("socket sending timeout: %is\n", nTime - pnode->nLastSend);
-                    pnode->fDisconnect = true;
-                }
-                else if (nTime - pnode->nLastRecv > (pnode->nVersion > BIP0031_VERSION ? TIMEOUT_INTERVAL : 90*60))
-                {
-                    LogPrintf("socket receive timeout: %is\n", nTime - pnode->nLastRecv);
-                    pnode->fDisconnect = true;
-                }
-                else if (pnode->nPingNonceSent && pnode->nPingUsecStart + TIMEOUT_INTERVAL * 1000000 < GetTimeMicros())
-                {
-                    LogPrintf("ping timeout: %fs\n", 0.000001 * (GetTimeMicros() - pnode->nPingUsecStart));
-                    pnode->fDisconnect = true;
-                }
+        //
+        // Receive
+        //
+        if (pnode->fSocketRecvReady && pnode->fSocketSendReady && pnode->hSocket != INVALID_SOCKET)
+        {
+            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+            if (!lockRecv)
+                fBusy = true;
+            else if (ReceiveBufferFull(pnode)) {
+                // The message handler wakes us up when there is room again.
+                pnode->fPauseRecv = true;
+                setNodesPaused.insert(pnode);
+            } else if (SocketRecvData(pnode) == SOCKET_RECV_BUFFER_SIZE) {
+                // There may be more data waiting.
+                fMoreWork = true;
+            } else {
+                pnode->fSocketRecvReady = false;
             }
         }
+
+        if (!fBusy && !(pnode->fSocketRecvReady && pnode->fSocketSendReady && !pnode->fPauseRecv))
+            setNodesReady.erase(pnode);
+    }
+
+    return fMoreWork;
+}
+
+void CConnman::RegisterNodeSocket(CNode* pnode)
+{
+    if (hEpoll == -1)
+        return;
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+}
+#else
+void CConnman::RegisterNodeSocket(CNode* pnode)
+{
+}
+#endif
+
+void CConnman::WakeSocketHandler()
+{
+#ifndef WIN32
+    if (hWakeupPipe[1] == -1 || fWakeupPending.exchange(true))
+        return;
+    char c = 0;
+    if (write(hWakeupPipe[1], &c, 1) != 1)
+        fWakeupPending = false;
+#endif
+}
+
+void CConnman::DrainWakeupPipe()
+{
+#ifndef WIN32
+    fWakeupPending = false;
+    char buf[128];
+    while (read(hWakeupPipe[0], buf, sizeof(buf)) > 0) {}
+#endif
+}
+
+void CConnman::ThreadSocketHandler()
+{
+    unsigned int nPrevNodeCount = 0;
+#ifdef HAVE_SYS_EPOLL_H
+    int64_t nLastInactivityCheck = 0;
+    bool fMoreWork = false;
+#endif
+    while (true)
+    {
+        //
+        // Disconnect nodes
+        //
+        DisconnectNodes();
+
+        size_t vNodesSize;
         {
             LOCK(cs_vNodes);
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-                pnode->Release();
+            vNodesSize = vNodes.size();
         }
+        if(vNodesSize != nPrevNodeCount) {
+            nPrevNodeCount = vNodesSize;
+            if(clientInterface)
+                clientInterface->NotifyNumConnectionsChanged(nPrevNodeCount);
+        }
+
+#ifdef HAVE_SYS_EPOLL_H
+        if (hEpoll != -1) {
+            fMoreWork = SocketHandlerEpoll(fMoreWork);
+
+            // With epoll, idle nodes are not visited on each wakeup.
+            // Check them for timeouts once per second instead.
+            const int64_t nTime = GetTime();
+            if (nTime != nLastInactivityCheck) {
+                nLastInactivityCheck = nTime;
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes)
+                    InactivityCheck(pnode);
+            }
+            continue;
+        }
+#endif
+
+        SocketHandlerSelect();
     }
 }
 
@@ -1820,11 +2064,8 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
 }
 
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nThread)
 {
-    boost::mutex condition_mutex;
-    boost::unique_lock<boost::mutex> lock(condition_mutex);
-
     while (true)
     {
         std::vector<CNode*> vNodesCopy;
@@ -1837,12 +2078,22 @@ void CConnman::ThreadMessageHandler()
         }
 
         bool fSleep = true;
+        int nNodesWithWork = 0;
 
-        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+        // Start at a different node in each thread, so that they do not all
+        // compete for the same peers.
+        const size_t nStart = vNodesCopy.empty() ? 0 : (nThread * vNodesCopy.size() / nMessageHandlerThreads);
+        for (size_t i = 0; i < vNodesCopy.size(); ++i)
         {
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
             if (pnode->fDisconnect)
                 continue;
 
+            // Only one thread handles a node at a time, which keeps its
+            // messages in order.
+            if (pnode->fInMessageHandler.exchange(true))
+                continue;
+
             // Receive messages
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
@@ -1851,11 +2102,17 @@ void CConnman::ThreadMessageHandler()
                     if (!GetNodeSignals().ProcessMessages(pnode, *this))
                         pnode->CloseSocketDisconnect();
 
+                    if (pnode->fPauseRecv && !ReceiveBufferFull(pnode)) {
+                        pnode->fPauseRecv = false;
+                        WakeSocketHandler();
+                    }
+
                     if (pnode->nSendSize < GetSendBufferSize())
                     {
                         if (!pnode->vRecvGetData.empty() || (!pnode->vRecvMsg.empty() && pnode->vRecvMsg[0].complete()))
                         {
                             fSleep = false;
+                            ++nNodesWithWork;
                         }
                     }
                 }
@@ -1868,6 +2125,7 @@ void CConnman::ThreadMessageHandler()
                 if (lockSend)
                     GetNodeSignals().SendMessages(pnode, *this);
             }
+            pnode->fInMessageHandler = false;
             boost::this_thread::interruption_point();
         }
 
@@ -1877,8 +2135,14 @@ void CConnman::ThreadMessageHandler()
                 pnode->Release();
         }
 
-        if (fSleep)
+        // Let another thread help with the remaining work.
+        if (nNodesWithWork > 1)
+            messageHandlerCondition.notify_one();
+
+        if (fSleep) {
+            boost::unique_lock<boost::mutex> lock(mutexMsgProc);
             messageHandlerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        }
     }
 }
 
@@ -2068,8 +2332,12 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     semOutbound = NULL;
     nMaxConnections = 0;
     nMaxOutbound = 0;
+    nMessageHandlerThreads = 1;
     nBestHeight = 0;
     clientInterface = NULL;
+    hEpoll = -1;
+    hWakeupPipe[0] = hWakeupPipe[1] = -1;
+    fWakeupPending = false;
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2089,6 +2357,7 @@ bool CConnman::Start(boost::thread_group& threadGroup, CScheduler& scheduler, st
     nMaxConnections = connOptions.nMaxConnections;
     nMaxOutbound = std::min((connOptions.nMaxOutbound), nMaxConnections);
     nMaxFeeler = connOptions.nMaxFeeler;
+    nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHAND_THREADS));
 
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nSendBufferMaxSize;
@@ -2141,6 +2410,8 @@ bool CConnman::Start(boost::thread_group& threadGroup, CScheduler& scheduler, st
         semOutbound = new CSemaphore(std::min((nMaxOutbound + nMaxFeeler), nMaxConnections));
     }
 
+    InitSocketEvents();
+
     //
     // Start threads
     //
@@ -2161,7 +2432,8 @@ bool CConnman::Start(boost::thread_group& threadGroup, CScheduler& scheduler, st
         threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "opencon", boost::function<void()>(boost::bind(&CConnman::ThreadOpenConnections, this))));
 
     // Process messages
-    threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&CConnman::ThreadMessageHandler, this))));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "msghand", boost::function<void()>(boost::bind(&CConnman::ThreadMessageHandler, this, i))));
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL);
@@ -2169,6 +2441,50 @@ bool CConnman::Start(boost::thread_group& threadGroup, CScheduler& scheduler, st
     return true;
 }
 
+void CConnman::InitSocketEvents()
+{
+#ifndef WIN32
+    if (pipe(hWakeupPipe) != 0) {
+        LogPrintf("Failed to create the socket handler wakeup pipe: %s\n", NetworkErrorString(WSAGetLastError()));
+        hWakeupPipe[0] = hWakeupPipe[1] = -1;
+    } else {
+        for (int i = 0; i < 2; ++i)
+            fcntl(hWakeupPipe[i], F_SETFL, fcntl(hWakeupPipe[i], F_GETFL) | O_NONBLOCK);
+    }
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (GetArg("-socketevents", DEFAULT_SOCKET_EVENTS) == "epoll") {
+        hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll == -1)
+            LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(WSAGetLastError()));
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        BOOST_FOREACH(const ListenSocket& hListenSocket, vhListenSocket) {
+            if (hEpoll == -1)
+                break;
+            event.data.ptr = NULL;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+                LogPrintf("epoll_ctl failed for a listen socket: %s\n", NetworkErrorString(WSAGetLastError()));
+                close(hEpoll);
+                hEpoll = -1;
+            }
+        }
+        if (hEpoll != -1 && hWakeupPipe[0] != -1) {
+            event.data.ptr = hWakeupPipe;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hWakeupPipe[0], &event) != 0) {
+                LogPrintf("epoll_ctl failed for the wakeup pipe: %s\n", NetworkErrorString(WSAGetLastError()));
+                close(hEpoll);
+                hEpoll = -1;
+            }
+        }
+    }
+#endif
+
+    LogPrintf("Using %s for socket events\n", hEpoll != -1 ? "epoll" : "select");
+}
+
 class CNetCleanup
 {
 public:
@@ -2215,9 +2531,22 @@ void CConnman::Stop()
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+    setNodesReady.clear();
+    setNodesPaused.clear();
     vhListenSocket.clear();
     delete semOutbound;
     semOutbound = NULL;
+
+#ifndef WIN32
+    if (hEpoll != -1)
+        close(hEpoll);
+    hEpoll = -1;
+    for (int i = 0; i < 2; ++i) {
+        if (hWakeupPipe[i] != -1)
+            close(hWakeupPipe[i]);
+        hWakeupPipe[i] = -1;
+    }
+#endif
 }
 
 void CConnman::DeleteNode(CNode* pnode)
@@ -2521,6 +2850,10 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fFeeler = false;
     fSuccessfullyConnected = false;
     fDisconnect = false;
+    fSocketRecvReady = false;
+    fSocketSendReady = false;
+    fPauseRecv = false;
+    fInMessageHandler = false;
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
@@ -2614,6 +2947,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
     size_t nBytesSent = 0;
+    bool fWakeup = false;
     {
         LOCK(pnode->cs_vSend);
         if(pnode->hSocket == INVALID_SOCKET) {
@@ -2632,9 +2966,15 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
             nBytesSent = SocketSendData(pnode);
+
+        // select() only waits for sockets that had queued data when it was
+        // called, so wake it up to send the rest.  epoll notices by itself.
+        fWakeup = (hEpoll == -1 && !pnode->vSendMsg.empty());
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
+    if (fWakeup)
+        WakeSocketHandler();
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
@@ -87,6 +87,12 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** Default number of message handler threads */
+static const int DEFAULT_MSGHAND_THREADS = 4;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
+/** How the socket handler waits for socket events: "epoll" (if available) or "select" */
+static const char* const DEFAULT_SOCKET_EVENTS = "epoll";
 
 static const ServiceFlags REQUIRED_SERVICES = NODE_NETWORK;
 
@@ -139,6 +145,7 @@ public:
         int nMaxConnections = 0;
         int nMaxOutbound = 0;
         int nMaxFeeler = 0;
+        int nMessageHandlerThreads = 1;
         int nBestHeight = 0;
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
@@ -337,8 +344,18 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
+    void DisconnectNodes();
+    bool ReceiveBufferFull(CNode* pnode) const;
+    int SocketRecvData(CNode* pnode);
+    void InactivityCheck(CNode* pnode);
+    void InitSocketEvents();
+    void RegisterNodeSocket(CNode* pnode);
+    void WakeSocketHandler();
+    void DrainWakeupPipe();
+    void SocketHandlerSelect();
+    bool SocketHandlerEpoll(bool fPoll);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -409,6 +426,17 @@ private:
     mutable CCriticalSection cs_vNodes;
     std::atomic<NodeId> nLastNodeId;
     boost::condition_variable messageHandlerCondition;
+    boost::mutex mutexMsgProc;
+
+    /** epoll instance of the socket handler, -1 when using select */
+    int hEpoll;
+    /** Pipe used to wake up the socket handler while it waits for events */
+    int hWakeupPipe[2];
+    std::atomic<bool> fWakeupPending;
+    /** Nodes with sockets that may be read or written without blocking (epoll only) */
+    std::set<CNode*> setNodesReady;
+    /** Nodes that are not read because their receive buffer is full (epoll only) */
+    std::set<CNode*> setNodesPaused;
 
     /** Services this instance offers */
     ServiceFlags nLocalServices;
@@ -420,6 +448,7 @@ private:
     int nMaxConnections;
     int nMaxOutbound;
     int nMaxFeeler;
+    int nMessageHandlerThreads;
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface;
 
@@ -621,6 +650,15 @@ public:
     const bool fInbound;
     bool fSuccessfullyConnected;
     std::atomic_bool fDisconnect;
+    // Socket readiness from the edge-triggered socket events, only used by
+    // the socket handler thread.
+    bool fSocketRecvReady;
+    bool fSocketSendReady;
+    // Set by the socket handler when it stops reading because the receive
+    // buffer is full, cleared by the message handler (both under cs_vRecvMsg).
+    std::atomic_bool fPauseRecv;
+    // Set while a message handler thread processes the node's messages.
+    std::atomic_bool fInMessageHandler;
     // We use fRelayTxes for two purposes -
     // a) it allows us to not relay tx invs before receiving the peer's version message
     // b) the peer may tell us in its version message that we should not relay tx invs
@@ -644,8 +682,11 @@ public:
     int nStartingHeight;
 
     // flood relay
+    // vAddrToSend and addrKnown are protected by cs_addrSend, since other
+    // peers' message handlers relay addresses to this node.
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
+    CCriticalSection cs_addrSend;
     bool fGetAddr;
     std::set<uint256> setKnown;
     int64_t nNextAddrSend;
@@ -781,6 +822,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -789,6 +831,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_addrSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.rand32() % vAddrToSend.size()] = _addr;
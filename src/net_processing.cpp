@@ -43,7 +43,7 @@ int64_t nTimeBestReceived = 0; // Used only to inform the wallet of when we last
 struct IteratorComparator
 {
     template<typename I>
-    bool operator()(const I& a, const I& b)
+    bool operator()(const I& a, const I& b) const
     {
         return &(*a) < &(*b);
     }
@@ -548,6 +548,29 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBl
     }
 }
 
+/** Add missing blocks before the base of a loaded UTXO snapshot to vBlocks, oldest first,
+ *  until it has at most count entries. */
+void FindSnapshotHistoryToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks) {
+    if (pindexSnapshotBase == NULL || vBlocks.size() >= count)
+        return;
+
+    // Only peers that have the snapshot's block can have the blocks before it.
+    CNodeState *state = State(nodeid);
+    assert(state != NULL);
+    if (state->pindexBestKnownBlock == NULL || state->pindexBestKnownBlock->GetAncestor(pindexSnapshotBase->nHeight) != pindexSnapshotBase)
+        return;
+
+    const int nWindowEnd = std::min(pindexSnapshotBase->nHeight, GetSnapshotHistoryHeight() + (int)BLOCK_DOWNLOAD_WINDOW);
+    for (int nHeight = GetSnapshotHistoryHeight() + 1; nHeight <= nWindowEnd; nHeight++) {
+        CBlockIndex* pindex = pindexSnapshotBase->GetAncestor(nHeight);
+        if (pindex->nStatus & BLOCK_HAVE_DATA || mapBlocksInFlight.count(pindex->GetBlockHash()))
+            continue;
+        vBlocks.push_back(pindex);
+        if (vBlocks.size() == count)
+            return;
+    }
+}
+
 } // anon namespace
 
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
@@ -826,12 +849,13 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                 recentRejects->reset();
             }
 
-            // Use pcoinsTip->HaveCoinsInCache as a quick approximation to exclude
+            // Use pcoinsTip->HaveCoinInCache as a quick approximation to exclude
             // requesting or processing some txs which have already been included in a block
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoinsInCache(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_BLOCK:
     case MSG_WITNESS_BLOCK:
@@ -886,13 +910,72 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman& connma
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/** Serialization flags for block headers exchanged with a peer.  The compact
+    auxpow encoding is used if both sides signal NODE_AUXPOW_COMPACT.  */
+static int GetAuxpowSerializeFlags(const CNode* pnode) {
+    if ((pnode->GetLocalServices() & NODE_AUXPOW_COMPACT) && (pnode->nServices & NODE_AUXPOW_COMPACT))
+        return SERIALIZE_AUXPOW_COMPACT;
+    return 0;
+}
+
+/**
+ * Look up a block requested with getdata and decide whether it may be
+ * served to the peer.  On success, sets the position of the block data on
+ * disk and the index entry of the block.
+ */
+static bool GetBlockToServe(CNode* pfrom, const CInv& inv, const Consensus::Params& consensusParams, CConnman& connman, CBlockIndex*& pindex, CDiskBlockPos& pos) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    bool send = false;
+    BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
+    if (mi == mapBlockIndex.end())
+        return false;
+    pindex = mi->second;
+    if (chainActive.Contains(pindex)) {
+        send = true;
+    } else {
+        static const int nOneMonth = 30 * 24 * 60 * 60;
+        // To prevent fingerprinting attacks, only send blocks outside of the active
+        // chain if they are valid, and no more than a month older (both in time, and in
+        // best equivalent proof of work) than the best header chain we know about.
+        send = pindex->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
+            (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() < nOneMonth) &&
+            (GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, consensusParams) < nOneMonth);
+        if (!send) {
+            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+        }
+    }
+    // disconnect node in case we have reached the outbound limit for serving historical blocks
+    // never disconnect whitelisted nodes
+    static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
+    if (send && connman.OutboundTargetReached(true) && ( ((pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > nOneWeek)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
+    {
+        LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+
+        //disconnect node
+        pfrom->fDisconnect = true;
+        send = false;
+    }
+    // Pruned nodes may have deleted the block, so check whether
+    // it's available before trying to send.
+    if (!send || !(pindex->nStatus & BLOCK_HAVE_DATA))
+        return false;
+    pos = pindex->GetBlockPos();
+    return true;
+}
+
+/**
+ * Answer the getdata requests queued for a peer.  Blocks are looked up
+ * with cs_main held, but read from disk and sent without it, so that
+ * serving old blocks does not stall other peers.  Block files are
+ * immutable except for pruning, and a block that was pruned in the
+ * meantime fails the hash check when reading it.
+ */
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman& connman)
 {
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     unsigned int nMaxSendBufferSize = connman.GetSendBufferSize();
     vector<CInv> vNotFound;
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    LOCK(cs_main);
 
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway
@@ -906,48 +989,36 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
 
             if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
             {
-                bool send = false;
-                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
-                if (mi != mapBlockIndex.end())
+                bool send;
+                CBlockIndex* pindex = NULL;
+                CDiskBlockPos pos;
+                bool fPeerWantsWitness = false;
+                bool fSendCompact = false;
+                uint256 hashTip;
                 {
-                    if (chainActive.Contains(mi->second)) {
-                        send = true;
-                    } else {
-                        static const int nOneMonth = 30 * 24 * 60 * 60;
-                        // To prevent fingerprinting attacks, only send blocks outside of the active
-                        // chain if they are valid, and no more than a month older (both in time, and in
-                        // best equivalent proof of work) than the best header chain we know about.
-                        send = mi->second->IsValid(BLOCK_VALID_SCRIPTS) && (pindexBestHeader != NULL) &&
-                            (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() < nOneMonth) &&
-                            (GetBlockProofEquivalentTime(*pindexBestHeader, *mi->second, *pindexBestHeader, consensusParams) < nOneMonth);
-                        if (!send) {
-                            LogPrintf("%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-                        }
+                    LOCK(cs_main);
+                    send = GetBlockToServe(pfrom, inv, consensusParams, connman, pindex, pos);
+                    if (send) {
+                        fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+                        fSendCompact = CanDirectFetch(consensusParams) && pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+                        hashTip = chainActive.Tip()->GetBlockHash();
                     }
                 }
-                // disconnect node in case we have reached the outbound limit for serving historical blocks
-                // never disconnect whitelisted nodes
-                static const int nOneWeek = 7 * 24 * 60 * 60; // assume > 1 week = historical
-                if (send && connman.OutboundTargetReached(true) && ( ((pindexBestHeader != NULL) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > nOneWeek)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
-                {
-                    LogPrint("net", "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
-                    //disconnect node
-                    pfrom->fDisconnect = true;
-                    send = false;
-                }
-                // Pruned nodes may have deleted the block, so check whether
-                // it's available before trying to send.
-                if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
+                if (send)
                 {
                     // Send block from disk
                     CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
+                    if (!ReadBlockFromDisk(block, pos, consensusParams) || block.GetHash() != inv.hash) {
+                        LogPrintf("%s: failed to read block %s requested by peer=%d\n", __func__, inv.hash.ToString(), pfrom->GetId());
+                        vNotFound.push_back(inv);
+                        break;
+                    }
+                    const int nAuxpowFlags = GetAuxpowSerializeFlags(pfrom);
                     if (inv.type == MSG_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block));
+                        connman.PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS | nAuxpowFlags, NetMsgType::BLOCK, block));
                     else if (inv.type == MSG_WITNESS_BLOCK)
-                        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+                        connman.PushMessage(pfrom, msgMaker.Make(nAuxpowFlags, NetMsgType::BLOCK, block));
                     else if (inv.type == MSG_FILTERED_BLOCK)
                     {
                         bool sendMerkleBlock = false;
@@ -960,7 +1031,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                             }
                         }
                         if (sendMerkleBlock) {
-                            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                            connman.PushMessage(pfrom, msgMaker.Make(nAuxpowFlags, NetMsgType::MERKLEBLOCK, merkleBlock));
                             // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
                             // This avoids hurting performance by pointlessly requiring a round-trip
                             // Note that there is currently no way for a node to request any single transactions we didn't send here -
@@ -980,9 +1051,8 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                         // they won't have a useful mempool to match against a compact block,
                         // and we don't feel like constructing the object for them, so
                         // instead we respond with the full, non-compact block.
-                        bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                        int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                        if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                        int nSendFlags = (fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS) | nAuxpowFlags;
+                        if (fSendCompact) {
                             CBlockHeaderAndShortTxIDs cmpctblock(block, fPeerWantsWitness);
                             connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                         } else
@@ -996,7 +1066,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                         // and we want it right after the last block so they don't
                         // wait for other stuff first.
                         vector<CInv> vInv;
-                        vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
+                        vInv.push_back(CInv(MSG_BLOCK, hashTip));
                         connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
                         pfrom->hashContinue.SetNull();
                     }
@@ -1006,10 +1076,16 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             {
                 // Send stream from relay memory
                 bool push = false;
-                auto mi = mapRelay.find(inv.hash);
+                CTransactionRef tx;
+                {
+                    LOCK(cs_main);
+                    auto mi = mapRelay.find(inv.hash);
+                    if (mi != mapRelay.end())
+                        tx = mi->second;
+                }
                 int nSendFlags = (inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0);
-                if (mi != mapRelay.end()) {
-                    connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
+                if (tx) {
+                    connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *tx));
                     push = true;
                 } else if (pfrom->timeLastMempoolReq) {
                     auto txinfo = mempool.info(inv.hash);
@@ -1492,44 +1568,55 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         BlockTransactionsRequest req;
         vRecv >> req;
 
-        LOCK(cs_main);
+        CDiskBlockPos pos;
+        bool fWantsCmpctWitness;
+        {
+            LOCK(cs_main);
 
-        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
-        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
-            LogPrintf("Peer %d sent us a getblocktxn for a block we don't have", pfrom->id);
-            return true;
-        }
+            BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+            if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+                LogPrintf("Peer %d sent us a getblocktxn for a block we don't have", pfrom->id);
+                return true;
+            }
 
-        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
-            // If an older block is requested (should never happen in practice,
-            // but can happen in tests) send a block response instead of a
-            // blocktxn response. Sending a full block response instead of a
-            // small blocktxn response is preferable in the case where a peer
-            // might maliciously send lots of getblocktxn requests to trigger
-            // expensive disk reads, because it will require the peer to
-            // actually receive all the data read from disk over the network.
-            LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep", pfrom->id, MAX_BLOCKTXN_DEPTH);
-            CInv inv;
-            inv.type = State(pfrom->GetId())->fWantsCmpctWitness ? MSG_WITNESS_BLOCK : MSG_BLOCK;
-            inv.hash = req.blockhash;
-            pfrom->vRecvGetData.push_back(inv);
+            fWantsCmpctWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+            if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+                // If an older block is requested (should never happen in practice,
+                // but can happen in tests) send a block response instead of a
+                // blocktxn response. Sending a full block response instead of a
+                // small blocktxn response is preferable in the case where a peer
+                // might maliciously send lots of getblocktxn requests to trigger
+                // expensive disk reads, because it will require the peer to
+                // actually receive all the data read from disk over the network.
+                LogPrint("net", "Peer %d sent us a getblocktxn for a block > %i deep", pfrom->id, MAX_BLOCKTXN_DEPTH);
+                CInv inv;
+                inv.type = fWantsCmpctWitness ? MSG_WITNESS_BLOCK : MSG_BLOCK;
+                inv.hash = req.blockhash;
+                pfrom->vRecvGetData.push_back(inv);
+                pos.SetNull();
+            } else
+                pos = it->second->GetBlockPos();
+        }
+        if (pos.IsNull()) {
             ProcessGetData(pfrom, chainparams.GetConsensus(), connman);
             return true;
         }
 
         CBlock block;
-        assert(ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()));
+        if (!ReadBlockFromDisk(block, pos, chainparams.GetConsensus()) || block.GetHash() != req.blockhash)
+            return error("%s: failed to read block %s for getblocktxn", __func__, req.blockhash.ToString());
 
         BlockTransactions resp(req);
         for (size_t i = 0; i < req.indexes.size(); i++) {
             if (req.indexes[i] >= block.vtx.size()) {
+                LOCK(cs_main);
                 Misbehaving(pfrom->GetId(), 100);
                 LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices", pfrom->id);
                 return true;
             }
             resp.txn[i] = block.vtx[req.indexes[i]];
         }
-        int nSendFlags = State(pfrom->GetId())->fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+        int nSendFlags = fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
         connman.PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCKTXN, resp));
     }
 
@@ -1540,48 +1627,67 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
-        LOCK(cs_main);
-        if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
-            LogPrint("net", "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->id);
-            return true;
-        }
-
-        CNodeState *nodestate = State(pfrom->GetId());
-        CBlockIndex* pindex = NULL;
-        if (locator.IsNull())
+        // Find the blocks to send with cs_main held.  Building the headers
+        // may need to read their auxpow from disk, which is done without it.
+        vector<CBlockIndex*> vIndex;
+        CBlockIndex* pindexLastSent;
         {
-            // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end())
+            LOCK(cs_main);
+            if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
+                LogPrint("net", "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->id);
                 return true;
-            pindex = (*mi).second;
-        }
-        else
-        {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(chainActive, locator);
-            if (pindex)
-                pindex = chainActive.Next(pindex);
+            }
+
+            CBlockIndex* pindex = NULL;
+            if (locator.IsNull())
+            {
+                // If locator is null, return the hashStop block
+                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+                if (mi == mapBlockIndex.end())
+                    return true;
+                pindex = (*mi).second;
+            }
+            else
+            {
+                // Find the last block the caller has in the main chain
+                pindex = FindForkInGlobalIndex(chainActive, locator);
+                if (pindex)
+                    pindex = chainActive.Next(pindex);
+            }
+
+            LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->id);
+            for (; pindex; pindex = chainActive.Next(pindex))
+            {
+                vIndex.push_back(pindex);
+                if (vIndex.size() >= MAX_HEADERS_RESULTS
+                      || pindex->GetBlockHash() == hashStop)
+                    break;
+            }
+
+            // pindex can be NULL either if we send chainActive.Tip() OR
+            // if our peer has chainActive.Tip() (and thus we are sending an empty
+            // headers message). In both cases it's safe to update
+            // pindexBestHeaderSent to be our tip.
+            pindexLastSent = pindex ? pindex : chainActive.Tip();
         }
 
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         vector<CBlock> vHeaders;
-        unsigned nCount = 0;
         unsigned nSize = 0;
-        LogPrint("net", "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex))
+        const int nAuxpowFlags = GetAuxpowSerializeFlags(pfrom);
+        BOOST_FOREACH(CBlockIndex* pindex, vIndex)
         {
             const CBlockHeader header = pindex->GetBlockHeader(chainparams.GetConsensus());
-            ++nCount;
-            nSize += GetSerializeSize(header, SER_NETWORK, PROTOCOL_VERSION);
-            vHeaders.push_back(header);
-            if (nCount >= MAX_HEADERS_RESULTS
-                  || pindex->GetBlockHash() == hashStop)
+            if (header.IsNull())
                 break;
+            nSize += GetSerializeSize(header, SER_NETWORK, PROTOCOL_VERSION | nAuxpowFlags);
+            vHeaders.push_back(header);
             if (pfrom->nVersion >= SIZE_HEADERS_LIMIT_VERSION
                   && nSize >= THRESHOLD_HEADERS_SIZE)
                 break;
         }
+        if (vHeaders.size() < vIndex.size())
+            pindexLastSent = vHeaders.empty() ? NULL : vIndex[vHeaders.size() - 1];
 
         /* Check maximum headers size before pushing the message
            if the peer enforces it.  This should not fail since we
@@ -1593,13 +1699,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             LogPrintf("ERROR: not pushing 'headers', too large\n");
         else
         {
-            LogPrint("net", "pushing %u headers, %u bytes\n", nCount, nSize);
-            // pindex can be NULL either if we sent chainActive.Tip() OR
-            // if our peer has chainActive.Tip() (and thus we are sending an empty
-            // headers message). In both cases it's safe to update
-            // pindexBestHeaderSent to be our tip.
-            nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+            LogPrint("net", "pushing %u headers, %u bytes\n", vHeaders.size(), nSize);
+            if (pindexLastSent)
+            {
+                LOCK(cs_main);
+                State(pfrom->GetId())->pindexBestHeaderSent = pindexLastSent;
+            }
+            connman.PushMessage(pfrom, msgMaker.Make(nAuxpowFlags, NetMsgType::HEADERS, vHeaders));
         }
     }
 
@@ -1802,6 +1908,15 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             }
         }
 
+        // The BLOCKTXN and HEADERS handling that this may fall back to is
+        // run after releasing cs_main, since connecting a block must not
+        // be started with cs_main held.
+        bool fProcessBLOCKTXN = false;
+        CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+        bool fRevertToHeaderProcessing = false;
+        CDataStream vHeadersMsg(SER_NETWORK, PROTOCOL_VERSION);
+
+        {
         LOCK(cs_main);
         // If AcceptBlockHeader returned true, it set pindex
         assert(pindex);
@@ -1883,9 +1998,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
                     txn.blockhash = cmpctblock.header.GetHash();
-                    CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
                     blockTxnMsg << txn;
-                    return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, connman);
+                    fProcessBLOCKTXN = true;
                 } else {
                     req.blockhash = pindex->GetBlockHash();
                     connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
@@ -1904,11 +2018,17 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 // Dirty hack to process as if it were just a headers message (TODO: move message handling into their own functions)
                 std::vector<CBlock> headers;
                 headers.push_back(cmpctblock.header);
-                CDataStream vHeadersMsg(SER_NETWORK, PROTOCOL_VERSION);
                 vHeadersMsg << headers;
-                return ProcessMessage(pfrom, NetMsgType::HEADERS, vHeadersMsg, nTimeReceived, chainparams, connman);
+                fRevertToHeaderProcessing = true;
             }
         }
+        } // cs_main
+
+        if (fProcessBLOCKTXN)
+            return ProcessMessage(pfrom, NetMsgType::BLOCKTXN, blockTxnMsg, nTimeReceived, chainparams, connman);
+
+        if (fRevertToHeaderProcessing)
+            return ProcessMessage(pfrom, NetMsgType::HEADERS, vHeadersMsg, nTimeReceived, chainparams, connman);
     }
 
     else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
@@ -1992,11 +2112,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         headers.resize(nCount);
         unsigned nSize = 0;
+        // Measure the size as the peer did when it filled the message
+        const int nAuxpowFlags = GetAuxpowSerializeFlags(pfrom);
         for (unsigned int n = 0; n < nCount; n++) {
             vRecv >> headers[n];
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
 
-            nSize += GetSerializeSize(headers[n], SER_NETWORK, PROTOCOL_VERSION);
+            nSize += GetSerializeSize(headers[n], SER_NETWORK, PROTOCOL_VERSION | nAuxpowFlags);
             if (pfrom->nVersion >= SIZE_HEADERS_LIMIT_VERSION
                   && nSize > MAX_HEADERS_SIZE) {
                 Misbehaving(pfrom->GetId(), 20);
@@ -2202,7 +2324,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         vector<CAddress> vAddr = connman.GetAddresses();
         FastRandomContext insecure_rand;
         BOOST_FOREACH(const CAddress &addr, vAddr)
@@ -2495,6 +2620,10 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman)
             continue;
         }
 
+        // Block headers from peers that negotiated it use the compact auxpow encoding
+        if (strCommand == NetMsgType::HEADERS || strCommand == NetMsgType::BLOCK || strCommand == NetMsgType::CMPCTBLOCK)
+            vRecv.SetVersion(vRecv.GetVersion() | GetAuxpowSerializeFlags(pfrom));
+
         // Process message
         bool fRet = false;
         try
@@ -2556,7 +2685,7 @@ public:
         mp = _mempool;
     }
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b) const
     {
         /* As std::make_heap produces a max-heap, we want the entries with the
          * fewest ancestors/highest fee to sort later. */
@@ -2642,28 +2771,28 @@ bool SendMessages(CNode* pto, CConnman& connman)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            vector<CAddress> vAddrToSend;
             vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH(const CAddress& addr, pto->vAddrToSend)
             {
-                if (!pto->addrKnown.contains(addr.GetKey()))
+                LOCK(pto->cs_addrSend);
+                vAddrToSend.swap(pto->vAddrToSend);
+                vAddr.reserve(vAddrToSend.size());
+                BOOST_FOREACH(const CAddress& addr, vAddrToSend)
                 {
-                    pto->addrKnown.insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
+                    if (!pto->addrKnown.contains(addr.GetKey()))
                     {
-                        connman.PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, vAddr));
-                        vAddr.clear();
+                        pto->addrKnown.insert(addr.GetKey());
+                        vAddr.push_back(addr);
                     }
                 }
             }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                connman.PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, vAddr));
-            // we only send the big addr message once
-            if (pto->vAddrToSend.capacity() > 40)
-                pto->vAddrToSend.shrink_to_fit();
+            // receiver rejects addr messages larger than 1000
+            for (size_t i = 0; i < vAddr.size(); i += 1000)
+            {
+                const size_t nEnd = std::min(vAddr.size(), i + 1000);
+                const vector<CAddress> vChunk(vAddr.begin() + i, vAddr.begin() + nEnd);
+                connman.PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, vChunk));
+            }
         }
 
         // Start block sync
@@ -2775,7 +2904,7 @@ bool SendMessages(CNode* pto, CConnman& connman)
                     CBlock block;
                     assert(ReadBlockFromDisk(block, pBestIndex, consensusParams));
                     CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
-                    int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+                    int nSendFlags = (state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS) | GetAuxpowSerializeFlags(pto);
                     connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                     state.pindexBestHeaderSent = pBestIndex;
                 } else if (state.fPreferHeaders) {
@@ -2788,7 +2917,7 @@ bool SendMessages(CNode* pto, CConnman& connman)
                         LogPrint("net", "%s: sending header %s to peer=%d\n", __func__,
                                 vHeaders.front().GetHash().ToString(), pto->id);
                     }
-                    connman.PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    connman.PushMessage(pto, msgMaker.Make(GetAuxpowSerializeFlags(pto), NetMsgType::HEADERS, vHeaders));
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
                     fRevertToInv = true;
@@ -2989,6 +3118,7 @@ bool SendMessages(CNode* pto, CConnman& connman)
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindSnapshotHistoryToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto, pindex->pprev, consensusParams);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -16,10 +16,7 @@ GetLastBlockIndex(const CBlockIndex* pindex, PowAlgo algo)
     if (!pindex)
         return NULL;
 
-    while (pindex && (pindex->GetAlgo() != algo))
-        pindex = pindex->pprev;
-
-    return pindex;
+    return pindex->GetLastOfAlgo(algo);
 }
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
@@ -267,6 +267,10 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_AUXPOW_COMPACT means the node can receive block headers with the
+    // compact auxpow encoding, and sends them that way to peers that signal
+    // it as well.
+    NODE_AUXPOW_COMPACT = (1 << 5),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
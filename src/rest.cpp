@@ -5,6 +5,8 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "game/db.h"
+#include "game/state.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "names/common.h"
@@ -14,14 +16,19 @@
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "ui_interface.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/dynamic_bitset.hpp>
+#include <boost/foreach.hpp>
 
 #include <univalue.h>
 
+#include <map>
+#include <memory>
+
 using namespace std;
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
@@ -44,16 +51,19 @@ static const struct {
 };
 
 struct CCoin {
-    uint32_t nTxVer; // Don't call this nVersion, that name has a special meaning inside IMPLEMENT_SERIALIZE
     uint32_t nHeight;
     CTxOut out;
 
     ADD_SERIALIZE_METHODS;
 
+    CCoin() : nHeight(0) {}
+    CCoin(Coin&& in) : nHeight(in.nHeight), out(std::move(in.out)) {}
+
     template <typename Stream, typename Operation>
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
-        READWRITE(nTxVer);
+        uint32_t nTxVerDummy = 0;
+        READWRITE(nTxVerDummy);
         READWRITE(nHeight);
         READWRITE(out);
     }
@@ -567,21 +577,10 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
             view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
 
         for (size_t i = 0; i < vOutPoints.size(); i++) {
-            CCoins coins;
-            uint256 hash = vOutPoints[i].hash;
-            if (view.GetCoins(hash, coins)) {
-                mempool.pruneSpent(hash, coins);
-                if (coins.IsAvailable(vOutPoints[i].n)) {
-                    hits[i] = true;
-                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
-                    // n is valid but points to an already spent output (IsNull).
-                    CCoin coin;
-                    coin.nTxVer = coins.nVersion;
-                    coin.nHeight = coins.nHeight;
-                    coin.out = coins.vout.at(vOutPoints[i].n);
-                    assert(!coin.out.IsNull());
-                    outs.push_back(coin);
-                }
+            Coin coin;
+            if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i])) {
+                hits[i] = true;
+                outs.emplace_back(std::move(coin));
             }
 
             bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
@@ -624,7 +623,6 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
         UniValue utxos(UniValue::VARR);
         BOOST_FOREACH (const CCoin& coin, outs) {
             UniValue utxo(UniValue::VOBJ);
-            utxo.push_back(Pair("txvers", (int32_t)coin.nTxVer));
             utxo.push_back(Pair("height", (int32_t)coin.nHeight));
             utxo.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
 
@@ -706,6 +704,267 @@ static bool rest_name(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Serialise the game state for the given block hash in the given format.
+ * The binary and hex formats pass on the serialised state from the game db
+ * directly, without constructing a GameState at all if the state is readily
+ * available.  Returns false if the state could not be fetched.
+ */
+static bool GetGameStateData(const uint256& hash, RetFormat rf, std::string& strData)
+{
+    if (rf == RF_JSON) {
+        GameState state(Params().GetConsensus());
+        if (!pgameDb->get(hash, state))
+            return false;
+        strData = state.ToJsonValue().write() + "\n";
+        return true;
+    }
+
+    CDataStream ssState(SER_NETWORK, PROTOCOL_VERSION);
+    if (!pgameDb->getSerialized(hash, ssState))
+        return false;
+    if (rf == RF_HEX)
+        strData = HexStr(ssState.begin(), ssState.end()) + "\n";
+    else
+        strData = ssState.str();
+    return true;
+}
+
+/** Write out the game state for the given block hash in the requested format.  */
+static bool WriteGameState(HTTPRequest* req, const uint256& hash, RetFormat rf)
+{
+    std::string strContentType;
+    switch (rf)
+    {
+    case RF_BINARY:
+        strContentType = "application/octet-stream";
+        break;
+    case RF_HEX:
+        strContentType = "text/plain";
+        break;
+    case RF_JSON:
+        strContentType = "application/json";
+        break;
+    default:
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "output format not found (available: "
+                        + AvailableDataFormatsString() + ")");
+    }
+
+    std::string strData;
+    if (!GetGameStateData(hash, rf, strData))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR,
+                       "Failed to fetch game state");
+    req->WriteHeader("Content-Type", strContentType);
+    req->WriteReply(HTTP_OK, strData);
+    return true;
+}
+
+/**
+ * Clients of /rest/game/stream.  Each new game state is serialised once
+ * per format and the same data is pushed to all of them.
+ */
+struct GameStreamClient
+{
+    std::shared_ptr<HTTPReplyStream> stream;
+    RetFormat rf;
+    //! Block of the last state sent to the client
+    uint256 hashSent;
+};
+static CCriticalSection cs_gameStreams;
+static std::vector<GameStreamClient> vGameStreams;
+static bool fGameStreamsStopped = false;
+
+/** Serialised game states of one block, by format */
+class GameStreamCache
+{
+private:
+    uint256 hash;
+    std::map<RetFormat, std::shared_ptr<const std::string> > mapData;
+
+public:
+    std::shared_ptr<const std::string> Get(const uint256& hashIn, RetFormat rf)
+    {
+        if (hashIn != hash) {
+            hash = hashIn;
+            mapData.clear();
+        }
+        std::shared_ptr<const std::string>& data = mapData[rf];
+        if (!data) {
+            std::string strData;
+            if (!GetGameStateData(hash, rf, strData))
+                return nullptr;
+            data = std::make_shared<const std::string>(std::move(strData));
+        }
+        return data;
+    }
+};
+static GameStreamCache gameStreamCache;
+
+/**
+ * Send the state at the current tip to all clients that do not have it yet.
+ * cs_gameStreams is locked before cs_main, so that pushes are in order.
+ */
+static void PushGameStates()
+{
+    LOCK(cs_gameStreams);
+    if (vGameStreams.empty())
+        return;
+
+    uint256 hash;
+    {
+        LOCK(cs_main);
+        hash = chainActive.Tip()->GetBlockHash();
+    }
+
+    std::vector<GameStreamClient>::iterator it = vGameStreams.begin();
+    while (it != vGameStreams.end()) {
+        if (it->stream->IsClosed()) {
+            it = vGameStreams.erase(it);
+            continue;
+        }
+        if (it->hashSent != hash) {
+            std::shared_ptr<const std::string> data = gameStreamCache.Get(hash, it->rf);
+            if (!data) {
+                LogPrintf("%s: failed to fetch game state %s\n", __func__, hash.GetHex());
+                return;
+            }
+            it->stream->Write(data);
+            it->hashSent = hash;
+        }
+        ++it;
+    }
+}
+
+static void GameStreamNotifyBlockTip(bool fInitialSync, const CBlockIndex* pindex)
+{
+    if (fInitialSync || !pindex)
+        return;
+    // Load and serialise the state off the validation thread, which may
+    // hold cs_main.  If the queue is full, the next block catches up.
+    if (!EnqueueHTTPWork(PushGameStates))
+        LogPrint("http", "%s: work queue full, game state not pushed\n", __func__);
+}
+
+static bool rest_game_state(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+    }
+
+    return WriteGameState(req, hash, rf);
+}
+
+static bool rest_game_tip(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI: " + param);
+
+    uint256 hash;
+    {
+        LOCK(cs_main);
+        hash = chainActive.Tip()->GetBlockHash();
+    }
+
+    return WriteGameState(req, hash, rf);
+}
+
+static bool rest_game_player(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string encodedName;
+    const RetFormat rf = ParseDataFormat(encodedName, strURIPart);
+
+    valtype plainName;
+    if (!DecodeName(plainName, encodedName))
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Invalid encoded name: " + encodedName);
+
+    if (rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "output format not found (available: json)");
+
+    uint256 hash;
+    {
+        LOCK(cs_main);
+        hash = chainActive.Tip()->GetBlockHash();
+    }
+
+    GameState state(Params().GetConsensus());
+    if (!pgameDb->get(hash, state))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR,
+                       "Failed to fetch game state");
+
+    const PlayerID name = ValtypeToString(plainName);
+    const PlayerStateMap::const_iterator mi = state.players.find(name);
+    if (mi == state.players.end())
+        return RESTERR(req, HTTP_NOT_FOUND, "'" + name + "' not found");
+
+    int crownIndex = -1;
+    if (name == state.crownHolder.player)
+        crownIndex = state.crownHolder.index;
+
+    const std::string strJSON = mi->second.ToJsonValue(crownIndex).write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+/**
+ * Stream the game state:  The state at the current tip is sent right away,
+ * and then the state after each new tip, as one line per state.
+ */
+static bool rest_game_stream(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (!param.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI: " + param);
+
+    std::string strContentType;
+    switch (rf)
+    {
+    case RF_HEX:
+        strContentType = "text/plain";
+        break;
+    case RF_JSON:
+        strContentType = "application/json";
+        break;
+    default:
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "output format not found (available: hex, json)");
+    }
+
+    LOCK(cs_gameStreams);
+    if (fGameStreamsStopped)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Shutting down");
+    req->WriteHeader("Content-Type", strContentType);
+    GameStreamClient client;
+    client.stream = req->StartReplyStream(HTTP_OK);
+    client.rf = rf;
+    vGameStreams.push_back(client);
+    PushGameStates();
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -719,12 +978,17 @@ static const struct {
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/name/", rest_name},
+      {"/rest/game/state/", rest_game_state},
+      {"/rest/game/player/", rest_game_player},
+      {"/rest/game/tip", rest_game_tip},
+      {"/rest/game/stream", rest_game_stream},
 };
 
 bool StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
         RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+    uiInterface.NotifyBlockTip.connect(&GameStreamNotifyBlockTip);
     return true;
 }
 
@@ -736,4 +1000,11 @@ void StopREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
         UnregisterHTTPHandler(uri_prefixes[i].prefix, false);
+    uiInterface.NotifyBlockTip.disconnect(&GameStreamNotifyBlockTip);
+
+    LOCK(cs_gameStreams);
+    BOOST_FOREACH(GameStreamClient& client, vGameStreams)
+        client.stream->End();
+    vGameStreams.clear();
+    fGameStreamsStopped = true;
 }
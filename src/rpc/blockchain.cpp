@@ -10,12 +10,15 @@
 #include "coins.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "game/db.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
+#include "snapshot.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -26,6 +29,7 @@
 
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 #include <mutex>
@@ -79,12 +83,8 @@ double GetDifficulty(const CBlockIndex* blockindex)
 double GetDifficulty(PowAlgo algo)
 {
     const CBlockIndex* pindex = chainActive.Tip();
-    while (pindex)
-    {
-        if (pindex->GetAlgo() == algo)
-            break;
-        pindex = pindex->pprev;
-    }
+    if (pindex)
+        pindex = pindex->GetLastOfAlgo(algo);
 
     if (!pindex)
         return 1.0;
@@ -846,6 +846,22 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
 };
 
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    const Coin& first = outputs.begin()->second;
+    ss << hash;
+    ss << VARINT(first.nHeight * 4 + (first.fGameTx ? 2 : 0) + (first.fCoinBase ? 1 : 0));
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out;
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+    }
+    ss << VARINT(0);
+}
+
 //! Calculate statistics about the unspent transaction output set
 static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 {
@@ -858,32 +874,29 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    nTotalAmount += out.nValue;
-                }
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                outputs.clear();
             }
-            stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+            stats.nSerializedSize += 32 + 4 + pcursor->GetValueSize();
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
+    if (!outputs.empty()) {
+        ApplyStats(stats, ss, prevkey, outputs);
+    }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -901,7 +914,7 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
@@ -919,7 +932,7 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
@@ -927,6 +940,147 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue DBStatsToJSON(const CDBStats& stats)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("blockcache", (int64_t)stats.options.nBlockCacheSize));
+    ret.push_back(Pair("writebuffer", (int64_t)stats.options.nWriteBufferSize));
+    ret.push_back(Pair("bloombits", stats.options.nBloomBits));
+    ret.push_back(Pair("maxopenfiles", stats.options.nMaxOpenFiles));
+    ret.push_back(Pair("reads", (int64_t)stats.nReads));
+    ret.push_back(Pair("hits", (int64_t)stats.nHits));
+    ret.push_back(Pair("usage", (int64_t)stats.nMemoryUsage));
+    ret.push_back(Pair("files", (int64_t)stats.nFiles));
+    return ret;
+}
+
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the settings and read statistics of the LevelDB databases.\n"
+            "The counters start at zero when the node is started.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"chainstate\": {           (object) The coin and name database\n"
+            "    \"blockcache\": n,        (numeric) Size of the block cache in bytes\n"
+            "    \"writebuffer\": n,       (numeric) Size of the write buffer in bytes\n"
+            "    \"bloombits\": n,         (numeric) Bits per key of the bloom filters, 0 if disabled\n"
+            "    \"maxopenfiles\": n,      (numeric) Number of table files kept open\n"
+            "    \"reads\": n,             (numeric) Number of point reads\n"
+            "    \"hits\": n,              (numeric) Number of point reads that found their key\n"
+            "    \"usage\": n,             (numeric) Estimated memory usage in bytes\n"
+            "    \"files\": n              (numeric) Number of table files\n"
+            "  },\n"
+            "  \"names\": {                (object) Lookups of name data in the chainstate\n"
+            "    \"reads\": n,             (numeric) Number of lookups\n"
+            "    \"hits\": n               (numeric) Number of lookups that found the name\n"
+            "  },\n"
+            "  \"blockindex\": { ... },    (object) The block index, same fields as chainstate\n"
+            "  \"gamestates\": { ... }     (object) The game state database, same fields as chainstate\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    if (pcoinsdbview) {
+        ret.push_back(Pair("chainstate", DBStatsToJSON(pcoinsdbview->GetDBStats())));
+        uint64_t nReads, nHits;
+        pcoinsdbview->GetNameStats(nReads, nHits);
+        UniValue names(UniValue::VOBJ);
+        names.push_back(Pair("reads", (int64_t)nReads));
+        names.push_back(Pair("hits", (int64_t)nHits));
+        ret.push_back(Pair("names", names));
+    }
+    if (pblocktree)
+        ret.push_back(Pair("blockindex", DBStatsToJSON(pblocktree->GetStats())));
+    if (pgameDb)
+        ret.push_back(Pair("gamestates", DBStatsToJSON(pgameDb->getDBStats())));
+    return ret;
+}
+
+static UniValue SnapshotStatsToJSON(const std::string& strPath, const CSnapshotStats& stats)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("path", strPath));
+    ret.push_back(Pair("blockhash", stats.metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("height", stats.metadata.nHeight));
+    ret.push_back(Pair("coins", (int64_t)stats.nCoins));
+    ret.push_back(Pair("names", (int64_t)stats.nNames));
+    ret.push_back(Pair("hash", stats.hash.GetHex()));
+    return ret;
+}
+
+UniValue dumpsnapshot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "dumpsnapshot \"path\"\n"
+            "\nWrites the unspent outputs, names and game state at the current tip to a new file.\n"
+            "A node that has only synced the block headers can start from it with loadsnapshot.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"         (string, required) The file to write, relative to the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"...\",        (string) the file that was written\n"
+            "  \"blockhash\": \"hex\",   (string) the block the snapshot was taken at\n"
+            "  \"height\": n,            (numeric) its height\n"
+            "  \"coins\": n,             (numeric) the number of unspent outputs\n"
+            "  \"names\": n,             (numeric) the number of names\n"
+            "  \"hash\": \"hex\"         (string) the hash of the snapshot's contents\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumpsnapshot", "\"utxo.dat\"")
+            + HelpExampleRpc("dumpsnapshot", "\"utxo.dat\"")
+        );
+
+    const boost::filesystem::path path = boost::filesystem::absolute(request.params[0].get_str(), GetDataDir());
+    CSnapshotStats stats;
+    std::string strError;
+    if (!DumpSnapshot(path, stats, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    return SnapshotStatsToJSON(path.string(), stats);
+}
+
+UniValue loadsnapshot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw runtime_error(
+            "loadsnapshot \"path\"\n"
+            "\nReplaces the chainstate with one written by dumpsnapshot.  This is only possible\n"
+            "before any blocks are connected, and once the headers up to the snapshot's block\n"
+            "are synced.  The node continues from that block at once, and the blocks before it\n"
+            "are downloaded and checked against the snapshot in the background.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"         (string, required) The file to read, relative to the data directory\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"path\": \"...\",        (string) the file that was read\n"
+            "  \"blockhash\": \"hex\",   (string) the block the snapshot was taken at\n"
+            "  \"height\": n,            (numeric) its height\n"
+            "  \"coins\": n,             (numeric) the number of unspent outputs\n"
+            "  \"names\": n,             (numeric) the number of names\n"
+            "  \"hash\": \"hex\"         (string) the hash of the snapshot's contents\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("loadsnapshot", "\"utxo.dat\"")
+            + HelpExampleRpc("loadsnapshot", "\"utxo.dat\"")
+        );
+
+    const boost::filesystem::path path = boost::filesystem::absolute(request.params[0].get_str(), GetDataDir());
+    CSnapshotStats stats;
+    std::string strError;
+    if (!LoadSnapshot(path, stats, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    return SnapshotStatsToJSON(path.string(), stats);
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -952,7 +1106,6 @@ UniValue gettxout(const JSONRPCRequest& request)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "  \"bounty\" : true|false     (boolean) Game bounty or not\n"
             "}\n"
@@ -977,34 +1130,34 @@ UniValue gettxout(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
-    CCoins coins;
+    COutPoint out(hash, n);
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) { // TODO: filtering spent coins should be done by the CCoinsViewMemPool
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        }
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin)) {
             return NullUniValue;
+        }
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT) {
         ret.push_back(Pair("confirmations", 0));
-    else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+    } else {
+        ret.push_back(Pair("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1)));
+    }
+    ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.IsCoinBase()));
-    ret.push_back(Pair("bounty", coins.IsGameTx()));
+    ret.push_back(Pair("coinbase", (bool)coin.fCoinBase));
+    ret.push_back(Pair("bounty", (bool)coin.fGameTx));
 
     return ret;
 }
@@ -1115,6 +1268,11 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
             "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
             "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored\n"
+            "  \"snapshot\": {             (object) only while the history of a loaded UTXO snapshot is not validated\n"
+            "     \"blockhash\": \"...\",   (string) the block the snapshot was taken at\n"
+            "     \"height\": xxxxxx,       (numeric) its height\n"
+            "     \"historyheight\": xxxxxx, (numeric) the height up to which all blocks before it were downloaded\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1173,6 +1331,15 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
 
         obj.push_back(Pair("pruneheight",        block->nHeight));
     }
+
+    if (pindexSnapshotBase)
+    {
+        UniValue snapshot(UniValue::VOBJ);
+        snapshot.push_back(Pair("blockhash", pindexSnapshotBase->GetBlockHash().GetHex()));
+        snapshot.push_back(Pair("height", pindexSnapshotBase->nHeight));
+        snapshot.push_back(Pair("historyheight", GetSnapshotHistoryHeight()));
+        obj.push_back(Pair("snapshot", snapshot));
+    }
     return obj;
 }
 
@@ -1443,33 +1610,36 @@ UniValue reconsiderblock(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true  },
-    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
-
-    { "blockchain",         "preciousblock",          &preciousblock,          true  },
+{ //  category              name                      actor (function)         okSafeMode  queue               readonly
+  //  --------------------- ------------------------  -----------------------  ----------  ------------------  --------
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getblock",               &getblock,               true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,       RPC_QUEUE_HEAVY,    true  },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "gettxout",               &gettxout,               true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,       RPC_QUEUE_HEAVY,    true  },
+    { "blockchain",         "verifychain",            &verifychain,            true,       RPC_QUEUE_HEAVY,    true  },
+    { "blockchain",         "getdbstats",             &getdbstats,             true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "dumpsnapshot",           &dumpsnapshot,           true,       RPC_QUEUE_HEAVY,    false },
+    { "blockchain",         "loadsnapshot",           &loadsnapshot,           true,       RPC_QUEUE_HEAVY,    false },
+
+    { "blockchain",         "preciousblock",          &preciousblock,          true,       RPC_QUEUE_CHEAP,    false },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
-    { "hidden",             "waitfornewblock",        &waitfornewblock,        true  },
-    { "hidden",             "waitforblock",           &waitforblock,           true  },
-    { "hidden",             "waitforblockheight",     &waitforblockheight,     true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,       RPC_QUEUE_CHEAP,    false },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,       RPC_QUEUE_CHEAP,    false },
+    { "hidden",             "waitfornewblock",        &waitfornewblock,        true,       RPC_QUEUE_LONGPOLL, true  },
+    { "hidden",             "waitforblock",           &waitforblock,           true,       RPC_QUEUE_LONGPOLL, true  },
+    { "hidden",             "waitforblockheight",     &waitforblockheight,     true,       RPC_QUEUE_LONGPOLL, true  },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &t)
@@ -211,7 +211,8 @@ game_waitforchange (const JSONRPCRequest& request)
   if (request.fHelp || request.params.size () > 1)
     throw std::runtime_error (
         "game_waitforchange (\"hash\")\n"
-        "\nDo not use this call in new applications.  Instead, -blocknotify\n"
+        "\nDo not use this call in new applications.  Instead, the game state\n"
+        "stream of the REST interface (/rest/game/stream.json), -blocknotify\n"
         "or the ZeroMQ system should be used.\n"
       );
 
@@ -311,12 +312,12 @@ game_getpath (const JSONRPCRequest& request)
 /* ************************************************************************** */
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "game",               "game_getplayerstate",    &game_getplayerstate,    true },
-    { "game",               "game_getstate",          &game_getstate,          true },
-    { "game",               "game_getpath",           &game_getpath,           true },
-    { "game",               "game_waitforchange",     &game_waitforchange,     true },
+{ //  category              name                      actor (function)         okSafeMode  queue               readonly
+  //  --------------------- ------------------------  -----------------------  ----------  ------------------  --------
+    { "game",               "game_getplayerstate",    &game_getplayerstate,    true,       RPC_QUEUE_CHEAP,    true  },
+    { "game",               "game_getstate",          &game_getstate,          true,       RPC_QUEUE_HEAVY,    true  },
+    { "game",               "game_getpath",           &game_getpath,           true,       RPC_QUEUE_CHEAP,    true  },
+    { "game",               "game_waitforchange",     &game_waitforchange,     true,       RPC_QUEUE_LONGPOLL, true  },
 };
 
 void RegisterGameRPCCommands(CRPCTable &tableRPC)
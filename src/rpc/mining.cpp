@@ -1136,21 +1136,21 @@ UniValue getauxblock(const JSONRPCRequest& request)
 /* ************************************************************************** */
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
-    { "mining",             "getauxblock",            &getauxblock,            true  },
-
-    { "generating",         "generate",               &generate,               true  },
-    { "generating",         "generatetoaddress",      &generatetoaddress,      true  },
-
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       true  },
-    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true  },
+{ //  category              name                      actor (function)         okSafeMode  queue               readonly
+  //  --------------------- ------------------------  -----------------------  ----------  ------------------  --------
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,       RPC_QUEUE_CHEAP,    true  },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,       RPC_QUEUE_CHEAP,    true  },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,       RPC_QUEUE_CHEAP,    false },
+    { "mining",             "submitblock",            &submitblock,            true,       RPC_QUEUE_CHEAP,    false },
+    { "mining",             "getauxblock",            &getauxblock,            true,       RPC_QUEUE_CHEAP,    false },
+
+    { "generating",         "generate",               &generate,               true,       RPC_QUEUE_HEAVY,    false },
+    { "generating",         "generatetoaddress",      &generatetoaddress,      true,       RPC_QUEUE_HEAVY,    false },
+
+    { "util",               "estimatefee",            &estimatefee,            true,       RPC_QUEUE_CHEAP,    true  },
+    { "util",               "estimatepriority",       &estimatepriority,       true,       RPC_QUEUE_CHEAP,    true  },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       true,       RPC_QUEUE_CHEAP,    true  },
+    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true,       RPC_QUEUE_CHEAP,    true  },
 };
 
 void RegisterMiningRPCCommands(CRPCTable &t)
@@ -12,6 +12,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
+#include "script/names.h"
 #include "timedata.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -594,18 +595,18 @@ getstatsforheight (const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "control",            "getmemoryinfo",          &getmemoryinfo,          true  },
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true  },
-    { "blockchain",         "getstatsforheight",      &getstatsforheight,      true  },
+{ //  category              name                      actor (function)         okSafeMode  queue               readonly
+  //  --------------------- ------------------------  -----------------------  ----------  ------------------  --------
+    { "control",            "getinfo",                &getinfo,                true,       RPC_QUEUE_CHEAP,    true  }, /* uses wallet if enabled */
+    { "control",            "getmemoryinfo",          &getmemoryinfo,          true,       RPC_QUEUE_CHEAP,    true  },
+    { "util",               "validateaddress",        &validateaddress,        true,       RPC_QUEUE_CHEAP,    true  }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,       RPC_QUEUE_CHEAP,    true  },
+    { "util",               "verifymessage",          &verifymessage,          true,       RPC_QUEUE_CHEAP,    true  },
+    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true,       RPC_QUEUE_CHEAP,    true  },
+    { "blockchain",         "getstatsforheight",      &getstatsforheight,      true,       RPC_QUEUE_HEAVY,    true  },
 
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "setmocktime",            &setmocktime,            true,       RPC_QUEUE_CHEAP,    false },
 };
 
 void RegisterMiscRPCCommands(CRPCTable &t)
@@ -547,14 +547,14 @@ name_checkdb (const JSONRPCRequest& request)
 /* ************************************************************************** */
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "namecoin",           "name_show",              &name_show,              false },
-    { "namecoin",           "name_history",           &name_history,           false },
-    { "namecoin",           "name_scan",              &name_scan,              false },
-    { "namecoin",           "name_filter",            &name_filter,            false },
-    { "namecoin",           "name_pending",           &name_pending,           true  },
-    { "namecoin",           "name_checkdb",           &name_checkdb,           false },
+{ //  category              name                      actor (function)         okSafeMode  queue               readonly
+  //  --------------------- ------------------------  -----------------------  ----------  ------------------  --------
+    { "namecoin",           "name_show",              &name_show,              false,      RPC_QUEUE_CHEAP,    true  },
+    { "namecoin",           "name_history",           &name_history,           false,      RPC_QUEUE_CHEAP,    true  },
+    { "namecoin",           "name_scan",              &name_scan,              false,      RPC_QUEUE_HEAVY,    true  },
+    { "namecoin",           "name_filter",            &name_filter,            false,      RPC_QUEUE_HEAVY,    true  },
+    { "namecoin",           "name_pending",           &name_pending,           true,       RPC_QUEUE_CHEAP,    true  },
+    { "namecoin",           "name_checkdb",           &name_checkdb,           false,      RPC_QUEUE_HEAVY,    true  },
 };
 
 void RegisterNameRPCCommands(CRPCTable &tableRPC)
@@ -594,20 +594,20 @@ UniValue setnetworkactive(const JSONRPCRequest& request)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "network",            "getconnectioncount",     &getconnectioncount,     true  },
-    { "network",            "ping",                   &ping,                   true  },
-    { "network",            "getpeerinfo",            &getpeerinfo,            true  },
-    { "network",            "addnode",                &addnode,                true  },
-    { "network",            "disconnectnode",         &disconnectnode,         true  },
-    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
-    { "network",            "getnettotals",           &getnettotals,           true  },
-    { "network",            "getnetworkinfo",         &getnetworkinfo,         true  },
-    { "network",            "setban",                 &setban,                 true  },
-    { "network",            "listbanned",             &listbanned,             true  },
-    { "network",            "clearbanned",            &clearbanned,            true  },
-    { "network",            "setnetworkactive",       &setnetworkactive,       true, },
+{ //  category              name                      actor (function)         okSafeMode  queue               readonly
+  //  --------------------- ------------------------  -----------------------  ----------  ------------------  --------
+    { "network",            "getconnectioncount",     &getconnectioncount,     true,       RPC_QUEUE_CHEAP,    true  },
+    { "network",            "ping",                   &ping,                   true,       RPC_QUEUE_CHEAP,    false },
+    { "network",            "getpeerinfo",            &getpeerinfo,            true,       RPC_QUEUE_CHEAP,    true  },
+    { "network",            "addnode",                &addnode,                true,       RPC_QUEUE_CHEAP,    false },
+    { "network",            "disconnectnode",         &disconnectnode,         true,       RPC_QUEUE_CHEAP,    false },
+    { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,       RPC_QUEUE_CHEAP,    true  },
+    { "network",            "getnettotals",           &getnettotals,           true,       RPC_QUEUE_CHEAP,    true  },
+    { "network",            "getnetworkinfo",         &getnetworkinfo,         true,       RPC_QUEUE_CHEAP,    true  },
+    { "network",            "setban",                 &setban,                 true,       RPC_QUEUE_CHEAP,    false },
+    { "network",            "listbanned",             &listbanned,             true,       RPC_QUEUE_CHEAP,    true  },
+    { "network",            "clearbanned",            &clearbanned,            true,       RPC_QUEUE_CHEAP,    false },
+    { "network",            "setnetworkactive",       &setnetworkactive,       true,       RPC_QUEUE_CHEAP,    false },
 };
 
 void RegisterNetRPCCommands(CRPCTable &t)
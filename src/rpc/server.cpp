@@ -25,7 +25,10 @@
 #include <boost/thread.hpp>
 #include <boost/algorithm/string/case_conv.hpp> // for to_upper()
 
+#include <atomic>
+#include <condition_variable>
 #include <memory> // for unique_ptr
+#include <mutex>
 
 using namespace RPCServer;
 using namespace std;
@@ -268,11 +271,11 @@ UniValue stop(const JSONRPCRequest& jsonRequest)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  queue               readonly
+  //  --------------------- ------------------------  -----------------------  ----------  ------------------  --------
     /* Overall control/query calls */
-    { "control",            "help",                   &help,                   true  },
-    { "control",            "stop",                   &stop,                   true  },
+    { "control",            "help",                   &help,                   true,       RPC_QUEUE_CHEAP,    true  },
+    { "control",            "stop",                   &stop,                   true,       RPC_QUEUE_CHEAP,    false },
 };
 
 CRPCTable::CRPCTable()
@@ -387,13 +390,15 @@ void JSONRPCRequest::parse(const UniValue& valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
 }
 
-static UniValue JSONRPCExecOne(const UniValue& req)
+static UniValue JSONRPCExecOne(const UniValue& req, int64_t nDeadline)
 {
     UniValue rpc_result(UniValue::VOBJ);
 
     JSONRPCRequest jreq;
     try {
         jreq.parse(req);
+        if (nDeadline && GetTimeMillis() > nDeadline)
+            throw JSONRPCError(RPC_MISC_ERROR, "Batch time budget exceeded");
 
         UniValue result = tableRPC.execute(jreq);
         rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
@@ -411,11 +416,100 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** Whether a call in a batch may run in parallel with the calls around it */
+static bool IsParallelBatchCall(const UniValue& req)
 {
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req, "method");
+    if (!method.isStr())
+        return false;
+    const CRPCCommand* pcmd = tableRPC[method.get_str()];
+    return pcmd && pcmd->fReadOnly && pcmd->queue == RPC_QUEUE_CHEAP;
+}
+
+/**
+ * A run of calls in a batch that are executed in parallel.  Every thread
+ * working on it takes the next call until there are none left, so that
+ * helpers which start late simply find nothing to do.
+ */
+class CRPCBatchRun
+{
+private:
+    //! The batch, only accessed for calls that have been taken
+    const UniValue* pvReq;
+    const unsigned int nBegin;
+    const unsigned int nEnd;
+    const int64_t nDeadline;
+    std::atomic<unsigned int> nNext;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned int nDone;
+
+public:
+    //! The replies of the run's calls, complete after Wait
+    std::vector<UniValue> vResults;
+
+    CRPCBatchRun(const UniValue& vReq, unsigned int nBeginIn, unsigned int nEndIn, int64_t nDeadlineIn) :
+        pvReq(&vReq), nBegin(nBeginIn), nEnd(nEndIn), nDeadline(nDeadlineIn), nNext(nBeginIn), nDone(0),
+        vResults(nEndIn - nBeginIn)
+    {
+    }
+
+    void Work()
+    {
+        while (true) {
+            const unsigned int i = nNext++;
+            if (i >= nEnd)
+                return;
+            vResults[i - nBegin] = JSONRPCExecOne((*pvReq)[i], nDeadline);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++nDone == nEnd - nBegin)
+                cond.notify_all();
+        }
+    }
+
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (nDone < nEnd - nBegin)
+            cond.wait(lock);
+    }
+};
+
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCDispatchFunction& dispatch, unsigned int nHelpers)
+{
+    const int64_t nTimeout = GetArg("-rpcbatchtimeout", DEFAULT_RPC_BATCH_TIMEOUT);
+    const int64_t nDeadline = nTimeout > 0 ? GetTimeMillis() + nTimeout * 1000 : 0;
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        unsigned int nEnd = reqIdx;
+        if (dispatch && nHelpers > 0)
+            while (nEnd < vReq.size() && IsParallelBatchCall(vReq[nEnd]))
+                nEnd++;
+
+        // Calls that change state are executed one at a time, in order
+        if (nEnd < reqIdx + 2) {
+            ret.push_back(JSONRPCExecOne(vReq[reqIdx], nDeadline));
+            reqIdx++;
+            continue;
+        }
+
+        std::shared_ptr<CRPCBatchRun> run = std::make_shared<CRPCBatchRun>(vReq, reqIdx, nEnd, nDeadline);
+        const unsigned int nWant = std::min(nHelpers, nEnd - reqIdx - 1);
+        for (unsigned int i = 0; i < nWant; i++)
+            if (!dispatch([run]() { run->Work(); }))
+                break;
+        run->Work();
+        run->Wait();
+        BOOST_FOREACH(const UniValue& result, run->vResults)
+            ret.push_back(result);
+        reqIdx = nEnd;
+    }
 
     return ret.write() + "\n";
 }
@@ -12,6 +12,7 @@
 #include "script/script.h"
 #include "uint256.h"
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -22,6 +23,8 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Default time budget for a JSON-RPC batch in seconds, 0 for no limit */
+static const int DEFAULT_RPC_BATCH_TIMEOUT = 0;
 
 class CRPCCommand;
 
@@ -136,6 +139,19 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 
 typedef UniValue(*rpcfn_type)(const JSONRPCRequest& jsonRequest);
 
+/** HTTP server work queue that a command is handled on */
+enum RPCQueue
+{
+    //! Cheap calls, on the normal work queue
+    RPC_QUEUE_CHEAP,
+    //! Expensive calls, on a separate queue so that they do not delay
+    //! cheap calls
+    RPC_QUEUE_HEAVY,
+    //! Calls that wait for an event (long-polls), on a queue of their own
+    //! so that idle waiters hold up neither cheap nor expensive calls
+    RPC_QUEUE_LONGPOLL,
+};
+
 class CRPCCommand
 {
 public:
@@ -143,6 +159,10 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    RPCQueue queue;
+    //! Does not change any state, so that it can run in parallel with the
+    //! calls around it in a JSON-RPC batch
+    bool fReadOnly;
 };
 
 /**
@@ -215,7 +235,21 @@ extern UniValue GameInputToJSON(const CScript& scriptSig);
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+
+/**
+ * Queue a function to run on another RPC thread.  Returns false if it
+ * could not be queued.
+ */
+typedef std::function<bool(const std::function<void()>&)> RPCDispatchFunction;
+
+/**
+ * Execute a JSON-RPC batch and return the reply.  Runs of cheap read-only
+ * calls are spread over up to nHelpers other threads through dispatch,
+ * while the calling thread works on them as well.  The replies are in
+ * request order.  Calls that are not started within the -rpcbatchtimeout
+ * budget are answered with an error.
+ */
+std::string JSONRPCExecBatch(const UniValue& vReq, const RPCDispatchFunction& dispatch = RPCDispatchFunction(), unsigned int nHelpers = 0);
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 
 // Retrieves any serialization flags requested in command line argument
@@ -10,8 +10,7 @@
 
 #include <vector>
 
-// DoS prevention: limit cache size to less than 40MB (over 500000
-// entries on 64-bit systems).
+// DoS prevention: limit cache size to 40MiB (over 1300000 entries).
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 40;
 
 class CPubKey;
@@ -27,4 +26,8 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/** Allocate the signature cache according to -maxsigcachesize.  This must
+    be called before any signatures are checked.  */
+void InitSignatureCache();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,138 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* 8-way interleaved scrypt-1024-1-1-256 using AVX2.  Word k of the scrypt
+   state of lane l is kept in element l of X[k], so that the Salsa20/8 core
+   runs on eight independent hashes at once.  The scratchpad uses the same
+   layout; the data-dependent reads of the second loop are done with a
+   gather.  The function is compiled for AVX2 via a target attribute and
+   must only be called after checking the CPU supports it.  */
+
+#include "scrypt/scrypt.h"
+
+#if defined(USE_SCRYPT_MULTILANE)
+
+#include <string.h>
+
+#include <immintrin.h>
+
+#define SCRYPT_AVX2 __attribute__((target("avx2")))
+
+#define ROTL8(a, b) \
+    _mm256_or_si256(_mm256_slli_epi32((a), (b)), _mm256_srli_epi32((a), 32 - (b)))
+#define QR8(x, a, b, r) \
+    x = _mm256_xor_si256(x, ROTL8(_mm256_add_epi32(a, b), r))
+
+static inline SCRYPT_AVX2 void xor_salsa8_8way(__m256i B[16], const __m256i Bx[16])
+{
+    __m256i x00, x01, x02, x03, x04, x05, x06, x07;
+    __m256i x08, x09, x10, x11, x12, x13, x14, x15;
+    int i;
+
+    x00 = (B[ 0] = _mm256_xor_si256(B[ 0], Bx[ 0]));
+    x01 = (B[ 1] = _mm256_xor_si256(B[ 1], Bx[ 1]));
+    x02 = (B[ 2] = _mm256_xor_si256(B[ 2], Bx[ 2]));
+    x03 = (B[ 3] = _mm256_xor_si256(B[ 3], Bx[ 3]));
+    x04 = (B[ 4] = _mm256_xor_si256(B[ 4], Bx[ 4]));
+    x05 = (B[ 5] = _mm256_xor_si256(B[ 5], Bx[ 5]));
+    x06 = (B[ 6] = _mm256_xor_si256(B[ 6], Bx[ 6]));
+    x07 = (B[ 7] = _mm256_xor_si256(B[ 7], Bx[ 7]));
+    x08 = (B[ 8] = _mm256_xor_si256(B[ 8], Bx[ 8]));
+    x09 = (B[ 9] = _mm256_xor_si256(B[ 9], Bx[ 9]));
+    x10 = (B[10] = _mm256_xor_si256(B[10], Bx[10]));
+    x11 = (B[11] = _mm256_xor_si256(B[11], Bx[11]));
+    x12 = (B[12] = _mm256_xor_si256(B[12], Bx[12]));
+    x13 = (B[13] = _mm256_xor_si256(B[13], Bx[13]));
+    x14 = (B[14] = _mm256_xor_si256(B[14], Bx[14]));
+    x15 = (B[15] = _mm256_xor_si256(B[15], Bx[15]));
+    for (i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        QR8(x04, x00, x12,  7);  QR8(x09, x05, x01,  7);
+        QR8(x14, x10, x06,  7);  QR8(x03, x15, x11,  7);
+
+        QR8(x08, x04, x00,  9);  QR8(x13, x09, x05,  9);
+        QR8(x02, x14, x10,  9);  QR8(x07, x03, x15,  9);
+
+        QR8(x12, x08, x04, 13);  QR8(x01, x13, x09, 13);
+        QR8(x06, x02, x14, 13);  QR8(x11, x07, x03, 13);
+
+        QR8(x00, x12, x08, 18);  QR8(x05, x01, x13, 18);
+        QR8(x10, x06, x02, 18);  QR8(x15, x11, x07, 18);
+
+        /* Operate on rows. */
+        QR8(x01, x00, x03,  7);  QR8(x06, x05, x04,  7);
+        QR8(x11, x10, x09,  7);  QR8(x12, x15, x14,  7);
+
+        QR8(x02, x01, x00,  9);  QR8(x07, x06, x05,  9);
+        QR8(x08, x11, x10,  9);  QR8(x13, x12, x15,  9);
+
+        QR8(x03, x02, x01, 13);  QR8(x04, x07, x06, 13);
+        QR8(x09, x08, x11, 13);  QR8(x14, x13, x12, 13);
+
+        QR8(x00, x03, x02, 18);  QR8(x05, x04, x07, 18);
+        QR8(x10, x09, x08, 18);  QR8(x15, x14, x13, 18);
+    }
+    B[ 0] = _mm256_add_epi32(B[ 0], x00);
+    B[ 1] = _mm256_add_epi32(B[ 1], x01);
+    B[ 2] = _mm256_add_epi32(B[ 2], x02);
+    B[ 3] = _mm256_add_epi32(B[ 3], x03);
+    B[ 4] = _mm256_add_epi32(B[ 4], x04);
+    B[ 5] = _mm256_add_epi32(B[ 5], x05);
+    B[ 6] = _mm256_add_epi32(B[ 6], x06);
+    B[ 7] = _mm256_add_epi32(B[ 7], x07);
+    B[ 8] = _mm256_add_epi32(B[ 8], x08);
+    B[ 9] = _mm256_add_epi32(B[ 9], x09);
+    B[10] = _mm256_add_epi32(B[10], x10);
+    B[11] = _mm256_add_epi32(B[11], x11);
+    B[12] = _mm256_add_epi32(B[12], x12);
+    B[13] = _mm256_add_epi32(B[13], x13);
+    B[14] = _mm256_add_epi32(B[14], x14);
+    B[15] = _mm256_add_epi32(B[15], x15);
+}
+
+SCRYPT_AVX2 void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad)
+{
+    uint8_t B[8][128];
+    union {
+        __m256i v[32];
+        uint32_t u32[32][8];
+    } X;
+    __m256i *V;
+    uint32_t i, k, l;
+
+    V = (__m256i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+    for (l = 0; l < 8; l++) {
+        PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, (const uint8_t *)&input[80 * l], 80, 1, B[l], 128);
+        for (k = 0; k < 32; k++)
+            X.u32[k][l] = le32dec(&B[l][4 * k]);
+    }
+
+    for (i = 0; i < 1024; i++) {
+        for (k = 0; k < 32; k++)
+            _mm256_store_si256(&V[i * 32 + k], X.v[k]);
+        xor_salsa8_8way(&X.v[0], &X.v[16]);
+        xor_salsa8_8way(&X.v[16], &X.v[0]);
+    }
+
+    /* Element l of V[j * 32 + k] is the 32-bit word at index
+       (j * 32 + k) * 8 + l.  */
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i mask = _mm256_set1_epi32(1023);
+    for (i = 0; i < 1024; i++) {
+        const __m256i j = _mm256_add_epi32(_mm256_slli_epi32(_mm256_and_si256(X.v[16], mask), 8), lanes);
+        for (k = 0; k < 32; k++)
+            X.v[k] = _mm256_xor_si256(X.v[k], _mm256_i32gather_epi32((const int *)&V[k], j, 4));
+        xor_salsa8_8way(&X.v[0], &X.v[16]);
+        xor_salsa8_8way(&X.v[16], &X.v[0]);
+    }
+
+    for (l = 0; l < 8; l++) {
+        for (k = 0; k < 32; k++)
+            le32enc(&B[l][4 * k], X.u32[k][l]);
+        PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, B[l], 128, 1, (uint8_t *)&output[32 * l], 32);
+    }
+}
+
+#endif // USE_SCRYPT_MULTILANE
@@ -0,0 +1,134 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* 16-way interleaved scrypt-1024-1-1-256 using AVX-512.  This is the same
+   kernel as scrypt-avx2.cpp with twice the number of lanes, and uses the
+   native rotate instruction.  It must only be called after checking the
+   CPU supports AVX-512F.  */
+
+#include "scrypt/scrypt.h"
+
+#if defined(USE_SCRYPT_MULTILANE)
+
+#include <string.h>
+
+#include <immintrin.h>
+
+#define SCRYPT_AVX512 __attribute__((target("avx512f")))
+
+#define QR16(x, a, b, r) \
+    x = _mm512_xor_si512(x, _mm512_rol_epi32(_mm512_add_epi32(a, b), r))
+
+static inline SCRYPT_AVX512 void xor_salsa8_16way(__m512i B[16], const __m512i Bx[16])
+{
+    __m512i x00, x01, x02, x03, x04, x05, x06, x07;
+    __m512i x08, x09, x10, x11, x12, x13, x14, x15;
+    int i;
+
+    x00 = (B[ 0] = _mm512_xor_si512(B[ 0], Bx[ 0]));
+    x01 = (B[ 1] = _mm512_xor_si512(B[ 1], Bx[ 1]));
+    x02 = (B[ 2] = _mm512_xor_si512(B[ 2], Bx[ 2]));
+    x03 = (B[ 3] = _mm512_xor_si512(B[ 3], Bx[ 3]));
+    x04 = (B[ 4] = _mm512_xor_si512(B[ 4], Bx[ 4]));
+    x05 = (B[ 5] = _mm512_xor_si512(B[ 5], Bx[ 5]));
+    x06 = (B[ 6] = _mm512_xor_si512(B[ 6], Bx[ 6]));
+    x07 = (B[ 7] = _mm512_xor_si512(B[ 7], Bx[ 7]));
+    x08 = (B[ 8] = _mm512_xor_si512(B[ 8], Bx[ 8]));
+    x09 = (B[ 9] = _mm512_xor_si512(B[ 9], Bx[ 9]));
+    x10 = (B[10] = _mm512_xor_si512(B[10], Bx[10]));
+    x11 = (B[11] = _mm512_xor_si512(B[11], Bx[11]));
+    x12 = (B[12] = _mm512_xor_si512(B[12], Bx[12]));
+    x13 = (B[13] = _mm512_xor_si512(B[13], Bx[13]));
+    x14 = (B[14] = _mm512_xor_si512(B[14], Bx[14]));
+    x15 = (B[15] = _mm512_xor_si512(B[15], Bx[15]));
+    for (i = 0; i < 8; i += 2) {
+        /* Operate on columns. */
+        QR16(x04, x00, x12,  7);  QR16(x09, x05, x01,  7);
+        QR16(x14, x10, x06,  7);  QR16(x03, x15, x11,  7);
+
+        QR16(x08, x04, x00,  9);  QR16(x13, x09, x05,  9);
+        QR16(x02, x14, x10,  9);  QR16(x07, x03, x15,  9);
+
+        QR16(x12, x08, x04, 13);  QR16(x01, x13, x09, 13);
+        QR16(x06, x02, x14, 13);  QR16(x11, x07, x03, 13);
+
+        QR16(x00, x12, x08, 18);  QR16(x05, x01, x13, 18);
+        QR16(x10, x06, x02, 18);  QR16(x15, x11, x07, 18);
+
+        /* Operate on rows. */
+        QR16(x01, x00, x03,  7);  QR16(x06, x05, x04,  7);
+        QR16(x11, x10, x09,  7);  QR16(x12, x15, x14,  7);
+
+        QR16(x02, x01, x00,  9);  QR16(x07, x06, x05,  9);
+        QR16(x08, x11, x10,  9);  QR16(x13, x12, x15,  9);
+
+        QR16(x03, x02, x01, 13);  QR16(x04, x07, x06, 13);
+        QR16(x09, x08, x11, 13);  QR16(x14, x13, x12, 13);
+
+        QR16(x00, x03, x02, 18);  QR16(x05, x04, x07, 18);
+        QR16(x10, x09, x08, 18);  QR16(x15, x14, x13, 18);
+    }
+    B[ 0] = _mm512_add_epi32(B[ 0], x00);
+    B[ 1] = _mm512_add_epi32(B[ 1], x01);
+    B[ 2] = _mm512_add_epi32(B[ 2], x02);
+    B[ 3] = _mm512_add_epi32(B[ 3], x03);
+    B[ 4] = _mm512_add_epi32(B[ 4], x04);
+    B[ 5] = _mm512_add_epi32(B[ 5], x05);
+    B[ 6] = _mm512_add_epi32(B[ 6], x06);
+    B[ 7] = _mm512_add_epi32(B[ 7], x07);
+    B[ 8] = _mm512_add_epi32(B[ 8], x08);
+    B[ 9] = _mm512_add_epi32(B[ 9], x09);
+    B[10] = _mm512_add_epi32(B[10], x10);
+    B[11] = _mm512_add_epi32(B[11], x11);
+    B[12] = _mm512_add_epi32(B[12], x12);
+    B[13] = _mm512_add_epi32(B[13], x13);
+    B[14] = _mm512_add_epi32(B[14], x14);
+    B[15] = _mm512_add_epi32(B[15], x15);
+}
+
+SCRYPT_AVX512 void scrypt_1024_1_1_256_sp_avx512_16way(const char *input, char *output, char *scratchpad)
+{
+    uint8_t B[16][128];
+    union {
+        __m512i v[32];
+        uint32_t u32[32][16];
+    } X;
+    __m512i *V;
+    uint32_t i, k, l;
+
+    V = (__m512i *)(((uintptr_t)(scratchpad) + 63) & ~ (uintptr_t)(63));
+
+    for (l = 0; l < 16; l++) {
+        PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, (const uint8_t *)&input[80 * l], 80, 1, B[l], 128);
+        for (k = 0; k < 32; k++)
+            X.u32[k][l] = le32dec(&B[l][4 * k]);
+    }
+
+    for (i = 0; i < 1024; i++) {
+        for (k = 0; k < 32; k++)
+            _mm512_store_si512(&V[i * 32 + k], X.v[k]);
+        xor_salsa8_16way(&X.v[0], &X.v[16]);
+        xor_salsa8_16way(&X.v[16], &X.v[0]);
+    }
+
+    /* Element l of V[j * 32 + k] is the 32-bit word at index
+       (j * 32 + k) * 16 + l.  */
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i mask = _mm512_set1_epi32(1023);
+    for (i = 0; i < 1024; i++) {
+        const __m512i j = _mm512_add_epi32(_mm512_slli_epi32(_mm512_and_si512(X.v[16], mask), 9), lanes);
+        for (k = 0; k < 32; k++)
+            X.v[k] = _mm512_xor_si512(X.v[k], _mm512_i32gather_epi32(j, (const int *)&V[k], 4));
+        xor_salsa8_16way(&X.v[0], &X.v[16]);
+        xor_salsa8_16way(&X.v[16], &X.v[0]);
+    }
+
+    for (l = 0; l < 16; l++) {
+        for (k = 0; k < 32; k++)
+            le32enc(&B[l][4 * k], X.u32[k][l]);
+        PBKDF2_SHA256((const uint8_t *)&input[80 * l], 80, B[l], 128, 1, (uint8_t *)&output[32 * l], 32);
+    }
+}
+
+#endif // USE_SCRYPT_MULTILANE
@@ -28,12 +28,13 @@
  */
 
 #include "scrypt/scrypt.h"
+#include "crypto/hmac_sha256.h"
 #include "util.h"
 
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <openssl/sha.h>
+#include <memory>
 
 static inline uint32_t be32dec(const void *pp)
 {
@@ -51,74 +52,6 @@ static inline void be32enc(void *pp, uint32_t x)
 	p[0] = (x >> 24) & 0xff;
 }
 
-typedef struct HMAC_SHA256Context {
-	SHA256_CTX ictx;
-	SHA256_CTX octx;
-} HMAC_SHA256_CTX;
-
-/* Initialize an HMAC-SHA256 operation with the given key. */
-static void
-HMAC_SHA256_Init(HMAC_SHA256_CTX *ctx, const void *_K, size_t Klen)
-{
-	unsigned char pad[64];
-	unsigned char khash[32];
-	const unsigned char *K = (const unsigned char *)_K;
-	size_t i;
-
-	/* If Klen > 64, the key is really SHA256(K). */
-	if (Klen > 64) {
-		SHA256_Init(&ctx->ictx);
-		SHA256_Update(&ctx->ictx, K, Klen);
-		SHA256_Final(khash, &ctx->ictx);
-		K = khash;
-		Klen = 32;
-	}
-
-	/* Inner SHA256 operation is SHA256(K xor [block of 0x36] || data). */
-	SHA256_Init(&ctx->ictx);
-	memset(pad, 0x36, 64);
-	for (i = 0; i < Klen; i++)
-		pad[i] ^= K[i];
-	SHA256_Update(&ctx->ictx, pad, 64);
-
-	/* Outer SHA256 operation is SHA256(K xor [block of 0x5c] || hash). */
-	SHA256_Init(&ctx->octx);
-	memset(pad, 0x5c, 64);
-	for (i = 0; i < Klen; i++)
-		pad[i] ^= K[i];
-	SHA256_Update(&ctx->octx, pad, 64);
-
-	/* Clean the stack. */
-	memset(khash, 0, 32);
-}
-
-/* Add bytes to the HMAC-SHA256 operation. */
-static void
-HMAC_SHA256_Update(HMAC_SHA256_CTX *ctx, const void *in, size_t len)
-{
-	/* Feed data to the inner SHA256 operation. */
-	SHA256_Update(&ctx->ictx, in, len);
-}
-
-/* Finish an HMAC-SHA256 operation. */
-static void
-HMAC_SHA256_Final(unsigned char digest[32], HMAC_SHA256_CTX *ctx)
-{
-	unsigned char ihash[32];
-
-	/* Finish the inner SHA256 operation. */
-	SHA256_Final(ihash, &ctx->ictx);
-
-	/* Feed the inner hash to the outer SHA256 operation. */
-	SHA256_Update(&ctx->octx, ihash, 32);
-
-	/* Finish the outer SHA256 operation. */
-	SHA256_Final(digest, &ctx->octx);
-
-	/* Clean the stack. */
-	memset(ihash, 0, 32);
-}
-
 /**
  * PBKDF2_SHA256(passwd, passwdlen, salt, saltlen, c, buf, dkLen):
  * Compute PBKDF2(passwd, salt, c, dkLen) using HMAC-SHA256 as the PRF, and
@@ -128,7 +61,6 @@ void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
     size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen)
 {
-	HMAC_SHA256_CTX PShctx, hctx;
 	size_t i;
 	uint8_t ivec[4];
 	uint8_t U[32];
@@ -137,9 +69,10 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 	int k;
 	size_t clen;
 
-	/* Compute HMAC state after processing P and S. */
-	HMAC_SHA256_Init(&PShctx, passwd, passwdlen);
-	HMAC_SHA256_Update(&PShctx, salt, saltlen);
+	/* Compute HMAC state after processing P, and after processing P and S. */
+	const CHMAC_SHA256 Phctx(passwd, passwdlen);
+	CHMAC_SHA256 PShctx(Phctx);
+	PShctx.Write(salt, saltlen);
 
 	/* Iterate through the blocks. */
 	for (i = 0; i * 32 < dkLen; i++) {
@@ -147,18 +80,16 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 		be32enc(ivec, (uint32_t)(i + 1));
 
 		/* Compute U_1 = PRF(P, S || INT(i)). */
-		memcpy(&hctx, &PShctx, sizeof(HMAC_SHA256_CTX));
-		HMAC_SHA256_Update(&hctx, ivec, 4);
-		HMAC_SHA256_Final(U, &hctx);
+		CHMAC_SHA256 hctx(PShctx);
+		hctx.Write(ivec, 4);
+		hctx.Finalize(U);
 
 		/* T_i = U_1 ... */
 		memcpy(T, U, 32);
 
 		for (j = 2; j <= c; j++) {
 			/* Compute U_j. */
-			HMAC_SHA256_Init(&hctx, passwd, passwdlen);
-			HMAC_SHA256_Update(&hctx, U, 32);
-			HMAC_SHA256_Final(U, &hctx);
+			CHMAC_SHA256(Phctx).Write(U, 32).Finalize(U);
 
 			/* ... xor U_j ... */
 			for (k = 0; k < 32; k++)
@@ -171,9 +102,6 @@ PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
 			clen = 32;
 		memcpy(&buf[i * 32], T, clen);
 	}
-
-	/* Clean PShctx, since we never called _Final on it. */
-	memset(&PShctx, 0, sizeof(HMAC_SHA256_CTX));
 }
 
 #define ROTL(a, b) (((a) << (b)) | ((a) >> (32 - (b))))
@@ -322,3 +250,70 @@ void scrypt_1024_1_1_256(const char *input, char *output)
         scrypt_1024_1_1_256_sp_generic(input, output, scratchpad);
 #endif
 }
+
+#if defined(USE_SCRYPT_MULTILANE)
+static void (*scrypt_multilane)(const char *input, char *output, char *scratchpad) = NULL;
+static size_t scrypt_lanes = 1;
+#endif
+
+const char *scrypt_detect_multilane()
+{
+#if defined(USE_SCRYPT_MULTILANE)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		scrypt_multilane = &scrypt_1024_1_1_256_sp_avx512_16way;
+		scrypt_lanes = 16;
+		return "avx512 (16-way)";
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		scrypt_multilane = &scrypt_1024_1_1_256_sp_avx2_8way;
+		scrypt_lanes = 8;
+		return "avx2 (8-way)";
+	}
+#endif
+	return "standard";
+}
+
+#if defined(USE_SCRYPT_MULTILANE)
+/* The multi-lane scratchpad is too large for the stack.  Each thread
+   allocates one on first use and keeps it, so that batches checked on the
+   same worker thread do not allocate again.  */
+static char *scrypt_multilane_scratchpad()
+{
+	static thread_local std::unique_ptr<char[]> scratchpad;
+	if (!scratchpad)
+		scratchpad.reset(new char[SCRYPT_MULTILANE_SCRATCHPAD_SIZE]);
+	return scratchpad.get();
+}
+#endif
+
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t n)
+{
+#if defined(USE_SCRYPT_MULTILANE)
+	if (scrypt_multilane && n > 1) {
+		char *scratchpad = scrypt_multilane_scratchpad();
+		char in[80 * SCRYPT_MAX_LANES];
+		char out[32 * SCRYPT_MAX_LANES];
+		for (; n >= scrypt_lanes; n -= scrypt_lanes) {
+			scrypt_multilane(input, output, scratchpad);
+			input += 80 * scrypt_lanes;
+			output += 32 * scrypt_lanes;
+		}
+		/* Pad a partial batch with copies of its last input, unless
+		   it is small enough that hashing one by one is faster.  */
+		if (n > 1) {
+			memcpy(in, input, 80 * n);
+			for (size_t i = n; i < scrypt_lanes; i++)
+				memcpy(&in[80 * i], &input[80 * (n - 1)], 80);
+			scrypt_multilane(in, out, scratchpad);
+			memcpy(output, out, 32 * n);
+			n = 0;
+		}
+	}
+#endif
+	for (; n > 0; n--) {
+		scrypt_1024_1_1_256(input, output);
+		input += 80;
+		output += 32;
+	}
+}
@@ -13,6 +13,27 @@ void scrypt_1024_1_1_256_sp_sse2(const char *input, char *output, char *scratchp
 extern void (*scrypt_1024_1_1_256_sp)(const char *input, char *output, char *scratchpad);
 #endif
 
+/* Multi-lane kernels hash several 80-byte inputs (stored back to back) at
+   once.  They are compiled with target attributes and are selected at
+   runtime by scrypt_detect_multilane.  */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define USE_SCRYPT_MULTILANE
+static const int SCRYPT_MAX_LANES = 16;
+void scrypt_1024_1_1_256_sp_avx2_8way(const char *input, char *output, char *scratchpad);
+void scrypt_1024_1_1_256_sp_avx512_16way(const char *input, char *output, char *scratchpad);
+#else
+static const int SCRYPT_MAX_LANES = 1;
+#endif
+static const int SCRYPT_MULTILANE_SCRATCHPAD_SIZE = 131072 * SCRYPT_MAX_LANES + 63;
+
+/* Select the widest multi-lane kernel the CPU supports and return its
+   name.  This should be called once at startup; before (or without) it,
+   the batch function hashes one input at a time.  */
+const char *scrypt_detect_multilane();
+
+/* Hash n 80-byte inputs stored back to back, writing n 32-byte hashes.  */
+void scrypt_1024_1_1_256_batch(const char *input, char *output, size_t n);
+
 void
 PBKDF2_SHA256(const uint8_t *passwd, size_t passwdlen, const uint8_t *salt,
     size_t saltlen, uint64_t c, uint8_t *buf, size_t dkLen);
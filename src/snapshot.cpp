@@ -0,0 +1,450 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "game/db.h"
+#include "game/state.h"
+#include "hash.h"
+#include "init.h"
+#include "names/common.h"
+#include "streams.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+namespace {
+
+/** Number of coins or names written per chunk.  */
+const unsigned int SNAPSHOT_CHUNK_SIZE = 10000;
+/** Directory (in the data dir) the history of a snapshot is connected in.  */
+const char* const SNAPSHOT_CHECK_DIR = "snapshotcheck";
+/** LevelDB cache for the chainstate used to validate a snapshot.  */
+const size_t SNAPSHOT_CHECK_DB_CACHE = 8 << 20;
+
+/** Stream that writes to a file and hashes everything written.  */
+class CHashedFileWriter
+{
+private:
+    CAutoFile& file;
+    CHashWriter hasher;
+
+public:
+    explicit CHashedFileWriter(CAutoFile& fileIn) : file(fileIn), hasher(fileIn.GetType(), fileIn.GetVersion()) {}
+
+    int GetType() const { return file.GetType(); }
+    int GetVersion() const { return file.GetVersion(); }
+
+    void write(const char* pch, size_t nSize)
+    {
+        file.write(pch, nSize);
+        hasher.write(pch, nSize);
+    }
+
+    template<typename T>
+    CHashedFileWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+
+    uint256 GetHash() { return hasher.GetHash(); }
+};
+
+/** Write the entries of a chunk if it is full, or if fLast is set.  */
+template<typename Stream, typename T>
+void WriteChunk(Stream& s, std::vector<T>& vChunk, bool fLast)
+{
+    if (vChunk.size() < SNAPSHOT_CHUNK_SIZE && !fLast)
+        return;
+    if (!vChunk.empty())
+        s << vChunk;
+    vChunk.clear();
+    // An empty chunk ends the list
+    if (fLast)
+        s << vChunk;
+}
+
+/** Write everything in a snapshot except its trailing hash.  */
+template<typename Stream>
+void WriteSnapshotContents(Stream& s, const CSnapshotMetadata& metadata, const CCoinsView& view, const GameState& gameState, CSnapshotStats& stats)
+{
+    s << metadata;
+
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    std::vector<std::pair<COutPoint, Coin> > vCoins;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        boost::this_thread::interruption_point();
+        std::pair<COutPoint, Coin> entry;
+        if (!pcursor->GetKey(entry.first) || !pcursor->GetValue(entry.second))
+            throw std::runtime_error("unable to read coin database");
+        vCoins.push_back(std::move(entry));
+        stats.nCoins++;
+        WriteChunk(s, vCoins, false);
+    }
+    WriteChunk(s, vCoins, true);
+
+    std::unique_ptr<CNameIterator> pnames(view.IterateNames());
+    pnames->seek(valtype());
+    std::vector<std::pair<valtype, CNameData> > vNames;
+    std::pair<valtype, CNameData> name;
+    while (pnames->next(name.first, name.second)) {
+        boost::this_thread::interruption_point();
+        vNames.push_back(name);
+        stats.nNames++;
+        WriteChunk(s, vNames, false);
+    }
+    WriteChunk(s, vNames, true);
+
+    s << gameState;
+}
+
+/** Read a snapshot file and check its trailing hash.  */
+bool CheckSnapshotFile(const boost::filesystem::path& path, uint256& hash, std::string& strError)
+{
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = "unable to open " + path.string();
+        return false;
+    }
+    if (fseek(file.Get(), 0, SEEK_END) != 0 || ftell(file.Get()) < (long)sizeof(uint256)) {
+        strError = "snapshot file is truncated";
+        return false;
+    }
+    size_t nRemaining = ftell(file.Get()) - sizeof(uint256);
+    rewind(file.Get());
+
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    std::vector<char> vBuffer(1 << 20);
+    while (nRemaining > 0) {
+        boost::this_thread::interruption_point();
+        const size_t nRead = std::min(nRemaining, vBuffer.size());
+        file.read(&vBuffer[0], nRead);
+        hasher.write(&vBuffer[0], nRead);
+        nRemaining -= nRead;
+    }
+    uint256 hashFile;
+    file >> hashFile;
+    hash = hasher.GetHash();
+    if (hash != hashFile) {
+        strError = "snapshot file is corrupted";
+        return false;
+    }
+    return true;
+}
+
+/** Check that a snapshot can be loaded now.  */
+bool CheckLoadPreconditions(const CSnapshotMetadata& metadata, std::string& strError)
+{
+    AssertLockHeld(cs_main);
+    if (memcmp(metadata.pchMessageStart, Params().MessageStart(), sizeof(metadata.pchMessageStart)) != 0)
+        strError = "snapshot is for a different network";
+    else if (metadata.nVersion != CSnapshotMetadata::CURRENT_VERSION)
+        strError = strprintf("unsupported snapshot version %u", metadata.nVersion);
+    else if (metadata.nHeight <= 0 || metadata.nChainTx > std::numeric_limits<unsigned int>::max())
+        strError = "invalid snapshot metadata";
+    else if (fPruneMode || fTxIndex || fNameHistory)
+        strError = "snapshots can not be loaded with -prune, -txindex or -namehistory";
+    else if (fReindex || fImporting || pindexSnapshotBase || chainActive.Height() != 0)
+        strError = "snapshots can only be loaded before any blocks are connected";
+    if (!strError.empty())
+        return false;
+
+    BlockMap::const_iterator mi = mapBlockIndex.find(metadata.hashBlock);
+    if (mi == mapBlockIndex.end()) {
+        strError = "the snapshot's block is unknown, wait for the headers to be synced";
+        return false;
+    }
+    const CBlockIndex* pindex = mi->second;
+    if (pindex->nHeight != metadata.nHeight)
+        strError = "the snapshot's block has a different height";
+    else if (pindex->nStatus & BLOCK_FAILED_MASK)
+        strError = "the snapshot's block is invalid";
+    else if (pindexBestHeader->GetAncestor(pindex->nHeight) != pindex)
+        strError = "the snapshot's block is not on the best header chain";
+    return strError.empty();
+}
+
+/** Connect the blocks up to a snapshot in a new chainstate and compare.  */
+bool ValidateSnapshot(const CSnapshotRecord& record, CBlockIndex* pindexBase)
+{
+    const CChainParams& chainparams = Params();
+    const int64_t nStart = GetTimeMillis();
+    LogPrintf("%s: validating the %d blocks up to the UTXO snapshot\n", __func__, pindexBase->nHeight);
+
+    bool fValid = true;
+    {
+        CCoinsViewDB viewDB(SNAPSHOT_CHECK_DB_CACHE, false, true, SNAPSHOT_CHECK_DIR);
+        CCoinsViewCache view(&viewDB);
+        int nLastProgress = 0;
+        for (int nHeight = 0; nHeight <= pindexBase->nHeight; ++nHeight) {
+            boost::this_thread::interruption_point();
+
+            LOCK(cs_main);
+            CBlockIndex* pindex = pindexBase->GetAncestor(nHeight);
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+                return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+            /* Connect the block fully, so that its undo data (holding the
+               game transactions) is written as for any other block.  */
+            CValidationState state;
+            if (!ConnectBlock(block, state, pindex, view, chainparams)) {
+                LogPrintf("%s: block %s is invalid: %s\n", __func__, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
+                fValid = false;
+                break;
+            }
+            if (view.DynamicMemoryUsage() > nCoinCacheUsage / 2 && !view.Flush())
+                return error("%s: failed to write chainstate", __func__);
+
+            const int nProgress = 10 * nHeight / pindexBase->nHeight;
+            if (nProgress > nLastProgress) {
+                LogPrintf("%s: [%d%%]\n", __func__, 10 * nProgress);
+                nLastProgress = nProgress;
+            }
+        }
+
+        if (fValid) {
+            if (!view.Flush())
+                return error("%s: failed to write chainstate", __func__);
+            GameState gameState(chainparams.GetConsensus());
+            if (!pgameDb->get(pindexBase->GetBlockHash(), gameState))
+                return error("%s: failed to get game state", __func__);
+            CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+            CSnapshotStats stats;
+            WriteSnapshotContents(hasher, record.metadata, viewDB, gameState, stats);
+            fValid = (hasher.GetHash() == record.hash);
+        }
+    }
+    boost::filesystem::remove_all(GetDataDir() / SNAPSHOT_CHECK_DIR);
+
+    LOCK(cs_main);
+    if (!fValid || !CompleteSnapshotValidation(record.metadata.nChainTx)) {
+        /* Everything after the snapshot's block was built on a state
+           that the block chain does not lead to, so do not go on with it.
+           The snapshot record stays, so that a restart checks again until
+           the chainstate is rebuilt.  */
+        strMiscWarning = _("Error: The loaded UTXO snapshot does not match the block chain! Rebuild the chainstate using -reindex-chainstate.");
+        LogPrintf("*** %s\n", strMiscWarning);
+        uiInterface.ThreadSafeMessageBox(strMiscWarning, "", CClientUIInterface::MSG_ERROR);
+        StartShutdown();
+        return error("%s: the UTXO snapshot at height %d is invalid", __func__, pindexBase->nHeight);
+    }
+    FlushStateToDisk();
+    pblocktree->EraseSnapshot();
+    pgameDb->setPinned(uint256());
+    LogPrintf("%s: the UTXO snapshot is valid (%.2fs)\n", __func__, (GetTimeMillis() - nStart) * 0.001);
+    return true;
+}
+
+}
+
+bool DumpSnapshot(const boost::filesystem::path& path, CSnapshotStats& stats, std::string& strError)
+{
+    if (boost::filesystem::exists(path)) {
+        strError = path.string() + " already exists";
+        return false;
+    }
+
+    LOCK(cs_main);
+    FlushStateToDisk();
+    const CBlockIndex* pindex = chainActive.Tip();
+    stats.metadata.SetNull();
+    memcpy(stats.metadata.pchMessageStart, Params().MessageStart(), sizeof(stats.metadata.pchMessageStart));
+    stats.metadata.hashBlock = pindex->GetBlockHash();
+    stats.metadata.nHeight = pindex->nHeight;
+    stats.metadata.nChainTx = pindex->nChainTx;
+    assert(pcoinsTip->GetBestBlock() == stats.metadata.hashBlock);
+
+    GameState gameState(Params().GetConsensus());
+    if (!pgameDb->get(stats.metadata.hashBlock, gameState)) {
+        strError = "unable to get the game state";
+        return false;
+    }
+
+    CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = "unable to create " + path.string();
+        return false;
+    }
+    try {
+        CHashedFileWriter writer(file);
+        WriteSnapshotContents(writer, stats.metadata, *pcoinsTip, gameState, stats);
+        stats.hash = writer.GetHash();
+        file << stats.hash;
+        FileCommit(file.Get());
+    } catch (const std::exception& e) {
+        file.fclose();
+        boost::filesystem::remove(path);
+        strError = strprintf("failed to write snapshot: %s", e.what());
+        return false;
+    }
+
+    LogPrintf("%s: wrote snapshot at height %d with %u coins and %u names to %s\n", __func__,
+              stats.metadata.nHeight, stats.nCoins, stats.nNames, path.string());
+    return true;
+}
+
+bool LoadSnapshot(const boost::filesystem::path& path, CSnapshotStats& stats, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        strError = "unable to open " + path.string();
+        return false;
+    }
+
+    CBlockIndex* pindexBase;
+    try {
+        file >> stats.metadata;
+        {
+            LOCK(cs_main);
+            if (!CheckLoadPreconditions(stats.metadata, strError))
+                return false;
+        }
+        if (!CheckSnapshotFile(path, stats.hash, strError))
+            return false;
+
+        LOCK(cs_main);
+        if (!CheckLoadPreconditions(stats.metadata, strError))
+            return false;
+        pindexBase = mapBlockIndex[stats.metadata.hashBlock];
+        LogPrintf("%s: loading snapshot at height %d from %s\n", __func__, stats.metadata.nHeight, path.string());
+
+        // Until the chainstate is complete, the node refuses to start
+        CSnapshotRecord record;
+        record.metadata = stats.metadata;
+        record.hash = stats.hash;
+        record.fLoading = true;
+        if (!pblocktree->WriteSnapshot(record)) {
+            strError = "failed to write to the block tree database";
+            return false;
+        }
+
+        // Drop whatever the genesis block left in the chainstate
+        FlushStateToDisk();
+        std::vector<COutPoint> vOld;
+        {
+            std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsTip->Cursor());
+            for (; pcursor->Valid(); pcursor->Next()) {
+                COutPoint outpoint;
+                if (pcursor->GetKey(outpoint))
+                    vOld.push_back(outpoint);
+            }
+        }
+        BOOST_FOREACH(const COutPoint& outpoint, vOld)
+            pcoinsTip->SpendCoin(outpoint);
+
+        std::vector<std::pair<COutPoint, Coin> > vCoins;
+        for (file >> vCoins; !vCoins.empty(); file >> vCoins) {
+            boost::this_thread::interruption_point();
+            for (size_t i = 0; i < vCoins.size(); i++)
+                pcoinsTip->AddCoin(vCoins[i].first, std::move(vCoins[i].second), true);
+            stats.nCoins += vCoins.size();
+            if (pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage && !pcoinsTip->Flush()) {
+                strError = "failed to write to the chainstate";
+                return false;
+            }
+        }
+
+        std::vector<std::pair<valtype, CNameData> > vNames;
+        for (file >> vNames; !vNames.empty(); file >> vNames) {
+            for (size_t i = 0; i < vNames.size(); i++)
+                pcoinsTip->SetName(vNames[i].first, vNames[i].second, false);
+            stats.nNames += vNames.size();
+        }
+
+        GameState gameState(chainparams.GetConsensus());
+        file >> gameState;
+        if (gameState.hashBlock != stats.metadata.hashBlock || gameState.nHeight != stats.metadata.nHeight) {
+            strError = "the game state does not belong to the snapshot's block";
+            return false;
+        }
+        pgameDb->setPinned(stats.metadata.hashBlock);
+        pgameDb->store(stats.metadata.hashBlock, gameState);
+
+        pcoinsTip->SetBestBlock(stats.metadata.hashBlock);
+        ActivateSnapshot(pindexBase, stats.metadata.nChainTx);
+        FlushStateToDisk();
+        record.fLoading = false;
+        if (!pblocktree->WriteSnapshot(record)) {
+            strError = "failed to write to the block tree database";
+            return false;
+        }
+        StartSnapshotValidation();
+    } catch (const std::exception& e) {
+        strError = strprintf("failed to read snapshot: %s", e.what());
+        return false;
+    }
+
+    LogPrintf("%s: loaded %u coins and %u names, new tip %s\n", __func__,
+              stats.nCoins, stats.nNames, stats.metadata.hashBlock.ToString());
+    uiInterface.NotifyBlockTip(IsInitialBlockDownload(), pindexBase);
+
+    // Connect blocks after the snapshot we may know already
+    CValidationState state;
+    if (!ActivateBestChain(state, chainparams))
+        LogPrintf("%s: %s\n", __func__, FormatStateMessage(state));
+    return true;
+}
+
+namespace {
+
+boost::mutex cs_threadSnapshotValidation;
+boost::thread threadSnapshotValidation;
+
+void ThreadSnapshotValidation()
+{
+    while (true) {
+        CSnapshotRecord record;
+        CBlockIndex* pindexBase = NULL;
+        {
+            LOCK(cs_main);
+            if (pindexSnapshotBase && GetSnapshotHistoryHeight() == pindexSnapshotBase->nHeight
+                && pblocktree->ReadSnapshot(record))
+                pindexBase = pindexSnapshotBase;
+        }
+        if (pindexBase) {
+            ValidateSnapshot(record, pindexBase);
+            return;
+        }
+        MilliSleep(5000);
+    }
+}
+
+}
+
+void StartSnapshotValidation()
+{
+    boost::unique_lock<boost::mutex> lock(cs_threadSnapshotValidation);
+    if (threadSnapshotValidation.joinable())
+        return;
+    threadSnapshotValidation = boost::thread(boost::bind(&TraceThread<void (*)()>, "snapcheck", &ThreadSnapshotValidation));
+}
+
+void StopSnapshotValidation()
+{
+    boost::unique_lock<boost::mutex> lock(cs_threadSnapshotValidation);
+    if (!threadSnapshotValidation.joinable())
+        return;
+    threadSnapshotValidation.interrupt();
+    threadSnapshotValidation.join();
+}
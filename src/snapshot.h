@@ -0,0 +1,124 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SNAPSHOT_H
+#define BITCOIN_SNAPSHOT_H
+
+#include "protocol.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+/**
+ * UTXO snapshots hold the full chainstate at some block: all unspent
+ * outputs, the name database and the game state.  A new node can load
+ * one and start from its block right away, while the blocks before it
+ * are downloaded and validated in the background.
+ *
+ * The file starts with the metadata, followed by the coins and the names
+ * in chunks (vectors of entries, ended by an empty one) and the game
+ * state.  The last 32 bytes are the hash of everything before them.
+ */
+
+/** Snapshot file metadata, describing the block it was taken at.  */
+class CSnapshotMetadata
+{
+public:
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t nVersion;
+    CMessageHeader::MessageStartChars pchMessageStart;
+    uint256 hashBlock;
+    int32_t nHeight;
+    //! Number of transactions in the chain up to and including the block
+    uint64_t nChainTx;
+
+    CSnapshotMetadata()
+    {
+        SetNull();
+    }
+
+    void SetNull()
+    {
+        nVersion = CURRENT_VERSION;
+        memset(pchMessageStart, 0, sizeof(pchMessageStart));
+        hashBlock.SetNull();
+        nHeight = -1;
+        nChainTx = 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(nVersion);
+        READWRITE(hashBlock);
+        READWRITE(nHeight);
+        READWRITE(nChainTx);
+    }
+};
+
+/**
+ * What the block tree database remembers about a loaded snapshot until
+ * the blocks before it have been validated.
+ */
+class CSnapshotRecord
+{
+public:
+    CSnapshotMetadata metadata;
+    //! Hash of the snapshot's contents
+    uint256 hash;
+    //! Set while the snapshot is being written to the chainstate
+    bool fLoading;
+
+    CSnapshotRecord() : fLoading(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(metadata);
+        READWRITE(hash);
+        READWRITE(fLoading);
+    }
+};
+
+/** Summary of a snapshot that was written or read.  */
+struct CSnapshotStats
+{
+    CSnapshotMetadata metadata;
+    uint64_t nCoins;
+    uint64_t nNames;
+    uint256 hash;
+
+    CSnapshotStats() : nCoins(0), nNames(0) {}
+};
+
+/** Write a snapshot of the current chainstate to a new file.  */
+bool DumpSnapshot(const boost::filesystem::path& path, CSnapshotStats& stats, std::string& strError);
+
+/**
+ * Replace the chainstate of a node that has not synced any blocks yet
+ * with a snapshot.  Its block must be on the best header chain.
+ */
+bool LoadSnapshot(const boost::filesystem::path& path, CSnapshotStats& stats, std::string& strError);
+
+/**
+ * Start a thread that waits for the blocks before a loaded snapshot to be
+ * downloaded, then connects them in a separate chainstate and checks that
+ * it matches the snapshot.  The node shuts down if it does not.  Only
+ * needed while a snapshot is in use; does nothing if already started.
+ */
+void StartSnapshotValidation();
+
+/** Interrupt the snapshot validation thread and wait for it to exit.  */
+void StopSnapshotValidation();
+
+#endif // BITCOIN_SNAPSHOT_H
@@ -458,7 +458,7 @@ private:
     CAutoFile& operator=(const CAutoFile&);
 
     const int nType;
-    const int nVersion;
+    int nVersion;
 
     FILE* file;	
 
@@ -501,6 +501,7 @@ public:
     // Stream subset
     //
     int GetType() const          { return nType; }
+    void SetVersion(int n)       { nVersion = n; }
     int GetVersion() const       { return nVersion; }
 
     void read(char* pch, size_t nSize)
@@ -567,7 +568,7 @@ private:
     CBufferedFile& operator=(const CBufferedFile&);
 
     const int nType;
-    const int nVersion;
+    int nVersion;
 
     FILE *src;            // source file
     uint64_t nSrcPos;     // how many bytes have been read from source
@@ -607,6 +608,7 @@ public:
         fclose();
     }
 
+    void SetVersion(int n) { nVersion = n; }
     int GetVersion() const { return nVersion; }
     int GetType() const { return nType; }
 
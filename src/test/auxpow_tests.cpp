@@ -322,6 +322,133 @@ BOOST_AUTO_TEST_CASE (check_auxpow)
   BOOST_CHECK (builder2.get ().check (hashAux, ourChainId, params));
 }
 
+BOOST_AUTO_TEST_CASE (auxpow_check_cache)
+{
+  const Consensus::Params& params = Params ().GetConsensus ();
+  CAuxpowBuilder builder(5, 42);
+
+  const uint256 hashAux = ArithToUint256 (arith_uint256(54321));
+  const int32_t ourChainId = params.nAuxpowChainId[ALGO_SHA256D];
+  const unsigned height = 5;
+  const int nonce = 3;
+
+  const int index = CAuxPow::getExpectedIndex (nonce, ourChainId, height);
+  const valtype auxRoot = builder.buildAuxpowChain (hashAux, height, index);
+  const valtype data
+    = CAuxpowBuilder::buildCoinbaseData (true, auxRoot, height, nonce);
+  builder.setCoinbase (CScript () << data);
+
+  /* The second check is answered from the cache.  */
+  const CAuxPow auxpow = builder.get ();
+  BOOST_CHECK (auxpow.check (hashAux, ourChainId, params));
+  BOOST_CHECK (auxpow.check (hashAux, ourChainId, params));
+  BOOST_CHECK (auxpow.checkUncached (hashAux, ourChainId, params));
+
+  /* Tampered copies with the same parent block share the cached entry of
+     the valid auxpow, but must still be rejected.  */
+  CAuxPow tampered(auxpow);
+  tamperWith (tampered.vChainMerkleBranch[0]);
+  BOOST_CHECK (!tampered.check (hashAux, ourChainId, params));
+
+  tampered = auxpow;
+  tampered.vMerkleBranch.push_back (uint256 ());
+  BOOST_CHECK (!tampered.check (hashAux, ourChainId, params));
+
+  tampered = auxpow;
+  tampered.nChainIndex ^= 1;
+  BOOST_CHECK (!tampered.check (hashAux, ourChainId, params));
+
+  BOOST_CHECK (!auxpow.check (hashAux, ourChainId + 1, params));
+  BOOST_CHECK (auxpow.check (hashAux, ourChainId, params));
+}
+
+/* ************************************************************************** */
+
+/**
+ * Round-trip an auxpow through the compact encoding and check that the
+ * result serialises to the same legacy bytes.
+ * @param auxpow The auxpow to check.
+ * @return The number of bytes saved by the compact encoding.
+ */
+static int
+checkCompactRoundTrip (const CAuxPow& auxpow)
+{
+  const int nCompact = PROTOCOL_VERSION | SERIALIZE_AUXPOW_COMPACT;
+
+  CDataStream legacy(SER_NETWORK, PROTOCOL_VERSION);
+  legacy << auxpow;
+  CDataStream compact(SER_NETWORK, nCompact);
+  compact << auxpow;
+  BOOST_CHECK_EQUAL (compact.size (),
+                     GetSerializeSize (auxpow, SER_NETWORK, nCompact));
+
+  CAuxPow decoded;
+  compact >> decoded;
+  BOOST_CHECK (compact.empty ());
+
+  CDataStream reencoded(SER_NETWORK, PROTOCOL_VERSION);
+  reencoded << decoded;
+  BOOST_CHECK (reencoded.str () == legacy.str ());
+
+  return legacy.size () - GetSerializeSize (auxpow, SER_NETWORK, nCompact);
+}
+
+BOOST_AUTO_TEST_CASE (auxpow_compact_serialisation)
+{
+  const Consensus::Params& params = Params ().GetConsensus ();
+  CAuxpowBuilder builder(5, 42);
+
+  const uint256 hashAux = ArithToUint256 (arith_uint256(12345));
+  const int32_t ourChainId = params.nAuxpowChainId[ALGO_SHA256D];
+  const unsigned height = 3;
+  const int nonce = 7;
+
+  const int index = CAuxPow::getExpectedIndex (nonce, ourChainId, height);
+  const valtype auxRoot = builder.buildAuxpowChain (hashAux, height, index);
+  const valtype data
+    = CAuxpowBuilder::buildCoinbaseData (true, auxRoot, height, nonce);
+  builder.setCoinbase (CScript () << data);
+
+  /* A typical auxpow leaves out hashBlock, nIndex and the merkle root,
+     at the cost of one byte for the flags.  */
+  CAuxPow auxpow = builder.get ();
+  BOOST_CHECK (auxpow.check (hashAux, ourChainId, params));
+  BOOST_CHECK_EQUAL (checkCompactRoundTrip (auxpow), 67);
+
+  /* Old auxpows have a null hashBlock.  */
+  auxpow.hashBlock.SetNull ();
+  BOOST_CHECK_EQUAL (checkCompactRoundTrip (auxpow), 67);
+
+  /* Fields that do not have their derivable value are kept.  */
+  auxpow.hashBlock = hashAux;
+  BOOST_CHECK_EQUAL (checkCompactRoundTrip (auxpow), 35);
+  auxpow.nIndex = 1;
+  BOOST_CHECK_EQUAL (checkCompactRoundTrip (auxpow), 31);
+  tamperWith (auxpow.parentBlock.hashMerkleRoot);
+  BOOST_CHECK_EQUAL (checkCompactRoundTrip (auxpow), -1);
+
+  /* Full headers round-trip with the stream flag as well.  */
+  CBlockHeader header;
+  header.nTime = 1234;
+  header.SetAuxpow (new CAuxPow (builder.get ()));
+
+  CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_AUXPOW_COMPACT);
+  ss << header;
+  CBlockHeader decoded;
+  ss >> decoded;
+  BOOST_CHECK (decoded.GetHash () == header.GetHash ());
+  BOOST_CHECK (decoded.auxpow);
+  BOOST_CHECK (decoded.auxpow->parentBlock.GetHash ()
+                == header.auxpow->parentBlock.GetHash ());
+
+  /* Unknown flags are rejected.  */
+  CDataStream invalid(SER_NETWORK,
+                      PROTOCOL_VERSION | SERIALIZE_AUXPOW_COMPACT);
+  invalid << static_cast<unsigned char> (0xff);
+  CAuxPow dummy;
+  BOOST_CHECK_THROW (invalid >> dummy, std::ios_base::failure);
+}
+
 /* ************************************************************************** */
 
 /**
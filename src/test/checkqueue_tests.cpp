@@ -0,0 +1,143 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+namespace {
+
+std::atomic<unsigned int> nChecked;
+
+/** A check that counts how often it was run and fails if told to.  */
+class CCountingCheck
+{
+private:
+    bool fOk;
+
+public:
+    CCountingCheck() : fOk(true) {}
+    explicit CCountingCheck(bool fOkIn) : fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        nChecked++;
+        return fOk;
+    }
+
+    void swap(CCountingCheck& check)
+    {
+        std::swap(fOk, check.fOk);
+    }
+};
+
+typedef CCheckQueue<CCountingCheck> CCountingQueue;
+
+/** Run a few blocks of checks of different sizes through the queue.  */
+void RunBlocks(CCountingQueue& queue)
+{
+    const unsigned int vSizes[] = {0, 1, 3, 17, 128, 1000, 10000};
+    for (unsigned int nSize : vSizes) {
+        nChecked = 0;
+        {
+            CCheckQueueControl<CCountingCheck> control(&queue);
+            for (unsigned int i = 0; i < nSize; i += 3) {
+                std::vector<CCountingCheck> vChecks(std::min(3U, nSize - i));
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecked.load(), nSize);
+        BOOST_CHECK(queue.IsIdle());
+    }
+}
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_checked)
+{
+    // more threads than deques, so that some share theirs
+    CCountingQueue queue(128, 4);
+    RunBlocks(queue);
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 6; i++)
+        threadGroup.create_thread(boost::bind(&CCountingQueue::Thread, boost::ref(queue)));
+    for (int i = 0; i < 10; i++)
+        RunBlocks(queue);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    CCountingQueue queue(16);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CCountingQueue::Thread, boost::ref(queue)));
+
+    for (unsigned int nFail : {0U, 1U, 499U, 999U}) {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        for (unsigned int i = 0; i < 1000; i++) {
+            std::vector<CCountingCheck> vChecks(1, CCountingCheck(i != nFail));
+            control.Add(vChecks);
+        }
+        BOOST_CHECK(!control.Wait());
+    }
+
+    // the result is reset for the next block
+    {
+        CCheckQueueControl<CCountingCheck> control(&queue);
+        std::vector<CCountingCheck> vChecks(100);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_tasks)
+{
+    CCountingQueue queue(128);
+
+    // without workers, tasks only run when someone helps
+    std::atomic<int> nTasks(0);
+    queue.AddTask([&nTasks]() { nTasks++; });
+    BOOST_CHECK_EQUAL(nTasks.load(), 0);
+    BOOST_CHECK(queue.RunTask());
+    BOOST_CHECK(!queue.RunTask());
+    BOOST_CHECK_EQUAL(nTasks.load(), 1);
+
+    // workers run tasks alongside checks
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(boost::bind(&CCountingQueue::Thread, boost::ref(queue)));
+
+    std::vector<std::future<void>> vResults;
+    for (int i = 0; i < 100; i++) {
+        auto task = std::make_shared<std::packaged_task<void()>>([&nTasks]() { nTasks++; });
+        vResults.push_back(task->get_future());
+        queue.AddTask([task]() { (*task)(); });
+    }
+    RunBlocks(queue);
+    for (std::future<void>& result : vResults)
+        result.wait();
+    BOOST_CHECK_EQUAL(nTasks.load(), 101);
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
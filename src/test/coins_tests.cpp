@@ -4,7 +4,9 @@
 
 #include "coins.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
+#include "undo.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
@@ -20,30 +22,39 @@ class CNameCache;
 
 namespace
 {
+bool operator==(const Coin &a, const Coin &b) {
+    // Empty Coin objects are always equal.
+    if (a.IsSpent() && b.IsSpent()) return true;
+    return a.fCoinBase == b.fCoinBase &&
+           a.fGameTx == b.fGameTx &&
+           a.nHeight == b.nHeight &&
+           a.out == b.out;
+}
+
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
-    std::map<uint256, CCoins> map_;
+    std::map<COutPoint, Coin> map_;
 
 public:
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
-        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
             return false;
         }
-        coins = it->second;
-        if (coins.IsPruned() && insecure_rand() % 2 == 0) {
+        coin = it->second;
+        if (coin.IsSpent() && insecure_rand() % 2 == 0) {
             // Randomly return false in case of an empty entry.
             return false;
         }
         return true;
     }
 
-    bool HaveCoins(const uint256& txid) const
+    bool HaveCoin(const COutPoint& outpoint) const
     {
-        CCoins coins;
-        return GetCoins(txid, coins);
+        Coin coin;
+        return GetCoin(outpoint, coin);
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
@@ -53,8 +64,8 @@ public:
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
-                map_[it->first] = it->second.coins;
-                if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
+                map_[it->first] = it->second.coin;
+                if (it->second.coin.IsSpent() && insecure_rand() % 3 == 0) {
                     // Randomly delete empty entries on write.
                     map_.erase(it->first);
                 }
@@ -76,9 +87,12 @@ public:
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
         size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t count = 0;
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+            ret += it->second.coin.DynamicMemoryUsage();
+            ++count;
         }
+        BOOST_CHECK_EQUAL(GetCacheSize(), count);
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
@@ -93,7 +107,7 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // This is a large randomized insert/remove simulation test on a variable-size
 // stack of caches on top of CCoinsViewTest.
 //
-// It will randomly create/update/delete CCoins entries to a tip of caches, with
+// It will randomly create/update/delete Coin entries to a tip of caches, with
 // txids picked from a limited list of random 256-bit hashes. Occasionally, a
 // new tip is added to the stack of caches, or the tip is flushed and removed.
 //
@@ -105,13 +119,15 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool removed_all_caches = false;
     bool reached_4_caches = false;
     bool added_an_entry = false;
+    bool added_an_unspendable_entry = false;
     bool removed_an_entry = false;
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool uncached_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
@@ -129,36 +145,52 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         // Do a random modification.
         {
             uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
-            CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
-                    added_an_entry = true;
+            Coin& coin = result[COutPoint(txid, 0)];
+            const Coin& entry = (insecure_rand() % 500 == 0) ? AccessByTxid(*stack.back(), txid) : stack.back()->AccessCoin(COutPoint(txid, 0));
+            BOOST_CHECK(coin == entry);
+
+            if (insecure_rand() % 5 == 0 || coin.IsSpent()) {
+                Coin newcoin;
+                newcoin.out.nValue = insecure_rand();
+                newcoin.nHeight = 1;
+                newcoin.fGameTx = (insecure_rand() % 4 == 0);
+                if (insecure_rand() % 16 == 0 && coin.IsSpent()) {
+                    newcoin.out.scriptPubKey.assign(1 + (insecure_rand() & 0x3F), OP_RETURN);
+                    BOOST_CHECK(newcoin.out.scriptPubKey.IsUnspendable());
+                    added_an_unspendable_entry = true;
                 } else {
-                    updated_an_entry = true;
+                    newcoin.out.scriptPubKey.assign(insecure_rand() & 0x3F, 0); // Random sizes so we can test memory usage accounting
+                    (coin.IsSpent() ? added_an_entry : updated_an_entry) = true;
+                    coin = newcoin;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
+                stack.back()->AddCoin(COutPoint(txid, 0), std::move(newcoin), !coin.IsSpent() || insecure_rand() & 1);
             } else {
-                coins.Clear();
-                entry->Clear();
                 removed_an_entry = true;
+                coin.Clear();
+                stack.back()->SpendCoin(COutPoint(txid, 0));
             }
         }
 
+        // One every 10 iterations, remove a random entry from the cache
+        if (insecure_rand() % 10 == 0) {
+            COutPoint out(txids[insecure_rand() % txids.size()], 0);
+            int cacheid = insecure_rand() % stack.size();
+            stack[cacheid]->Uncache(out);
+            uncached_an_entry |= !stack[cacheid]->HaveCoinInCache(out);
+        }
+
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                    found_an_entry = true;
-                } else {
-                    BOOST_CHECK(it->second.IsPruned());
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                bool have = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(have == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
+                if (coin.IsSpent()) {
                     missed_an_entry = true;
+                } else {
+                    BOOST_CHECK(stack.back()->HaveCoinInCache(it->first));
+                    found_an_entry = true;
                 }
             }
             BOOST_FOREACH(const CCoinsViewCacheTest *test, stack) {
@@ -207,10 +239,12 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(removed_all_caches);
     BOOST_CHECK(reached_4_caches);
     BOOST_CHECK(added_an_entry);
+    BOOST_CHECK(added_an_unspendable_entry);
     BOOST_CHECK(removed_an_entry);
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(uncached_an_entry);
 }
 
 // This test is similar to the previous test
@@ -218,11 +252,13 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
 // random txs are created and UpdateCoins is used to update the cache stack
 // In particular it is tested that spending a duplicate coinbase tx
 // has the expected effect (the other duplicate is overwitten at all cache levels)
+// and that undoing a spend with ApplyTxInUndo restores the output.
 BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 {
     bool spent_a_duplicate_coinbase = false;
+    bool undid_a_spend = false;
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
@@ -240,7 +276,8 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             tx.vin.resize(1);
             tx.vout.resize(1);
             tx.vout[0].nValue = i; //Keep txs unique unless intended to duplicate
-            unsigned int height = insecure_rand();
+            tx.vout[0].scriptPubKey.assign(insecure_rand() & 0x3F, 0); // Random sizes so we can test memory usage accounting
+            unsigned int height = 1 + insecure_rand() % 100000;
 
             // 1/10 times create a coinbase
             if (insecure_rand() % 10 == 0 || coinbaseids.size() < 10) {
@@ -251,7 +288,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
                         coinbaseIt = coinbaseids.begin();
                     }
                     //Use same random value to have same hash and be a true duplicate
-                    tx.vout[0].nValue = coinbaseIt->second;
+                    tx.vout[0] = result[COutPoint(coinbaseIt->first, 0)].out;
                     assert(tx.GetHash() == coinbaseIt->first);
                     duplicateids.insert(coinbaseIt->first);
                 }
@@ -275,8 +312,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
                 tx.vin[0].prevout.n = 0;
 
                 // Update the expected result of prevouthash to know these coins are spent
-                CCoins& oldcoins = result[prevouthash];
-                oldcoins.Clear();
+                result[tx.vin[0].prevout].Clear();
 
                 // It is of particular importance here that once we spend a coinbase tx hash
                 // it is no longer available to be duplicated (or spent again)
@@ -292,25 +328,37 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 
                 assert(!CTransaction(tx).IsCoinBase());
             }
-            // Track this tx to possibly spend later
-            alltxids.insert(tx.GetHash());
 
-            // Update the expected result to know about the new output coins
-            CCoins &coins = result[tx.GetHash()];
-            coins.FromTx(tx, height);
+            const CTransaction txConst(tx);
+            CTxUndo undo;
+            UpdateCoins(txConst, *(stack.back()), undo, height);
+
+            // 1/20 times undo the transaction again right away
+            if (!txConst.IsCoinBase() && insecure_rand() % 20 == 0) {
+                const COutPoint out(txConst.GetHash(), 0);
+                BOOST_CHECK(stack.back()->SpendCoin(out));
+                BOOST_CHECK_EQUAL(undo.vprevout.size(), 1);
+                Coin& prev = undo.vprevout[0];
+                result[txConst.vin[0].prevout] = prev;
+                BOOST_CHECK(ApplyTxInUndo(std::move(prev), *(stack.back()), txConst.vin[0].prevout));
+                alltxids.insert(txConst.vin[0].prevout.hash);
+                undid_a_spend = true;
+            } else {
+                // Track this tx to possibly spend later
+                alltxids.insert(txConst.GetHash());
 
-            UpdateCoins(tx, *(stack.back()), height);
+                // Update the expected result to know about the new output coins
+                result[COutPoint(txConst.GetHash(), 0)] = Coin(txConst.vout[0], height, txConst.IsCoinBase());
+            }
         }
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                 } else {
-                    BOOST_CHECK(it->second.IsPruned());
-                 }
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                bool have = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(have == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
             }
         }
 
@@ -346,61 +394,39 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 
     // Verify coverage.
     BOOST_CHECK(spent_a_duplicate_coinbase);
+    BOOST_CHECK(undid_a_spend);
 }
 
-// FIXME: Reenable with updated serialisation for game tx flag.
-#if 0
 BOOST_AUTO_TEST_CASE(ccoins_serialization)
 {
-    // Good example
-    CDataStream ss1(ParseHex("0104835800816115944e077fe7c803cfa57f29b36bf87c1d358bb85e"), SER_DISK, CLIENT_VERSION);
-    CCoins cc1;
-    ss1 >> cc1;
-    BOOST_CHECK_EQUAL(cc1.nVersion, 1);
-    BOOST_CHECK_EQUAL(cc1.fCoinBase, false);
-    BOOST_CHECK_EQUAL(cc1.nHeight, 203998);
-    BOOST_CHECK_EQUAL(cc1.vout.size(), 2);
-    BOOST_CHECK_EQUAL(cc1.IsAvailable(0), false);
-    BOOST_CHECK_EQUAL(cc1.IsAvailable(1), true);
-    BOOST_CHECK_EQUAL(cc1.vout[1].nValue, 60000000000ULL);
-    BOOST_CHECK_EQUAL(HexStr(cc1.vout[1].scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))))));
-
-    // Good example
-    CDataStream ss2(ParseHex("0109044086ef97d5790061b01caab50f1b8e9c50a5057eb43c2d9563a4eebbd123008c988f1a4a4de2161e0f50aac7f17e7f9555caa486af3b"), SER_DISK, CLIENT_VERSION);
-    CCoins cc2;
-    ss2 >> cc2;
-    BOOST_CHECK_EQUAL(cc2.nVersion, 1);
-    BOOST_CHECK_EQUAL(cc2.fCoinBase, true);
-    BOOST_CHECK_EQUAL(cc2.nHeight, 120891);
-    BOOST_CHECK_EQUAL(cc2.vout.size(), 17);
-    for (int i = 0; i < 17; i++) {
-        BOOST_CHECK_EQUAL(cc2.IsAvailable(i), i == 4 || i == 16);
-    }
-    BOOST_CHECK_EQUAL(cc2.vout[4].nValue, 234925952);
-    BOOST_CHECK_EQUAL(HexStr(cc2.vout[4].scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("61b01caab50f1b8e9c50a5057eb43c2d9563a4ee"))))));
-    BOOST_CHECK_EQUAL(cc2.vout[16].nValue, 110397);
-    BOOST_CHECK_EQUAL(HexStr(cc2.vout[16].scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("8c988f1a4a4de2161e0f50aac7f17e7f9555caa4"))))));
-
-    // Smallest possible example
-    CDataStream ssx(SER_DISK, CLIENT_VERSION);
-    BOOST_CHECK_EQUAL(HexStr(ssx.begin(), ssx.end()), "");
-
-    CDataStream ss3(ParseHex("0002000600"), SER_DISK, CLIENT_VERSION);
-    CCoins cc3;
-    ss3 >> cc3;
-    BOOST_CHECK_EQUAL(cc3.nVersion, 0);
-    BOOST_CHECK_EQUAL(cc3.fCoinBase, false);
-    BOOST_CHECK_EQUAL(cc3.nHeight, 0);
-    BOOST_CHECK_EQUAL(cc3.vout.size(), 1);
-    BOOST_CHECK_EQUAL(cc3.IsAvailable(0), true);
-    BOOST_CHECK_EQUAL(cc3.vout[0].nValue, 0);
-    BOOST_CHECK_EQUAL(cc3.vout[0].scriptPubKey.size(), 0);
+    const CScript script = GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))));
+
+    // Coinbase output of a game tx
+    CDataStream ss1(SER_DISK, CLIENT_VERSION);
+    ss1 << Coin(CTxOut(60000000000LL, script), 203998, true, true);
+    Coin c1;
+    ss1 >> c1;
+    BOOST_CHECK_EQUAL(c1.fCoinBase, true);
+    BOOST_CHECK_EQUAL(c1.fGameTx, true);
+    BOOST_CHECK_EQUAL(c1.nHeight, 203998);
+    BOOST_CHECK_EQUAL(c1.out.nValue, 60000000000LL);
+    BOOST_CHECK_EQUAL(HexStr(c1.out.scriptPubKey), HexStr(script));
+
+    // Smallest possible example: height 1, both flags set, empty script
+    CDataStream ss2(ParseHex("070006"), SER_DISK, CLIENT_VERSION);
+    Coin c2;
+    ss2 >> c2;
+    BOOST_CHECK_EQUAL(c2.fCoinBase, true);
+    BOOST_CHECK_EQUAL(c2.fGameTx, true);
+    BOOST_CHECK_EQUAL(c2.nHeight, 1);
+    BOOST_CHECK_EQUAL(c2.out.nValue, 0);
+    BOOST_CHECK_EQUAL(c2.out.scriptPubKey.size(), 0);
 
     // scriptPubKey that ends beyond the end of the stream
-    CDataStream ss4(ParseHex("0002000800"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss3(ParseHex("000008"), SER_DISK, CLIENT_VERSION);
     try {
-        CCoins cc4;
-        ss4 >> cc4;
+        Coin c3;
+        ss3 >> c3;
         BOOST_CHECK_MESSAGE(false, "We should have thrown");
     } catch (const std::ios_base::failure& e) {
     }
@@ -410,14 +436,90 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     uint64_t x = 3000000000ULL;
     tmp << VARINT(x);
     BOOST_CHECK_EQUAL(HexStr(tmp.begin(), tmp.end()), "8a95c0bb00");
-    CDataStream ss5(ParseHex("0002008a95c0bb0000"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss4(ParseHex("00008a95c0bb0000"), SER_DISK, CLIENT_VERSION);
     try {
-        CCoins cc5;
-        ss5 >> cc5;
+        Coin c4;
+        ss4 >> c4;
         BOOST_CHECK_MESSAGE(false, "We should have thrown");
     } catch (const std::ios_base::failure& e) {
     }
 }
-#endif // disabled test
+
+/** CCoinsViewDB that gives access to its database.  */
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+    CDBWrapper& GetDB() { return db; }
+};
+
+BOOST_AUTO_TEST_CASE(ccoins_upgrade)
+{
+    const CScript script = GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))));
+    const uint256 txidCoinBase = GetRandHash();
+    const uint256 txidGame = GetRandHash();
+    CCoinsViewDBTest view;
+
+    // Per-tx records ('c') as written by older versions:  A coinbase at
+    // height 1000 with outputs 0 (50 HUC), 2 (1 HUC) and 3 (OP_RETURN)
+    // unspent, and a game tx at height 2000 with only output 9 unspent.
+    CDataStream ss1(ParseHex("0115033200816115944e077fe7c803cfa57f29b36bf87c1d350900816115944e077fe7c803cfa57f29b36bf87c1d3500096a012a8668"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss2(ParseHex("0102808390e7ea3d00816115944e077fe7c803cfa57f29b36bf87c1d358e50"), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(view.GetDB().Write(std::make_pair('c', txidCoinBase), ss1));
+    BOOST_CHECK(view.GetDB().Write(std::make_pair('c', txidGame), ss2));
+
+    BOOST_CHECK(view.Upgrade());
+    BOOST_CHECK(!view.GetDB().Exists(std::make_pair('c', txidCoinBase)));
+    BOOST_CHECK(!view.GetDB().Exists(std::make_pair('c', txidGame)));
+
+    Coin coin;
+    BOOST_CHECK(view.GetCoin(COutPoint(txidCoinBase, 0), coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 50 * COIN);
+    BOOST_CHECK(coin.out.scriptPubKey == script);
+    BOOST_CHECK_EQUAL(coin.nHeight, 1000);
+    BOOST_CHECK(coin.IsCoinBase());
+    BOOST_CHECK(!coin.IsGameTx());
+    BOOST_CHECK(!view.HaveCoin(COutPoint(txidCoinBase, 1)));
+    BOOST_CHECK(view.GetCoin(COutPoint(txidCoinBase, 2), coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, COIN);
+    BOOST_CHECK_EQUAL(coin.nHeight, 1000);
+    BOOST_CHECK(coin.IsCoinBase());
+    // Unspendable outputs are dropped
+    BOOST_CHECK(!view.HaveCoin(COutPoint(txidCoinBase, 3)));
+
+    for (unsigned int i = 0; i < 11; ++i)
+        BOOST_CHECK_EQUAL(view.HaveCoin(COutPoint(txidGame, i)), i == 9);
+    BOOST_CHECK(view.GetCoin(COutPoint(txidGame, 9), coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 123456789);
+    BOOST_CHECK(coin.out.scriptPubKey == script);
+    BOOST_CHECK_EQUAL(coin.nHeight, 2000);
+    BOOST_CHECK(!coin.IsCoinBase());
+    BOOST_CHECK(coin.IsGameTx());
+}
+
+BOOST_AUTO_TEST_CASE(txinundo_serialization)
+{
+    // Undo records written by older versions carry the transaction version
+    // after the metadata of a tx's last spent output.
+    CDataStream ss1(ParseHex("0f010006"), SER_DISK, CLIENT_VERSION);
+    Coin c1;
+    ss1 >> REF(TxInUndoDeserializer(&c1));
+    BOOST_CHECK(ss1.empty());
+    BOOST_CHECK_EQUAL(c1.nHeight, 3);
+    BOOST_CHECK_EQUAL(c1.fCoinBase, true);
+    BOOST_CHECK_EQUAL(c1.fGameTx, true);
+
+    // Other spends of the same transaction had no metadata at all
+    CDataStream ss2(ParseHex("000006"), SER_DISK, CLIENT_VERSION);
+    Coin c2;
+    ss2 >> REF(TxInUndoDeserializer(&c2));
+    BOOST_CHECK(ss2.empty());
+    BOOST_CHECK_EQUAL(c2.nHeight, 0);
+
+    // We still write the dummy version, so that older versions can read it
+    CDataStream ss3(SER_DISK, CLIENT_VERSION);
+    ss3 << TxInUndoSerializer(&c1);
+    BOOST_CHECK_EQUAL(HexStr(ss3.begin(), ss3.end()), "0f000006");
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
@@ -233,7 +234,17 @@ BOOST_AUTO_TEST_CASE(sha1_testvectors) {
     TestSHA1(test1, "b7755760681cbfd971451668f32af5774f4656b5");
 }
 
-BOOST_AUTO_TEST_CASE(sha256_testvectors) {
+/** Every combination of SHA256 kernels, so that each of them is exercised
+ *  even on hosts where autodetection would pick another one. */
+static const sha256_implementation::UseImplementation sha256_implementations[] = {
+    sha256_implementation::STANDARD,
+    sha256_implementation::USE_SSE41,
+    sha256_implementation::USE_AVX2,
+    sha256_implementation::UseImplementation(sha256_implementation::USE_SSE41 | sha256_implementation::USE_AVX2),
+    sha256_implementation::USE_ALL,
+};
+
+static void TestSHA256Vectors() {
     TestSHA256("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
     TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
     TestSHA256("message digest",
@@ -255,6 +266,14 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256_testvectors) {
+    for (const auto use : sha256_implementations) {
+        BOOST_TEST_MESSAGE("SHA256 implementation: " << SHA256AutoDetect(use));
+        TestSHA256Vectors();
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -439,4 +458,36 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+static void TestSHA256D64()
+{
+    // Compare the batched (and possibly multi-lane) implementation to CHash256,
+    // for counts that exercise all combinations of the 8-way, 4-way and
+    // single hash code paths.
+    for (int i = 0; i <= 32; ++i) {
+        std::vector<unsigned char> in(64 * 32);
+        std::vector<unsigned char> out1(32 * 32), out2(32 * 32);
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = insecure_rand() & 0xff;
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(&in[64 * j], 64).Finalize(&out1[32 * j]);
+        }
+        SHA256D64(&out2[0], &in[0], i);
+        BOOST_CHECK(out1 == out2);
+
+        // In place, as done by the merkle root computation.
+        SHA256D64(&in[0], &in[0], i);
+        BOOST_CHECK(std::equal(out1.begin(), out1.begin() + 32 * i, in.begin()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (const auto use : sha256_implementations) {
+        BOOST_TEST_MESSAGE("SHA256 implementation: " << SHA256AutoDetect(use));
+        TestSHA256D64();
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
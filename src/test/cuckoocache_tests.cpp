@@ -0,0 +1,112 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+
+#include "hash.h"
+#include "utilstrencodings.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+/** Deterministic, uniformly random test keys.  */
+static uint256 TestKey(uint32_t n)
+{
+    return Hash(BEGIN(n), END(n));
+}
+
+/** Fraction of the keys in [begin, end) that the cache contains.  */
+static double HitRate(CCuckooCache& cache, uint32_t begin, uint32_t end)
+{
+    size_t nHits = 0;
+    for (uint32_t i = begin; i < end; ++i)
+        nHits += cache.contains(TestKey(i), false);
+    return double(nHits) / (end - begin);
+}
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cuckoocache_basics)
+{
+    CCuckooCache cache;
+    BOOST_CHECK(cache.capacity() == 0);
+    cache.insert(TestKey(0));
+    BOOST_CHECK(!cache.contains(TestKey(0), false));
+
+    // memory is rounded down to whole cache lines
+    BOOST_CHECK(cache.setup_bytes(CCuckooCache::BUCKET_SIZE * 1000 + 10) == 2000);
+    BOOST_CHECK(!cache.contains(TestKey(0), false));
+
+    // at half load, nearly everything is found and nothing else is
+    for (uint32_t i = 0; i < 1000; ++i)
+        cache.insert(TestKey(i));
+    BOOST_CHECK(HitRate(cache, 0, 1000) > 0.98);
+    BOOST_CHECK(HitRate(cache, 1000, 100000) == 0.0);
+
+    // erasing
+    cache.insert(TestKey(2));
+    BOOST_CHECK(cache.contains(TestKey(2), true));
+    BOOST_CHECK(!cache.contains(TestKey(2), false));
+    cache.insert(TestKey(2));
+    BOOST_CHECK(cache.contains(TestKey(2), false));
+
+    // setting up again clears the cache
+    cache.setup_bytes(CCuckooCache::BUCKET_SIZE * 1000);
+    BOOST_CHECK(HitRate(cache, 0, 1000) == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_generations)
+{
+    CCuckooCache cache;
+    const uint32_t nCapacity = cache.setup_bytes(CCuckooCache::BUCKET_SIZE * 4096);
+
+    // overfill the cache several times; the most recently inserted
+    // keys survive, and old ones are evicted
+    const uint32_t nTotal = 4 * nCapacity;
+    for (uint32_t i = 0; i < nTotal; ++i)
+        cache.insert(TestKey(i));
+    BOOST_CHECK(HitRate(cache, nTotal - nCapacity / 4, nTotal) > 0.95);
+    BOOST_CHECK(HitRate(cache, 0, nCapacity) < 0.05);
+
+    // erased slots are reused before live ones are evicted
+    const uint32_t nOlder = nTotal - nCapacity / 2;
+    const double nOlderRate = HitRate(cache, nOlder, nOlder + nCapacity / 4);
+    for (uint32_t i = nTotal - nCapacity / 4; i < nTotal; ++i)
+        cache.contains(TestKey(i), true);
+    for (uint32_t i = nTotal; i < nTotal + nCapacity / 8; ++i)
+        cache.insert(TestKey(i));
+    BOOST_CHECK(HitRate(cache, nTotal, nTotal + nCapacity / 8) > 0.95);
+    BOOST_CHECK(HitRate(cache, nOlder, nOlder + nCapacity / 4) > nOlderRate - 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_threads)
+{
+    CCuckooCache cache;
+    const uint32_t nCapacity = cache.setup_bytes(CCuckooCache::BUCKET_SIZE * 4096);
+    const uint32_t nThreads = 4;
+    const uint32_t nPerThread = nCapacity / 2 / nThreads;
+
+    // concurrent inserts of disjoint keys, while other threads look up
+    // keys that are never inserted
+    std::vector<size_t> vFalseHits(nThreads, 0);
+    boost::thread_group threads;
+    for (uint32_t t = 0; t < nThreads; ++t) {
+        threads.create_thread([&cache, &vFalseHits, t, nPerThread, nThreads]() {
+            for (uint32_t i = t * nPerThread; i < (t + 1) * nPerThread; ++i) {
+                cache.insert(TestKey(i));
+                vFalseHits[t] += cache.contains(TestKey(i + nThreads * nPerThread), false);
+            }
+        });
+    }
+    threads.join_all();
+
+    for (uint32_t t = 0; t < nThreads; ++t)
+        BOOST_CHECK(vFalseHits[t] == 0);
+    BOOST_CHECK(HitRate(cache, 0, nThreads * nPerThread) > 0.97);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
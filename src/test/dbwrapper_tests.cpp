@@ -322,6 +322,55 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
-
+BOOST_AUTO_TEST_CASE(dbwrapper_options)
+{
+    const CDBOptions defaults(8 << 20);
+    BOOST_CHECK_EQUAL(defaults.nBlockCacheSize, 4U << 20);
+    BOOST_CHECK_EQUAL(defaults.nWriteBufferSize, 2U << 20);
+    BOOST_CHECK_EQUAL(defaults.nBloomBits, 10);
+
+    mapMultiArgs["-dbbloombits"].push_back("chainstate:16");
+    mapMultiArgs["-dbbloombits"].push_back("blockindex:0");
+    mapMultiArgs["-dbblockcache"].push_back("chainstate:32");
+    mapMultiArgs["-dbwritebuffer"].push_back("chainstate:invalid");
+    mapMultiArgs["-dbmaxopenfiles"].push_back("gamestates:100");
+
+    const CDBOptions chainstate = GetDBOptions("chainstate", defaults);
+    BOOST_CHECK_EQUAL(chainstate.nBloomBits, 16);
+    BOOST_CHECK_EQUAL(chainstate.nBlockCacheSize, 32U << 20);
+    BOOST_CHECK_EQUAL(chainstate.nWriteBufferSize, defaults.nWriteBufferSize);
+    BOOST_CHECK_EQUAL(chainstate.nMaxOpenFiles, defaults.nMaxOpenFiles);
+
+    const CDBOptions blockindex = GetDBOptions("blockindex", defaults);
+    BOOST_CHECK_EQUAL(blockindex.nBloomBits, 0);
+    BOOST_CHECK_EQUAL(blockindex.nBlockCacheSize, defaults.nBlockCacheSize);
+
+    BOOST_CHECK_EQUAL(GetDBOptions("gamestates", defaults).nMaxOpenFiles, 100);
+
+    mapMultiArgs.erase("-dbbloombits");
+    mapMultiArgs.erase("-dbblockcache");
+    mapMultiArgs.erase("-dbwritebuffer");
+    mapMultiArgs.erase("-dbmaxopenfiles");
+
+    // Reads are counted with and without bloom filters.
+    for (int nBloomBits = 0; nBloomBits <= 10; nBloomBits += 10) {
+        CDBOptions options(1 << 20);
+        options.nBloomBits = nBloomBits;
+        path ph = temp_directory_path() / unique_path();
+        CDBWrapper dbw(ph, options, true);
+        const CDBStats before = dbw.GetStats();
+        BOOST_CHECK_EQUAL(before.options.nBloomBits, nBloomBits);
+
+        uint256 value;
+        BOOST_CHECK(dbw.Write('a', GetRandHash()));
+        BOOST_CHECK(dbw.Read('a', value));
+        BOOST_CHECK(!dbw.Read('b', value));
+        BOOST_CHECK(dbw.Exists('a'));
+
+        const CDBStats after = dbw.GetStats();
+        BOOST_CHECK_EQUAL(after.nReads - before.nReads, 3U);
+        BOOST_CHECK_EQUAL(after.nHits - before.nHits, 2U);
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -126,6 +126,15 @@ BOOST_AUTO_TEST_CASE(siphash)
     CHashWriter ss(SER_DISK, CLIENT_VERSION);
     ss << CTransaction();
     BOOST_CHECK_EQUAL(SipHashUint256(1, 2, ss.GetHash()), 0x79751e980c2a0a35ULL);
+
+    // SipHashUint256Extra matches hashing the uint256 followed by 4 extra bytes
+    const uint256 val = uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    for (uint32_t extra : {0U, 1U, 0x23222120U, 0xffffffffU}) {
+        const unsigned char vchExtra[4] = {(unsigned char)extra, (unsigned char)(extra >> 8), (unsigned char)(extra >> 16), (unsigned char)(extra >> 24)};
+        CSipHasher hasher4(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
+        hasher4.Write(val.begin(), 32).Write(vchExtra, 4);
+        BOOST_CHECK_EQUAL(SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, val, extra), hasher4.Finalize());
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
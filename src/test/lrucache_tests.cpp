@@ -0,0 +1,67 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(lrucache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(lrucache_test)
+{
+    // create a cache capped at 10 items
+    lrucache<int, int> cache(10);
+    BOOST_CHECK(cache.max_size() == 10);
+    BOOST_CHECK(cache.empty());
+
+    // fill it up
+    for (int i = 0; i < 10; i++)
+        cache.insert(i, i + 100);
+    BOOST_CHECK(cache.size() == 10);
+
+    // touch the oldest element, so that 1 is now the least recently used
+    int v;
+    BOOST_CHECK(cache.get(0, v));
+    BOOST_CHECK(v == 100);
+
+    // inserting a new element evicts 1, but not 0
+    cache.insert(10, 110);
+    BOOST_CHECK(cache.size() == 10);
+    BOOST_CHECK(cache.count(0) == 1);
+    BOOST_CHECK(cache.count(1) == 0);
+    BOOST_CHECK(!cache.get(1, v));
+
+    // count does not touch, so 2 is evicted next
+    BOOST_CHECK(cache.count(2) == 1);
+    cache.insert(11, 111);
+    BOOST_CHECK(cache.count(2) == 0);
+
+    // re-inserting replaces the value and marks the element as used
+    cache.insert(3, 42);
+    cache.insert(12, 112);
+    BOOST_CHECK(cache.get(3, v));
+    BOOST_CHECK(v == 42);
+    BOOST_CHECK(cache.count(4) == 0);
+    BOOST_CHECK(cache.size() == 10);
+
+    // erase an element
+    cache.erase(3);
+    cache.erase(3);
+    BOOST_CHECK(cache.size() == 9);
+    BOOST_CHECK(!cache.get(3, v));
+
+    // shrink the cache, keeping the most recently used elements
+    cache.max_size(3);
+    BOOST_CHECK(cache.size() == 3);
+    BOOST_CHECK(cache.count(10) == 1);
+    BOOST_CHECK(cache.count(11) == 1);
+    BOOST_CHECK(cache.count(12) == 1);
+
+    cache.clear();
+    BOOST_CHECK(cache.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
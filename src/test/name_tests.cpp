@@ -457,8 +457,7 @@ addTestCoin (const CScript& scr, unsigned nHeight, CCoinsViewCache& view)
   mtx.vout.push_back (CTxOut (1000 * COIN, scr));
   const CTransaction tx(mtx);
 
-  CCoinsModifier entry = view.ModifyCoins (tx.GetHash ());
-  *entry = CCoins (tx, nHeight);
+  AddCoins (view, tx, nHeight);
 
   return tx.GetHash ();
 }
@@ -0,0 +1,85 @@
+// Copyright (c) 2017 The Huntercoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "scrypt/scrypt.h"
+#include "uint256.h"
+#include "utilstrencodings.h"
+
+#include "test/test_bitcoin.h"
+#include "test/test_random.h"
+
+#include <string.h>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(scrypt_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(scrypt_hashtest)
+{
+    // Litecoin block 29255
+    const std::vector<unsigned char> input = ParseHex("020000004c1271c211717198227392b029a64a7971931d351b387bb80db027f270411e398a07046f7d4a08dd815412a8712f874a7ebf0507e3878bd24e20a3b73fd750a667d2f451eac7471b00de6659");
+    const uint256 expected = uint256S("00000000002bef4107f882f6115e0b01f348d21195dacd3582aa2dabd7985806");
+
+    uint256 hash;
+    scrypt_1024_1_1_256((const char*)&input[0], (char*)hash.begin());
+    BOOST_CHECK_EQUAL(hash.GetHex(), expected.GetHex());
+
+    char scratchpad[SCRYPT_SCRATCHPAD_SIZE];
+    scrypt_1024_1_1_256_sp_generic((const char*)&input[0], (char*)hash.begin(), scratchpad);
+    BOOST_CHECK_EQUAL(hash.GetHex(), expected.GetHex());
+}
+
+static std::vector<char> RandomInputs(size_t n)
+{
+    std::vector<char> inputs(80 * n);
+    for (size_t i = 0; i < inputs.size(); i++)
+        inputs[i] = insecure_rand();
+    return inputs;
+}
+
+static std::vector<char> SingleHashes(const std::vector<char>& inputs)
+{
+    const size_t n = inputs.size() / 80;
+    std::vector<char> hashes(32 * n);
+    for (size_t i = 0; i < n; i++)
+        scrypt_1024_1_1_256(&inputs[80 * i], &hashes[32 * i]);
+    return hashes;
+}
+
+#if defined(USE_SCRYPT_MULTILANE)
+static void TestKernel(void (*kernel)(const char*, char*, char*), size_t lanes)
+{
+    const std::vector<char> inputs = RandomInputs(lanes);
+    std::vector<char> hashes(32 * lanes);
+    std::vector<char> scratchpad(SCRYPT_MULTILANE_SCRATCHPAD_SIZE);
+    kernel(&inputs[0], &hashes[0], &scratchpad[0]);
+    BOOST_CHECK(hashes == SingleHashes(inputs));
+}
+
+BOOST_AUTO_TEST_CASE(scrypt_multilane)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        TestKernel(&scrypt_1024_1_1_256_sp_avx2_8way, 8);
+    if (__builtin_cpu_supports("avx512f"))
+        TestKernel(&scrypt_1024_1_1_256_sp_avx512_16way, 16);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(scrypt_batch)
+{
+    BOOST_TEST_MESSAGE("scrypt implementation: " << scrypt_detect_multilane());
+
+    // Cover empty, partial and several full batches of every kernel
+    const size_t sizes[] = {0, 1, 2, 7, 8, 9, 17, 35};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const std::vector<char> inputs = RandomInputs(sizes[i]);
+        std::vector<char> hashes(32 * sizes[i]);
+        scrypt_1024_1_1_256_batch(inputs.empty() ? NULL : &inputs[0], hashes.empty() ? NULL : &hashes[0], sizes[i]);
+        BOOST_CHECK(hashes == SingleHashes(inputs));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -44,6 +44,35 @@ BOOST_AUTO_TEST_CASE(skiplist_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(skiplist_algo_test)
+{
+    std::vector<CBlockIndex> vIndex(SKIPLIST_LENGTH);
+
+    // Mine with the two algorithms in runs of random length, so that
+    // there are also long stretches without one of them.
+    PowAlgo algo = ALGO_SHA256D;
+    for (int i=0; i<SKIPLIST_LENGTH; i++) {
+        if (insecure_rand() % 100 == 0)
+            algo = (algo == ALGO_SHA256D ? ALGO_SCRYPT : ALGO_SHA256D);
+        CBlockHeader header;
+        header.SetAlgo(algo);
+        vIndex[i].nVersion = header.nVersion;
+        vIndex[i].nHeight = i;
+        vIndex[i].pprev = (i == 0) ? NULL : &vIndex[i - 1];
+        vIndex[i].BuildSkip();
+    }
+
+    // Compare against keeping track of the last block of each algo.
+    const CBlockIndex* pindexLast[NUM_ALGOS] = {NULL, NULL};
+    for (int i=0; i<SKIPLIST_LENGTH; i++) {
+        for (int a=0; a<NUM_ALGOS; a++)
+            BOOST_CHECK(vIndex[i].pprevAlgo[a] == pindexLast[a]);
+        pindexLast[vIndex[i].GetAlgo()] = &vIndex[i];
+        for (int a=0; a<NUM_ALGOS; a++)
+            BOOST_CHECK(vIndex[i].GetLastOfAlgo(static_cast<PowAlgo>(a)) == pindexLast[a]);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(getlocator_test)
 {
     // Build a main chain 100000 blocks long.
@@ -6,9 +6,11 @@
 
 #include "test_bitcoin.h"
 
+#include "auxpow.h"
 #include "chainparams.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "game/db.h"
 #include "key.h"
 #include "validation.h"
@@ -21,6 +23,7 @@
 #include "ui_interface.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/sigcache.h"
 
 #include "test/testutil.h"
 
@@ -38,12 +41,15 @@ extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
 {
+        SHA256AutoDetect();
         ECC_Start();
         SetupEnvironment();
         SetupNetworking();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         SelectParams(chainName);
+        InitSignatureCache();
+        InitAuxpowCheckCache();
         noui_connect();
 }
 
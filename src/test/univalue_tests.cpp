@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <vector>
 #include <string>
+#include <limits>
 #include <map>
 #include <univalue.h>
 #include "test/test_bitcoin.h"
@@ -343,6 +344,56 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK_EQUAL(v[0].get_str(), correctValue);
 }
 
+BOOST_AUTO_TEST_CASE(univalue_long_strings)
+{
+    /* Strings are scanned in blocks of eight bytes.  Check that special
+       characters are found at every position within a block.  */
+    const std::string plain = "abcdefghijklmnopqrstuvwxyz0123456789";
+    const std::string specials[] = {"\"", "\\", "\n", "\x7f", "\xc3\xa4"};
+    for (const std::string& special : specials) {
+        for (unsigned i = 0; i <= 16; ++i) {
+            const std::string str = plain.substr(0, i) + special + plain;
+            UniValue v(UniValue::VARR);
+            BOOST_CHECK(v.push_back(str));
+
+            const std::string json = v.write();
+            UniValue r;
+            BOOST_CHECK(r.read(json));
+            BOOST_CHECK_EQUAL(r[0].get_str(), str);
+            BOOST_CHECK(r.read(json, false));
+            BOOST_CHECK_EQUAL(r[0].get_str(), str);
+            BOOST_CHECK_EQUAL(r.write(), json);
+        }
+    }
+
+    /* Raw control characters are only accepted in lenient mode.  */
+    UniValue v;
+    const std::string jsonControl = "[\"" + plain + "\t" + plain + "\"]";
+    BOOST_CHECK(!v.read(jsonControl));
+    BOOST_CHECK(v.read(jsonControl, false));
+    BOOST_CHECK_EQUAL(v[0].get_str(), plain + "\t" + plain);
+
+    /* Invalid UTF-8 after a long run is still rejected in strict mode.  */
+    const std::string jsonInvalid = "[\"" + plain + "\xc3" + plain + "\"]";
+    BOOST_CHECK(!v.read(jsonInvalid));
+    BOOST_CHECK(v.read(jsonInvalid, false));
+
+    /* Parsing stops at an embedded NUL byte, as for C strings.  */
+    std::string jsonNul("[42]");
+    jsonNul.push_back('\0');
+    jsonNul += " garbage";
+    BOOST_CHECK(v.read(jsonNul));
+    BOOST_CHECK_EQUAL(v.write(), "[42]");
+    BOOST_CHECK(!v.read(jsonNul.data(), jsonNul.find(']')));
+
+    /* Integers are formatted directly.  */
+    BOOST_CHECK_EQUAL(UniValue(std::numeric_limits<int64_t>::min()).getValStr(),
+                      "-9223372036854775808");
+    BOOST_CHECK_EQUAL(UniValue(std::numeric_limits<uint64_t>::max()).getValStr(),
+                      "18446744073709551615");
+    BOOST_CHECK_EQUAL(UniValue(0).getValStr(), "0");
+}
+
 /* Special tests for accepting various "wrong" constructs that appear
    in the Huntercoin blockchain.  */
 
@@ -19,6 +19,7 @@
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class CSnapshotRecord;
 class uint256;
 
 //! -dbcache default (MiB)
@@ -35,6 +36,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Table files kept open for the coin DB.  Name and coin lookups that miss
+//! are answered by the bloom filters of open tables without reading from
+//! disk.  64-bit builds mmap up to 1000 tables without holding descriptors.
+static const int nDefaultCoinsDBMaxOpenFiles = sizeof(void*) > 4 ? 1000 : 64;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -78,16 +83,53 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/**
+ * Entry of the game transaction index.  Game transactions are only stored
+ * in the undo files.  The position points directly to the tx in the undo
+ * file, and the hash of the block that generated it is stored alongside.
+ * Thus a lookup needs a single read, in contrast to game tx entries in
+ * the ordinary tx index (which need the block header to be read as well).
+ */
+struct CDiskGameTxPos : public CDiskBlockPos
+{
+    uint256 hashBlock;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(*(CDiskBlockPos*)this);
+        READWRITE(hashBlock);
+    }
+
+    CDiskGameTxPos(const CDiskBlockPos &posIn, const uint256 &hashBlockIn)
+      : CDiskBlockPos(posIn.nFile, posIn.nPos), hashBlock(hashBlockIn)
+    {}
+
+    CDiskGameTxPos() {
+        SetNull();
+    }
+
+    void SetNull() {
+        CDiskBlockPos::SetNull();
+        hashBlock.SetNull();
+    }
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! Lookups of current name data, which share the database with the coins
+    mutable std::atomic<uint64_t> nNameReads;
+    mutable std::atomic<uint64_t> nNameHits;
 public:
-    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, const std::string& strName = "chainstate");
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     bool GetName(const valtype &name, CNameData &data) const;
     bool GetNameHistory(const valtype &name, CNameHistory &data) const;
@@ -95,6 +137,12 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const CNameCache &names);
     CCoinsViewCursor *Cursor() const;
     bool ValidateNameDB(CGameDB& gameDb) const;
+
+    CDBStats GetDBStats() const { return db.GetStats(); }
+    void GetNameStats(uint64_t& nReads, uint64_t& nHits) const;
+
+    //! Attempt to update from an older database format. Returns whether an error occurred.
+    bool Upgrade();
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -103,8 +151,8 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     ~CCoinsViewDBCursor() {}
 
-    bool GetKey(uint256 &key) const;
-    bool GetValue(CCoins &coins) const;
+    bool GetKey(COutPoint &key) const;
+    bool GetValue(Coin &coin) const;
     unsigned int GetValueSize() const;
 
     bool Valid() const;
@@ -114,7 +162,7 @@ private:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
         CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
     std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
 };
@@ -135,8 +183,13 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool ReadGameTxIndex(const uint256 &txid, CDiskGameTxPos &pos);
+    bool WriteGameTxIndex(const std::vector<std::pair<uint256, CDiskGameTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    bool WriteSnapshot(const CSnapshotRecord &record);
+    bool ReadSnapshot(CSnapshotRecord &record);
+    bool EraseSnapshot();
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -6,67 +6,103 @@
 #ifndef BITCOIN_UNDO_H
 #define BITCOIN_UNDO_H
 
+#include "coins.h"
 #include "compressor.h" 
+#include "consensus/consensus.h"
 #include "names/main.h"
 #include "primitives/transaction.h"
 #include "serialize.h"
+#include "version.h"
 
 /** Undo information for a CTxIn
  *
- *  Contains the prevout's CTxOut being spent, and if this was the
- *  last output of the affected transaction, its metadata as well
- *  (coinbase or not, height, transaction version)
+ *  Contains the prevout's CTxOut being spent, and its metadata as well
+ *  (coinbase or not, game tx or not, height). The serialization contains a
+ *  dummy value of zero. This is be compatible with older versions which
+ *  expect to see the transaction version there.
  */
-class CTxInUndo
+class TxInUndoSerializer
 {
-public:
-    CTxOut txout;         // the txout data before being spent
-    bool fCoinBase;       // if the outpoint was the last unspent: whether it belonged to a coinbase
-    bool fGameTx;         // if the outpoint was the last unspent: whether it belonged to a game tx
-    unsigned int nHeight; // if the outpoint was the last unspent: its height
-    int nVersion;         // if the outpoint was the last unspent: its version
-
-    CTxInUndo()
-      : txout(), fCoinBase(false), fGameTx(false), nHeight(0), nVersion(0) {}
-    CTxInUndo(const CTxOut &txoutIn, bool fCoinBaseIn = false,
-              bool fGameTxIn = false, unsigned int nHeightIn = 0,
-              int nVersionIn = 0)
-      : txout(txoutIn), fCoinBase(fCoinBaseIn), fGameTx(fGameTxIn),
-        nHeight(nHeightIn), nVersion(nVersionIn) { }
+    const Coin* txout;
 
+public:
     template<typename Stream>
     void Serialize(Stream &s) const {
-        ::Serialize(s, VARINT(nHeight*4+(fCoinBase ? 1 : 0)+(fGameTx ? 2 : 0)));
-        if (nHeight > 0)
-            ::Serialize(s, VARINT(this->nVersion));
-        ::Serialize(s, CTxOutCompressor(REF(txout)));
+        ::Serialize(s, VARINT(txout->nHeight * 4 + (txout->fCoinBase ? 1 : 0) + (txout->fGameTx ? 2 : 0)));
+        if (txout->nHeight > 0) {
+            // Required to maintain compatibility with older undo format.
+            ::Serialize(s, (unsigned char)0);
+        }
+        ::Serialize(s, CTxOutCompressor(REF(txout->out)));
     }
 
+    TxInUndoSerializer(const Coin* coin) : txout(coin) {}
+};
+
+class TxInUndoDeserializer
+{
+    Coin* txout;
+
+public:
     template<typename Stream>
     void Unserialize(Stream &s) {
         unsigned int nCode = 0;
         ::Unserialize(s, VARINT(nCode));
-        nHeight = nCode / 4;
-        fCoinBase = nCode & 1;
-        fGameTx = nCode & 2;
-        if (nHeight > 0)
-            ::Unserialize(s, VARINT(this->nVersion));
-        ::Unserialize(s, REF(CTxOutCompressor(REF(txout))));
+        txout->nHeight = nCode / 4;
+        txout->fCoinBase = nCode & 1;
+        txout->fGameTx = (nCode & 2) != 0;
+        if (txout->nHeight > 0) {
+            // Old versions stored the version number for the last spend of
+            // a transaction's outputs. Non-final spends were indicated with
+            // height = 0.
+            int nVersionDummy;
+            ::Unserialize(s, VARINT(nVersionDummy));
+        }
+        ::Unserialize(s, REF(CTxOutCompressor(REF(txout->out))));
     }
+
+    TxInUndoDeserializer(Coin* coin) : txout(coin) {}
 };
 
+static const size_t MAX_INPUTS_PER_BLOCK = MAX_BLOCK_BASE_SIZE / ::GetSerializeSize(CTxIn(), SER_NETWORK, PROTOCOL_VERSION);
+
+/** Serialize a list of spent coins in the undo format.  */
+template<typename Stream>
+void SerializeUndoCoins(Stream& s, const std::vector<Coin>& vcoins)
+{
+    uint64_t count = vcoins.size();
+    ::Serialize(s, COMPACTSIZE(REF(count)));
+    for (const auto& coin : vcoins)
+        ::Serialize(s, REF(TxInUndoSerializer(&coin)));
+}
+
+template<typename Stream>
+void UnserializeUndoCoins(Stream& s, std::vector<Coin>& vcoins)
+{
+    uint64_t count = 0;
+    ::Unserialize(s, COMPACTSIZE(count));
+    if (count > MAX_INPUTS_PER_BLOCK)
+        throw std::ios_base::failure("Too many input undo records");
+    vcoins.resize(count);
+    for (auto& coin : vcoins)
+        ::Unserialize(s, REF(TxInUndoDeserializer(&coin)));
+}
+
 /** Undo information for a CTransaction */
 class CTxUndo
 {
 public:
     // undo information for all txins
-    std::vector<CTxInUndo> vprevout;
+    std::vector<Coin> vprevout;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        SerializeUndoCoins(s, vprevout);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(vprevout);
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        UnserializeUndoCoins(s, vprevout);
     }
 };
 
@@ -79,7 +115,7 @@ public:
     /** Stack of operations done to the name database.  */
     std::vector<CNameTxUndo> vnameundo;
     /** Undo information for expired name coins.  */
-    std::vector<CTxInUndo> vexpired;
+    std::vector<Coin> vexpired;
 
     /**
      * Store game transactions.  They are not on disk anywhere else and
@@ -88,18 +124,23 @@ public:
      */
     std::vector<CTransactionRef> vgametx;
 
-    ADD_SERIALIZE_METHODS;
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
+    /* Store the vgametx first.  This allows us to compute the appropriate
+       offsets most easily.  */
 
-        /* Store the vgametx first.  This allows us to compute the appropriate
-           offsets most easily.  */
-        READWRITE(vgametx);
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        ::Serialize(s, vgametx);
+        ::Serialize(s, vtxundo);
+        ::Serialize(s, vnameundo);
+        SerializeUndoCoins(s, vexpired);
+    }
 
-        READWRITE(vtxundo);
-        READWRITE(vnameundo);
-        READWRITE(vexpired);
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        ::Unserialize(s, vgametx);
+        ::Unserialize(s, vtxundo);
+        ::Unserialize(s, vnameundo);
+        UnserializeUndoCoins(s, vexpired);
     }
 };
 
@@ -47,7 +47,6 @@ public:
         std::string s(val_);
         setStr(s);
     }
-    ~UniValue() {}
 
     void clear();
 
@@ -84,6 +83,7 @@ public:
     bool isObject() const { return (typ == VOBJ); }
 
     bool push_back(const UniValue& val);
+    bool push_back(UniValue&& val);
     bool push_back(const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return push_back(tmpVal);
@@ -95,6 +95,7 @@ public:
     bool push_backV(const std::vector<UniValue>& vec);
 
     bool pushKV(const std::string& key, const UniValue& val);
+    bool pushKV(const std::string& key, UniValue&& val);
     bool pushKV(const std::string& key, const std::string& val_) {
         UniValue tmpVal(VSTR, val_);
         return pushKV(key, tmpVal);
@@ -124,9 +125,10 @@ public:
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
 
+    bool read(const char *raw, size_t size, bool fStrict = true);
     bool read(const char *raw, bool fStrict = true);
     bool read(const std::string& rawStr, bool fStrict = true) {
-        return read(rawStr.c_str(), fStrict);
+        return read(rawStr.data(), rawStr.size(), fStrict);
     }
 
 private:
@@ -136,6 +138,8 @@ private:
     std::vector<UniValue> values;
 
     int findKey(const std::string& key) const;
+    size_t sizeHint() const;
+    void writeTo(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
     void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
 
@@ -154,7 +158,7 @@ public:
 
     enum VType type() const { return getType(); }
     bool push_back(std::pair<std::string,UniValue> pear) {
-        return pushKV(pear.first, pear.second);
+        return pushKV(pear.first, std::move(pear.second));
     }
     friend const UniValue& find_value( const UniValue& obj, const std::string& name);
 
@@ -243,7 +247,7 @@ enum jtokentype {
 
 extern enum jtokentype getJsonToken(std::string& tokenVal,
                                     unsigned int& consumed, const char *raw,
-                                    bool fStrict = true);
+                                    const char *end, bool fStrict = true);
 extern const char *uvTypeName(UniValue::VType t);
 
 static inline bool jsonTokenIsValue(enum jtokentype jtt)
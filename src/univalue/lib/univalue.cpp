@@ -104,7 +104,8 @@ static bool validNumStr(const string& s)
 {
     string tokenVal;
     unsigned int consumed;
-    enum jtokentype tt = getJsonToken(tokenVal, consumed, s.c_str());
+    enum jtokentype tt = getJsonToken(tokenVal, consumed, s.data(),
+                                      s.data() + s.size());
     return (tt == JTOK_NUMBER);
 }
 
@@ -119,22 +120,40 @@ bool UniValue::setNumStr(const string& val_)
     return true;
 }
 
-bool UniValue::setInt(uint64_t val_)
+// Format an integer directly, without a stream and the validation done by
+// setNumStr.  Large JSON replies (e. g. the game state) consist mostly
+// of integers.
+static void formatInt(uint64_t val_, bool negative, string& out)
 {
-    ostringstream oss;
+    char buf[24];
+    char *p = buf + sizeof(buf);
+    do {
+        *--p = '0' + (val_ % 10);
+        val_ /= 10;
+    } while (val_ != 0);
+    if (negative)
+        *--p = '-';
 
-    oss << val_;
+    out.assign(p, buf + sizeof(buf));
+}
 
-    return setNumStr(oss.str());
+bool UniValue::setInt(uint64_t val_)
+{
+    clear();
+    typ = VNUM;
+    formatInt(val_, false, val);
+    return true;
 }
 
 bool UniValue::setInt(int64_t val_)
 {
-    ostringstream oss;
-
-    oss << val_;
-
-    return setNumStr(oss.str());
+    clear();
+    typ = VNUM;
+    if (val_ < 0)
+        formatInt(-static_cast<uint64_t>(val_), true, val);
+    else
+        formatInt(val_, false, val);
+    return true;
 }
 
 bool UniValue::setFloat(double val_)
@@ -179,6 +198,15 @@ bool UniValue::push_back(const UniValue& val_)
     return true;
 }
 
+bool UniValue::push_back(UniValue&& val_)
+{
+    if (typ != VARR)
+        return false;
+
+    values.push_back(std::move(val_));
+    return true;
+}
+
 bool UniValue::push_backV(const std::vector<UniValue>& vec)
 {
     if (typ != VARR)
@@ -199,6 +227,16 @@ bool UniValue::pushKV(const std::string& key, const UniValue& val_)
     return true;
 }
 
+bool UniValue::pushKV(const std::string& key, UniValue&& val_)
+{
+    if (typ != VOBJ)
+        return false;
+
+    keys.push_back(key);
+    values.push_back(std::move(val_));
+    return true;
+}
+
 bool UniValue::pushKVs(const UniValue& obj)
 {
     if (typ != VOBJ || obj.typ != VOBJ)
@@ -266,7 +304,7 @@ bool UniValue::extractField(const std::string& name, UniValue& res)
     for (unsigned i = 0; i < keys.size(); ++i)
         if (keys[i] == name)
         {
-            res = values[i];
+            res = std::move(values[i]);
             keys.erase(keys.begin() + i);
             values.erase(values.begin() + i);
             return true;
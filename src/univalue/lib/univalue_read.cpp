@@ -42,17 +42,63 @@ static const char *hatoui(const char *first, const char *last,
     return first;
 }
 
+/* Bytes that end a run of plain string characters:  Quotes and backslashes
+   always, and in strict mode also control characters and non-ASCII bytes
+   (which go through the UTF-8 filter).  */
+static inline bool json_isplain(unsigned char ch, bool fStrict)
+{
+    if (ch == '"' || ch == '\\')
+        return false;
+    return !fStrict || (ch >= 0x20 && ch < 0x80);
+}
+
+static const uint64_t ONES = 0x0101010101010101ULL;
+static const uint64_t HIGHS = 0x8080808080808080ULL;
+
+/* Return nonzero if any byte in x is zero or less than n (n <= 0x80).  */
+static inline uint64_t hasLess(uint64_t x, unsigned char n)
+{
+    return (x - ONES * n) & ~x & HIGHS;
+}
+
+/* Skip a run of plain string characters, eight bytes at a time as long as
+   there are enough of them.  */
+static const char *skipPlain(const char *raw, const char *end, bool fStrict)
+{
+    while (end - raw >= 8) {
+        uint64_t x;
+        memcpy(&x, raw, sizeof(x));
+
+        uint64_t special = hasLess(x ^ (ONES * '"'), 1)
+                            | hasLess(x ^ (ONES * '\\'), 1);
+        if (fStrict)
+            special |= hasLess(x, 0x20) | (x & HIGHS);
+        if (special)
+            break;
+
+        raw += 8;
+    }
+
+    while (raw < end && json_isplain(*raw, fStrict))
+        raw++;
+
+    return raw;
+}
+
 enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
-                            const char *raw, bool fStrict)
+                            const char *raw, const char *end, bool fStrict)
 {
     tokenVal.clear();
     consumed = 0;
 
     const char *rawStart = raw;
 
-    while ((*raw) && (json_isspace(*raw)))             // skip whitespace
+    while (raw < end && (json_isspace(*raw)))          // skip whitespace
         raw++;
 
+    if (raw >= end)
+        return JTOK_NONE;
+
     switch (*raw) {
 
     case 0:
@@ -87,15 +133,15 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case 'n':
     case 't':
     case 'f':
-        if (!strncmp(raw, "null", 4)) {
+        if (end - raw >= 4 && !memcmp(raw, "null", 4)) {
             raw += 4;
             consumed = (raw - rawStart);
             return JTOK_KW_NULL;
-        } else if (!strncmp(raw, "true", 4)) {
+        } else if (end - raw >= 4 && !memcmp(raw, "true", 4)) {
             raw += 4;
             consumed = (raw - rawStart);
             return JTOK_KW_TRUE;
-        } else if (!strncmp(raw, "false", 5)) {
+        } else if (end - raw >= 5 && !memcmp(raw, "false", 5)) {
             raw += 5;
             consumed = (raw - rawStart);
             return JTOK_KW_FALSE;
@@ -114,63 +160,54 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '8':
     case '9': {
         // part 1: int
-        string numStr;
-
         if (*raw == '-')
           {
-            if (!json_isdigit (raw[1]))
+            if (end - raw < 2 || !json_isdigit (raw[1]))
               return JTOK_ERR;
-            numStr += *raw;
+            tokenVal += *raw;
             ++raw;
           }
 
         /* Special rule for Huntercoin:  Allow leading zeros
            on integer literals.  This is necessary to accept, e. g.,
            b61a163c424ab8341477e596d3b9edf14d1cd41516d8b8110c084d5a28c5e99f.  */
-        while (raw[0] == '0' && isdigit (raw[1]))
+        while (end - raw >= 2 && raw[0] == '0' && json_isdigit (raw[1]))
           {
             if (fStrict)
               return JTOK_ERR;
             ++raw;
           }
 
-        while ((*raw) && json_isdigit(*raw)) {     // copy digits
-            numStr += *raw;
+        // The remaining characters are copied as a whole.
+        const char *numStart = raw;
+
+        while (raw < end && json_isdigit(*raw))     // skip digits
             raw++;
-        }
 
         // part 2: frac
-        if (*raw == '.') {
-            numStr += *raw;                   // copy .
-            raw++;
+        if (raw < end && *raw == '.') {
+            raw++;                            // skip .
 
-            if (!json_isdigit(*raw))
+            if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while ((*raw) && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // skip digits
                 raw++;
-            }
         }
 
         // part 3: exp
-        if (*raw == 'e' || *raw == 'E') {
-            numStr += *raw;                   // copy E
-            raw++;
+        if (raw < end && (*raw == 'e' || *raw == 'E')) {
+            raw++;                            // skip E
 
-            if (*raw == '-' || *raw == '+') { // copy +/-
-                numStr += *raw;
+            if (raw < end && (*raw == '-' || *raw == '+')) // skip +/-
                 raw++;
-            }
 
-            if (!json_isdigit(*raw))
+            if (raw >= end || !json_isdigit(*raw))
                 return JTOK_ERR;
-            while ((*raw) && json_isdigit(*raw)) { // copy digits
-                numStr += *raw;
+            while (raw < end && json_isdigit(*raw)) // skip digits
                 raw++;
-            }
         }
 
-        tokenVal = numStr;
+        tokenVal.append(numStart, raw - numStart);
         consumed = (raw - rawStart);
         return JTOK_NUMBER;
         }
@@ -178,10 +215,15 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
     case '"': {
         raw++;                                // skip "
 
-        string valStr;
-        JSONUTF8StringFilter writer(valStr);
+        JSONUTF8StringFilter writer(tokenVal);
+
+        while (raw < end) {
+            const char *run = raw;
+            raw = skipPlain(raw, end, fStrict);
+            writer.append_run(run, raw - run);
+            if (raw >= end)
+                break;
 
-        while (*raw) {
             /* Since the Huntercoin chain contains some chat messages with
                raw characters that fail this check, disable the test.  A tx
                violating this rule is, e. g.,
@@ -192,6 +234,8 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
 
             if (*raw == '\\') {
                 raw++;                        // skip backslash
+                if (raw >= end)
+                    return JTOK_ERR;
 
                 switch (*raw) {
                 case '"':  writer.push_back('\"'); break;
@@ -210,12 +254,13 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
                 case '\'':
                     if (fStrict)
                         return JTOK_ERR;
-                    valStr += "'";
+                    tokenVal += "'";
                     break;
 
                 case 'u': {
                     unsigned int codepoint;
-                    if (hatoui(raw + 1, raw + 1 + 4, codepoint) !=
+                    if (end - raw < 1 + 4 ||
+                        hatoui(raw + 1, raw + 1 + 4, codepoint) !=
                                raw + 1 + 4)
                         return JTOK_ERR;
                     writer.push_back_u(codepoint);
@@ -236,20 +281,18 @@ enum jtokentype getJsonToken(string& tokenVal, unsigned int& consumed,
             }
 
             else {
-                // Huntercoin chat messages contain invalid UTF-8, so we just
-                // replicate the raw characters.
+                // Only non-ASCII bytes in strict mode end up here.  In
+                // non-strict mode, raw characters are copied as part of
+                // the plain runs above, since Huntercoin chat messages
+                // contain invalid UTF-8.
                 // FIXME: Work out a better solution here.
-                if (fStrict)
-                    writer.push_back(*raw);
-                else
-                    valStr += *raw;
+                writer.push_back(*raw);
                 raw++;
             }
         }
 
         if (fStrict && !writer.finalize())
             return JTOK_ERR;
-        tokenVal = valStr;
         consumed = (raw - rawStart);
         return JTOK_STRING;
         }
@@ -272,9 +315,21 @@ enum expect_bits {
 #define clearExpect(bit) (expectMask &= ~EXP_##bit)
 
 bool UniValue::read(const char *raw, bool fStrict)
+{
+    return read(raw, strlen(raw), fStrict);
+}
+
+bool UniValue::read(const char *raw, size_t size, bool fStrict)
 {
     clear();
 
+    /* Like for C strings, parsing stops at the first NUL byte.  Moves are
+       parsed from std::strings taken from the chain, so this must not
+       change their meaning.  */
+    const char *end = static_cast<const char *>(memchr(raw, 0, size));
+    if (!end)
+        end = raw + size;
+
     uint32_t expectMask = 0;
     vector<UniValue*> stack;
 
@@ -285,7 +340,7 @@ bool UniValue::read(const char *raw, bool fStrict)
     do {
         last_tok = tok;
 
-        tok = getJsonToken(tokenVal, consumed, raw, fStrict);
+        tok = getJsonToken(tokenVal, consumed, raw, end, fStrict);
         if (tok == JTOK_NONE || tok == JTOK_ERR)
             return false;
         raw += consumed;
@@ -337,9 +392,8 @@ bool UniValue::read(const char *raw, bool fStrict)
                     setArray();
                 stack.push_back(this);
             } else {
-                UniValue tmpVal(utyp);
                 UniValue *top = stack.back();
-                top->values.push_back(tmpVal);
+                top->values.push_back(UniValue(utyp));
 
                 UniValue *newTop = &(top->values.back());
                 stack.push_back(newTop);
@@ -399,23 +453,21 @@ bool UniValue::read(const char *raw, bool fStrict)
             if (!stack.size())
                 return false;
 
-            UniValue tmpVal;
+            UniValue *top = stack.back();
+            top->values.push_back(UniValue());
             switch (tok) {
             case JTOK_KW_NULL:
                 // do nothing more
                 break;
             case JTOK_KW_TRUE:
-                tmpVal.setBool(true);
+                top->values.back().setBool(true);
                 break;
             case JTOK_KW_FALSE:
-                tmpVal.setBool(false);
+                top->values.back().setBool(false);
                 break;
             default: /* impossible */ break;
             }
 
-            UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
-
             setExpect(NOT_VALUE);
             break;
             }
@@ -424,9 +476,10 @@ bool UniValue::read(const char *raw, bool fStrict)
             if (!stack.size())
                 return false;
 
-            UniValue tmpVal(VNUM, tokenVal);
+            // The token is moved into the new value instead of copied.
             UniValue *top = stack.back();
-            top->values.push_back(tmpVal);
+            top->values.push_back(UniValue(VNUM));
+            top->values.back().val.swap(tokenVal);
 
             setExpect(NOT_VALUE);
             break;
@@ -439,12 +492,13 @@ bool UniValue::read(const char *raw, bool fStrict)
             UniValue *top = stack.back();
 
             if (expect(OBJ_NAME)) {
-                top->keys.push_back(tokenVal);
+                top->keys.push_back(string());
+                top->keys.back().swap(tokenVal);
                 clearExpect(OBJ_NAME);
                 setExpect(COLON);
             } else {
-                UniValue tmpVal(VSTR, tokenVal);
-                top->values.push_back(tmpVal);
+                top->values.push_back(UniValue(VSTR));
+                top->values.back().val.swap(tokenVal);
             }
 
             setExpect(NOT_VALUE);
@@ -457,7 +511,7 @@ bool UniValue::read(const char *raw, bool fStrict)
     } while (!stack.empty ());
 
     /* Check that nothing follows the initial construct (parsed above).  */
-    tok = getJsonToken(tokenVal, consumed, raw, fStrict);
+    tok = getJsonToken(tokenVal, consumed, raw, end, fStrict);
     if (fStrict && tok != JTOK_NONE)
         return false;
 
@@ -45,6 +45,17 @@ public:
                 push_back_u(codepoint);
         }
     }
+    // Write a run of characters that are not part of a UTF-8 sequence.
+    // Outside of a sequence, this is the same as pushing them one by one.
+    void append_run(const char *begin, size_t len)
+    {
+        if (state == 0) {
+            str.append(begin, len);
+            return;
+        }
+        for (size_t i = 0; i < len; ++i)
+            push_back(begin[i]);
+    }
     // Write codepoint directly, possibly collating surrogate pairs
     void push_back_u(unsigned int codepoint)
     {
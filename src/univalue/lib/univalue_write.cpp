@@ -10,30 +10,66 @@
 
 using namespace std;
 
-static string json_escape(const string& inS)
+// Append inS to outS with JSON escaping.  Runs of characters that need no
+// escaping are copied as a whole.
+static void json_escape(const string& inS, string& outS)
 {
-    string outS;
-    outS.reserve(inS.size() * 2);
+    const char *run = inS.data();
+    const char *end = run + inS.size();
 
-    for (unsigned int i = 0; i < inS.size(); i++) {
-        unsigned char ch = inS[i];
-        const char *escStr = escapes[ch];
+    for (const char *p = run; p != end; ++p) {
+        const char *escStr = escapes[(unsigned char)*p];
+        if (!escStr)
+            continue;
 
-        if (escStr)
-            outS += escStr;
-        else
-            outS += ch;
+        outS.append(run, p - run);
+        outS += escStr;
+        run = p + 1;
     }
 
-    return outS;
+    outS.append(run, end - run);
 }
 
 string UniValue::write(unsigned int prettyIndent,
                        unsigned int indentLevel) const
 {
     string s;
-    s.reserve(1024);
+    s.reserve(sizeHint());
 
+    writeTo(prettyIndent, indentLevel, s);
+
+    return s;
+}
+
+// Rough size of the compact output, used to reserve the output buffer
+// once instead of growing it repeatedly for large replies.
+size_t UniValue::sizeHint() const
+{
+    switch (typ) {
+    case VNULL:
+    case VBOOL:
+        return 5;
+    case VSTR:
+        return val.size() + 2;
+    case VNUM:
+        return val.size();
+    case VOBJ:
+    case VARR:
+        break;
+    }
+
+    size_t size = 2 + values.size();
+    for (unsigned int i = 0; i < keys.size(); i++)
+        size += keys[i].size() + 3;
+    for (unsigned int i = 0; i < values.size(); i++)
+        size += values[i].sizeHint();
+
+    return size;
+}
+
+void UniValue::writeTo(unsigned int prettyIndent, unsigned int indentLevel,
+                       string& s) const
+{
     unsigned int modIndent = indentLevel;
     if (modIndent == 0)
         modIndent = 1;
@@ -49,7 +85,9 @@ string UniValue::write(unsigned int prettyIndent,
         writeArray(prettyIndent, modIndent, s);
         break;
     case VSTR:
-        s += "\"" + json_escape(val) + "\"";
+        s += '"';
+        json_escape(val, s);
+        s += '"';
         break;
     case VNUM:
         s += val;
@@ -58,8 +96,6 @@ string UniValue::write(unsigned int prettyIndent,
         s += (val == "1" ? "true" : "false");
         break;
     }
-
-    return s;
 }
 
 static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, string& s)
@@ -76,7 +112,7 @@ void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, s
     for (unsigned int i = 0; i < values.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += values[i].write(prettyIndent, indentLevel + 1);
+        values[i].writeTo(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1)) {
             s += ",";
             if (prettyIndent)
@@ -100,10 +136,12 @@ void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel,
     for (unsigned int i = 0; i < keys.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += "\"" + json_escape(keys[i]) + "\":";
+        s += '"';
+        json_escape(keys[i], s);
+        s += "\":";
         if (prettyIndent)
             s += " ";
-        s += values.at(i).write(prettyIndent, indentLevel + 1);
+        values.at(i).writeTo(prettyIndent, indentLevel + 1, s);
         if (i != (values.size() - 1))
             s += ",";
         if (prettyIndent)
@@ -114,4 +152,3 @@ void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel,
         indentStr(prettyIndent, indentLevel - 1, s);
     s += "}";
 }
-
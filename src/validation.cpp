@@ -19,6 +19,7 @@
 #include "game/tx.h"
 #include "hash.h"
 #include "init.h"
+#include "lrucache.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -28,6 +29,8 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "scrypt/scrypt.h"
+#include "snapshot.h"
 #include "timedata.h"
 #include "tinyformat.h"
 #include "txdb.h"
@@ -41,6 +44,9 @@
 #include "versionbits.h"
 
 #include <atomic>
+#include <deque>
+#include <future>
+#include <limits>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -65,12 +71,14 @@ CCriticalSection cs_main;
 BlockMap mapBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
+CBlockIndex *pindexSnapshotBase = NULL;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
+bool fCompactAuxpowStorage = DEFAULT_COMPACT_AUXPOW_STORAGE;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -158,8 +166,30 @@ namespace {
     /** Dirty block index entries. */
     set<CBlockIndex*> setDirtyBlockIndex;
 
+    /** All blocks up to this height before pindexSnapshotBase have data. */
+    int nSnapshotHistoryHeight = 0;
+
     /** Dirty block file entries. */
     set<int> setDirtyFileInfo;
+
+    /** Recently generated or looked-up game transactions, together with
+     *  the hash of the block they belong to.  Protected by cs_main. */
+    lrucache<uint256, std::pair<CTransactionRef, uint256> > recentGameTx(MAX_RECENT_GAMETX);
+
+    /** Auxpows of recently accepted or served block headers, so that
+     *  answering getheaders does not need a disk read (and a parent
+     *  block PoW check) per header.  The auxpows are shared with the
+     *  headers handed out and must not be modified. */
+    CCriticalSection cs_auxpowCache;
+    lrucache<uint256, boost::shared_ptr<CAuxPow> > auxpowCache((DEFAULT_AUXPOW_CACHE_SIZE << 20) / MAX_AUXPOW_CACHE_ENTRY_SIZE);
+
+    void CacheAuxpow(const uint256& hash, const boost::shared_ptr<CAuxPow>& auxpow)
+    {
+        if (!auxpow || ::GetSerializeSize(*auxpow, SER_NETWORK, PROTOCOL_VERSION) > MAX_AUXPOW_CACHE_ENTRY_SIZE)
+            return;
+        LOCK(cs_auxpowCache);
+        auxpowCache.insert(hash, auxpow);
+    }
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -181,6 +211,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 CBlockTreeDB *pblocktree = NULL;
 CGameDB *pgameDb = NULL;
 
@@ -369,15 +400,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -437,7 +468,7 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
     unsigned int nSigOps = 0;
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
+        const CTxOut &prevout = inputs.AccessCoin(tx.vin[i].prevout).out;
         if (prevout.scriptPubKey.IsPayToScriptHash(true))
             nSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
     }
@@ -457,7 +488,7 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
-        const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
+        const CTxOut &prevout = inputs.AccessCoin(tx.vin[i].prevout).out;
         nSigOps += CountWitnessSigOps(tx.vin[i].scriptSig, prevout.scriptPubKey, i < tx.wit.vtxinwit.size() ? &tx.wit.vtxinwit[i].scriptWitness : NULL, flags);
     }
     return nSigOps;
@@ -521,9 +552,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -538,7 +569,7 @@ std::string FormatStateMessage(const CValidationState &state)
 
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
-                              std::vector<uint256>& vHashTxnToUncache)
+                              std::vector<COutPoint>& coins_to_uncache)
 {
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
@@ -635,22 +666,26 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         view.SetBackend(viewMemPool);
 
         // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+        for (size_t out = 0; out < tx.vout.size(); out++) {
+            COutPoint outpoint(hash, out);
+            bool had_coin_in_cache = pcoinsTip->HaveCoinInCache(outpoint);
+            if (view.HaveCoin(outpoint)) {
+                if (!had_coin_in_cache) {
+                    coins_to_uncache.push_back(outpoint);
+                }
+                return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+            }
         }
 
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
-                if (pfMissingInputs)
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                coins_to_uncache.push_back(txin.prevout);
+            }
+            if (!view.HaveCoin(txin.prevout)) {
+                if (pfMissingInputs) {
                     *pfMissingInputs = true;
+                }
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
             }
         }
@@ -715,8 +750,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         // during reorgs to ensure COINBASE_MATURITY is still met.
         bool fSpendsCoinbase = false;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase() || coins->IsGameTx()) {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (coin.IsCoinBase() || coin.IsGameTx()) {
                 fSpendsCoinbase = true;
                 break;
             }
@@ -1001,10 +1036,10 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> coins_to_uncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+        BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
     }
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
@@ -1019,6 +1054,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, nAbsurdFee);
 }
 
+/** Flag in the size of a block record in the block files.  It marks
+    blocks written with the compact auxpow encoding.  */
+static const unsigned int BLOCKFILE_COMPACT_AUXPOW = 0x80000000;
+
+/** Serialization version for blocks in the block files.  */
+static int GetBlockFileVersion(bool fCompact)
+{
+    return fCompact ? (CLIENT_VERSION | SERIALIZE_AUXPOW_COMPACT) : CLIENT_VERSION;
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1033,14 +1078,43 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
         return true;
     }
 
+    /* Game transactions are not in any block file.  Look them up in the
+       cache of recently generated ones and in the game tx index, which
+       points directly into the undo files.  */
+    std::pair<CTransactionRef, uint256> recent;
+    if (recentGameTx.get(hash, recent)) {
+        txOut = recent.first;
+        hashBlock = recent.second;
+        return true;
+    }
+    CDiskGameTxPos posGameTx;
+    if (pblocktree->ReadGameTxIndex(hash, posGameTx)) {
+        CAutoFile undo(OpenUndoFile(posGameTx, true), SER_DISK, CLIENT_VERSION);
+        if (undo.IsNull())
+            return error("%s: OpenUndoFile failed", __func__);
+        try {
+            undo >> txOut;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+        if (txOut->GetHash() != hash)
+            return error("%s: txid mismatch", __func__);
+        hashBlock = posGameTx.hashBlock;
+        recentGameTx.insert(hash, std::make_pair(txOut, hashBlock));
+        return true;
+    }
+
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+            CAutoFile file(OpenBlockFile(CDiskBlockPos(postx.nFile, postx.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
             CBlockHeader header;
             try {
+                unsigned int nSize;
+                file >> nSize;
+                file.SetVersion(GetBlockFileVersion(nSize & BLOCKFILE_COMPACT_AUXPOW));
                 file >> header;
                 if (!postx.IsGameTx()) {
                     fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
@@ -1072,24 +1146,36 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
         }
     }
 
+    bool fSlowGameTx = false;
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
         int nHeight = -1;
         {
-            const CCoinsViewCache& view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
+            const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+            if (!coin.IsSpent()) {
+                nHeight = coin.nHeight;
+                fSlowGameTx = coin.IsGameTx();
+            }
         }
         if (nHeight > 0)
             pindexSlow = chainActive[nHeight];
     }
 
-    /* Note that this won't work for game transactions.  For them,
-       the tx index is the only chance.  */
-    /* TODO: Fix this if important.  We could read also the undo file
-       and go over the game tx.  */
-
-    if (pindexSlow) {
+    /* For game transactions (that are not yet in the game tx index,
+       because it was created after their block), read them from the
+       undo data of the block.  */
+    if (pindexSlow && fSlowGameTx) {
+        CBlock block;
+        std::vector<CTransactionRef> vGameTx;
+        if (ReadBlockFromDisk(block, vGameTx, pindexSlow, consensusParams)) {
+            for (const auto& tx : vGameTx) {
+                if (tx->GetHash() == hash) {
+                    txOut = tx;
+                    hashBlock = pindexSlow->GetBlockHash();
+                    return true;
+                }
+            }
+        }
+    } else if (pindexSlow) {
         CBlock block;
         if (ReadBlockFromDisk(block, pindexSlow, consensusParams)) {
             for (const auto& tx : block.vtx) {
@@ -1115,7 +1201,9 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
-bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+/* Check the proof-of-work of a block header.  If pPowHash is not NULL, it
+   is the already computed PoW hash of the block or of its auxpow parent.  */
+static bool CheckProofOfWork(const CBlockHeader& block, const uint256* pPowHash, const Consensus::Params& params)
 {
     const PowAlgo algo = block.GetAlgo();
 
@@ -1137,7 +1225,8 @@ bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params
             return error("%s : no auxpow on block with auxpow version",
                          __func__);
 
-        if (!CheckProofOfWork(block.GetPowHash(algo), block.nBits, algo, params))
+        const uint256 hash = pPowHash ? *pPowHash : block.GetPowHash(algo);
+        if (!CheckProofOfWork(hash, block.nBits, algo, params))
             return error("%s : non-AUX proof of work failed", __func__);
 
         return true;
@@ -1156,22 +1245,177 @@ bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params
 
     if (!block.auxpow->check(block.GetHash(), block.GetChainId(), params))
         return error("%s : AUX POW is not valid", __func__);
-    if (!CheckProofOfWork(block.auxpow->getParentBlockHash(algo), block.nBits, algo, params))
+    const uint256 hash = pPowHash ? *pPowHash : block.auxpow->getParentBlockHash(algo);
+    if (!CheckProofOfWork(hash, block.nBits, algo, params))
         return error("%s : AUX proof of work failed", __func__);
 
     return true;
 }
 
+bool CheckProofOfWork(const CBlockHeader& block, const Consensus::Params& params)
+{
+    return CheckProofOfWork(block, NULL, params);
+}
+
+/**
+ * The script check threads.  Besides script checks, they also run the game
+ * step and proof-of-work checks as tasks (see RunOnCheckThreads).
+ */
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck() {
+    RenameThread("bitcoin-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+/**
+ * Run a function as a task on the script check threads, or right away if
+ * there are none.  The caller must wait for the returned future (e.g. with
+ * WaitForCheckTask) before anything that the function references goes out
+ * of scope.
+ */
+template <typename F>
+static std::future<bool> RunOnCheckThreads(F func)
+{
+    std::shared_ptr<std::packaged_task<bool()>> task = std::make_shared<std::packaged_task<bool()>>(std::move(func));
+    std::future<bool> result = task->get_future();
+    if (nScriptCheckThreads)
+        scriptcheckqueue.AddTask([task]() { (*task)(); });
+    else
+        (*task)();
+    return result;
+}
+
+/** Wait until a task is done, running queued tasks meanwhile. */
+static void HelpUntilReady(const std::future<bool>& result)
+{
+    while (result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (!scriptcheckqueue.RunTask())
+            result.wait();
+    }
+}
+
+/** Wait for a task from RunOnCheckThreads and return its result. */
+static bool WaitForCheckTask(std::future<bool>& result)
+{
+    HelpUntilReady(result);
+    return result.get();
+}
+
+/** RAII helper that waits for a pending task from RunOnCheckThreads. */
+class CCheckTaskWaiter
+{
+private:
+    std::future<bool>& result;
+
+public:
+    explicit CCheckTaskWaiter(std::future<bool>& resultIn) : result(resultIn) {}
+
+    ~CCheckTaskWaiter()
+    {
+        if (result.valid())
+            HelpUntilReady(result);
+    }
+};
+
+namespace {
+
+/**
+ * Closure representing the proof-of-work checks of a few block headers.
+ * The scrypt hashes of all of them are computed in one batch, so that
+ * the multi-lane scrypt kernels can be used.
+ */
+class CPowCheck
+{
+private:
+    std::vector<const CBlockHeader*> vHeaders;
+    const Consensus::Params* pparams;
+    //! Set to 1 for each header whose proof-of-work is valid
+    char* pfPassed;
+
+public:
+    CPowCheck(std::vector<const CBlockHeader*>::const_iterator begin, std::vector<const CBlockHeader*>::const_iterator end, const Consensus::Params& params, char* pfPassedIn) :
+        vHeaders(begin, end), pparams(&params), pfPassed(pfPassedIn) {}
+
+    bool operator()()
+    {
+        std::vector<char> vInput;
+        for (const CBlockHeader* pheader : vHeaders) {
+            if (pheader->GetAlgo() != ALGO_SCRYPT)
+                continue;
+            const CPureBlockHeader& powHeader = (pheader->auxpow ? pheader->auxpow->getParentBlock() : *pheader);
+            // Caution: scrypt_1024_1_1_256 assumes fixed length of 80 bytes
+            vInput.insert(vInput.end(), BEGIN(powHeader.nVersion), BEGIN(powHeader.nVersion) + 80);
+        }
+        std::vector<char> vHashes(vInput.size() / 80 * 32);
+        if (!vInput.empty())
+            scrypt_1024_1_1_256_batch(&vInput[0], &vHashes[0], vInput.size() / 80);
+
+        size_t nScrypt = 0;
+        for (size_t i = 0; i < vHeaders.size(); i++) {
+            const CBlockHeader* pheader = vHeaders[i];
+            if (pheader->GetAlgo() != ALGO_SCRYPT) {
+                if (!CheckProofOfWork(*pheader, NULL, *pparams))
+                    return false;
+            } else {
+                uint256 hash;
+                memcpy(hash.begin(), &vHashes[32 * nScrypt++], 32);
+                if (!CheckProofOfWork(*pheader, &hash, *pparams))
+                    return false;
+            }
+            pfPassed[i] = 1;
+        }
+        return true;
+    }
+};
+
+/** Number of headers whose proof-of-work is checked in one CPowCheck. */
+const size_t POW_CHECK_BATCH_SIZE = SCRYPT_MAX_LANES;
+
+/**
+ * Check the proof-of-work of a number of headers, spread over the script
+ * check threads.  vPassed[i] is set to 1 for each header whose check passed.
+ * Headers after the first failing one may be left unchecked (0).  Returns
+ * false if any of the checks fails.
+ */
+bool CheckProofOfWorkParallel(const std::vector<const CBlockHeader*>& vHeaders, const Consensus::Params& params, std::vector<char>& vPassed)
+{
+    vPassed.assign(vHeaders.size(), 0);
+    std::atomic<size_t> nFirstFailed(std::numeric_limits<size_t>::max());
+    std::vector<std::future<bool>> vResults;
+    for (size_t i = 0; i < vHeaders.size(); i += POW_CHECK_BATCH_SIZE) {
+        const size_t nEnd = std::min(vHeaders.size(), i + POW_CHECK_BATCH_SIZE);
+        CPowCheck check(vHeaders.begin() + i, vHeaders.begin() + nEnd, params, &vPassed[i]);
+        vResults.push_back(RunOnCheckThreads([check, i, &nFirstFailed]() mutable {
+            // Headers behind a failed one are not accepted anyway
+            if (i > nFirstFailed)
+                return true;
+            if (!check()) {
+                size_t nFailed = nFirstFailed;
+                while (i < nFailed && !nFirstFailed.compare_exchange_weak(nFailed, i)) {}
+            }
+            return true;
+        }));
+    }
+    // All tasks reference nFirstFailed and vPassed, so wait for each of them
+    for (std::future<bool>& result : vResults)
+        WaitForCheckTask(result);
+    return nFirstFailed == std::numeric_limits<size_t>::max();
+}
+
+} // anon namespace
+
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+    const bool fCompact = fCompactAuxpowStorage;
+    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, GetBlockFileVersion(fCompact));
     if (fileout.IsNull())
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
     unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << (fCompact ? nSize | BLOCKFILE_COMPACT_AUXPOW : nSize);
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
@@ -1191,13 +1435,19 @@ static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensu
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, starting at the size of the record,
+    // which tells how the block is encoded
+    if (pos.nPos < sizeof(unsigned int))
+        return error("ReadBlockFromDisk: invalid position %s", pos.ToString());
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(unsigned int)), true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
     // Read block
     try {
+        unsigned int nSize;
+        filein >> nSize;
+        filein.SetVersion(GetBlockFileVersion(nSize & BLOCKFILE_COMPACT_AUXPOW));
         filein >> block;
     }
     catch (const std::exception& e) {
@@ -1261,6 +1511,29 @@ bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, con
     return ReadBlockOrHeader(block, pindex, consensusParams);
 }
 
+bool ReadBlockAuxpow(boost::shared_ptr<CAuxPow>& auxpow, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    const uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_auxpowCache);
+        if (auxpowCache.get(hash, auxpow))
+            return true;
+    }
+
+    CBlockHeader header;
+    if (!ReadBlockHeaderFromDisk(header, pindex, consensusParams))
+        return false;
+    auxpow = header.auxpow;
+    CacheAuxpow(hash, auxpow);
+    return true;
+}
+
+void SetAuxpowCacheSize(size_t nBytes)
+{
+    LOCK(cs_auxpowCache);
+    auxpowCache.max_size(std::max<size_t>(1, nBytes / MAX_AUXPOW_CACHE_ENTRY_SIZE));
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1432,19 +1705,13 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
                 continue;
             }
 
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
-            // mark an outpoint spent, and construct undo information
-            CTxInUndo undo;
-            coins->Spend(nPos, &undo);
-            txundo.vprevout.push_back(undo);
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -1489,29 +1756,29 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
             /* This rule is disabled for the genesis block, so that
                the premine is spendable.  */
-            if (coins->IsCoinBase()) {
-                if (nSpendHeight - coins->nHeight < COINBASE_MATURITY
-                      && coins->nHeight > 0)
+            if (coin.IsCoinBase()) {
+                if (nSpendHeight - coin.nHeight < COINBASE_MATURITY
+                      && coin.nHeight > 0)
                     return state.Invalid(false,
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
             }
-            else if (coins->IsGameTx()) {
-                if (nSpendHeight - coins->nHeight < GAMETX_MATURITY)
+            else if (coin.IsGameTx()) {
+                if (nSpendHeight - coin.nHeight < GAMETX_MATURITY)
                     return state.Invalid(
-                        error("CheckInputs(): tried to spend game reward at depth %d", nSpendHeight - coins->nHeight),
+                        error("CheckInputs(): tried to spend game reward at depth %d", nSpendHeight - coin.nHeight),
                         REJECT_INVALID, "bad-txns-premature-spend-of-gametx");
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
         }
@@ -1554,11 +1821,19 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
+
+                // We very carefully only pass in things to CScriptCheck which
+                // are clearly committed to by tx' witness hash. This provides
+                // a sanity check that our caching is not introducing consensus
+                // failures through additional data in, eg, the coins being
+                // spent being checked as a part of CScriptCheck.
+                const CScript& scriptPubKey = coin.out.scriptPubKey;
+                const CAmount amount = coin.out.nValue;
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheStore, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1570,7 +1845,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
+                        CScriptCheck check2(scriptPubKey, amount, tx, i,
                                 flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -1668,41 +1943,37 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 } // anon namespace
 
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the UTXO in a Coin at a given COutPoint.
+ * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out)
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
+    if (view.HaveCoin(out))
+        fClean = fClean && error("%s: undo data overwriting existing output", __func__);
+
     /* Special case for Huntercoin:  Since the genesis output is spendable,
-       it may happen that we actually have nHeight=0 while the tx
-       does not yet exist (namely for the tx spending the genesis
-       output).  Check for this case.  */
+       undo data for it legitimately has nHeight=0.  Do not mistake it for
+       an old-style record without metadata.  */
     const bool isGenesis = (out.hash == Params().GenesisBlock().hashMerkleRoot);
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0 || isGenesis) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->fGameTx = undo.fGameTx;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
+    if (undo.nHeight == 0 && !isGenesis) {
+        // Missing undo metadata (height, coinbase and game tx). Older versions
+        // included this information only in undo records for the last spend
+        // of a transactions' outputs. This implies that it must be present for
+        // some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("%s: undo data adding output to missing transaction", __func__);
+        undo.nHeight = alternate.nHeight;
+        undo.fCoinBase = alternate.fCoinBase;
+        undo.fGameTx = alternate.fGameTx;
     }
-    if (coins->IsAvailable(out.n))
-        fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+    view.AddCoin(out, std::move(undo), undo.fCoinBase);
 
     return fClean;
 }
@@ -1737,42 +2008,34 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-        {
-            /* This may be due to a historic bug.  For them, some names
-               are marked immediately as unspendable.  They fail this check
-               when undoing, thus ignore them here.  */
-            CChainParams::BugType type;
-            if (!Params ().IsHistoricBug (tx.GetHash (), pindex->nHeight, type) || type != CChainParams::BUG_FULLY_IGNORE)
-                fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-        }
-
-        // remove outputs
-        outs->Clear();
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight
+                      || tx.IsCoinBase() != coin.IsCoinBase() || tx.IsGameTx() != coin.IsGameTx()) {
+                    /* This may be due to a historic bug.  For them, some names
+                       are marked immediately as unspendable.  They fail this check
+                       when undoing, thus ignore them here.  */
+                    CChainParams::BugType type;
+                    if (!Params ().IsHistoricBug (hash, pindex->nHeight, type) || type != CChainParams::BUG_FULLY_IGNORE)
+                        fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
+                }
+            }
         }
 
         /* Restore inputs.  The coinbase does not have a corresponding
            txundo, but game tx have.  The inputs for bounty collections
            are empty, though, so make sure to handle that.  */
         if (i > 0 && !tx.IsBountyTx()) {
-            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(): transaction and undo data inconsistent");
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
                 assert (!out.IsNull());
-                const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out))
                     fClean = false;
             }
         }
@@ -1820,12 +2083,6 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
-void ThreadScriptCheck() {
-    RenameThread("bitcoin-scriptch");
-    scriptcheckqueue.Thread();
-}
 
 // Protected by cs_main
 VersionBitsCache versionbitscache;
@@ -1934,10 +2191,12 @@ bool ConnectBlockWithGameTx(const CBlock& block, CValidationState& state, CBlock
 
     if (fEnforceBIP30) {
         for (const auto& tx : block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx->GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx->vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx->GetHash(), o))) {
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+                }
+            }
         }
     }
 
@@ -1977,14 +2236,42 @@ bool ConnectBlockWithGameTx(const CBlock& block, CValidationState& state, CBlock
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
+    /* Advance game state for the current block.  This includes further
+       checks about validity of all moves.  Ignore this for the genesis
+       block, since there is no "previous state" to fetch and advance.
+       There are no game transactions for it, either.  In this case,
+       the default-constructed StepResult is fine.
+
+       The game step does not depend on the transactions being connected
+       or their scripts, except for the address-lock permissions checked
+       by CheckMovePermissions below.  Thus we run it as a task on the
+       script check threads (if we have any) while the transactions
+       are connected and their scripts verified.  If we return early,
+       gameStepWaiter waits for the task to finish.  */
+    const bool isGenesis = (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock);
+    GameState prevGameState(chainparams.GetConsensus());
+    GameState newGameState(chainparams.GetConsensus());
+    StepResult stepResult;
+    CValidationState stateGameStep;
+    std::future<bool> gameStep;
+    CCheckTaskWaiter gameStepWaiter(gameStep);
+    if (!isGenesis)
+    {
+        if (!pgameDb->get(*pindex->pprev->phashBlock, prevGameState))
+            return state.Error("ConnectBlock: failed to read prev game state");
+
+        gameStep = RunOnCheckThreads([&block, &prevGameState, &stateGameStep, &stepResult, &newGameState] () {
+            return PerformStep(block, prevGameState, NULL, stateGameStep, stepResult, newGameState);
+        });
+    }
+
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    /* Reserve also space for up to two game tx.  */
-    vPos.reserve(block.vtx.size() + 2);
+    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1 + 2);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -2009,7 +2296,7 @@ bool ConnectBlockWithGameTx(const CBlock& block, CValidationState& state, CBlock
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
@@ -2053,27 +2340,28 @@ bool ConnectBlockWithGameTx(const CBlock& block, CValidationState& state, CBlock
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
 
-    /* Advance game state for the current block.  This includes further
-       checks about validity of all moves.  Ignore this for the genesis
-       block, since there is no "previous state" to fetch and advance.
-       There are no game transactions for it, either.  In this case,
-       the default-constructed StepResult is fine.  */
-    const bool isGenesis = (block.GetHash() == chainparams.GetConsensus().hashGenesisBlock);
-    StepResult stepResult;
+    /* Join the game step and check the move permissions against the
+       now updated view.  */
     if (!isGenesis)
-      {
-        GameState prevGameState(chainparams.GetConsensus ());
-        if (!pgameDb->get (*pindex->pprev->phashBlock, prevGameState))
-          return state.Error ("ConnectBlock: failed to read prev game state");
-
-        GameState newGameState(chainparams.GetConsensus ());
-        if (!PerformStep (block, prevGameState, &view, state,
-                          stepResult, newGameState))
-          return state.Invalid (error ("%s: game engine step failed",
-                                       __func__));
+    {
+        const bool fStepOk = WaitForCheckTask(gameStep);
+        int64_t nTimeGame = GetTimeMicros();
+        LogPrint("bench", "      - Wait for game step: %.2fms\n", 0.001 * (nTimeGame - nTime3));
+        if (!fStepOk || !CheckMovePermissions(block, prevGameState, view, stateGameStep)) {
+            /* The step ran against its own state, so pass on what it
+               found (DoS score, reject reason) to the caller's.  */
+            int nDoS = 0;
+            if (stateGameStep.IsError())
+                return state.Error(stateGameStep.GetRejectReason());
+            if (stateGameStep.IsInvalid(nDoS))
+                return state.DoS(nDoS, error("%s: game engine step failed: %s", __func__, FormatStateMessage(stateGameStep)),
+                                 stateGameStep.GetRejectCode(), stateGameStep.GetRejectReason(),
+                                 stateGameStep.CorruptionPossible(), stateGameStep.GetDebugMessage());
+            return state.Invalid(error("%s: game engine step failed", __func__));
+        }
 
-        pgameDb->store (block.GetHash (), newGameState);
-      }
+        pgameDb->store(block.GetHash(), newGameState);
+    }
     nFees += stepResult.nTaxAmount;
 
     /* Construct and handle game transactions.  */
@@ -2125,20 +2413,28 @@ bool ConnectBlockWithGameTx(const CBlock& block, CValidationState& state, CBlock
         setDirtyBlockIndex.insert(pindex);
     }
 
-    /* Find disk positions for game tx in the undo file.  */
-    if (fTxIndex && !isGenesis)
+    /* Index the game tx by their disk positions in the undo file.  This is
+       done independently of -txindex, since there are only few of them
+       and they cannot be found in the block files.  */
+    if (!isGenesis && !vGameTx.empty ())
       {
         assert (!pindex->GetUndoPos ().IsNull ());
-        int gameTxOffset = pindex->GetUndoPos().nPos;
-        gameTxOffset += GetSizeOfCompactSize (vGameTx.size ());
-        CDiskTxPos pos(pindex->GetBlockPos (), -gameTxOffset);
+        CDiskBlockPos posGame = pindex->GetUndoPos ();
+        posGame.nPos += GetSizeOfCompactSize (vGameTx.size ());
+        std::vector<std::pair<uint256, CDiskGameTxPos> > vGamePos;
+        vGamePos.reserve (vGameTx.size ());
         for (unsigned i = 0; i < vGameTx.size (); ++i)
           {
             const CTransaction& tx = *vGameTx[i];
-            assert (tx.IsGameTx () && pos.IsGameTx ());
-            vPos.push_back (std::make_pair (tx.GetHash (), pos));
-            pos.nTxOffset -= ::GetSerializeSize (tx, SER_DISK, CLIENT_VERSION);
+            assert (tx.IsGameTx ());
+            vGamePos.push_back (std::make_pair (tx.GetHash (),
+                                                CDiskGameTxPos (posGame, pindex->GetBlockHash ())));
+            posGame.nPos += ::GetSerializeSize (tx, SER_DISK, CLIENT_VERSION);
+            recentGameTx.insert (tx.GetHash (),
+                                 std::make_pair (vGameTx[i], pindex->GetBlockHash ()));
           }
+        if (!pblocktree->WriteGameTxIndex (vGamePos))
+            return AbortNode(state, "Failed to write game transaction index");
       }
 
     if (fTxIndex)
@@ -2251,12 +2547,12 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
@@ -2365,6 +2661,8 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
     }
+    for (const auto& tx : vGameTx)
+        recentGameTx.erase(tx->GetHash());
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
@@ -2697,7 +2995,16 @@ static void NotifyHeaderTip() {
  * or an activated best chain. pblock is either NULL or a pointer to a block
  * that is already loaded (to avoid loading it again from disk).
  */
+/**
+ * Serializes calls to ActivateBestChain.  Blocks from different peers are
+ * processed in parallel by the message handler threads, and interleaved
+ * calls could otherwise work on a stale pindexMostWork.  Must not be
+ * acquired with cs_main held.
+ */
+static CCriticalSection cs_activateBestChain;
+
 bool ActivateBestChain(CValidationState &state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock) {
+    LOCK(cs_activateBestChain);
     CBlockIndex *pindexMostWork = NULL;
     CBlockIndex *pindexNewTip = NULL;
     do {
@@ -3316,7 +3623,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const Co
     return true;
 }
 
-static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW = true)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3335,7 +3642,7 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3354,8 +3661,11 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
         if (!ContextualCheckBlockHeader(block, state, chainparams.GetConsensus(), pindexPrev, GetAdjustedTime()))
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
     }
-    if (pindex == NULL)
+    if (pindex == NULL) {
         pindex = AddToBlockIndex(block);
+        if (block.IsAuxpow())
+            CacheAuxpow(hash, block.auxpow);
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3368,10 +3678,69 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
 {
+    /* First do the cheap checks (known parent and the nBits required by
+       GetNextWorkRequired) in order, on temporary index entries for the
+       headers we do not know yet.  Only the prefix of headers passing them
+       gets its proof-of-work checked in parallel, without holding cs_main.
+       The remaining headers, and those whose parallel check did not pass,
+       are handled by AcceptBlockHeader exactly as before.  */
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+    std::vector<const CBlockHeader*> vNewHeaders;
+    std::vector<size_t> vNewIndices;
+    std::vector<uint256> vHashes;
+    // The temporary index entries point into vHashes, so it must not grow
+    vHashes.reserve(headers.size());
     {
         LOCK(cs_main);
+        std::deque<CBlockIndex> dequeTemp;
+        std::map<uint256, CBlockIndex*> mapTemp;
         for (const CBlockHeader& header : headers) {
-            if (!AcceptBlockHeader(header, state, chainparams, ppindex)) {
+            vHashes.push_back(header.GetHash());
+            const uint256& hash = vHashes.back();
+            BlockMap::iterator miSelf = mapBlockIndex.find(hash);
+            if (miSelf != mapBlockIndex.end()) {
+                if (miSelf->second->nStatus & BLOCK_FAILED_MASK)
+                    break;
+                continue;
+            }
+            if (mapTemp.count(hash) != 0)
+                continue;
+
+            CBlockIndex* pindexPrev = NULL;
+            std::map<uint256, CBlockIndex*>::iterator miTemp = mapTemp.find(header.hashPrevBlock);
+            if (miTemp != mapTemp.end()) {
+                pindexPrev = miTemp->second;
+            } else {
+                BlockMap::iterator mi = mapBlockIndex.find(header.hashPrevBlock);
+                if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_FAILED_MASK))
+                    break;
+                pindexPrev = mi->second;
+            }
+            if (header.nBits != GetNextWorkRequired(pindexPrev, &header, consensusParams))
+                break;
+
+            dequeTemp.emplace_back(header);
+            CBlockIndex* pindexTemp = &dequeTemp.back();
+            pindexTemp->phashBlock = &hash;
+            pindexTemp->pprev = pindexPrev;
+            pindexTemp->nHeight = pindexPrev->nHeight + 1;
+            pindexTemp->BuildSkip();
+            mapTemp[hash] = pindexTemp;
+            vNewHeaders.push_back(&header);
+            vNewIndices.push_back(vHashes.size() - 1);
+        }
+    }
+    std::vector<char> vPowPassed;
+    CheckProofOfWorkParallel(vNewHeaders, consensusParams, vPowPassed);
+    std::vector<char> vCheckPow(headers.size(), 1);
+    for (size_t i = 0; i < vNewHeaders.size(); i++)
+        if (vPowPassed[i])
+            vCheckPow[vNewIndices[i]] = 0;
+
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); i++) {
+            if (!AcceptBlockHeader(headers[i], state, chainparams, ppindex, vCheckPow[i])) {
                 return false;
             }
         }
@@ -3381,7 +3750,7 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
 }
 
 /** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
-static bool AcceptBlock(const CBlock& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
+static bool AcceptBlock(const CBlock& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock, bool fCheckPOW = true)
 {
     if (fNewBlock) *fNewBlock = false;
     AssertLockHeld(cs_main);
@@ -3389,7 +3758,8 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     CBlockIndex *pindexDummy = NULL;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    // If CheckBlock already passed, the PoW need not be checked again
+    if (!AcceptBlockHeader(block, state, chainparams, &pindex, fCheckPOW && !block.fChecked))
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3419,7 +3789,7 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
     }
     if (fNewBlock) *fNewBlock = true;
 
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), GetAdjustedTime()) ||
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), fCheckPOW) ||
         !ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindex->pprev)) {
         if (state.IsInvalid() && !state.CorruptionPossible()) {
             pindex->nStatus |= BLOCK_FAILED_VALID;
@@ -3432,7 +3802,9 @@ static bool AcceptBlock(const CBlock& block, CValidationState& state, const CCha
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        // Blocks already on disk may be in either encoding; the compact one
+        // is never larger for valid auxpows, so the full size is an upper bound.
+        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, GetBlockFileVersion(dbp == NULL && fCompactAuxpowStorage));
         CDiskBlockPos blockPos;
         if (dbp != NULL)
             blockPos = *dbp;
@@ -3677,6 +4049,19 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+/**
+ * Set nChainTx for a block up to the base of a loaded UTXO snapshot.  The
+ * base uses the count from the snapshot, and the blocks before it, which
+ * may not have been downloaded yet, get made-up increasing counts.
+ */
+static void SetSnapshotChainTx(CBlockIndex* pindex, unsigned int nBaseChainTx)
+{
+    if (pindex == pindexSnapshotBase)
+        pindex->nChainTx = nBaseChainTx;
+    else
+        pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + std::max(pindex->nTx, 1u);
+}
+
 bool static LoadBlockIndexDB(const CChainParams& chainparams)
 {
     if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
@@ -3684,6 +4069,23 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 
     boost::this_thread::interruption_point();
 
+    // Check whether we run from a UTXO snapshot that is not validated yet
+    CSnapshotRecord snapshot;
+    std::vector<CBlockIndex*> vSnapshotChain;
+    if (pblocktree->ReadSnapshot(snapshot)) {
+        if (snapshot.fLoading)
+            return error("%s: loading a UTXO snapshot was interrupted, restart with -reindex-chainstate", __func__);
+        BlockMap::iterator it = mapBlockIndex.find(snapshot.metadata.hashBlock);
+        if (it == mapBlockIndex.end())
+            return error("%s: base block of the UTXO snapshot is missing", __func__);
+        pindexSnapshotBase = it->second;
+        vSnapshotChain.resize(pindexSnapshotBase->nHeight + 1);
+        for (CBlockIndex* pindex = pindexSnapshotBase; pindex; pindex = pindex->pprev)
+            vSnapshotChain[pindex->nHeight] = pindex;
+        pgameDb->setPinned(snapshot.metadata.hashBlock);
+        LogPrintf("%s: running from the UTXO snapshot at height %d\n", __func__, pindexSnapshotBase->nHeight);
+    }
+
     // Calculate nChainWork
     vector<pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
@@ -3699,7 +4101,9 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
-        if (pindex->nTx > 0) {
+        if (pindexSnapshotBase && pindex->nHeight <= pindexSnapshotBase->nHeight && vSnapshotChain[pindex->nHeight] == pindex) {
+            SetSnapshotChainTx(pindex, snapshot.metadata.nChainTx);
+        } else if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3790,6 +4194,86 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     return true;
 }
 
+bool ActivateSnapshot(CBlockIndex* pindexBase, unsigned int nChainTx)
+{
+    AssertLockHeld(cs_main);
+    assert(pindexSnapshotBase == NULL);
+    pindexSnapshotBase = pindexBase;
+    nSnapshotHistoryHeight = 0;
+
+    std::vector<CBlockIndex*> vChain(pindexBase->nHeight + 1);
+    for (CBlockIndex* pindex = pindexBase; pindex; pindex = pindex->pprev)
+        vChain[pindex->nHeight] = pindex;
+
+    // Link the blocks up to the base, and any downloaded blocks that
+    // could not be linked so far because they come after one of them
+    std::deque<CBlockIndex*> queue;
+    BOOST_FOREACH(CBlockIndex* pindex, vChain) {
+        SetSnapshotChainTx(pindex, nChainTx);
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        for (std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first; it != range.second; ++it) {
+            if (it->second->nHeight > pindexBase->nHeight || vChain[it->second->nHeight] != it->second)
+                queue.push_back(it->second);
+        }
+        mapBlocksUnlinked.erase(range.first, range.second);
+    }
+    while (!queue.empty()) {
+        CBlockIndex* pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        setBlockIndexCandidates.insert(pindex);
+        std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = mapBlocksUnlinked.equal_range(pindex);
+        for (std::multimap<CBlockIndex*, CBlockIndex*>::iterator it = range.first; it != range.second; ++it)
+            queue.push_back(it->second);
+        mapBlocksUnlinked.erase(range.first, range.second);
+    }
+
+    pindexBase->RaiseValidity(BLOCK_VALID_SCRIPTS);
+    setDirtyBlockIndex.insert(pindexBase);
+    setBlockIndexCandidates.insert(pindexBase);
+    chainActive.SetTip(pindexBase);
+    PruneBlockIndexCandidates();
+    mempool.clear();
+
+    return true;
+}
+
+int GetSnapshotHistoryHeight()
+{
+    AssertLockHeld(cs_main);
+    assert(pindexSnapshotBase);
+    while (nSnapshotHistoryHeight < pindexSnapshotBase->nHeight
+           && (pindexSnapshotBase->GetAncestor(nSnapshotHistoryHeight + 1)->nStatus & BLOCK_HAVE_DATA))
+        ++nSnapshotHistoryHeight;
+    return nSnapshotHistoryHeight;
+}
+
+bool CompleteSnapshotValidation(unsigned int nChainTx)
+{
+    AssertLockHeld(cs_main);
+    assert(pindexSnapshotBase);
+    assert(GetSnapshotHistoryHeight() == pindexSnapshotBase->nHeight);
+
+    std::vector<CBlockIndex*> vChain(pindexSnapshotBase->nHeight + 1);
+    uint64_t nTotal = 0;
+    for (CBlockIndex* pindex = pindexSnapshotBase; pindex; pindex = pindex->pprev) {
+        vChain[pindex->nHeight] = pindex;
+        nTotal += pindex->nTx;
+    }
+    if (nTotal != nChainTx)
+        return error("%s: the UTXO snapshot claims %u transactions up to its block, but there are %u", __func__, nChainTx, nTotal);
+
+    BOOST_FOREACH(CBlockIndex* pindex, vChain) {
+        pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
+        if (pindex->RaiseValidity(BLOCK_VALID_SCRIPTS))
+            setDirtyBlockIndex.insert(pindex);
+    }
+    pindexSnapshotBase = NULL;
+    nSnapshotHistoryHeight = 0;
+
+    return true;
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks..."), 0);
@@ -3837,6 +4321,11 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
+        if (!(pindex->nStatus & BLOCK_HAVE_UNDO)) {
+            // Blocks up to a loaded UTXO snapshot were never connected here
+            LogPrintf("VerifyDB(): block verification stopping at height %d (no undo data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
@@ -4010,6 +4499,8 @@ void UnloadBlockIndex()
     chainActive.SetTip(NULL);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
+    pindexSnapshotBase = NULL;
+    nSnapshotHistoryHeight = 0;
     mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -4017,6 +4508,11 @@ void UnloadBlockIndex()
     nBlockSequenceId = 1;
     setDirtyBlockIndex.clear();
     setDirtyFileInfo.clear();
+    recentGameTx.clear();
+    {
+        LOCK(cs_auxpowCache);
+        auxpowCache.clear();
+    }
     versionbitscache.Clear();
     for (int b = 0; b < VERSIONBITS_NUM_BITS; b++) {
         warningcache[b].clear();
@@ -4057,7 +4553,7 @@ bool InitBlockIndex(const CChainParams& chainparams)
         try {
             CBlock &block = const_cast<CBlock&>(chainparams.GenesisBlock());
             // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, GetBlockFileVersion(fCompactAuxpowStorage));
             CDiskBlockPos blockPos;
             CValidationState state;
             if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
@@ -4088,100 +4584,148 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        bool fEndOfData = false;
+        bool fAbort = false;
+        while (!fAbort && !fEndOfData && !blkdat.eof()) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
+            // Read ahead a batch of blocks, so that their proof-of-work
+            // can be checked in parallel before they are accepted in order
+            std::vector<std::shared_ptr<CBlock> > vBlocks;
+            std::vector<CDiskBlockPos> vBlockPos;
+            uint64_t nBatchSize = 0;
+            while (!blkdat.eof() && vBlocks.size() < MAX_IMPORT_BATCH_BLOCKS && nBatchSize < MAX_IMPORT_BATCH_SIZE) {
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                bool fCompact = false;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    fCompact = nSize & BLOCKFILE_COMPACT_AUXPOW;
+                    nSize &= ~BLOCKFILE_COMPACT_AUXPOW;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fEndOfData = true;
+                    break;
                 }
+                try {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    CDiskBlockPos pos;
+                    if (dbp) {
+                        pos = *dbp;
+                        pos.nPos = nBlockPos;
+                    }
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    blkdat.SetPos(nBlockPos);
+                    blkdat.SetVersion(GetBlockFileVersion(fCompact));
+                    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                    blkdat >> *pblock;
+                    nRewind = blkdat.GetPos();
+                    vBlocks.push_back(pblock);
+                    vBlockPos.push_back(pos);
+                    nBatchSize += nSize;
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
+            }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(block, state, chainparams, NULL, true, dbp, NULL))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            std::vector<const CBlockHeader*> vNewBlocks;
+            {
+                LOCK(cs_main);
+                for (const std::shared_ptr<CBlock>& pblock : vBlocks) {
+                    BlockMap::iterator mi = mapBlockIndex.find(pblock->GetHash());
+                    if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_HAVE_DATA) == 0)
+                        vNewBlocks.push_back(pblock.get());
                 }
+            }
+            std::vector<char> vPowPassed;
+            CheckProofOfWorkParallel(vNewBlocks, chainparams.GetConsensus(), vPowPassed);
+            std::set<uint256> setPowPassed;
+            for (size_t i = 0; i < vNewBlocks.size(); i++)
+                if (vPowPassed[i])
+                    setPowPassed.insert(vNewBlocks[i]->GetHash());
+
+            for (size_t i = 0; i < vBlocks.size() && !fAbort; i++) {
+                const CBlock& block = *vBlocks[i];
+                CDiskBlockPos* pos = (dbp ? &vBlockPos[i] : NULL);
+                try {
+                    // detect out of order blocks, and store them for later
+                    uint256 hash = block.GetHash();
+                    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                                block.hashPrevBlock.ToString());
+                        if (pos)
+                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *pos));
+                        continue;
+                    }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
+                    // process in case the block isn't known yet
+                    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                        LOCK(cs_main);
+                        CValidationState state;
+                        if (AcceptBlock(block, state, chainparams, NULL, true, pos, NULL, setPowPassed.count(hash) == 0))
+                            nLoaded++;
+                        if (state.IsError()) {
+                            fAbort = true;
+                            break;
+                        }
+                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                        LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
                     }
-                }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(block, dummy, chainparams, NULL, true, &it->second, NULL))
+                    // Activate the genesis block so normal node progress can continue
+                    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                        CValidationState state;
+                        if (!ActivateBestChain(state, chainparams)) {
+                            fAbort = true;
+                            break;
+                        }
+                    }
+
+                    NotifyHeaderTip();
+
+                    // Recursively process earlier encountered successors of this block
+                    deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                            CBlock blockChild;
+                            if (ReadBlockFromDisk(blockChild, it->second, chainparams.GetConsensus()))
                             {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
+                                LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                                        head.ToString());
+                                LOCK(cs_main);
+                                CValidationState dummy;
+                                if (AcceptBlock(blockChild, dummy, chainparams, NULL, true, &it->second, NULL))
+                                {
+                                    nLoaded++;
+                                    queue.push_back(blockChild.GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                            NotifyHeaderTip();
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
     } catch (const std::runtime_error& e) {
@@ -4208,6 +4752,11 @@ void static CheckBlockIndex(const Consensus::Params& consensusParams)
         return;
     }
 
+    // The blocks before an unvalidated UTXO snapshot have made-up nChainTx
+    // values and are missing data, which breaks many of the checks below.
+    if (pindexSnapshotBase)
+        return;
+
     // Verify that all entries are non-NULL.
     for (BlockMap::const_iterator it = mapBlockIndex.begin();
          it != mapBlockIndex.end(); ++it)
@@ -4273,6 +4822,10 @@ void static CheckBlockIndex(const Consensus::Params& consensusParams)
         assert(pindex->nHeight == nHeight); // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork); // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight))); // The pskip pointer must point back for all but the first 2 blocks.
+        for (int algo = 0; algo < NUM_ALGOS; ++algo) {
+            // The per-algo pointers must point to the last predecessor with that algo.
+            assert(pindex->pprevAlgo[algo] == (pindex->pprev ? pindex->pprev->GetLastOfAlgo(static_cast<PowAlgo>(algo)) : NULL));
+        }
         assert(pindexFirstNotTreeValid == NULL); // All mapBlockIndex entries must at least be TREE valid
         if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TREE) assert(pindexFirstNotTreeValid == NULL); // TREE valid implies all parents are TREE valid
         if ((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_CHAIN) assert(pindexFirstNotChainValid == NULL); // CHAIN valid implies all parents are CHAIN valid
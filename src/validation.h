@@ -36,12 +36,12 @@
 class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
+class CCoinsViewDB;
 class CChainParams;
 class CGameDB;
 class CInv;
 class CConnman;
 class CScriptCheck;
-class CTxInUndo;
 class CTxMemPool;
 class CTxUndo;
 class CValidationInterface;
@@ -84,6 +84,10 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The maximum number of blocks read ahead when importing block files */
+static const unsigned int MAX_IMPORT_BATCH_BLOCKS = 128;
+/** The maximum total size of the blocks read ahead when importing block files */
+static const uint64_t MAX_IMPORT_BATCH_SIZE = 0x1000000; // 16 MiB
 
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
@@ -155,6 +159,14 @@ static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Number of recent game transactions kept in memory for GetTransaction */
+static const unsigned int MAX_RECENT_GAMETX = 1000;
+/** Default for -auxpowcache, the memory (in MiB) used for cached auxpows */
+static const unsigned int DEFAULT_AUXPOW_CACHE_SIZE = 32;
+/** Memory budgeted per cached auxpow; larger ones are always read from disk */
+static const unsigned int MAX_AUXPOW_CACHE_ENTRY_SIZE = 2048;
+/** Default for -compactauxpow */
+static const bool DEFAULT_COMPACT_AUXPOW_STORAGE = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -191,6 +203,8 @@ extern std::atomic_bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Whether new blocks are written with the compact auxpow encoding */
+extern bool fCompactAuxpowStorage;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -211,6 +225,9 @@ extern boost::condition_variable cv_stateChange;
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
 
+/** Base block of a loaded UTXO snapshot while the blocks before it are not validated yet. */
+extern CBlockIndex *pindexSnapshotBase;
+
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
@@ -301,7 +318,7 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransactionRef &tx, const Consensus::Params& params, uint256 &hashBlock, bool fAllowSlow = false);
-/** Find the best known block, and make it the tip of the block chain */
+/** Find the best known block, and make it the tip of the block chain.  Must be called without cs_main held. */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, std::shared_ptr<const CBlock> pblock = std::shared_ptr<const CBlock>());
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 
@@ -461,8 +478,8 @@ private:
 
 public:
     CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
+    CScriptCheck(const CScript& scriptPubKeyIn, const CAmount amountIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(scriptPubKeyIn), amount(amountIn),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
@@ -487,12 +504,16 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Look up the auxpow of a block in the in-memory cache, or read it from disk. */
+bool ReadBlockAuxpow(boost::shared_ptr<CAuxPow>& auxpow, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Set the memory budget (in bytes) of the auxpow cache. */
+void SetAuxpowCacheSize(size_t nBytes);
 bool ReadBlockFromDisk(CBlock& block, std::vector<CTransactionRef>& vGameTx,
                        const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 
 /** Functions for validating blocks and updating the block tree */
 
-bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out);
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out);
 
 /** Context-independent validity checks */
 bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true);
@@ -550,6 +571,22 @@ public:
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
+/**
+ * Make the base block of a UTXO snapshot the tip, after its chainstate was
+ * written to pcoinsTip.  The blocks before it count as connected from now
+ * on, even though most of them are still missing.
+ */
+bool ActivateSnapshot(CBlockIndex* pindexBase, unsigned int nChainTx);
+
+/** Height up to which the blocks before pindexSnapshotBase have been downloaded. */
+int GetSnapshotHistoryHeight();
+
+/**
+ * Mark the blocks up to pindexSnapshotBase as valid once they have been
+ * connected in the background, and fix up their nChainTx.
+ */
+bool CompleteSnapshotValidation(unsigned int nChainTx);
+
 /** Mark a block as precious and reorganize. */
 bool PreciousBlock(CValidationState& state, const CChainParams& params, CBlockIndex *pindex);
 
@@ -565,6 +602,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the coins database below pcoinsTip (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
@@ -34,17 +34,27 @@ static bool
 getNamePrevout (const uint256& txid, CTxOut& txOut, CTxIn& txIn)
 {
   AssertLockHeld (cs_main);
-
-  CCoins coins;
-  if (!pcoinsTip->GetCoins (txid, coins))
+  LOCK (pwalletMain->cs_wallet);
+
+  /* The UTXO set is keyed by outpoint.  The name_new we update is ours,
+     so find its name output from the wallet tx and look only that one
+     up in the UTXO set.  */
+  const std::map<uint256, CWalletTx>::const_iterator mit
+    = pwalletMain->mapWallet.find (txid);
+  if (mit == pwalletMain->mapWallet.end ())
     return false;
 
-  for (unsigned i = 0; i < coins.vout.size (); ++i)
-    if (!coins.vout[i].IsNull ()
-        && CNameScript::isNameScript (coins.vout[i].scriptPubKey))
+  const CTransaction& tx = *mit->second.tx;
+  for (unsigned i = 0; i < tx.vout.size (); ++i)
+    if (CNameScript::isNameScript (tx.vout[i].scriptPubKey))
       {
-        txOut = coins.vout[i];
-        txIn = CTxIn (COutPoint (txid, i));
+        const COutPoint outp(txid, i);
+        Coin coin;
+        if (!pcoinsTip->GetCoin (outp, coin))
+          return false;
+
+        txOut = coin.out;
+        txIn = CTxIn (outp);
         return true;
       }
 
@@ -78,81 +88,94 @@ GetRequiredGameFee (const valtype& name, const valtype& value)
  * Helper class for the implementation of name_list.  In Huntercoin, things
  * are more complicated due to kill transactions that might change multiple
  * names in a single tx.  To handle them, name_list uses this class
- * to track current heights of names and update them.
+ * to track the current entry of each name from the wallet's name index.
+ * Only the winning entry of a name is turned into a JSON object.
  */
 class NameListBuilder
 {
 private:
 
-  const valtype nameFilter;
+  /** The latest change of a name:  the wallet tx, the index entry
+      and the height it was confirmed at.  */
+  struct Entry
+  {
+    const CWalletTx* tx;
+    CWalletNameTx ref;
+    int nHeight;
 
-  std::map<valtype, int> mapHeights;
-  std::map<valtype, UniValue> mapObjects;
+    inline Entry (const CWalletTx* t, const CWalletNameTx& r, int h)
+      : tx(t), ref(r), nHeight(h)
+    {}
+  };
 
-  /* Data for the current tx, which may be used for multiple changes
-     if we handle kill transactions.  */
-  int nHeight;
-  bool isKillTx;
+  std::map<valtype, Entry> mapEntries;
 
 public:
 
-  explicit inline NameListBuilder (const valtype& filter)
-    : nameFilter(filter),
-      mapHeights(), mapObjects()
+  inline NameListBuilder ()
+    : mapEntries()
   {}
 
-  /* Returns false if the tx should be skipped (is unconfirmed).  */
-  bool startTx (const CWalletTx& tx);
-
-  inline int
-  getHeight () const
-  {
-    return nHeight;
-  }
-
-  void add (const valtype& name, const UniValue& obj);
+  /* Consider a change of the name from the wallet's name index.
+     Unconfirmed txs and kills of names that are not ours are skipped.  */
+  void add (const valtype& name, const CWalletTx& tx,
+            const CWalletNameTx& ref);
 
   UniValue build () const;
 
 };
 
-bool
-NameListBuilder::startTx (const CWalletTx& tx)
+void
+NameListBuilder::add (const valtype& name, const CWalletTx& tx,
+                      const CWalletNameTx& ref)
 {
   const CBlockIndex* pindex;
   const int depth = tx.GetDepthInMainChain (pindex);
   if (depth <= 0)
-    return false;
-
-  nHeight = pindex->nHeight;
-  isKillTx = tx.IsKillTx ();
-
-  return true;
-}
+    return;
+  const int nHeight = pindex->nHeight;
 
-void
-NameListBuilder::add (const valtype& name, const UniValue& obj)
-{
-  if (!nameFilter.empty () && nameFilter != name)
+  if (ref.fKill && !pwalletMain->IsMine (tx.tx->vin[ref.n]))
     return;
 
   /* Kill transactions have precedence over the non-kill name_update that
      might be in the same block (when self-destructing).  */
-  const std::map<valtype, int>::const_iterator mit = mapHeights.find (name);
-  if (mit == mapHeights.end () || mit->second < nHeight
-      || (mit->second == nHeight && isKillTx))
-    {
-      mapHeights[name] = nHeight;
-      mapObjects[name] = obj;
-    }
+  const std::map<valtype, Entry>::iterator mit = mapEntries.find (name);
+  if (mit == mapEntries.end ())
+    mapEntries.insert (std::make_pair (name, Entry (&tx, ref, nHeight)));
+  else if (mit->second.nHeight < nHeight
+           || (mit->second.nHeight == nHeight && ref.fKill))
+    mit->second = Entry (&tx, ref, nHeight);
 }
 
 UniValue
 NameListBuilder::build () const
 {
   UniValue res(UniValue::VARR);
-  BOOST_FOREACH (const PAIRTYPE(const valtype, UniValue)& item, mapObjects)
-    res.push_back (item.second);
+  BOOST_FOREACH (const PAIRTYPE(const valtype, Entry)& item, mapEntries)
+    {
+      const valtype& name = item.first;
+      const Entry& e = item.second;
+
+      if (e.ref.fKill)
+        {
+          res.push_back (getNameInfo (name, valtype (), true,
+                                      COutPoint (e.tx->GetHash (), 0),
+                                      CScript (), e.nHeight));
+          continue;
+        }
+
+      const CNameScript nameOp(e.tx->tx->vout[e.ref.n].scriptPubKey);
+      UniValue obj
+        = getNameInfo (name, nameOp.getOpValue (), false,
+                       COutPoint (e.tx->GetHash (), e.ref.n),
+                       nameOp.getAddress (), e.nHeight);
+
+      const bool mine = IsMine (*pwalletMain, nameOp.getAddress ());
+      obj.push_back (Pair ("transferred", !mine));
+
+      res.push_back (obj);
+    }
 
   return res;
 }
@@ -184,77 +207,39 @@ name_list (const JSONRPCRequest& request)
   if (request.params.size () == 1)
     nameFilter = ValtypeFromString (request.params[0].get_str ());
 
-  NameListBuilder builder(nameFilter);
+  NameListBuilder builder;
 
   {
   LOCK2 (cs_main, pwalletMain->cs_wallet);
-  for (const auto& item : pwalletMain->mapWallet)
-    {
-      const CWalletTx& tx = item.second;
-      if (!tx.tx->IsNamecoin () && !tx.IsKillTx ())
-        continue;
-
-      if (!builder.startTx (tx))
-        continue;
-
-      if (tx.IsKillTx ())
-        {
-          for (const auto& txIn : tx.tx->vin)
-            {
-              if (!pwalletMain->IsMine (txIn))
-                continue;
-
-              valtype name;
-              if (!NameFromGameTransactionInput (txIn.scriptSig, name))
-                {
-                  LogPrintf ("ERROR: failed to get name from kill input");
-                  continue;
-                }
-
-              UniValue obj = getNameInfo (name, valtype (), true,
-                                          COutPoint (tx.GetHash (), 0),
-                                          CScript (), builder.getHeight ());
-              builder.add (name, obj);
-            }
-
-          continue;
-        }
-
-      CNameScript nameOp;
-      int nOut = -1;
-      for (unsigned i = 0; i < tx.tx->vout.size (); ++i)
-        {
-          const CNameScript cur(tx.tx->vout[i].scriptPubKey);
-          if (cur.isNameOp ())
-            {
-              if (nOut != -1)
-                LogPrintf ("ERROR: wallet contains tx with multiple"
-                           " name outputs");
-              else
-                {
-                  nameOp = cur;
-                  nOut = i;
-                }
-            }
-        }
-
-      if (nOut == -1 || !nameOp.isAnyUpdate ())
-        continue;
-
-      const valtype& name = nameOp.getOpName ();
-      UniValue obj
-        = getNameInfo (name, nameOp.getOpValue (), false,
-                       COutPoint (tx.GetHash (), nOut),
-                       nameOp.getAddress (), builder.getHeight ());
 
-      const bool mine = IsMine (*pwalletMain, nameOp.getAddress ());
-      obj.push_back (Pair ("transferred", !mine));
-
-      builder.add (name, obj);
+  /* Only the wallet txs that change names are looked at, in the order
+     of their txid per name.  The builder picks the latest change of each
+     name by height and builds JSON only for those.  It refers to the
+     wallet txs, so the locks are held until the result is built.  */
+  CWallet::NameTxMap::const_iterator begin, end;
+  if (nameFilter.empty ())
+    {
+      begin = pwalletMain->mapNameTxs.begin ();
+      end = pwalletMain->mapNameTxs.end ();
+    }
+  else
+    {
+      begin = pwalletMain->mapNameTxs.find (nameFilter);
+      end = begin;
+      if (end != pwalletMain->mapNameTxs.end ())
+        ++end;
     }
-  }
+
+  for (CWallet::NameTxMap::const_iterator nit = begin; nit != end; ++nit)
+    for (const auto& ref : nit->second)
+      {
+        const auto mit = pwalletMain->mapWallet.find (ref.txid);
+        if (mit != pwalletMain->mapWallet.end ())
+          builder.add (nit->first, mit->second, ref);
+      }
 
   return builder.build ();
+  }
 }
 
 /* ************************************************************************** */
@@ -2641,63 +2641,63 @@ extern UniValue name_register(const JSONRPCRequest& request);
 extern UniValue sendtoname(const JSONRPCRequest& request);
 
 static const CRPCCommand commands[] =
-{ //  category              name                        actor (function)           okSafeMode
-    //  --------------------- ------------------------    -----------------------    ----------
-    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false },
-    { "hidden",             "resendwallettransactions", &resendwallettransactions, true  },
-    { "wallet",             "abandontransaction",       &abandontransaction,       false },
-    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true  },
-    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true  },
-    { "wallet",             "backupwallet",             &backupwallet,             true  },
-    { "wallet",             "dumpprivkey",              &dumpprivkey,              true  },
-    { "wallet",             "dumpwallet",               &dumpwallet,               true  },
-    { "wallet",             "encryptwallet",            &encryptwallet,            true  },
-    { "wallet",             "getaccountaddress",        &getaccountaddress,        true  },
-    { "wallet",             "getaccount",               &getaccount,               true  },
-    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true  },
-    { "wallet",             "getbalance",               &getbalance,               false },
-    { "wallet",             "getnewaddress",            &getnewaddress,            true  },
-    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true  },
-    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false },
-    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false },
-    { "wallet",             "gettransaction",           &gettransaction,           false },
-    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false },
-    { "wallet",             "getwalletinfo",            &getwalletinfo,            false },
-    { "wallet",             "importmulti",              &importmulti,              true  },
-    { "wallet",             "importprivkey",            &importprivkey,            true  },
-    { "wallet",             "importwallet",             &importwallet,             true  },
-    { "wallet",             "importaddress",            &importaddress,            true  },
-    { "wallet",             "importprunedfunds",        &importprunedfunds,        true  },
-    { "wallet",             "importpubkey",             &importpubkey,             true  },
-    { "wallet",             "keypoolrefill",            &keypoolrefill,            true  },
-    { "wallet",             "listaccounts",             &listaccounts,             false },
-    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false },
-    { "wallet",             "listlockunspent",          &listlockunspent,          false },
-    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false },
-    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false },
-    { "wallet",             "listsinceblock",           &listsinceblock,           false },
-    { "wallet",             "listtransactions",         &listtransactions,         false },
-    { "wallet",             "listunspent",              &listunspent,              false },
-    { "wallet",             "lockunspent",              &lockunspent,              true  },
-    { "wallet",             "move",                     &movecmd,                  false },
-    { "wallet",             "sendfrom",                 &sendfrom,                 false },
-    { "wallet",             "sendmany",                 &sendmany,                 false },
-    { "wallet",             "sendtoaddress",            &sendtoaddress,            false },
-    { "wallet",             "setaccount",               &setaccount,               true  },
-    { "wallet",             "settxfee",                 &settxfee,                 true  },
-    { "wallet",             "signmessage",              &signmessage,              true  },
-    { "wallet",             "walletlock",               &walletlock,               true  },
-    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true  },
-    { "wallet",             "walletpassphrase",         &walletpassphrase,         true  },
-    { "wallet",             "removeprunedfunds",        &removeprunedfunds,        true  },
+{ //  category              name                        actor (function)           okSafeMode  queue               readonly
+    //  --------------------- ------------------------    -----------------------    ----------  ------------------  --------
+    { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false,      RPC_QUEUE_CHEAP,    false },
+    { "hidden",             "resendwallettransactions", &resendwallettransactions, true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "abandontransaction",       &abandontransaction,       false,      RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "backupwallet",             &backupwallet,             true,       RPC_QUEUE_HEAVY,    false },
+    { "wallet",             "dumpprivkey",              &dumpprivkey,              true,       RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "dumpwallet",               &dumpwallet,               true,       RPC_QUEUE_HEAVY,    false },
+    { "wallet",             "encryptwallet",            &encryptwallet,            true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "getaccountaddress",        &getaccountaddress,        true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "getaccount",               &getaccount,               true,       RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "getaddressesbyaccount",    &getaddressesbyaccount,    true,       RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "getbalance",               &getbalance,               false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "getnewaddress",            &getnewaddress,            true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "gettransaction",           &gettransaction,           false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "getwalletinfo",            &getwalletinfo,            false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "importmulti",              &importmulti,              true,       RPC_QUEUE_HEAVY,    false },
+    { "wallet",             "importprivkey",            &importprivkey,            true,       RPC_QUEUE_HEAVY,    false },
+    { "wallet",             "importwallet",             &importwallet,             true,       RPC_QUEUE_HEAVY,    false },
+    { "wallet",             "importaddress",            &importaddress,            true,       RPC_QUEUE_HEAVY,    false },
+    { "wallet",             "importprunedfunds",        &importprunedfunds,        true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "importpubkey",             &importpubkey,             true,       RPC_QUEUE_HEAVY,    false },
+    { "wallet",             "keypoolrefill",            &keypoolrefill,            true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "listaccounts",             &listaccounts,             false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "listaddressgroupings",     &listaddressgroupings,     false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "listlockunspent",          &listlockunspent,          false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "listreceivedbyaccount",    &listreceivedbyaccount,    false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "listreceivedbyaddress",    &listreceivedbyaddress,    false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "listsinceblock",           &listsinceblock,           false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "listtransactions",         &listtransactions,         false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "listunspent",              &listunspent,              false,      RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "lockunspent",              &lockunspent,              true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "move",                     &movecmd,                  false,      RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "sendfrom",                 &sendfrom,                 false,      RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "sendmany",                 &sendmany,                 false,      RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "sendtoaddress",            &sendtoaddress,            false,      RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "setaccount",               &setaccount,               true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "settxfee",                 &settxfee,                 true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "signmessage",              &signmessage,              true,       RPC_QUEUE_CHEAP,    true  },
+    { "wallet",             "walletlock",               &walletlock,               true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "walletpassphrasechange",   &walletpassphrasechange,   true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "walletpassphrase",         &walletpassphrase,         true,       RPC_QUEUE_CHEAP,    false },
+    { "wallet",             "removeprunedfunds",        &removeprunedfunds,        true,       RPC_QUEUE_CHEAP,    false },
 
     // Namecoin-specific wallet calls.
-    { "namecoin",           "name_list",                &name_list,                false },
-    { "namecoin",           "name_new",                 &name_new,                 false },
-    { "namecoin",           "name_firstupdate",         &name_firstupdate,         false },
-    { "namecoin",           "name_update",              &name_update,              false },
-    { "namecoin",           "name_register",            &name_register,            false },
-    { "namecoin",           "sendtoname",               &sendtoname,               false },
+    { "namecoin",           "name_list",                &name_list,                false,      RPC_QUEUE_HEAVY,    true  },
+    { "namecoin",           "name_new",                 &name_new,                 false,      RPC_QUEUE_CHEAP,    false },
+    { "namecoin",           "name_firstupdate",         &name_firstupdate,         false,      RPC_QUEUE_CHEAP,    false },
+    { "namecoin",           "name_update",              &name_update,              false,      RPC_QUEUE_CHEAP,    false },
+    { "namecoin",           "name_register",            &name_register,            false,      RPC_QUEUE_CHEAP,    false },
+    { "namecoin",           "sendtoname",               &sendtoname,               false,      RPC_QUEUE_CHEAP,    false },
 };
 
 void RegisterWalletRPCCommands(CRPCTable &t)
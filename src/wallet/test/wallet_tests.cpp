@@ -4,8 +4,18 @@
 
 #include "wallet/wallet.h"
 
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "names/common.h"
+#include "random.h"
+#include "script/names.h"
+#include "script/sign.h"
+#include "validation.h"
+#include "wallet/db.h"
+
 #include <set>
 #include <stdint.h>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -264,13 +274,19 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
         BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
 
         // test with many inputs
+        const CAmount nCostOfChange = CWallet::GetCostOfChange();
         for (CAmount amt=1500; amt < COIN; amt*=10) {
              empty_wallet();
              // Create 676 inputs (=  (old MAX_STANDARD_TX_SIZE == 100000)  / 148 bytes per input)
              for (uint16_t j = 0; j < 676; j++)
                  add_coin(amt);
              BOOST_CHECK(wallet.SelectCoinsMinConf(2000, 1, 1, vCoins, setCoinsRet, nValueRet));
-             if (amt - 2000 < MIN_CHANGE) {
+             const uint16_t nNoChangeSize = (2000 + amt - 1) / amt;
+             if (nNoChangeSize * amt - 2000 <= nCostOfChange) {
+                 // the fewest inputs that reach the target leave less than change costs:
+                 BOOST_CHECK_EQUAL(nValueRet, amt * nNoChangeSize);
+                 BOOST_CHECK_EQUAL(setCoinsRet.size(), nNoChangeSize);
+             } else if (amt - 2000 < MIN_CHANGE) {
                  // needs more than one input:
                  uint16_t returnSize = std::ceil((2000.0 + MIN_CHANGE)/amt);
                  CAmount returnValue = amt * returnSize;
@@ -283,6 +299,20 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
              }
         }
 
+        // test that fewer inputs beat a smaller excess when they waste less
+        const CAmount nCostOfInput = CWallet::GetCostOfInput();
+        BOOST_CHECK(nCostOfInput > 0);
+        empty_wallet();
+        add_coin(2 * COIN);
+        add_coin(2 * COIN + nCostOfInput / 2);
+        add_coin(1 * COIN);
+        add_coin(1 * COIN);
+
+        // 2 + 1 + 1 is exact, but its third input costs more than the excess of 2 + 2
+        BOOST_CHECK(wallet.SelectCoinsMinConf(4 * COIN, 1, 1, vCoins, setCoinsRet, nValueRet));
+        BOOST_CHECK_EQUAL(nValueRet, 4 * COIN + nCostOfInput / 2);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
         // test randomness
         {
             empty_wallet();
@@ -351,4 +381,322 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
 }
 
+/**
+ * Wallet on top of the 100 block regtest chain, holding the key that the
+ * coinbases pay to.
+ */
+class BalanceTestingSetup : public TestChain100Setup
+{
+public:
+    BalanceTestingSetup()
+    {
+        ::bitdb.MakeMock();
+        pwallet.reset(new CWallet("wallet_test.dat"));
+        bool fFirstRun;
+        pwallet->LoadWallet(fFirstRun);
+        {
+            LOCK(pwallet->cs_wallet);
+            pwallet->AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+        }
+        pwallet->ScanForWalletTransactions(chainActive.Genesis());
+        RegisterValidationInterface(pwallet.get());
+    }
+
+    ~BalanceTestingSetup()
+    {
+        UnregisterValidationInterface(pwallet.get());
+        pwallet.reset();
+        ::bitdb.Flush(true);
+        ::bitdb.Reset();
+    }
+
+    /* Spend the coinbase of block n+1 to scriptPubKey.  */
+    CMutableTransaction SpendCoinbase(size_t n, const CScript& scriptPubKey, const CAmount& nFee)
+    {
+        const CTransaction& txFrom = coinbaseTxns[n];
+        CMutableTransaction tx;
+        tx.vin.push_back(CTxIn(txFrom.GetHash(), 0));
+        tx.vout.push_back(CTxOut(txFrom.vout[0].nValue - nFee, scriptPubKey));
+        BOOST_CHECK(SignSignature(*pwallet, txFrom, tx, 0, SIGHASH_ALL));
+        return tx;
+    }
+
+    /* Send nValue to scriptPubKey with the wallet's own coin selection.  */
+    CWalletTx SendFromWallet(const CScript& scriptPubKey, const CAmount& nValue)
+    {
+        CWalletTx wtx;
+        CReserveKey reservekey(pwallet.get());
+        CAmount nFee;
+        int nChangePos = -1;
+        std::string strError;
+        const std::vector<CRecipient> vecSend = {{scriptPubKey, nValue, false}};
+        BOOST_CHECK(pwallet->CreateTransaction(vecSend, NULL, wtx, reservekey, nFee, nChangePos, strError));
+        CValidationState state;
+        BOOST_CHECK(pwallet->CommitTransaction(wtx, reservekey, NULL, state));
+        return wtx;
+    }
+
+    std::unique_ptr<CWallet> pwallet;
+};
+
+typedef std::tuple<uint256, unsigned int, int, bool, bool> CoinTuple;
+
+/**
+ * Compare the running balances and the result of AvailableCoins with a full
+ * recomputation over mapWallet.
+ */
+static void CheckBalances(const CWallet& wallet)
+{
+    LOCK2(cs_main, wallet.cs_wallet);
+
+    CAmount nTrusted = 0, nUnconfirmed = 0, nImmature = 0;
+    CAmount nWatchTrusted = 0, nWatchUnconfirmed = 0, nWatchImmature = 0;
+    std::set<CoinTuple> setCoins[2];
+    for (const std::pair<const uint256, CWalletTx>& item : wallet.mapWallet)
+    {
+        const uint256& hash = item.first;
+        const CWalletTx& wtx = item.second;
+        const int nDepth = wtx.GetDepthInMainChain();
+
+        if (wtx.IsTrusted()) {
+            nTrusted += wtx.GetAvailableCredit(false);
+            nWatchTrusted += wtx.GetAvailableWatchOnlyCredit(false);
+        } else if (nDepth == 0 && wtx.InMempool()) {
+            nUnconfirmed += wtx.GetAvailableCredit(false);
+            nWatchUnconfirmed += wtx.GetAvailableWatchOnlyCredit(false);
+        }
+        nImmature += wtx.GetImmatureCredit(false);
+        nWatchImmature += wtx.GetImmatureWatchOnlyCredit(false);
+
+        if (!CheckFinalTx(wtx) || nDepth < 0 || (nDepth == 0 && !wtx.InMempool()))
+            continue;
+        if ((wtx.IsCoinBase() || wtx.IsGameTx()) && wtx.GetBlocksToMaturity() > 0)
+            continue;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+            const CTxOut& txout = wtx.tx->vout[i];
+            const isminetype mine = wallet.IsMine(txout);
+            if (mine == ISMINE_NO || wallet.IsSpent(hash, i) || wallet.IsLockedCoin(hash, i)
+                  || txout.nValue == 0 || CNameScript::isNameScript(txout.scriptPubKey))
+                continue;
+            const CoinTuple coin(hash, i, nDepth, (mine & ISMINE_SPENDABLE) != ISMINE_NO,
+                                 (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO);
+            setCoins[0].insert(coin);
+            if (wtx.IsTrusted())
+                setCoins[1].insert(coin);
+        }
+    }
+
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nTrusted);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedBalance(), nUnconfirmed);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), nImmature);
+    BOOST_CHECK_EQUAL(wallet.GetWatchOnlyBalance(), nWatchTrusted);
+    BOOST_CHECK_EQUAL(wallet.GetUnconfirmedWatchOnlyBalance(), nWatchUnconfirmed);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureWatchOnlyBalance(), nWatchImmature);
+
+    for (int fOnlyConfirmed = 0; fOnlyConfirmed < 2; ++fOnlyConfirmed) {
+        std::vector<COutput> vAvailable;
+        wallet.AvailableCoins(vAvailable, fOnlyConfirmed);
+        std::set<CoinTuple> setAvailable;
+        for (const COutput& out : vAvailable)
+            setAvailable.insert(CoinTuple(out.tx->GetHash(), out.i, out.nDepth, out.fSpendable, out.fSolvable));
+        BOOST_CHECK_EQUAL(vAvailable.size(), setAvailable.size());
+        BOOST_CHECK(setAvailable == setCoins[fOnlyConfirmed]);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(running_balances, BalanceTestingSetup)
+{
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    const CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+
+    // All coinbases are immature at first, and mature one per block.
+    CheckBalances(*pwallet);
+    BOOST_CHECK_EQUAL(pwallet->GetBalance(), 0);
+    CAmount nMatured = 0;
+    for (size_t i = 0; i < 20; ++i) {
+        CreateAndProcessBlock({}, scriptOther);
+        nMatured += coinbaseTxns[i].vout[0].nValue;
+        CheckBalances(*pwallet);
+        BOOST_CHECK_EQUAL(pwallet->GetBalance(), nMatured);
+    }
+
+    // Keep coin selection away from the coinbases spent by hand below.
+    {
+        LOCK(pwallet->cs_wallet);
+        for (size_t i = 10; i < 14; ++i)
+            pwallet->LockCoin(COutPoint(coinbaseTxns[i].GetHash(), 0));
+    }
+    CheckBalances(*pwallet);
+
+    // A spend that confirms and is then disconnected again.
+    pwallet->SetBroadcastTransactions(true);
+    const CWalletTx wtxSpend = SendFromWallet(scriptOther, COIN);
+    CheckBalances(*pwallet);
+    CreateAndProcessBlock({CMutableTransaction(*wtxSpend.tx)}, scriptOther);
+    CheckBalances(*pwallet);
+    CBlockIndex* pindexSpend = chainActive.Tip();
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), pindexSpend));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindexSpend->pprev);
+    CheckBalances(*pwallet);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(ResetBlockFailureFlags(pindexSpend));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    BOOST_CHECK(chainActive.Tip() == pindexSpend);
+    CheckBalances(*pwallet);
+
+    // A mempool tx that is conflicted by a block (MarkConflicted).
+    const CMutableTransaction txConflicted = SpendCoinbase(10, scriptOther, CENT);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, txConflicted, false, NULL));
+    }
+    CheckBalances(*pwallet);
+    CreateAndProcessBlock({SpendCoinbase(10, scriptOther, 2 * CENT)}, scriptOther);
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        BOOST_CHECK(pwallet->mapWallet[txConflicted.GetHash()].GetDepthInMainChain() < 0);
+    }
+    CheckBalances(*pwallet);
+
+    // A tx that never made it into the mempool and is abandoned.
+    const CMutableTransaction txAbandoned = SpendCoinbase(11, scriptOther, CENT);
+    const CAmount nBalance = pwallet->GetBalance();
+    BOOST_CHECK(pwallet->AddToWallet(CWalletTx(pwallet.get(), MakeTransactionRef(txAbandoned))));
+    CheckBalances(*pwallet);
+    BOOST_CHECK(pwallet->GetBalance() < nBalance);
+    BOOST_CHECK(pwallet->AbandonTransaction(txAbandoned.GetHash()));
+    CheckBalances(*pwallet);
+    BOOST_CHECK_EQUAL(pwallet->GetBalance(), nBalance);
+
+    // Zapping an abandoned and a confirmed tx.
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        std::vector<uint256> vHashIn = {txAbandoned.GetHash(), wtxSpend.GetHash()};
+        std::vector<uint256> vHashOut;
+        BOOST_CHECK(pwallet->ZapSelectTx(vHashIn, vHashOut) == DB_LOAD_OK);
+        BOOST_CHECK_EQUAL(vHashOut.size(), 2U);
+    }
+    CheckBalances(*pwallet);
+
+    // Importing a key and a watch-only address, the way importprivkey and
+    // importaddress do.  The key gets a payment and an immature coinbase.
+    CKey keyImport;
+    keyImport.MakeNewKey(true);
+    const CScript scriptImport = GetScriptForDestination(keyImport.GetPubKey().GetID());
+    CKey keyWatch;
+    keyWatch.MakeNewKey(true);
+    const CScript scriptWatch = GetScriptForDestination(keyWatch.GetPubKey().GetID());
+    const CMutableTransaction txWatch = SpendCoinbase(13, scriptWatch, CENT);
+    CreateAndProcessBlock({SpendCoinbase(12, scriptImport, CENT), txWatch}, scriptImport);
+    CheckBalances(*pwallet);
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        pwallet->MarkDirty();
+        BOOST_CHECK(pwallet->AddKeyPubKey(keyImport, keyImport.GetPubKey()));
+        BOOST_CHECK(pwallet->AddWatchOnly(scriptWatch));
+    }
+    pwallet->ScanForWalletTransactions(chainActive.Genesis(), true);
+    CheckBalances(*pwallet);
+    BOOST_CHECK(pwallet->GetImmatureBalance() > 0);
+    BOOST_CHECK_EQUAL(pwallet->GetWatchOnlyBalance(), txWatch.vout[0].nValue);
+}
+
+/* Return the index entries of a name as (txid, n, fKill) tuples.  */
+static std::set<std::tuple<uint256, unsigned int, bool> > GetNameIndex(const CWallet& wallet, const std::string& name)
+{
+    LOCK(wallet.cs_wallet);
+    std::set<std::tuple<uint256, unsigned int, bool> > res;
+    const CWallet::NameTxMap::const_iterator mit = wallet.mapNameTxs.find(ValtypeFromString(name));
+    if (mit != wallet.mapNameTxs.end())
+        for (const CWalletNameTx& ref : mit->second)
+            res.insert(std::make_tuple(ref.txid, ref.n, ref.fKill));
+    return res;
+}
+
+BOOST_FIXTURE_TEST_CASE(name_index, BalanceTestingSetup)
+{
+    const CScript scriptMine = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    // Name updates of two names, with the name output not at index 0.
+    CMutableTransaction txAlice;
+    txAlice.SetNamecoin();
+    txAlice.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txAlice.vout.push_back(CTxOut(COIN, scriptMine));
+    txAlice.vout.push_back(CTxOut(COIN, CNameScript::buildNameUpdate(scriptMine, ValtypeFromString("alice"), ValtypeFromString("{}"))));
+    CMutableTransaction txBob;
+    txBob.SetNamecoin();
+    txBob.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txBob.vout.push_back(CTxOut(COIN, CNameScript::buildNameUpdate(scriptMine, ValtypeFromString("bob"), ValtypeFromString("{}"))));
+
+    // A kill of alice; its second input spends her name.
+    CMutableTransaction txKill;
+    txKill.SetGameTx();
+    txKill.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0), CScript() << ValtypeFromString("carol")));
+    txKill.vin.push_back(CTxIn(COutPoint(txAlice.GetHash(), 1), CScript() << ValtypeFromString("alice")));
+
+    // A plain payment, which is not indexed.
+    CMutableTransaction txPlain;
+    txPlain.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    txPlain.vout.push_back(CTxOut(COIN, scriptMine));
+
+    for (const CMutableTransaction& tx : {txAlice, txBob, txKill, txPlain})
+        BOOST_CHECK(pwallet->AddToWallet(CWalletTx(pwallet.get(), MakeTransactionRef(tx))));
+
+    typedef std::set<std::tuple<uint256, unsigned int, bool> > IndexEntries;
+    BOOST_CHECK(GetNameIndex(*pwallet, "alice") == IndexEntries({std::make_tuple(txAlice.GetHash(), 1, false),
+                                                                 std::make_tuple(txKill.GetHash(), 1, true)}));
+    BOOST_CHECK(GetNameIndex(*pwallet, "bob") == IndexEntries({std::make_tuple(txBob.GetHash(), 0, false)}));
+    BOOST_CHECK(GetNameIndex(*pwallet, "carol") == IndexEntries({std::make_tuple(txKill.GetHash(), 0, true)}));
+    {
+        LOCK(pwallet->cs_wallet);
+        BOOST_CHECK_EQUAL(pwallet->mapNameTxs.size(), 3U);
+    }
+
+    // Zapping removes the entries of a tx, and names without any.
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        std::vector<uint256> vHashIn = {txAlice.GetHash(), txPlain.GetHash()};
+        std::vector<uint256> vHashOut;
+        BOOST_CHECK(pwallet->ZapSelectTx(vHashIn, vHashOut) == DB_LOAD_OK);
+        BOOST_CHECK_EQUAL(vHashOut.size(), 2U);
+    }
+    BOOST_CHECK(GetNameIndex(*pwallet, "alice") == IndexEntries({std::make_tuple(txKill.GetHash(), 1, true)}));
+    {
+        LOCK2(cs_main, pwallet->cs_wallet);
+        std::vector<uint256> vHashIn = {txBob.GetHash()};
+        std::vector<uint256> vHashOut;
+        BOOST_CHECK(pwallet->ZapSelectTx(vHashIn, vHashOut) == DB_LOAD_OK);
+        BOOST_CHECK_EQUAL(vHashOut.size(), 1U);
+    }
+    BOOST_CHECK(GetNameIndex(*pwallet, "bob").empty());
+    {
+        LOCK(pwallet->cs_wallet);
+        BOOST_CHECK_EQUAL(pwallet->mapNameTxs.count(ValtypeFromString("bob")), 0U);
+    }
+
+    // Loading the wallet again builds the same index through LoadToWallet.
+    const IndexEntries alice = GetNameIndex(*pwallet, "alice");
+    const IndexEntries carol = GetNameIndex(*pwallet, "carol");
+    UnregisterValidationInterface(pwallet.get());
+    pwallet.reset(new CWallet("wallet_test.dat"));
+    bool fFirstRun;
+    BOOST_CHECK(pwallet->LoadWallet(fFirstRun) == DB_LOAD_OK);
+    RegisterValidationInterface(pwallet.get());
+    BOOST_CHECK(GetNameIndex(*pwallet, "alice") == alice);
+    BOOST_CHECK(GetNameIndex(*pwallet, "carol") == carol);
+    BOOST_CHECK(GetNameIndex(*pwallet, "bob").empty());
+    {
+        LOCK(pwallet->cs_wallet);
+        BOOST_CHECK_EQUAL(pwallet->mapNameTxs.size(), 2U);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
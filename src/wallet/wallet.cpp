@@ -33,6 +33,10 @@
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 using namespace std;
 
 CWallet* pwalletMain = NULL;
@@ -42,6 +46,7 @@ unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
 bool fSendFreeTransactions = DEFAULT_SEND_FREE_TRANSACTIONS;
 bool fWalletRbf = DEFAULT_WALLET_RBF;
+unsigned int nConsolidateInputs = DEFAULT_CONSOLIDATE_INPUTS;
 
 const char * DEFAULT_WALLET_DAT = "wallet.dat";
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
@@ -63,15 +68,6 @@ CFeeRate CWallet::fallbackFee = CFeeRate(DEFAULT_FALLBACK_FEE);
  * @{
  */
 
-struct CompareValueOnly
-{
-    bool operator()(const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t1,
-                    const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->tx->vout[i].nValue));
@@ -541,6 +537,11 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
     pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     SyncMetaData(range);
+
+    // The available credit of the spent tx changes with it.
+    std::map<uint256, CWalletTx>::iterator mit = mapWallet.find(outpoint.hash);
+    if (mit != mapWallet.end())
+        mit->second.MarkDirty();
 }
 
 
@@ -817,6 +818,21 @@ bool CWallet::GetAccountPubkey(CPubKey &pubKey, std::string strAccount, bool bFo
     return true;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+
+    if (pwallet)
+        pwallet->MarkBalanceDirty(GetHash());
+}
+
 void CWallet::MarkDirty()
 {
     {
@@ -890,6 +906,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
                          wtxIn.hashBlock.ToString());
         }
         AddToSpends(hash);
+        AddToNameIndex(wtx);
     }
 
     bool fUpdated = false;
@@ -954,6 +971,7 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     wtx.BindWallet(this);
     wtxOrdered.insert(make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
     AddToSpends(hash);
+    AddToNameIndex(wtx);
     BOOST_FOREACH(const CTxIn& txin, wtx.tx->vin) {
         if (mapWallet.count(txin.prevout.hash)) {
             CWalletTx& prevtx = mapWallet[txin.prevout.hash];
@@ -968,12 +986,72 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     return true;
 }
 
+/** Find the name index entries for a wallet transaction.  */
+static void GetNameTxs(const CWalletTx& wtx,
+                       std::vector<std::pair<valtype, CWalletNameTx> >& vNameTxs)
+{
+    const uint256& hash = wtx.GetHash();
+
+    /* All inputs of kill transactions are indexed.  Whether they spend
+       one of our names can only be decided when the previous tx is known,
+       which is not yet the case while the wallet is loaded.  */
+    if (wtx.IsKillTx()) {
+        for (unsigned int i = 0; i < wtx.tx->vin.size(); ++i) {
+            valtype name;
+            if (NameFromGameTransactionInput(wtx.tx->vin[i].scriptSig, name))
+                vNameTxs.push_back(std::make_pair(name, CWalletNameTx(hash, i, true)));
+        }
+        return;
+    }
+
+    if (!wtx.tx->IsNamecoin())
+        return;
+
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+        const CNameScript nameOp(wtx.tx->vout[i].scriptPubKey);
+        if (!nameOp.isNameOp())
+            continue;
+
+        /* Only the first name output counts, and name_new's do not
+           refer to a name.  */
+        if (nameOp.isAnyUpdate())
+            vNameTxs.push_back(std::make_pair(nameOp.getOpName(), CWalletNameTx(hash, i, false)));
+        return;
+    }
+}
+
+void CWallet::AddToNameIndex(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::vector<std::pair<valtype, CWalletNameTx> > vNameTxs;
+    GetNameTxs(wtx, vNameTxs);
+    for (const auto& item : vNameTxs)
+        mapNameTxs[item.first].insert(item.second);
+}
+
+void CWallet::RemoveFromNameIndex(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::vector<std::pair<valtype, CWalletNameTx> > vNameTxs;
+    GetNameTxs(wtx, vNameTxs);
+    for (const auto& item : vNameTxs) {
+        NameTxMap::iterator mit = mapNameTxs.find(item.first);
+        if (mit == mapNameTxs.end())
+            continue;
+        mit->second.erase(item.second);
+        if (mit->second.empty())
+            mapNameTxs.erase(mit);
+    }
+}
+
 /**
  * Add a transaction to the wallet, or update it.
  * pblock is optional, but should be provided if the transaction is known to be in a block.
  * If fUpdate is true, existing transactions will be updated.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate, const bool* pfIsMine)
 {
     {
         AssertLockHeld(cs_wallet);
@@ -993,7 +1071,8 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex
 
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        if (fExisted || IsMine(tx) || IsFromMe(tx))
+        const bool fIsMine = pfIsMine ? *pfIsMine : IsMine(tx);
+        if (fExisted || fIsMine || IsFromMe(tx))
         {
             CWalletTx wtx(this, MakeTransactionRef(tx));
 
@@ -1528,17 +1607,175 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
     }
 }
 
+namespace
+{
+
+/**
+ * The txs of a block (followed by its game txs) as read by a rescan,
+ * together with the result of IsMine for each of them.
+ */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    std::vector<CTransactionRef> vtx;
+    std::vector<char> vIsMine;
+};
+
+/**
+ * Reads the blocks of a rescan in chunks of RESCAN_CHUNK_BLOCKS and runs
+ * IsMine on their txs.  This is done on worker threads ahead of the thread
+ * that adds the txs to the wallet in chain order.  IsFromMe and everything
+ * else that depends on the wallet txs found so far is left to that thread.
+ * It also reads a chunk itself if no worker has picked it up yet.
+ */
+class CRescanReader
+{
+private:
+    const CWallet& wallet;
+    const std::vector<CBlockIndex*>& vIndex;
+    const size_t nChunks;
+    /* How many chunks the workers may be ahead of the consumer.  */
+    const size_t nWindow;
+
+    std::mutex mut;
+    std::condition_variable cond;
+    std::vector<std::vector<CRescanBlock> > vChunks;
+    std::vector<bool> vReady;
+    size_t nNextChunk;
+    size_t nConsumed;
+    bool fStop;
+    std::vector<std::thread> vThreads;
+
+    void ReadChunk(size_t n, std::vector<CRescanBlock>& vBlocks) const;
+    void Worker();
+
+public:
+    CRescanReader(const CWallet& walletIn, const std::vector<CBlockIndex*>& vIndexIn, int nThreads);
+    ~CRescanReader();
+
+    size_t GetNumChunks() const
+    {
+        return nChunks;
+    }
+
+    /** Get the blocks of chunk n, which must be the one after the last.  */
+    void GetChunk(size_t n, std::vector<CRescanBlock>& vBlocks);
+};
+
+CRescanReader::CRescanReader(const CWallet& walletIn, const std::vector<CBlockIndex*>& vIndexIn, int nThreads)
+    : wallet(walletIn), vIndex(vIndexIn),
+      nChunks((vIndexIn.size() + RESCAN_CHUNK_BLOCKS - 1) / RESCAN_CHUNK_BLOCKS),
+      nWindow(2 * (nThreads + 1)),
+      vChunks(nChunks), vReady(nChunks, false),
+      nNextChunk(0), nConsumed(0), fStop(false)
+{
+    nThreads = std::min<size_t>(nThreads, nChunks > 0 ? nChunks - 1 : 0);
+    for (int i = 0; i < nThreads; ++i)
+        vThreads.emplace_back(&CRescanReader::Worker, this);
+}
+
+CRescanReader::~CRescanReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mut);
+        fStop = true;
+    }
+    cond.notify_all();
+    for (std::thread& t : vThreads)
+        t.join();
+}
+
+void CRescanReader::ReadChunk(size_t n, std::vector<CRescanBlock>& vBlocks) const
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const size_t nEnd = std::min(vIndex.size(), (n + 1) * RESCAN_CHUNK_BLOCKS);
+
+    vBlocks.clear();
+    for (size_t i = n * RESCAN_CHUNK_BLOCKS; i < nEnd; ++i)
+    {
+        CBlock block;
+        std::vector<CTransactionRef> vGameTx;
+        ReadBlockFromDisk(block, vGameTx, vIndex[i], consensusParams);
+
+        vBlocks.push_back(CRescanBlock());
+        CRescanBlock& res = vBlocks.back();
+        res.pindex = vIndex[i];
+        res.vtx.swap(block.vtx);
+        res.vtx.insert(res.vtx.end(), vGameTx.begin(), vGameTx.end());
+        res.vIsMine.reserve(res.vtx.size());
+        BOOST_FOREACH(const CTransactionRef& tx, res.vtx)
+            res.vIsMine.push_back(wallet.IsMine(*tx));
+    }
+}
+
+void CRescanReader::Worker()
+{
+    RenameThread("huntercoin-rescan");
+
+    std::unique_lock<std::mutex> lock(mut);
+    while (true)
+    {
+        cond.wait(lock, [this] {
+            return fStop || nNextChunk >= nChunks
+                    || nNextChunk < nConsumed + nWindow;
+        });
+        if (fStop || nNextChunk >= nChunks)
+            return;
+
+        const size_t n = nNextChunk++;
+        std::vector<CRescanBlock> vBlocks;
+        lock.unlock();
+        ReadChunk(n, vBlocks);
+        lock.lock();
+
+        vChunks[n].swap(vBlocks);
+        vReady[n] = true;
+        cond.notify_all();
+    }
+}
+
+void CRescanReader::GetChunk(size_t n, std::vector<CRescanBlock>& vBlocks)
+{
+    std::unique_lock<std::mutex> lock(mut);
+    assert(n == nConsumed && n < nChunks);
+
+    if (nNextChunk == n) {
+        ++nNextChunk;
+        lock.unlock();
+        ReadChunk(n, vBlocks);
+        lock.lock();
+    } else {
+        cond.wait(lock, [this, n] { return static_cast<bool>(vReady[n]); });
+        vBlocks.clear();
+        vBlocks.swap(vChunks[n]);
+    }
+
+    ++nConsumed;
+    cond.notify_all();
+}
+
+} // anonymous namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and checked against our keys on up to -rescanthreads
+ * threads, and the transactions are added in chain order.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
+    const int64_t nStart = GetTimeMicros();
     int64_t nNow = GetTime();
     const CChainParams& chainParams = Params();
 
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
@@ -1548,35 +1785,55 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
+        std::vector<CBlockIndex*> vIndex;
+        for (; pindex; pindex = chainActive.Next(pindex))
+            vIndex.push_back(pindex);
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex)
-        {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-
-            CBlock block;
-            std::vector<CTransactionRef> vGameTx;
-            ReadBlockFromDisk(block, vGameTx, pindex, Params().GetConsensus());
-            int posInBlock;
-            for (posInBlock = 0; posInBlock < (int)block.vtx.size(); posInBlock++)
-            {
-                if (AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate))
-                    ret++;
-            }
-            for (unsigned i = 0; i < vGameTx.size(); ++i)
+        double dProgressStart = 0.0;
+        double dProgressTip = 0.0;
+        if (!vIndex.empty()) {
+            dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), vIndex.front(), false);
+            dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
+        }
+
+        // The calling thread reads blocks as well, so it counts as one.
+        CRescanReader reader(*this, vIndex, nThreads - 1);
+        std::vector<CRescanBlock> vBlocks;
+        size_t nBlocks = 0;
+        size_t nTx = 0;
+        for (size_t c = 0; c < reader.GetNumChunks(); ++c)
+        {
+            reader.GetChunk(c, vBlocks);
+            BOOST_FOREACH(const CRescanBlock& blk, vBlocks)
             {
-                if (AddToWalletIfInvolvingMe(*vGameTx[i], pindex, block.vtx.size() + i, fUpdate))
-                    ret++;
-            }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                if (blk.pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), blk.pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                for (unsigned i = 0; i < blk.vtx.size(); ++i)
+                {
+                    const bool fIsMine = blk.vIsMine[i];
+                    if (AddToWalletIfInvolvingMe(*blk.vtx[i], blk.pindex, i, fUpdate, &fIsMine))
+                        ret++;
+                }
+
+                ++nBlocks;
+                nTx += blk.vtx.size();
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    const double dSeconds = 0.000001 * (GetTimeMicros() - nStart);
+                    LogPrintf("Still rescanning. At block %d. Progress=%f, %.1f blocks/s, %.1f tx/s\n",
+                              blk.pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), blk.pindex),
+                              nBlocks / dSeconds, nTx / dSeconds);
+                }
             }
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        const double dSeconds = 0.000001 * (GetTimeMicros() - nStart);
+        LogPrintf("Rescanned %u blocks (%u tx) in %.2fs using %d threads, %.1f blocks/s, found %d wallet tx\n",
+                  nBlocks, nTx, dSeconds, nThreads,
+                  dSeconds > 0.0 ? nBlocks / dSeconds : 0.0, ret);
     }
     return ret;
 }
@@ -1914,94 +2171,173 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-CAmount CWallet::GetBalance() const
+bool CWallet::CBalances::IsNull() const
 {
-    CAmount nTotal = 0;
+    return nTrusted == 0 && nUnconfirmed == 0 && nImmature == 0
+            && nWatchTrusted == 0 && nWatchUnconfirmed == 0
+            && nWatchImmature == 0;
+}
+
+CWallet::CBalances& CWallet::CBalances::operator+=(const CBalances& other)
+{
+    nTrusted += other.nTrusted;
+    nUnconfirmed += other.nUnconfirmed;
+    nImmature += other.nImmature;
+    nWatchTrusted += other.nWatchTrusted;
+    nWatchUnconfirmed += other.nWatchUnconfirmed;
+    nWatchImmature += other.nWatchImmature;
+    return *this;
+}
+
+CWallet::CBalances& CWallet::CBalances::operator-=(const CBalances& other)
+{
+    nTrusted -= other.nTrusted;
+    nUnconfirmed -= other.nUnconfirmed;
+    nImmature -= other.nImmature;
+    nWatchTrusted -= other.nWatchTrusted;
+    nWatchUnconfirmed -= other.nWatchUnconfirmed;
+    nWatchImmature -= other.nWatchImmature;
+    return *this;
+}
+
+void CWallet::MarkBalanceDirty(const uint256& hash) const
+{
+    LOCK(cs_wallet);
+    setBalanceDirty.insert(hash);
+}
+
+void CWallet::UpdateBalances() const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    // The state of volatile txs can change without them being marked dirty
+    // (mempool, chain height), so they are always evaluated again.
+    setBalanceDirty.insert(setBalanceVolatile.begin(), setBalanceVolatile.end());
+    setBalanceVolatile.clear();
+
+    // Disconnecting blocks makes matured coinbases and game txs immature
+    // again.  Reorgs are rare, so just look at all of them.
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexBalances && (!pindexTip || pindexTip->GetAncestor(pindexBalances->nHeight) != pindexBalances)) {
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            if (it->second.IsCoinBase() || it->second.IsGameTx())
+                setBalanceDirty.insert(it->first);
+    }
+    pindexBalances = pindexTip;
+
+    BOOST_FOREACH(const uint256& hash, setBalanceDirty)
     {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        std::map<uint256, CBalances>::iterator bit = mapTxBalances.find(hash);
+        if (bit != mapTxBalances.end()) {
+            balances -= bit->second;
+            mapTxBalances.erase(bit);
+        }
+        const bool fCoinTx = setCoinTxs.erase(hash) > 0;
+
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(hash);
+        if (mit == mapWallet.end()) {
+            // Only happens for zapped txs, so a scan is fine.
+            if (fCoinTx) {
+                std::set<std::pair<CAmount, COutPoint> >::iterator cit = setCoinsByValue.begin();
+                while (cit != setCoinsByValue.end()) {
+                    if (cit->second.hash == hash)
+                        setCoinsByValue.erase(cit++);
+                    else
+                        ++cit;
+                }
+            }
+            continue;
+        }
+        const CWalletTx& wtx = mit->second;
+
+        if (fCoinTx) {
+            for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i)
+                setCoinsByValue.erase(std::make_pair(wtx.tx->vout[i].nValue, COutPoint(hash, i)));
+        }
+
+        const int nDepth = wtx.GetDepthInMainChain();
+        const bool fTrusted = wtx.IsTrusted();
+        const bool fUnconfirmed = !fTrusted && nDepth == 0 && wtx.InMempool();
+
+        CBalances txBalances;
+        if (fTrusted) {
+            txBalances.nTrusted = wtx.GetAvailableCredit();
+            txBalances.nWatchTrusted = wtx.GetAvailableWatchOnlyCredit();
+        } else if (fUnconfirmed) {
+            txBalances.nUnconfirmed = wtx.GetAvailableCredit();
+            txBalances.nWatchUnconfirmed = wtx.GetAvailableWatchOnlyCredit();
+        }
+        txBalances.nImmature = wtx.GetImmatureCredit();
+        txBalances.nWatchImmature = wtx.GetImmatureWatchOnlyCredit();
+
+        if (!txBalances.IsNull()) {
+            mapTxBalances[hash] = txBalances;
+            balances += txBalances;
+        }
+
+        const bool fVolatile = nDepth <= 0
+            || ((wtx.IsCoinBase() || wtx.IsGameTx())
+                  && wtx.GetBlocksToMaturity() > 0);
+        if (fVolatile)
+            setBalanceVolatile.insert(hash);
+
+        // Whether the tx itself can be spent from now is left to
+        // AvailableCoins, since that depends on the query.
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i)
         {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+            const CTxOut& txout = wtx.tx->vout[i];
+            if (IsMine(txout) == ISMINE_NO || IsSpent(hash, i)
+                  || CNameScript::isNameScript(txout.scriptPubKey))
+                continue;
+
+            setCoinsByValue.insert(std::make_pair(txout.nValue, COutPoint(hash, i)));
+            setCoinTxs.insert(hash);
         }
     }
+    setBalanceDirty.clear();
+}
 
-    return nTotal;
+CAmount CWallet::GetBalance() const
+{
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+    return balances.nTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+    return balances.nUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+    return balances.nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+    return balances.nWatchTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+    return balances.nWatchUnconfirmed;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const CWalletTx* pcoin = &(*it).second;
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    LOCK2(cs_main, cs_wallet);
+    UpdateBalances();
+    return balances.nWatchImmature;
 }
 
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl, bool fIncludeZeroValue) const
@@ -2010,41 +2346,60 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
-        {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        UpdateBalances();
 
+        // Depth of each tx seen so far, or -1 if its outputs cannot be used.
+        std::map<const CWalletTx*, int> mapDepth;
+        const auto txDepth = [&](const CWalletTx* pcoin) {
             if (!CheckFinalTx(*pcoin))
-                continue;
+                return -1;
 
             if (fOnlyConfirmed && !pcoin->IsTrusted())
-                continue;
+                return -1;
 
             if ((pcoin->IsCoinBase() || pcoin->IsGameTx())
                   && pcoin->GetBlocksToMaturity() > 0)
-                continue;
+                return -1;
 
             int nDepth = pcoin->GetDepthInMainChain();
             if (nDepth < 0)
-                continue;
+                return -1;
 
             // We should not consider coins which aren't at least in our mempool
             // It's possible for these to be conflicted via ancestors which we may never be able to detect
             if (nDepth == 0 && !pcoin->InMempool())
+                return -1;
+
+            return nDepth;
+        };
+
+        // Largest coins first, which is the order coin selection wants.
+        std::set<std::pair<CAmount, COutPoint> >::const_reverse_iterator cit;
+        for (cit = setCoinsByValue.rbegin(); cit != setCoinsByValue.rend(); ++cit)
+        {
+            const COutPoint& outpoint = cit->second;
+            const std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(outpoint.hash);
+            if (it == mapWallet.end())
                 continue;
+            const CWalletTx* pcoin = &(*it).second;
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-                isminetype mine = IsMine(pcoin->tx->vout[i]);
-                if (!(IsSpent(wtxid, i)) && mine != ISMINE_NO &&
-                    !IsLockedCoin((*it).first, i) && (pcoin->tx->vout[i].nValue > 0 || fIncludeZeroValue) &&
-                    (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(COutPoint((*it).first, i)))
-                    && !CNameScript::isNameScript(pcoin->tx->vout[i].scriptPubKey))
-                        vCoins.push_back(COutput(pcoin, i, nDepth,
-                                                 ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
-                                                  (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO),
-                                                 (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO));
-            }
+            std::map<const CWalletTx*, int>::iterator dit = mapDepth.find(pcoin);
+            if (dit == mapDepth.end())
+                dit = mapDepth.insert(std::make_pair(pcoin, txDepth(pcoin))).first;
+            const int nDepth = dit->second;
+            if (nDepth < 0)
+                continue;
+
+            const unsigned int i = outpoint.n;
+            isminetype mine = IsMine(pcoin->tx->vout[i]);
+            if (!(IsSpent(outpoint.hash, i)) && mine != ISMINE_NO &&
+                !IsLockedCoin(outpoint.hash, i) && (pcoin->tx->vout[i].nValue > 0 || fIncludeZeroValue) &&
+                (!coinControl || !coinControl->HasSelected() || coinControl->fAllowOtherInputs || coinControl->IsSelected(outpoint))
+                && !CNameScript::isNameScript(pcoin->tx->vout[i].scriptPubKey))
+                    vCoins.push_back(COutput(pcoin, i, nDepth,
+                                             ((mine & ISMINE_SPENDABLE) != ISMINE_NO) ||
+                                              (coinControl && coinControl->fAllowWatchOnly && (mine & ISMINE_WATCH_SOLVABLE) != ISMINE_NO),
+                                             (mine & (ISMINE_SPENDABLE | ISMINE_WATCH_SOLVABLE)) != ISMINE_NO));
         }
     }
 }
@@ -2095,6 +2450,98 @@ static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,uns
     }
 }
 
+/**
+ * Branch and bound search for a subset of vValue (sorted by value, largest
+ * first) whose total is at least nTargetValue and exceeds it by at most
+ * nMaxExcess.  Subsets are scored by their waste, the excess plus
+ * nInputCost for each input, so that an exact match with many inputs does
+ * not beat a small excess with few.  The search is depth-first, including
+ * coins before excluding them, and stops after BNB_MAX_TRIES steps or once
+ * nothing can be wasted.  The subset with the least waste that was found
+ * is returned.
+ */
+static bool SelectCoinsBnB(const vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >& vValue, const CAmount& nTargetValue,
+                           const CAmount& nMaxExcess, const CAmount& nInputCost, vector<char>& vfBest, CAmount& nBest)
+{
+    // Total of the coins that are not decided on yet
+    CAmount nRemaining = 0;
+    for (unsigned int i = 0; i < vValue.size(); ++i)
+        nRemaining += vValue[i].first;
+    if (nRemaining < nTargetValue)
+        return false;
+
+    vector<char> vfSelected;
+    vfSelected.reserve(vValue.size());
+    CAmount nTotal = 0;
+    unsigned int nSelected = 0;
+    CAmount nBestWaste = 0;
+    bool fFound = false;
+
+    for (unsigned int nTries = 0; nTries < BNB_MAX_TRIES; ++nTries)
+    {
+        bool fBacktrack = false;
+        if (nTotal + nRemaining < nTargetValue || nTotal > nTargetValue + nMaxExcess)
+            fBacktrack = true;
+        else if (fFound && nSelected * nInputCost >= nBestWaste)
+            // More inputs cannot waste less than the best subset so far
+            fBacktrack = true;
+        else if (nTotal >= nTargetValue)
+        {
+            const CAmount nWaste = nTotal - nTargetValue + nSelected * nInputCost;
+            if (!fFound || nWaste < nBestWaste)
+            {
+                fFound = true;
+                nBestWaste = nWaste;
+                nBest = nTotal;
+                vfBest = vfSelected;
+                vfBest.resize(vValue.size(), false);
+                if (nBestWaste == 0)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack)
+        {
+            // Exclude the last included coin instead, with everything after it undecided again.
+            while (!vfSelected.empty() && !vfSelected.back())
+            {
+                vfSelected.pop_back();
+                nRemaining += vValue[vfSelected.size()].first;
+            }
+            if (vfSelected.empty())
+                break;
+            vfSelected.back() = false;
+            nTotal -= vValue[vfSelected.size() - 1].first;
+            --nSelected;
+        }
+        else
+        {
+            const size_t n = vfSelected.size();
+            const CAmount nValue = vValue[n].first;
+            nRemaining -= nValue;
+
+            // Including a coin right after excluding one of the same value
+            // would only repeat combinations that were tried already.
+            if (n > 0 && !vfSelected.back() && vValue[n - 1].first == nValue)
+                vfSelected.push_back(false);
+            else
+            {
+                vfSelected.push_back(true);
+                nTotal += nValue;
+                ++nSelected;
+            }
+        }
+    }
+
+    return fFound;
+}
+
+static bool CompareOutputValueDesc(const COutput& a, const COutput& b)
+{
+    return a.tx->tx->vout[a.i].nValue > b.tx->tx->vout[b.i].nValue;
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, vector<COutput> vCoins,
                                  set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
@@ -2108,7 +2555,26 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+    // Sort the coins by value, largest first, and in random order among
+    // coins of the same value.  The coins from AvailableCoins are sorted
+    // already, so that only the equal values need to be shuffled.
+    if (std::is_sorted(vCoins.begin(), vCoins.end(), CompareOutputValueDesc))
+    {
+        vector<COutput>::iterator itBegin = vCoins.begin();
+        while (itBegin != vCoins.end())
+        {
+            vector<COutput>::iterator itEnd = itBegin + 1;
+            while (itEnd != vCoins.end() && !CompareOutputValueDesc(*itBegin, *itEnd))
+                ++itEnd;
+            random_shuffle(itBegin, itEnd, GetRandInt);
+            itBegin = itEnd;
+        }
+    }
+    else
+    {
+        random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+        std::stable_sort(vCoins.begin(), vCoins.end(), CompareOutputValueDesc);
+    }
 
     BOOST_FOREACH(const COutput &output, vCoins)
     {
@@ -2161,12 +2627,26 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
         return true;
     }
 
-    // Solve subset sum by stochastic approximation
-    std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
-    std::reverse(vValue.begin(), vValue.end());
+    // vValue is sorted by value, largest first, since vCoins is.
     vector<char> vfBest;
     CAmount nBest;
 
+    // Look for inputs that need no change output
+    if (SelectCoinsBnB(vValue, nTargetValue, GetCostOfChange(), GetCostOfInput(), vfBest, nBest))
+    {
+        for (unsigned int i = 0; i < vValue.size(); i++)
+            if (vfBest[i])
+            {
+                setCoinsRet.insert(vValue[i].second);
+                nValueRet += vValue[i].first;
+            }
+
+        LogPrint("selectcoins", "SelectCoins() branch and bound: %u coins, total %s\n",
+                 setCoinsRet.size(), FormatMoney(nBest));
+        return true;
+    }
+
+    // Solve subset sum by stochastic approximation
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + MIN_CHANGE)
         ApproximateBestSubset(vValue, nTotalLower, nTargetValue + MIN_CHANGE, vfBest, nBest);
@@ -2256,6 +2736,31 @@ bool CWallet::SelectCoins(const vector<COutput>& vAvailableCoins, const CAmount&
     // add preset inputs to the total value selected
     nValueRet += nValueFromPresetInputs;
 
+    // If there is change anyway, add some of the smallest confirmed coins
+    // to it.  Coins that are dust would cost more than they are worth.
+    if (res && nConsolidateInputs > 0 && nValueRet - nTargetValue > GetCostOfChange())
+    {
+        vector<COutput> vSmall;
+        BOOST_FOREACH(const COutput& out, vCoins)
+        {
+            if (out.fSpendable && out.nDepth > 0
+                  && !out.tx->tx->vout[out.i].IsDust(::minRelayTxFee)
+                  && !setCoinsRet.count(make_pair(out.tx, out.i)))
+                vSmall.push_back(out);
+        }
+
+        const size_t nAdd = std::min<size_t>(nConsolidateInputs, vSmall.size());
+        std::partial_sort(vSmall.begin(), vSmall.begin() + nAdd, vSmall.end(),
+                          [](const COutput& a, const COutput& b) {
+                              return CompareOutputValueDesc(b, a);
+                          });
+        for (size_t i = 0; i < nAdd; ++i)
+        {
+            setCoinsRet.insert(make_pair(vSmall[i].tx, vSmall[i].i));
+            nValueRet += vSmall[i].tx->tx->vout[vSmall[i].i].nValue;
+        }
+    }
+
     return res;
 }
 
@@ -2552,9 +3057,11 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend,
                         }
                     }
 
-                    // Never create dust outputs; if we would, just
-                    // add the dust to the fee.
-                    if (newTxOut.IsDust(::minRelayTxFee))
+                    // Never create dust outputs, nor change that costs more
+                    // to create and spend than coin selection allows as
+                    // excess; if we would, just add it to the fee.
+                    if (newTxOut.IsDust(::minRelayTxFee)
+                        || (nSubtractFeeFromAmount == 0 && nChange <= GetCostOfChange()))
                     {
                         nChangePosInOut = -1;
                         nFeeRet += nChange;
@@ -2759,6 +3266,21 @@ CAmount CWallet::GetRequiredFee(unsigned int nTxBytes)
     return std::max(minTxFee.GetFee(nTxBytes), ::minRelayTxFee.GetFee(nTxBytes));
 }
 
+CAmount CWallet::GetCostOfInput()
+{
+    // A P2PKH input, sized as in CTxOut::GetDustThreshold.
+    const unsigned int nInputBytes = 32 + 4 + 1 + 107 + 4;
+    return GetMinimumFee(nInputBytes, nTxConfirmTarget, mempool);
+}
+
+CAmount CWallet::GetCostOfChange()
+{
+    // A P2PKH change output and the input spending it later.
+    const CTxOut txoutChange(0, GetScriptForDestination(CKeyID()));
+    const unsigned int nOutputBytes = GetSerializeSize(txoutChange, SER_DISK, 0);
+    return GetMinimumFee(nOutputBytes, nTxConfirmTarget, mempool) + GetCostOfInput();
+}
+
 CAmount CWallet::GetMinimumFee(unsigned int nTxBytes, unsigned int nConfirmTarget, const CTxMemPool& pool)
 {
     // payTxFee is user-set "I want to pay this much"
@@ -3481,6 +4003,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
 {
     std::string strUsage = HelpMessageGroup(_("Wallet options:"));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
+    strUsage += HelpMessageOpt("-consolidateinputs=<n>", strprintf(_("Spend up to n of the smallest extra outputs with each transaction that has change, to consolidate the wallet (0-%u, default: %u)"), MAX_CONSOLIDATE_INPUTS, DEFAULT_CONSOLIDATE_INPUTS));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
     strUsage += HelpMessageOpt("-fallbackfee=<amt>", strprintf(_("A fee rate (in %s/kB) that will be used when fee estimation has insufficient data (default: %s)"),
                                                                CURRENCY_UNIT, FormatMoney(DEFAULT_FALLBACK_FEE)));
@@ -3489,6 +4012,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                                             CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads reading blocks for a rescan (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
@@ -3782,6 +4306,7 @@ bool CWallet::ParameterInteraction()
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", DEFAULT_SEND_FREE_TRANSACTIONS);
     fWalletRbf = GetBoolArg("-walletrbf", DEFAULT_WALLET_RBF);
+    nConsolidateInputs = std::min<int64_t>(std::max<int64_t>(GetArg("-consolidateinputs", DEFAULT_CONSOLIDATE_INPUTS), 0), MAX_CONSOLIDATE_INPUTS);
 
     return true;
 }
@@ -42,6 +42,7 @@ extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 extern bool fSendFreeTransactions;
 extern bool fWalletRbf;
+extern unsigned int nConsolidateInputs;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 100;
 //! -paytxfee default
@@ -60,12 +61,24 @@ static const bool DEFAULT_SEND_FREE_TRANSACTIONS = false;
 static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 //! -walletrbf default
 static const bool DEFAULT_WALLET_RBF = false;
+//! -consolidateinputs default
+static const unsigned int DEFAULT_CONSOLIDATE_INPUTS = 0;
+//! Maximum value for -consolidateinputs
+static const unsigned int MAX_CONSOLIDATE_INPUTS = 100;
+//! Number of steps after which the branch and bound coin selection gives up
+static const unsigned int BNB_MAX_TRIES = 100000;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
 static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! -rescanthreads default (0 = one per core, <0 = leave that many cores free)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of threads reading blocks for a rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! Number of blocks that a rescan thread reads and filters at a time
+static const unsigned int RESCAN_CHUNK_BLOCKS = 64;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -164,6 +177,30 @@ struct COutputEntry
     int vout;
 };
 
+/**
+ * Reference to a wallet transaction that changes a name, as kept in
+ * CWallet::mapNameTxs.  For name operations, n is the index of the name
+ * output.  For kill transactions, it is the index of the input that spends
+ * the name.
+ */
+struct CWalletNameTx
+{
+    uint256 txid;
+    unsigned int n;
+    bool fKill;
+
+    CWalletNameTx(const uint256& txidIn, unsigned int nIn, bool fKillIn)
+        : txid(txidIn), n(nIn), fKill(fKillIn)
+    {}
+
+    friend bool operator<(const CWalletNameTx& a, const CWalletNameTx& b)
+    {
+        if (a.txid != b.txid)
+            return a.txid < b.txid;
+        return a.n < b.n;
+    }
+};
+
 /** 
  * A transaction with a bunch of additional info that only the owner cares about.
  * It includes any unrecorded transactions needed to link it back to the block chain.
@@ -293,17 +330,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -519,6 +546,50 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /* Amounts that a wallet tx contributes to the various balances.  */
+    struct CBalances
+    {
+        CAmount nTrusted;
+        CAmount nUnconfirmed;
+        CAmount nImmature;
+        CAmount nWatchTrusted;
+        CAmount nWatchUnconfirmed;
+        CAmount nWatchImmature;
+
+        CBalances()
+            : nTrusted(0), nUnconfirmed(0), nImmature(0),
+              nWatchTrusted(0), nWatchUnconfirmed(0), nWatchImmature(0)
+        {}
+
+        bool IsNull() const;
+        CBalances& operator+=(const CBalances& other);
+        CBalances& operator-=(const CBalances& other);
+    };
+
+    /**
+     * Running balances of the wallet, so that they need not be summed up
+     * over all of mapWallet for each query.  Txs whose contribution may
+     * have changed are marked by CWalletTx::MarkDirty.  Unconfirmed,
+     * conflicted and immature txs depend on the mempool and the chain
+     * height, so they are evaluated again for every query.
+     */
+    mutable CBalances balances;
+    mutable std::map<uint256, CBalances> mapTxBalances;
+    mutable std::set<uint256> setBalanceDirty;
+    mutable std::set<uint256> setBalanceVolatile;
+    //! Chain tip at the last update of the running balances
+    mutable const CBlockIndex* pindexBalances;
+
+    /**
+     * Unspent non-name outputs of ours, sorted by value, and the wallet txs
+     * that have entries in it.  This is kept up to date together with the
+     * balances and is what AvailableCoins iterates.
+     */
+    mutable std::set<std::pair<CAmount, COutPoint> > setCoinsByValue;
+    mutable std::set<uint256> setCoinTxs;
+
+    void UpdateBalances() const;
+
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
@@ -584,11 +655,22 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        pindexBalances = NULL;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
     std::list<CAccountingEntry> laccentries;
 
+    /**
+     * Wallet transactions that change each name, so that name_list need not
+     * go through all of mapWallet.  Whether they are confirmed is checked
+     * when the index is used, so reorgs and conflicts need no updates here.
+     */
+    typedef std::map<valtype, std::set<CWalletNameTx> > NameTxMap;
+    NameTxMap mapNameTxs;
+    void AddToNameIndex(const CWalletTx& wtx);
+    void RemoveFromNameIndex(const CWalletTx& wtx);
+
     typedef std::pair<CWalletTx*, CAccountingEntry*> TxPair;
     typedef std::multimap<int64_t, TxPair > TxItems;
     TxItems wtxOrdered;
@@ -683,11 +765,17 @@ public:
     bool GetAccountPubkey(CPubKey &pubKey, std::string strAccount, bool bForceNew = false);
 
     void MarkDirty();
+    //! Mark the running balances of a tx for re-evaluation
+    void MarkBalanceDirty(const uint256& hash) const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
     void NameConflict(const CTransaction& tx, const uint256& hashBlock);
-    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
+    /**
+     * Add tx to the wallet if it is ours or spends from us.  pfIsMine can
+     * pass in the result of IsMine(tx) if it is already known.
+     */
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate, const bool* pfIsMine = nullptr);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman);
@@ -740,6 +828,18 @@ public:
      * floating relay fee and user set minimum transaction fee
      */
     static CAmount GetRequiredFee(unsigned int nTxBytes);
+    /**
+     * Fee for spending one more (P2PKH) input, at the fee rate
+     * CreateTransaction pays.
+     */
+    static CAmount GetCostOfInput();
+    /**
+     * Fee for adding a change output and for spending it later, at the
+     * fee rate CreateTransaction pays.  Coin selection accepts an excess
+     * up to this amount, and CreateTransaction adds change up to it to
+     * the fee instead of creating an output.
+     */
+    static CAmount GetCostOfChange();
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int kpSize = 0);
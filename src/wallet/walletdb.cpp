@@ -738,7 +738,10 @@ DBErrors CWalletDB::ZapSelectTx(CWallet* pwallet, vector<uint256>& vTxHashIn, ve
             break;
         }
         else if ((*it) == hash) {
+            if (pwallet->mapWallet.count(hash))
+                pwallet->RemoveFromNameIndex(pwallet->mapWallet[hash]);
             pwallet->mapWallet.erase(hash);
+            pwallet->MarkBalanceDirty(hash);
             if(!EraseTx(hash)) {
                 LogPrint("db", "Transaction was found for deletion but returned database error: %s\n", hash.GetHex());
                 delerror = true;